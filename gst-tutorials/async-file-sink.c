@@ -0,0 +1,384 @@
+#include "async-file-sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_MAX_BUFFERED (32 * G_GUINT64_CONSTANT (1024) * 1024)
+
+enum {
+  PROP_0,
+  PROP_LOCATION,
+  PROP_MAX_BUFFERED,
+};
+
+/* What the writer thread does next */
+typedef struct {
+  GstBuffer *buffer;          /* NULL for a seek */
+  guint64 offset;
+} WriteItem;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (AsyncFileSink, async_file_sink, GST_TYPE_BASE_SINK);
+
+static GMutex stats_lock;
+static AsyncFileSinkStats stats;
+
+void
+async_file_sink_get_stats (AsyncFileSinkStats *out)
+{
+  g_mutex_lock (&stats_lock);
+  *out = stats;
+  g_mutex_unlock (&stats_lock);
+}
+
+/* errno, or 0 once the whole buffer is written */
+static gint
+write_buffer (gint fd, GstBuffer *buffer)
+{
+  guint i;
+
+  for (i = 0; i < gst_buffer_n_memory (buffer); i++) {
+    GstMemory *mem = gst_buffer_peek_memory (buffer, i);
+    GstMapInfo map;
+    gsize done = 0;
+
+    if (!gst_memory_map (mem, &map, GST_MAP_READ))
+      return EIO;
+    while (done < map.size) {
+      gssize n = write (fd, map.data + done, map.size - done);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0) {
+        gint error = errno;
+
+        gst_memory_unmap (mem, &map);
+        return error;
+      }
+      done += n;
+    }
+    gst_memory_unmap (mem, &map);
+  }
+  return 0;
+}
+
+static gpointer
+writer_thread (AsyncFileSink *self)
+{
+  for (;;) {
+    WriteItem *item;
+    guint64 start, elapsed;
+    gsize size = 0;
+    gint error = 0;
+
+    g_mutex_lock (&self->lock);
+    while (g_queue_is_empty (&self->pending) && !self->closing)
+      g_cond_wait (&self->cond, &self->lock);
+    /* Closing: whatever is still queued is written first */
+    item = g_queue_pop_head (&self->pending);
+    g_mutex_unlock (&self->lock);
+    if (!item)
+      break;
+
+    start = gst_util_get_timestamp ();
+    if (item->buffer) {
+      size = gst_buffer_get_size (item->buffer);
+      error = write_buffer (self->fd, item->buffer);
+      gst_buffer_unref (item->buffer);
+    } else if (lseek (self->fd, item->offset, SEEK_SET) < 0) {
+      error = errno;
+    }
+    elapsed = gst_util_get_timestamp () - start;
+    g_free (item);
+
+    g_mutex_lock (&stats_lock);
+    stats.bytes += size;
+    stats.write_time += elapsed;
+    g_mutex_unlock (&stats_lock);
+
+    g_mutex_lock (&self->lock);
+    self->buffered -= size;
+    if (error && !self->error)
+      self->error = error;
+    g_cond_broadcast (&self->cond);
+    g_mutex_unlock (&self->lock);
+  }
+  return NULL;
+}
+
+static void
+queue_item (AsyncFileSink *self, GstBuffer *buffer, guint64 offset)
+{
+  WriteItem *item = g_new (WriteItem, 1);
+
+  item->buffer = buffer;
+  item->offset = offset;
+  g_queue_push_tail (&self->pending, item);
+  if (buffer)
+    self->buffered += gst_buffer_get_size (buffer);
+  g_cond_broadcast (&self->cond);
+}
+
+static GstFlowReturn
+async_file_sink_render (GstBaseSink *sink, GstBuffer *buffer)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (sink);
+  gsize size = gst_buffer_get_size (buffer);
+  guint64 start = 0;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gint error;
+
+  g_mutex_lock (&self->lock);
+  /* Room for this buffer, or an empty queue: a buffer larger than the bound still goes */
+  while (self->buffered > 0 && self->buffered + size > self->max_buffered &&
+      !self->error && !self->flushing) {
+    if (!start)
+      start = gst_util_get_timestamp ();
+    g_cond_wait (&self->cond, &self->lock);
+  }
+  error = self->error;
+  if (self->flushing)
+    ret = GST_FLOW_FLUSHING;
+  else if (!error)
+    queue_item (self, gst_buffer_ref (buffer), 0);
+  g_mutex_unlock (&self->lock);
+
+  if (start) {
+    guint64 waited = gst_util_get_timestamp () - start;
+
+    g_mutex_lock (&stats_lock);
+    stats.max_wait = MAX (stats.max_wait, waited);
+    g_mutex_unlock (&stats_lock);
+  }
+  if (error) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, ("Could not write to %s", self->location),
+        ("%s", g_strerror (error)));
+    return GST_FLOW_ERROR;
+  }
+  return ret;
+}
+
+static gboolean
+async_file_sink_event (GstBaseSink *sink, GstEvent *event)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (sink);
+
+  /* Muxers go back to rewrite their headers with a byte segment */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+    const GstSegment *segment;
+
+    gst_event_parse_segment (event, &segment);
+    if (segment->format == GST_FORMAT_BYTES) {
+      g_mutex_lock (&self->lock);
+      queue_item (self, NULL, segment->start);
+      g_mutex_unlock (&self->lock);
+    }
+  }
+  return GST_BASE_SINK_CLASS (async_file_sink_parent_class)->event (sink, event);
+}
+
+static gboolean
+async_file_sink_query (GstBaseSink *sink, GstQuery *query)
+{
+  /* Tells muxers they may seek back */
+  if (GST_QUERY_TYPE (query) == GST_QUERY_SEEKING) {
+    GstFormat format;
+
+    gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
+    gst_query_set_seeking (query, format, format == GST_FORMAT_BYTES, 0, -1);
+    return TRUE;
+  }
+  return GST_BASE_SINK_CLASS (async_file_sink_parent_class)->query (sink, query);
+}
+
+static gboolean
+async_file_sink_start (GstBaseSink *sink)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (sink);
+
+  if (!self->location) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND, ("No file name set"), (NULL));
+    return FALSE;
+  }
+  self->fd = open (self->location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (self->fd < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE, ("Could not open %s", self->location),
+        ("%s", g_strerror (errno)));
+    return FALSE;
+  }
+  self->closing = FALSE;
+  self->error = 0;
+  self->writer = g_thread_new ("asyncfilesink", (GThreadFunc) writer_thread, self);
+  return TRUE;
+}
+
+static gboolean
+async_file_sink_stop (GstBaseSink *sink)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (sink);
+  guint64 start, elapsed;
+  gint error;
+
+  if (!self->writer)
+    return TRUE;
+
+  g_mutex_lock (&self->lock);
+  self->closing = TRUE;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+  g_thread_join (self->writer);
+  self->writer = NULL;
+  /* Whatever went wrong while the queue drained, with no render left to report it */
+  error = self->error;
+
+  /* The queue is drained: this is where the disk really catches up */
+  start = gst_util_get_timestamp ();
+  if (fsync (self->fd) < 0 && !error)
+    error = errno;
+  if (close (self->fd) < 0 && !error)
+    error = errno;
+  elapsed = gst_util_get_timestamp () - start;
+  self->fd = -1;
+
+  g_mutex_lock (&stats_lock);
+  stats.files++;
+  stats.max_fsync = MAX (stats.max_fsync, elapsed);
+  g_mutex_unlock (&stats_lock);
+
+  if (error) {
+    GST_ELEMENT_ERROR (self, RESOURCE, CLOSE, ("Could not finish writing %s", self->location),
+        ("%s", g_strerror (error)));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+async_file_sink_unlock (GstBaseSink *sink)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (sink);
+
+  g_mutex_lock (&self->lock);
+  self->flushing = TRUE;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+  return TRUE;
+}
+
+static gboolean
+async_file_sink_unlock_stop (GstBaseSink *sink)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (sink);
+
+  g_mutex_lock (&self->lock);
+  self->flushing = FALSE;
+  g_mutex_unlock (&self->lock);
+  return TRUE;
+}
+
+static void
+async_file_sink_set_property (GObject *object, guint prop_id, const GValue *value,
+    GParamSpec *pspec)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_MAX_BUFFERED:
+      self->max_buffered = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+async_file_sink_get_property (GObject *object, guint prop_id, GValue *value,
+    GParamSpec *pspec)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_MAX_BUFFERED:
+      g_value_set_uint64 (value, self->max_buffered);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+async_file_sink_finalize (GObject *object)
+{
+  AsyncFileSink *self = ASYNC_FILE_SINK (object);
+
+  g_free (self->location);
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (async_file_sink_parent_class)->finalize (object);
+}
+
+static void
+async_file_sink_class_init (AsyncFileSinkClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *sink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->set_property = async_file_sink_set_property;
+  gobject_class->get_property = async_file_sink_get_property;
+  gobject_class->finalize = async_file_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "Location", "File to write", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_BUFFERED,
+      g_param_spec_uint64 ("max-buffered", "Max buffered",
+          "Bytes queued for the writer thread before render waits", 1, G_MAXUINT64,
+          DEFAULT_MAX_BUFFERED, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_set_static_metadata (element_class, "Asynchronous file sink",
+      "Sink/File", "Writes to a file from a thread of its own, through a bounded queue",
+      "gst-tutorials");
+
+  sink_class->render = GST_DEBUG_FUNCPTR (async_file_sink_render);
+  sink_class->event = GST_DEBUG_FUNCPTR (async_file_sink_event);
+  sink_class->query = GST_DEBUG_FUNCPTR (async_file_sink_query);
+  sink_class->start = GST_DEBUG_FUNCPTR (async_file_sink_start);
+  sink_class->stop = GST_DEBUG_FUNCPTR (async_file_sink_stop);
+  sink_class->unlock = GST_DEBUG_FUNCPTR (async_file_sink_unlock);
+  sink_class->unlock_stop = GST_DEBUG_FUNCPTR (async_file_sink_unlock_stop);
+}
+
+static void
+async_file_sink_init (AsyncFileSink *self)
+{
+  self->max_buffered = DEFAULT_MAX_BUFFERED;
+  self->fd = -1;
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+  g_queue_init (&self->pending);
+  /* A file is not a clock-synchronized output */
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
+
+gboolean
+async_file_sink_register (void)
+{
+  /* Registered without a plugin and with no rank: only used when asked for by name */
+  return gst_element_register (NULL, "asyncfilesink", GST_RANK_NONE, ASYNC_FILE_TYPE_SINK);
+}
@@ -0,0 +1,78 @@
+/*
+`asyncfilesink`: a file sink whose disk writes happen on a thread of its own.
+
+filesink writes (and, at the end of the file, flushes) on the streaming
+thread that renders into it, so a slow disk, a page-cache flush or the fsync
+closing a file holds up whatever feeds it. Here render only queues the buffer
+(a reference, no copy) and a writer thread per file does the write() calls,
+seeks (muxers rewrite their headers at EOS) and the final fsync + close:
+  - the queue is bounded by `max-buffered` bytes; when it is full, render
+    waits for the writer, which is the back-pressure a recorder must have
+    rather than growing without limit or losing data,
+  - stop() lets the writer drain the queue and fsync the file, so the file
+    is complete on disk when the element reaches READY. With splitmuxsink
+    async-finalize=true that happens on splitmuxsink's finalizer thread,
+    not on the streaming thread, and a segment rollover never waits for it.
+
+Properties:
+  location       file to write
+  max-buffered   bytes queued for the writer before render waits (default 32 MiB)
+
+Writes, their time, the longest fsync and the longest render wait are
+summed over every instance (splitmuxsink makes one per segment), see
+`async_file_sink_get_stats`.
+*/
+#ifndef __ASYNC_FILE_SINK_H__
+#define __ASYNC_FILE_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define ASYNC_FILE_TYPE_SINK (async_file_sink_get_type ())
+#define ASYNC_FILE_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), ASYNC_FILE_TYPE_SINK, AsyncFileSink))
+
+typedef struct _AsyncFileSink AsyncFileSink;
+typedef struct _AsyncFileSinkClass AsyncFileSinkClass;
+
+typedef struct _AsyncFileSinkStats {
+  guint files;                /* closed so far */
+  guint64 bytes;              /* written */
+  guint64 write_time;         /* nanoseconds in write() and lseek() */
+  guint64 max_fsync;          /* longest fsync + close */
+  guint64 max_wait;           /* longest render waiting for room in the queue */
+} AsyncFileSinkStats;
+
+struct _AsyncFileSink {
+  GstBaseSink parent;
+
+  gchar *location;
+  guint64 max_buffered;
+
+  gint fd;
+  GThread *writer;
+  GMutex lock;
+  GCond cond;
+  GQueue pending;             /* WriteItem: a buffer or a seek */
+  guint64 buffered;           /* bytes in `pending` */
+  gboolean closing;           /* stop(): drain and exit */
+  gboolean flushing;          /* unlock(): render gives up waiting */
+  gint error;                 /* errno of the first failed write, 0 if none */
+};
+
+struct _AsyncFileSinkClass {
+  GstBaseSinkClass parent_class;
+};
+
+GType async_file_sink_get_type (void);
+
+/* Registers the element for this process; call once after gst_init */
+gboolean async_file_sink_register (void);
+
+/* Totals over every asyncfilesink of the process */
+void async_file_sink_get_stats (AsyncFileSinkStats *stats);
+
+G_END_DECLS
+
+#endif /* __ASYNC_FILE_SINK_H__ */
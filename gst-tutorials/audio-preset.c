@@ -0,0 +1,261 @@
+#include "audio-preset.h"
+
+#include <time.h>
+#include <gst/audio/audio.h>
+
+static const AudioPreset presets[] = {
+  { "lowest-latency", "S16LE", "linear", 0, "auto", "none", "none", 20000, 5000 },
+  { "balanced", "F32LE", "kaiser", 4, "auto", "tpdf", "none", 100000, 10000 },
+  { "highest-quality", "F64LE", "kaiser", 10, "full", "tpdf-hf", "high", 200000, 10000 },
+};
+
+struct _AudioPresetChain {
+  GstElement *pipeline;           /* not a ref */
+  const AudioPreset *preset;
+  gulong added_id;
+
+  /* The measured chain; elements are added from streaming threads too */
+  GMutex lock;
+  GstPad *in_pad;                 /* audio-in's sink pad */
+  GstPad *out_pad;                /* audio-out's src pad, same parent */
+  gulong in_probe_id;
+  gulong out_probe_id;
+  GstElement *sink;               /* the first audio sink */
+  AudioPresetStats stats;
+
+  /* The chain's streaming thread only */
+  guint64 entered;                /* thread CPU time, 0 between buffers */
+};
+
+const AudioPreset *
+audio_preset_find (const gchar *name)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (presets); i++)
+    if (g_strcmp0 (presets[i].name, name) == 0)
+      return &presets[i];
+  return NULL;
+}
+
+const gchar *
+audio_preset_names (void)
+{
+  return "lowest-latency, balanced, highest-quality";
+}
+
+gchar *
+audio_preset_branch (const AudioPreset *preset, const gchar *sink)
+{
+  return g_strdup_printf ("audioconvert name=audio-in ! audio/x-raw,format=%s ! audioresample ! "
+      "audioconvert name=audio-out%s%s", preset->format, sink ? " ! " : "", sink ? sink : "");
+}
+
+static guint64
+thread_cpu_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (guint64) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+static GstPadProbeReturn
+in_probe (GstPad *pad, GstPadProbeInfo *info, AudioPresetChain *chain)
+{
+  /* A buffer the resampler kept back has no way out; the next one starts over */
+  chain->entered = thread_cpu_time ();
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+out_probe (GstPad *pad, GstPadProbeInfo *info, AudioPresetChain *chain)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstClockTime latency = GST_CLOCK_TIME_NONE;
+  guint64 now = thread_cpu_time ();
+
+  /* The converter and resampler are configured now; ask once */
+  if (!GST_CLOCK_TIME_IS_VALID (chain->stats.chain_latency)) {
+    GstQuery *query = gst_query_new_latency ();
+    gboolean live;
+    GstClockTime min, max;
+
+    if (gst_pad_query (pad, query)) {
+      gst_query_parse_latency (query, &live, &min, &max);
+      latency = min;
+    }
+    gst_query_unref (query);
+  }
+
+  g_mutex_lock (&chain->lock);
+  if (chain->entered) {
+    chain->stats.cpu_time += now - chain->entered;
+    chain->entered = 0;
+  }
+  if (GST_BUFFER_DURATION_IS_VALID (buffer))
+    chain->stats.media_time += GST_BUFFER_DURATION (buffer);
+  if (GST_CLOCK_TIME_IS_VALID (latency))
+    chain->stats.chain_latency = latency;
+  g_mutex_unlock (&chain->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+apply_preset (AudioPresetChain *chain, GstElement *element)
+{
+  const AudioPreset *preset = chain->preset;
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *name = factory ? GST_OBJECT_NAME (factory) : "";
+
+  if (g_strcmp0 (name, "audioresample") == 0) {
+    gst_util_set_object_arg (G_OBJECT (element), "resample-method", preset->resample_method);
+    gst_util_set_object_arg (G_OBJECT (element), "sinc-filter-mode", preset->sinc_filter_mode);
+    g_object_set (element, "quality", preset->quality, NULL);
+  } else if (g_strcmp0 (name, "audioconvert") == 0) {
+    gst_util_set_object_arg (G_OBJECT (element), "dithering", preset->dithering);
+    gst_util_set_object_arg (G_OBJECT (element), "noise-shaping", preset->noise_shaping);
+  } else if (GST_IS_AUDIO_BASE_SINK (element)) {
+    g_object_set (element, "buffer-time", preset->buffer_time,
+        "latency-time", preset->latency_time, NULL);
+  }
+}
+
+static void
+watch_out (AudioPresetChain *chain, GstElement *out)
+{
+  chain->out_pad = gst_element_get_static_pad (out, "src");
+  chain->out_probe_id = gst_pad_add_probe (chain->out_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) out_probe, chain, NULL);
+}
+
+/* The first audio-in, the audio-out next to it (either may come first) and the first audio sink */
+static void
+watch_element (AudioPresetChain *chain, GstElement *element)
+{
+  const gchar *name = GST_OBJECT_NAME (element);
+  GstObject *parent = GST_OBJECT_PARENT (element);
+
+  g_mutex_lock (&chain->lock);
+  if (!chain->sink && GST_IS_AUDIO_BASE_SINK (element)) {
+    chain->sink = gst_object_ref (element);
+  } else if (!chain->in_pad && g_strcmp0 (name, "audio-in") == 0 && GST_IS_BIN (parent)) {
+    GstElement *out = gst_bin_get_by_name (GST_BIN (parent), "audio-out");
+
+    chain->in_pad = gst_element_get_static_pad (element, "sink");
+    chain->in_probe_id = gst_pad_add_probe (chain->in_pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) in_probe, chain, NULL);
+    if (out) {
+      watch_out (chain, out);
+      gst_object_unref (out);
+    }
+  } else if (chain->in_pad && !chain->out_pad && g_strcmp0 (name, "audio-out") == 0 &&
+      parent == GST_OBJECT_PARENT (GST_OBJECT_PARENT (chain->in_pad))) {
+    watch_out (chain, element);
+  }
+  g_mutex_unlock (&chain->lock);
+}
+
+static void
+deep_element_added (GstBin *bin, GstBin *sub_bin, GstElement *element, AudioPresetChain *chain)
+{
+  apply_preset (chain, element);
+  watch_element (chain, element);
+}
+
+AudioPresetChain *
+audio_preset_attach (GstElement *pipeline, const AudioPreset *preset)
+{
+  AudioPresetChain *chain = g_new0 (AudioPresetChain, 1);
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  chain->pipeline = pipeline;
+  chain->preset = preset;
+  chain->stats.chain_latency = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&chain->lock);
+
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    deep_element_added (NULL, NULL, g_value_get_object (&item), chain);
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  chain->added_id = g_signal_connect (pipeline, "deep-element-added",
+      G_CALLBACK (deep_element_added), chain);
+  return chain;
+}
+
+void
+audio_preset_free (AudioPresetChain *chain)
+{
+  g_signal_handler_disconnect (chain->pipeline, chain->added_id);
+  if (chain->in_pad) {
+    gst_pad_remove_probe (chain->in_pad, chain->in_probe_id);
+    gst_object_unref (chain->in_pad);
+  }
+  if (chain->out_pad) {
+    gst_pad_remove_probe (chain->out_pad, chain->out_probe_id);
+    gst_object_unref (chain->out_pad);
+  }
+  if (chain->sink)
+    gst_object_unref (chain->sink);
+  g_mutex_clear (&chain->lock);
+  g_free (chain);
+}
+
+/* What the sink's ring buffer holds when full, from what it got, or asked for */
+static GstClockTime
+sink_buffer_time (GstElement *sink)
+{
+  GstAudioRingBuffer *ringbuffer = GST_AUDIO_BASE_SINK (sink)->ringbuffer;
+  gint64 buffer_time;
+
+  if (ringbuffer && gst_audio_ring_buffer_is_acquired (ringbuffer)) {
+    GstAudioRingBufferSpec *spec = &ringbuffer->spec;
+    gint bpf = GST_AUDIO_INFO_BPF (&spec->info);
+
+    if (bpf && GST_AUDIO_INFO_RATE (&spec->info))
+      return gst_util_uint64_scale ((guint64) spec->segtotal * spec->segsize / bpf,
+          GST_SECOND, GST_AUDIO_INFO_RATE (&spec->info));
+  }
+  g_object_get (sink, "buffer-time", &buffer_time, NULL);
+  return buffer_time * GST_USECOND;
+}
+
+void
+audio_preset_get_stats (AudioPresetChain *chain, AudioPresetStats *stats)
+{
+  GstElement *sink;
+
+  g_mutex_lock (&chain->lock);
+  *stats = chain->stats;
+  sink = chain->sink ? gst_object_ref (chain->sink) : NULL;
+  g_mutex_unlock (&chain->lock);
+
+  stats->sink_buffer = sink ? sink_buffer_time (sink) : 0;
+  if (sink)
+    gst_object_unref (sink);
+}
+
+void
+audio_preset_report (AudioPresetChain *chain)
+{
+  const AudioPreset *preset = chain->preset;
+  AudioPresetStats stats;
+  gdouble chain_ms;
+
+  audio_preset_get_stats (chain, &stats);
+  chain_ms = GST_CLOCK_TIME_IS_VALID (stats.chain_latency) ? stats.chain_latency / 1e6 : 0;
+
+  g_print ("Audio preset %s: %s, %s resampler at quality %d, dithering %s, noise shaping %s\n",
+      preset->name, preset->format, preset->resample_method, preset->quality,
+      preset->dithering, preset->noise_shaping);
+  g_print ("  latency: %.1f ms in the chain + %.1f ms sink buffer = %.1f ms end to end\n",
+      chain_ms, stats.sink_buffer / 1e6, chain_ms + stats.sink_buffer / 1e6);
+  if (stats.media_time)
+    g_print ("  cpu: %.1f ms for %.1f s of audio, %.3f%% of a core in real time\n",
+        stats.cpu_time / 1e6, stats.media_time / 1e9,
+        100.0 * stats.cpu_time / stats.media_time);
+}
@@ -0,0 +1,82 @@
+/*
+Audio chain presets: resampler, conversion formats and sink buffering, set
+together.
+
+bt3 and bt6 played audio with whatever audioconvert, audioresample and the
+audio sink default to: a Kaiser resampler at quality 4, TPDF dithering and
+a 200 ms ring buffer in the sink filled in 10 ms segments. Those settings
+pull against each other (a longer filter sounds better, adds delay and
+costs CPU; a bigger ring buffer survives scheduling hiccups and delays
+everything behind it), so a preset picks them as a whole:
+
+  preset           works in  resampler             dither/noise shaping  sink buffer
+  lowest-latency   S16LE     linear                none / none           20 ms in 5 ms
+  balanced         F32LE     kaiser, quality 4     tpdf / none           100 ms in 10 ms
+  highest-quality  F64LE     kaiser, quality 10,   tpdf-hf / high        200 ms in 10 ms
+                             full sinc table
+
+The quality sets the resampler's filter length, and with it the delay the
+filter adds (half its taps at the output rate). `audio_preset_branch` gives
+the chain in gst-launch syntax:
+  audioconvert name=audio-in ! audio/x-raw,format=<F> ! audioresample !
+  audioconvert name=audio-out [! sink]
+the first converter brings the decoded audio to the preset's working format,
+the second to whatever the sink takes (passthrough when it takes that).
+
+`audio_preset_attach` applies the preset to the pipeline's audioresample,
+audioconvert and audio sink elements, including the ones added later
+(deep-element-added; autoaudiosink only creates its real sink in READY), and
+measures the first chain it sees:
+  - CPU: the thread CPU time from a buffer entering audio-in to it leaving
+    audio-out, i.e. the conversions and resampling only, not the source
+    or the sink; `audio_preset_report` gives it per second of audio,
+  - latency: what a LATENCY query at audio-out reports (the resampler's
+    filter delay plus whatever is upstream), plus the sink's ring buffer,
+    which a sample waits behind before the device plays it.
+*/
+#ifndef __AUDIO_PRESET_H__
+#define __AUDIO_PRESET_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AudioPreset {
+  const gchar *name;
+  const gchar *format;            /* the resampler works in it */
+  const gchar *resample_method;   /* audioresample: nearest, linear, cubic, kaiser, ... */
+  gint quality;                   /* 0-10, the filter length */
+  const gchar *sinc_filter_mode;  /* auto, interpolated or full */
+  const gchar *dithering;         /* audioconvert */
+  const gchar *noise_shaping;
+  gint64 buffer_time;             /* audio sink, microseconds */
+  gint64 latency_time;
+} AudioPreset;
+
+typedef struct _AudioPresetStats {
+  guint64 cpu_time;               /* ns, in the chain */
+  GstClockTime media_time;        /* audio through the chain */
+  GstClockTime chain_latency;     /* LATENCY query at audio-out, NONE before the first buffer */
+  GstClockTime sink_buffer;       /* 0 without an audio sink */
+} AudioPresetStats;
+
+typedef struct _AudioPresetChain AudioPresetChain;
+
+/* NULL if there is no such preset */
+const AudioPreset *audio_preset_find (const gchar *name);
+/* "lowest-latency, balanced, highest-quality", for --help */
+const gchar *audio_preset_names (void);
+
+/* The chain in gst-launch syntax, followed by `sink` unless it is NULL */
+gchar *audio_preset_branch (const AudioPreset *preset, const gchar *sink);
+
+/* `preset` must stay valid as long as the chain. Attach before PLAYING. */
+AudioPresetChain *audio_preset_attach (GstElement *pipeline, const AudioPreset *preset);
+void audio_preset_free (AudioPresetChain *chain);
+
+void audio_preset_get_stats (AudioPresetChain *chain, AudioPresetStats *stats);
+void audio_preset_report (AudioPresetChain *chain);
+
+G_END_DECLS
+
+#endif /* __AUDIO_PRESET_H__ */
@@ -0,0 +1,401 @@
+#include "batch-decoder.h"
+
+#include <string.h>
+
+#include "pipeline-runtime.h"
+
+typedef struct _Worker Worker;
+
+typedef struct _Branch {
+  GstElement *bin;            /* our ref; in the pipeline only while in use */
+  guint rule;
+  gboolean in_use;
+  Worker *worker;
+} Branch;
+
+struct _Worker {
+  BatchDecoder *batch;
+  guint id;
+  GstElement *pipeline;
+  GstElement *source;
+  PipelineRuntime *runtime;
+  GPtrArray *branches;
+
+  /* Current job */
+  gchar *uri;                 /* NULL between jobs */
+  guint64 started;            /* gst_util_get_timestamp () */
+  gboolean failed;
+
+  /* Branch streaming threads and pad-added */
+  GMutex lock;
+  GstClockTime media_start;
+  GstClockTime media_end;
+};
+
+struct _BatchDecoder {
+  const StreamRule *rules;
+  guint n_rules;
+  guint n_workers;
+  gboolean reuse;
+  gboolean verbose;
+
+  /* Main loop only, during batch_decoder_run */
+  gchar **uris;
+  guint next;
+  GPtrArray *workers;
+  BatchDecoderStats stats;
+};
+
+static void
+branch_free (Branch *branch)
+{
+  gst_element_set_state (branch->bin, GST_STATE_NULL);
+  gst_object_unref (branch->bin);
+  g_free (branch);
+}
+
+/* Media time covered by the buffers of every stream of the job */
+static GstPadProbeReturn
+branch_probe (GstPad *pad, GstPadProbeInfo *info, Branch *branch)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  Worker *worker = branch->worker;
+  GstClockTime end;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+  end = GST_BUFFER_PTS (buffer) +
+      (GST_BUFFER_DURATION_IS_VALID (buffer) ? GST_BUFFER_DURATION (buffer) : 0);
+
+  g_mutex_lock (&worker->lock);
+  if (!GST_CLOCK_TIME_IS_VALID (worker->media_start) ||
+      GST_BUFFER_PTS (buffer) < worker->media_start)
+    worker->media_start = GST_BUFFER_PTS (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (worker->media_end) || end > worker->media_end)
+    worker->media_end = end;
+  g_mutex_unlock (&worker->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static Branch *
+build_branch (Worker *worker, guint rule)
+{
+  GError *error = NULL;
+  GstElement *bin;
+  GstPad *pad;
+  Branch *branch;
+  gchar *description;
+
+  /* The queue is what puts the branch on a thread of its own */
+  description = g_strdup_printf ("queue ! %s", worker->batch->rules[rule].branch);
+  bin = gst_parse_bin_from_description (description, TRUE, &error);
+  g_free (description);
+  if (!bin) {
+    g_printerr ("Could not build branch '%s': %s\n", worker->batch->rules[rule].branch,
+        error->message);
+    g_clear_error (&error);
+    return NULL;
+  }
+
+  branch = g_new0 (Branch, 1);
+  branch->bin = gst_object_ref_sink (bin);
+  branch->rule = rule;
+  branch->worker = worker;
+  pad = gst_element_get_static_pad (bin, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) branch_probe,
+      branch, NULL);
+  gst_object_unref (pad);
+  return branch;
+}
+
+/* Streaming thread: an idle branch for the pad's rule, or a new one */
+static void
+pad_added (GstElement *source, GstPad *pad, Worker *worker)
+{
+  BatchDecoder *batch = worker->batch;
+  Branch *branch = NULL;
+  GstPad *sink_pad;
+  GstCaps *caps;
+  const gchar *name;
+  guint rule, i;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (!caps)
+    caps = gst_pad_query_caps (pad, NULL);
+  if (gst_caps_is_empty (caps) || gst_caps_is_any (caps)) {
+    gst_caps_unref (caps);
+    return;
+  }
+  name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+  for (rule = 0; rule < batch->n_rules; rule++)
+    if (g_str_has_prefix (name, batch->rules[rule].caps_prefix))
+      break;
+  gst_caps_unref (caps);
+  if (rule == batch->n_rules)
+    return;
+
+  g_mutex_lock (&worker->lock);
+  for (i = 0; i < worker->branches->len && !branch; i++) {
+    Branch *candidate = g_ptr_array_index (worker->branches, i);
+
+    if (candidate->rule == rule && !candidate->in_use)
+      branch = candidate;
+  }
+  if (!branch) {
+    branch = build_branch (worker, rule);
+    if (branch) {
+      g_ptr_array_add (worker->branches, branch);
+      g_atomic_int_inc ((gint *) &batch->stats.branches_built);
+    }
+  }
+  if (branch)
+    branch->in_use = TRUE;
+  g_mutex_unlock (&worker->lock);
+  if (!branch)
+    return;
+
+  gst_bin_add (GST_BIN (worker->pipeline), branch->bin);
+  gst_element_sync_state_with_parent (branch->bin);
+  sink_pad = gst_element_get_static_pad (branch->bin, "sink");
+  if (GST_PAD_LINK_FAILED (gst_pad_link (pad, sink_pad)))
+    g_printerr ("[worker %u] Could not link %s to '%s'.\n", worker->id, GST_PAD_NAME (pad),
+        batch->rules[rule].branch);
+  gst_object_unref (sink_pad);
+}
+
+static void job_done (PipelineRuntime *runtime, GstMessage *msg, Worker *worker);
+
+static Worker *
+worker_new (BatchDecoder *batch, guint id)
+{
+  Worker *worker = g_new0 (Worker, 1);
+  gchar *name = g_strdup_printf ("batch-worker%u", id);
+
+  worker->batch = batch;
+  worker->id = id;
+  worker->pipeline = gst_pipeline_new (name);
+  worker->source = gst_element_factory_make ("uridecodebin", NULL);
+  worker->branches = g_ptr_array_new_with_free_func ((GDestroyNotify) branch_free);
+  worker->media_start = worker->media_end = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&worker->lock);
+  g_free (name);
+
+  gst_bin_add (GST_BIN (worker->pipeline), worker->source);
+  g_signal_connect (worker->source, "pad-added", G_CALLBACK (pad_added), worker);
+
+  worker->runtime = pipeline_runtime_new (worker->pipeline);
+  pipeline_runtime_set_handler (worker->runtime, GST_MESSAGE_EOS | GST_MESSAGE_ERROR,
+      (PipelineMessageFunc) job_done, worker);
+  batch->stats.pipelines_built++;
+  return worker;
+}
+
+static void
+worker_free (Worker *worker)
+{
+  /* Takes the pipeline to NULL; branches out of the pipeline go to NULL in branch_free */
+  pipeline_runtime_free (worker->runtime);
+  g_ptr_array_unref (worker->branches);
+  gst_object_unref (worker->pipeline);
+  g_mutex_clear (&worker->lock);
+  g_free (worker->uri);
+  g_free (worker);
+}
+
+/* Back to READY (NULL after an error), nothing of the last job left on the bus */
+static void
+worker_reset (Worker *worker)
+{
+  GstBus *bus = gst_element_get_bus (worker->pipeline);
+  guint i;
+
+  gst_element_set_state (worker->pipeline, worker->failed ? GST_STATE_NULL : GST_STATE_READY);
+  gst_bus_set_flushing (bus, TRUE);
+  gst_bus_set_flushing (bus, FALSE);
+  gst_object_unref (bus);
+
+  /* uridecodebin has removed its pads; the branches wait outside for the next job */
+  g_mutex_lock (&worker->lock);
+  for (i = 0; i < worker->branches->len; i++) {
+    Branch *branch = g_ptr_array_index (worker->branches, i);
+
+    if (branch->in_use) {
+      gst_bin_remove (GST_BIN (worker->pipeline), branch->bin);
+      branch->in_use = FALSE;
+    }
+  }
+  worker->media_start = worker->media_end = GST_CLOCK_TIME_NONE;
+  g_mutex_unlock (&worker->lock);
+}
+
+static void
+finish_job (Worker *worker)
+{
+  BatchDecoder *batch = worker->batch;
+  GstClockTime media = 0;
+  gdouble seconds = (gst_util_get_timestamp () - worker->started) / 1e9;
+
+  g_mutex_lock (&worker->lock);
+  if (GST_CLOCK_TIME_IS_VALID (worker->media_start))
+    media = worker->media_end - worker->media_start;
+  g_mutex_unlock (&worker->lock);
+
+  if (worker->failed) {
+    batch->stats.jobs_failed++;
+  } else {
+    batch->stats.jobs_done++;
+    batch->stats.media_time += media;
+  }
+  if (batch->verbose)
+    g_print ("[worker %u] %s: %s, %.1f s of media in %.2f s\n", worker->id, worker->uri,
+        worker->failed ? "failed" : "done", media / 1e9, seconds);
+  g_clear_pointer (&worker->uri, g_free);
+}
+
+/* Main loop: the next URI, until there are none */
+static gboolean
+start_next_job (Worker *worker)
+{
+  BatchDecoder *batch = worker->batch;
+
+  while (batch->uris[batch->next]) {
+    worker->uri = g_strdup (batch->uris[batch->next++]);
+    worker->failed = FALSE;
+    worker->started = gst_util_get_timestamp ();
+    g_object_set (worker->source, "uri", worker->uri, NULL);
+    if (pipeline_runtime_start (worker->runtime))
+      return G_SOURCE_REMOVE;
+
+    worker->failed = TRUE;
+    finish_job (worker);
+    worker_reset (worker);
+  }
+  pipeline_runtime_stop (worker->runtime);
+  return G_SOURCE_REMOVE;
+}
+
+/* Main loop, outside of the bus dispatch: reset or replace the pipeline, next job */
+static gboolean
+advance (Worker *worker)
+{
+  BatchDecoder *batch = worker->batch;
+
+  if (batch->reuse || !batch->uris[batch->next]) {
+    worker_reset (worker);
+  } else {
+    Worker *fresh = worker_new (batch, worker->id);
+
+    /* Started before the old one stops, so the shared loop keeps running */
+    g_ptr_array_index (batch->workers, worker->id) = fresh;
+    start_next_job (fresh);
+    worker_free (worker);
+    return G_SOURCE_REMOVE;
+  }
+  return start_next_job (worker);
+}
+
+static void
+job_done (PipelineRuntime *runtime, GstMessage *msg, Worker *worker)
+{
+  /* Several elements may post an error for the same failure */
+  if (!worker->uri)
+    return;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    GError *error = NULL;
+
+    gst_message_parse_error (msg, &error, NULL);
+    g_printerr ("[worker %u] %s: %s\n", worker->id, worker->uri, error->message);
+    g_clear_error (&error);
+    worker->failed = TRUE;
+  }
+  finish_job (worker);
+  g_idle_add ((GSourceFunc) advance, worker);
+}
+
+BatchDecoder *
+batch_decoder_new (const StreamRule *rules, guint n_rules, guint n_workers, gboolean reuse)
+{
+  BatchDecoder *batch = g_new0 (BatchDecoder, 1);
+  guint cores = g_get_num_processors ();
+
+  batch->rules = rules;
+  batch->n_rules = n_rules;
+  batch->n_workers = n_workers ? MIN (n_workers, cores) : cores;
+  batch->reuse = reuse;
+  return batch;
+}
+
+void
+batch_decoder_free (BatchDecoder *batch)
+{
+  g_free (batch);
+}
+
+void
+batch_decoder_set_verbose (BatchDecoder *batch, gboolean verbose)
+{
+  batch->verbose = verbose;
+}
+
+gboolean
+batch_decoder_run (BatchDecoder *batch, gchar **uris)
+{
+  guint64 start = gst_util_get_timestamp ();
+  guint i, n_workers = MIN (batch->n_workers, g_strv_length (uris));
+
+  memset (&batch->stats, 0, sizeof (batch->stats));
+  batch->stats.workers = n_workers;
+  batch->uris = uris;
+  batch->next = 0;
+  batch->workers = g_ptr_array_new ();
+
+  for (i = 0; i < n_workers; i++)
+    g_ptr_array_add (batch->workers, worker_new (batch, i));
+  for (i = 0; i < n_workers; i++)
+    start_next_job (g_ptr_array_index (batch->workers, i));
+  pipeline_runtime_run ();
+
+  batch->stats.wall_time = gst_util_get_timestamp () - start;
+  g_ptr_array_foreach (batch->workers, (GFunc) worker_free, NULL);
+  g_ptr_array_unref (batch->workers);
+  batch->workers = NULL;
+  batch->uris = NULL;
+  return batch->stats.jobs_failed == 0;
+}
+
+void
+batch_decoder_get_stats (BatchDecoder *batch, BatchDecoderStats *stats)
+{
+  *stats = batch->stats;
+}
+
+gchar **
+batch_decoder_read_list (const gchar *path, GError **error)
+{
+  GPtrArray *uris;
+  gchar *contents, **lines;
+  guint i;
+
+  if (!g_file_get_contents (path, &contents, NULL, error))
+    return NULL;
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  uris = g_ptr_array_new ();
+  for (i = 0; lines[i]; i++) {
+    gchar *line = g_strstrip (lines[i]);
+    gchar *uri;
+
+    if (*line == '\0' || *line == '#')
+      continue;
+    uri = gst_uri_is_valid (line) ? g_strdup (line) : gst_filename_to_uri (line, NULL);
+    if (uri)
+      g_ptr_array_add (uris, uri);
+    else
+      g_printerr ("Skipping '%s': not a URI or file name.\n", line);
+  }
+  g_strfreev (lines);
+  g_ptr_array_add (uris, NULL);
+  return (gchar **) g_ptr_array_free (uris, FALSE);
+}
@@ -0,0 +1,64 @@
+/*
+Decodes a list of files with a pool of uridecodebin pipelines.
+
+bt3 decodes one URI per process; archives of clips need thousands. The
+batch decoder keeps `n_workers` pipelines (at most one per core, and no more
+than there are jobs), all dispatched by the shared runtime loop
+(pipeline-runtime.c), and hands each the next URI as soon as it finishes
+one. Each pipeline is uridecodebin plus one branch per decoded stream,
+"queue ! <rule>" with the same rules as the stream router (stream-router.h).
+
+Pipelines are reused across jobs: at EOS the pipeline goes to READY (NULL
+after an error), whatever is still on its bus is flushed, and uridecodebin
+gets the next URI. The pipeline, its bus and the branches are kept; a branch
+whose stream pad went away with READY is taken out of the pipeline and put
+back in, already built, the next time its rule matches a pad. Only
+uridecodebin's own source, demuxer and decoders are plugged per job. With
+`reuse` FALSE every job gets a new pipeline instead, for comparison.
+
+Media time is what reached the branches, from the first timestamp to the
+end of the last buffer of the longest stream. The stats add it up with the
+wall time, so media-seconds per wall-second is the throughput.
+*/
+#ifndef __BATCH_DECODER_H__
+#define __BATCH_DECODER_H__
+
+#include <gst/gst.h>
+
+#include "stream-router.h"
+
+G_BEGIN_DECLS
+
+typedef struct _BatchDecoder BatchDecoder;
+
+typedef struct _BatchDecoderStats {
+  guint workers;
+  guint jobs_done;
+  guint jobs_failed;
+  guint pipelines_built;
+  guint branches_built;
+  GstClockTime media_time;    /* decoded, over all jobs */
+  guint64 wall_time;          /* nanoseconds, of the last batch_decoder_run */
+} BatchDecoderStats;
+
+/*
+ `rules` must stay valid as long as the decoder; they should end in sinks
+ with sync=false. `n_workers` 0 is one per core.
+*/
+BatchDecoder *batch_decoder_new (const StreamRule *rules, guint n_rules, guint n_workers,
+    gboolean reuse);
+void batch_decoder_free (BatchDecoder *batch);
+
+/* Prints a line per job */
+void batch_decoder_set_verbose (BatchDecoder *batch, gboolean verbose);
+
+/* Runs every URI through the pool; returns once all are done, FALSE if any failed */
+gboolean batch_decoder_run (BatchDecoder *batch, gchar **uris);
+void batch_decoder_get_stats (BatchDecoder *batch, BatchDecoderStats *stats);
+
+/* One URI per line of `path` (file names are turned into URIs); '#' starts a comment */
+gchar **batch_decoder_read_list (const gchar *path, GError **error);
+
+G_END_DECLS
+
+#endif /* __BATCH_DECODER_H__ */
@@ -0,0 +1,143 @@
+/*
+Build: make bench-audio
+Run:   ./bench-audio [--seconds=60] [--input-rate=44100] [--cpu-budget=2]
+
+CPU cost and latency of each audio preset (audio-preset.c), headless. A
+decoder's typical output, F32LE stereo at `--input-rate`, is made by a
+non-live audiotestsrc and goes through the preset's chain to 48 kHz stereo
+S16LE, what a sound card takes, into a fakesink with sync=false, so the
+audio is processed as fast as the CPU allows instead of in real time:
+
+  audiotestsrc wave=pink-noise ! audio/x-raw,format=F32LE,rate=44100,channels=2 !
+  <preset chain> ! audio/x-raw,format=S16LE,rate=48000,channels=2 ! fakesink sync=false
+
+One JSON line per preset: the thread CPU time spent in the chain (the
+conversions and the resampling; not the source, which a decoder would
+replace), as a percentage of one core when playing in real time, against
+`--cpu-budget`; the process CPU for comparison; how much faster than real
+time it ran; the chain's latency and the sink buffer the preset would ask a
+real audio sink for. The exit status is 1 if a preset went over the budget.
+*/
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+
+#include "audio-preset.h"
+
+#define OUTPUT_CAPS "audio/x-raw,format=S16LE,rate=48000,channels=2"
+
+static gint seconds = 60;
+static gint input_rate = 44100;
+static gdouble cpu_budget = 2.0;
+
+static GOptionEntry entries[] = {
+  { "seconds", 's', 0, G_OPTION_ARG_INT, &seconds, "Seconds of audio per preset (default 60)", "S" },
+  { "input-rate", 'r', 0, G_OPTION_ARG_INT, &input_rate, "Sample rate into the chain (default 44100)", "HZ" },
+  { "cpu-budget", 'b', 0, G_OPTION_ARG_DOUBLE, &cpu_budget, "Percent of a core the chain may take (default 2)", "PCT" },
+  { NULL }
+};
+
+static const gchar *preset_names[] = { "lowest-latency", "balanced", "highest-quality" };
+
+static gdouble
+process_cpu_seconds (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/* FALSE if the preset could not run or went over the budget */
+static gboolean
+run (const AudioPreset *preset)
+{
+  GstElement *pipeline;
+  AudioPresetChain *chain;
+  AudioPresetStats stats;
+  GError *error = NULL;
+  GstMessage *msg;
+  gchar *branch, *description;
+  gdouble process_cpu, media, wall, cpu_pct;
+  guint64 start;
+  gboolean ok;
+
+  /* 1024 samples per buffer, about what a decoder hands out */
+  branch = audio_preset_branch (preset, OUTPUT_CAPS " ! fakesink sync=false");
+  description = g_strdup_printf ("audiotestsrc wave=pink-noise samplesperbuffer=1024 "
+      "num-buffers=%d ! audio/x-raw,format=F32LE,rate=%d,channels=2 ! %s",
+      (gint) ((gint64) seconds * input_rate / 1024), input_rate, branch);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  g_free (branch);
+  if (!pipeline) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return FALSE;
+  }
+
+  chain = audio_preset_attach (pipeline, preset);
+  process_cpu = process_cpu_seconds ();
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline), GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+  wall = (gst_util_get_timestamp () - start) / 1e9;
+  process_cpu = process_cpu_seconds () - process_cpu;
+  ok = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+  if (!ok) {
+    gst_message_parse_error (msg, &error, NULL);
+    g_printerr ("%s: %s\n", preset->name, error->message);
+    g_clear_error (&error);
+  }
+  gst_message_unref (msg);
+
+  audio_preset_get_stats (chain, &stats);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  audio_preset_free (chain);
+  gst_object_unref (pipeline);
+  if (!ok || !stats.media_time)
+    return FALSE;
+
+  media = stats.media_time / 1e9;
+  cpu_pct = 100.0 * stats.cpu_time / stats.media_time;
+  g_print ("{\"preset\":\"%s\",\"format\":\"%s\",\"resampler\":\"%s\",\"quality\":%d"
+      ",\"input_rate\":%d,\"media_s\":%.1f,\"wall_s\":%.3f,\"realtime_x\":%.0f"
+      ",\"chain_cpu_ms\":%.2f,\"chain_cpu_pct\":%.3f,\"process_cpu_pct\":%.3f"
+      ",\"chain_latency_ms\":%.3f,\"sink_buffer_ms\":%.1f,\"cpu_budget_pct\":%.1f"
+      ",\"within_budget\":%s}\n", preset->name, preset->format, preset->resample_method,
+      preset->quality, input_rate, media, wall, wall > 0 ? media / wall : 0.0,
+      stats.cpu_time / 1e6, cpu_pct, 100.0 * process_cpu / media,
+      GST_CLOCK_TIME_IS_VALID (stats.chain_latency) ? stats.chain_latency / 1e6 : 0.0,
+      preset->buffer_time / 1e3, cpu_budget, cpu_pct <= cpu_budget ? "true" : "false");
+  return cpu_pct <= cpu_budget;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gboolean ok = TRUE;
+  guint i;
+
+  context = g_option_context_new ("- CPU and latency of the audio presets");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (seconds <= 0 || input_rate <= 0) {
+    g_printerr ("--seconds and --input-rate must be positive.\n");
+    return -1;
+  }
+  gst_init (&argc, &argv);
+
+  for (i = 0; i < G_N_ELEMENTS (preset_names); i++)
+    ok &= run (audio_preset_find (preset_names[i]));
+  return ok ? 0 : 1;
+}
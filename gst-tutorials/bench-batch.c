@@ -0,0 +1,114 @@
+/*
+Build: make bench-batch
+Run:   ./bench-batch [--repeat=4] [--rebuild] clip1.webm [clip2.mkv ...]
+
+Scaling of the batch decoder (batch-decoder.c) on local files. The files,
+each listed `--repeat` times, are decoded with 1, 2, 4, ... workers up to
+one per core, with bt3's headless branches (audioconvert ! audioresample and
+videoconvert into fakesink sync=false). One JSON line per worker count with
+media-seconds decoded per wall-second, the speedup over one worker and the
+scaling efficiency (speedup / workers), and how many pipelines were built:
+one per worker when they are reused, one per file with `--rebuild`.
+
+The first pass also warms the page cache, so it is run once more and only
+the second run is reported.
+*/
+#include <gst/gst.h>
+
+#include "batch-decoder.h"
+
+static gint repeat = 4;
+static gboolean rebuild = FALSE;
+static gchar **files = NULL;
+
+static GOptionEntry entries[] = {
+  { "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat, "Decode every file this many times per run (default 4)", "N" },
+  { "rebuild", 0, 0, G_OPTION_ARG_NONE, &rebuild, "Build a new pipeline for every file instead of reusing them", NULL },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, "FILE..." },
+  { NULL }
+};
+
+/* The same branches as bt3 --headless */
+static const StreamRule rules[] = {
+  { "audio/x-raw", "audioconvert ! audioresample ! fakesink sync=false" },
+  { "video/x-raw", "videoconvert ! fakesink sync=false" },
+  { "", "fakesink sync=false" },
+};
+
+/* Media-seconds per wall-second, 0 if anything failed */
+static gdouble
+run (gchar **uris, guint workers, BatchDecoderStats *stats)
+{
+  BatchDecoder *batch = batch_decoder_new (rules, G_N_ELEMENTS (rules), workers, !rebuild);
+  gboolean ok = batch_decoder_run (batch, uris);
+
+  batch_decoder_get_stats (batch, stats);
+  batch_decoder_free (batch);
+  if (!ok || stats->wall_time == 0)
+    return 0;
+  return (gdouble) stats->media_time / stats->wall_time;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GPtrArray *uris;
+  BatchDecoderStats stats;
+  gdouble single = 0;
+  guint cores, workers;
+  gint i, r;
+
+  context = g_option_context_new ("- batch decoder scaling over local files");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (!files) {
+    g_printerr ("No files given.\n");
+    return -1;
+  }
+  gst_init (&argc, &argv);
+
+  uris = g_ptr_array_new_with_free_func (g_free);
+  for (r = 0; r < MAX (repeat, 1); r++) {
+    for (i = 0; files[i]; i++) {
+      gchar *uri = gst_filename_to_uri (files[i], &error);
+
+      if (!uri) {
+        g_printerr ("Invalid file %s: %s\n", files[i], error->message);
+        g_clear_error (&error);
+        return -1;
+      }
+      g_ptr_array_add (uris, uri);
+    }
+  }
+  g_ptr_array_add (uris, NULL);
+
+  cores = g_get_num_processors ();
+  run ((gchar **) uris->pdata, 1, &stats);
+
+  /* 1, 2, 4, ... and the core count itself */
+  for (workers = 1; workers <= cores; workers = workers * 2 > cores && workers < cores ?
+      cores : workers * 2) {
+    gdouble rate = run ((gchar **) uris->pdata, workers, &stats);
+
+    if (workers == 1)
+      single = rate;
+    g_print ("{\"workers\":%u,\"jobs\":%u,\"failed\":%u,\"pipelines_built\":%u"
+        ",\"media_s\":%.1f,\"wall_s\":%.3f,\"media_s_per_wall_s\":%.2f"
+        ",\"speedup\":%.2f,\"efficiency\":%.2f}\n", stats.workers, stats.jobs_done,
+        stats.jobs_failed, stats.pipelines_built, stats.media_time / 1e9,
+        stats.wall_time / 1e9, rate, single > 0 ? rate / single : 0.0,
+        single > 0 ? rate / single / stats.workers : 0.0);
+  }
+
+  g_ptr_array_unref (uris);
+  g_strfreev (files);
+  return 0;
+}
@@ -0,0 +1,201 @@
+/*
+Build: make bench-caps-index
+Run:   ./bench-caps-index [--index=FILE] [--rebuild] [--measure] [--iterations=200] [CAPS...]
+
+Lookup time of the caps index (caps-index.c) against the registry walk an
+autoplugger does: list every element factory, keep the converters,
+decoders, demuxers, parsers and sinks, intersect the caps with their sink
+templates (gst_element_factory_list_filter) and sort by rank. For each caps
+(a few raw and encoded defaults unless given), one JSON line with the time
+of the first index lookup (which parses that media type's template caps),
+of the later ones, of the registry walk, the speedup, the best five
+candidates and whether both found the same factories.
+
+The index is loaded from `--index` (default in the user's cache directory)
+or built and saved there; the first line says which and how long it took.
+`--measure` first measures the throughput of the converters for the raw
+caps, one line each with the conversion that was timed, and saves it in the
+index, which then ranks them by it among equal ranks.
+*/
+#include <gst/gst.h>
+
+#include "caps-index.h"
+
+#define MEASURE_BUFFERS 300
+
+static gchar *index_path = NULL;
+static gboolean rebuild = FALSE;
+static gboolean measure = FALSE;
+static gint iterations = 200;
+static gchar **caps_args = NULL;
+
+static GOptionEntry entries[] = {
+  { "index", 'i', 0, G_OPTION_ARG_FILENAME, &index_path, "Index file (default: in the user's cache directory)", "FILE" },
+  { "rebuild", 'r', 0, G_OPTION_ARG_NONE, &rebuild, "Build the index again even if it is up to date", NULL },
+  { "measure", 'm', 0, G_OPTION_ARG_NONE, &measure, "Measure converter throughput for the raw caps first", NULL },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Lookups per caps and method (default 200)", "N" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &caps_args, NULL, "[CAPS...]" },
+  { NULL }
+};
+
+/* What the tutorials play and the realsense camera sends */
+static const gchar *default_caps[] = {
+  "video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1",
+  "video/x-raw,format=I420,width=854,height=480,framerate=24/1",
+  "audio/x-raw,format=F32LE,layout=interleaved,rate=44100,channels=2",
+  "video/webm",
+  "video/x-vp8",
+  "audio/x-vorbis",
+  "video/x-h264,stream-format=byte-stream,alignment=au",
+  NULL
+};
+
+/* The autoplugger's way, every time */
+static GList *
+registry_walk (const GstCaps *caps)
+{
+  GList *factories, *kept = NULL, *matches, *l;
+
+  factories = gst_registry_get_feature_list (gst_registry_get (), GST_TYPE_ELEMENT_FACTORY);
+  for (l = factories; l; l = l->next)
+    if (caps_index_factory_kind (l->data))
+      kept = g_list_prepend (kept, gst_object_ref (l->data));
+  matches = gst_element_factory_list_filter (kept, caps, GST_PAD_SINK, FALSE);
+  matches = g_list_sort (matches, (GCompareFunc) gst_plugin_feature_rank_compare_func);
+  gst_plugin_feature_list_free (kept);
+  gst_plugin_feature_list_free (factories);
+  return matches;
+}
+
+static gboolean
+same_factories (GPtrArray *found, GList *walked)
+{
+  GHashTable *names = g_hash_table_new (g_str_hash, g_str_equal);
+  gboolean same = g_list_length (walked) == found->len;
+  GList *l;
+  guint i;
+
+  for (i = 0; i < found->len; i++)
+    g_hash_table_add (names, (gpointer) ((CapsIndexEntry *) g_ptr_array_index (found, i))->factory);
+  for (l = walked; same && l; l = l->next)
+    same = g_hash_table_contains (names, GST_OBJECT_NAME (l->data));
+  g_hash_table_unref (names);
+  return same;
+}
+
+static void
+run (CapsIndex *index, const gchar *caps_str)
+{
+  GstCaps *caps = gst_caps_from_string (caps_str);
+  GPtrArray *found;
+  GList *walked;
+  GString *best;
+  guint64 start, first, indexed, walk;
+  gint i;
+
+  if (!caps) {
+    g_printerr ("Invalid caps: %s\n", caps_str);
+    return;
+  }
+
+  start = gst_util_get_timestamp ();
+  found = caps_index_lookup (index, caps, CAPS_INDEX_ANY_KIND);
+  first = gst_util_get_timestamp () - start;
+  g_ptr_array_unref (found);
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < iterations; i++) {
+    found = caps_index_lookup (index, caps, CAPS_INDEX_ANY_KIND);
+    if (i < iterations - 1)
+      g_ptr_array_unref (found);
+  }
+  indexed = (gst_util_get_timestamp () - start) / iterations;
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < iterations; i++) {
+    walked = registry_walk (caps);
+    if (i < iterations - 1)
+      gst_plugin_feature_list_free (walked);
+  }
+  walk = (gst_util_get_timestamp () - start) / iterations;
+
+  best = g_string_new (NULL);
+  for (i = 0; i < (gint) MIN (found->len, 5); i++) {
+    CapsIndexEntry *entry = g_ptr_array_index (found, i);
+
+    g_string_append_printf (best, "%s\"%s\"", i ? "," : "", entry->factory);
+  }
+  g_print ("{\"caps\":\"%s\",\"matches\":%u,\"index_first_us\":%.1f,\"index_us\":%.2f"
+      ",\"registry_walk_us\":%.1f,\"speedup\":%.0f,\"same_factories\":%s,\"best\":[%s]}\n",
+      caps_str, found->len, first / 1e3, indexed / 1e3, walk / 1e3,
+      indexed ? (gdouble) walk / indexed : 0.0,
+      same_factories (found, walked) ? "true" : "false", best->str);
+
+  g_string_free (best, TRUE);
+  g_ptr_array_unref (found);
+  gst_plugin_feature_list_free (walked);
+  gst_caps_unref (caps);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  CapsIndex *index = NULL;
+  const gchar **caps_list;
+  gboolean loaded;
+  guint64 start;
+  gint i;
+
+  context = g_option_context_new ("- caps index lookups vs. the registry walk");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (iterations <= 0) {
+    g_printerr ("--iterations must be positive.\n");
+    return -1;
+  }
+  gst_init (&argc, &argv);
+  if (!index_path)
+    index_path = caps_index_default_path ();
+  caps_list = caps_args ? (const gchar **) caps_args : default_caps;
+
+  start = gst_util_get_timestamp ();
+  if (!rebuild)
+    index = caps_index_load (index_path);
+  loaded = index != NULL;
+  if (!index)
+    index = caps_index_build ();
+  g_print ("{\"index\":\"%s\",\"entries\":%u,\"loaded\":%s,\"open_ms\":%.2f}\n", index_path,
+      caps_index_get_n_entries (index), loaded ? "true" : "false",
+      (gst_util_get_timestamp () - start) / 1e6);
+
+  if (measure) {
+    for (i = 0; caps_list[i]; i++) {
+      GstCaps *caps = gst_caps_from_string (caps_list[i]);
+
+      if (caps) {
+        caps_index_measure (index, caps, MEASURE_BUFFERS);
+        gst_caps_unref (caps);
+      }
+    }
+  }
+  if ((!loaded || measure) && !caps_index_save (index, index_path, &error)) {
+    g_printerr ("Could not save %s: %s\n", index_path, error->message);
+    g_clear_error (&error);
+  }
+
+  for (i = 0; caps_list[i]; i++)
+    run (index, caps_list[i]);
+
+  caps_index_free (index);
+  g_free (index_path);
+  g_strfreev (caps_args);
+  return 0;
+}
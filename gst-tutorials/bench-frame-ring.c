@@ -0,0 +1,291 @@
+/*
+Build: make bench-frame-ring
+Run:   ./bench-frame-ring [--frames=600] [--width=1920 --height=1080] [--ring=4]
+
+Cost of getting frames out of an appsink, the usual way and through the
+frame ring (frame-ring.c):
+  - "copy": the new-sample callback copies every frame out with
+    gst_buffer_extract into freshly allocated memory and hands the copy to
+    the consumer thread through a GAsyncQueue,
+  - "ring": the callback maps the frame in place into a preallocated slot and
+    the consumer thread pops a view of it.
+The source is a non-live YUY2 videotestsrc, so the pipeline runs as fast as
+the consumer lets it. The consumer reads one byte per cache line of every
+frame, as a stand-in for analytics.
+
+malloc, calloc, realloc and the aligned allocators are interposed to count the allocations the whole
+process makes per frame once it is in its steady state (after the first
+WARMUP_FRAMES frames). Handoff latency is from the moment the appsink
+callback starts to the moment the consumer has the frame. The copy queue is
+unbounded and never drops; the ring drops the oldest frame when the consumer
+is behind. One JSON line per mode.
+*/
+#include <gst/gst.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "frame-ring.h"
+#include "latency-histogram.h"
+
+#define WARMUP_FRAMES 60
+#define CACHE_LINE 64
+/* The source never pauses for this long: a consumer that waited that long is done */
+#define CONSUMER_TIMEOUT G_USEC_PER_SEC
+
+static gint frames = 600;
+static gint width = 1920;
+static gint height = 1080;
+static gint ring_size = 4;
+
+static GOptionEntry entries[] = {
+  { "frames", 'n', 0, G_OPTION_ARG_INT, &frames, "Frames per run (default 600)", "N" },
+  { "width", 'W', 0, G_OPTION_ARG_INT, &width, "Frame width (default 1920)", "PIXELS" },
+  { "height", 'H', 0, G_OPTION_ARG_INT, &height, "Frame height (default 1080)", "PIXELS" },
+  { "ring", 'r', 0, G_OPTION_ARG_INT, &ring_size, "Frame ring slots (default 4)", "N" },
+  { NULL }
+};
+
+/* Allocation counting: glibc's own entry points do the work */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+static gint allocations = 0;
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+  g_atomic_int_inc (&allocations);
+  return __libc_memalign (alignment, size);
+}
+
+/* What GstMemory allocators with an alignment may use */
+int
+posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+  void *mem;
+
+  if (alignment % sizeof (void *) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  g_atomic_int_inc (&allocations);
+  mem = __libc_memalign (alignment, size);
+  if (!mem && size)
+    return ENOMEM;
+  *ptr = mem;
+  return 0;
+}
+
+/* A frame copied out of its buffer */
+typedef struct _Copy {
+  guint8 *data;
+  gsize size;
+  gint64 received;
+} Copy;
+
+typedef struct _Run {
+  const gchar *mode;
+  GAsyncQueue *copies;        /* "copy" mode */
+  FrameRing *ring;            /* "ring" mode */
+
+  /* Consumer thread only */
+  LatencyHistogram handoff;
+  guint consumed;
+  gint warm_allocations;
+  gint64 warm_time;
+  gint64 last_time;
+  gint last_allocations;
+  guint64 checksum;
+} Run;
+
+static guint64
+touch (const guint8 *data, gsize size)
+{
+  guint64 sum = 0;
+  gsize i;
+
+  for (i = 0; i < size; i += CACHE_LINE)
+    sum += data[i];
+  return sum;
+}
+
+/* Consumer side bookkeeping, shared by both modes */
+static void
+consumed (Run *run, gint64 received)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  latency_histogram_record (&run->handoff, (now - received) * 1000);
+  run->last_time = now;
+  run->last_allocations = g_atomic_int_get (&allocations);
+  if (++run->consumed == WARMUP_FRAMES) {
+    run->warm_allocations = g_atomic_int_get (&allocations);
+    run->warm_time = now;
+  }
+}
+
+static GstFlowReturn
+copy_new_sample (GstElement *appsink, Run *run)
+{
+  gint64 received = g_get_monotonic_time ();
+  GstSample *sample = NULL;
+  GstBuffer *buffer;
+  Copy *copy;
+
+  g_signal_emit_by_name (appsink, "pull-sample", &sample);
+  if (!sample)
+    return GST_FLOW_EOS;
+  buffer = gst_sample_get_buffer (sample);
+
+  copy = g_new (Copy, 1);
+  copy->size = gst_buffer_get_size (buffer);
+  copy->data = g_malloc (copy->size);
+  copy->received = received;
+  gst_buffer_extract (buffer, 0, copy->data, copy->size);
+  gst_sample_unref (sample);
+
+  g_async_queue_push (run->copies, copy);
+  return GST_FLOW_OK;
+}
+
+static gpointer
+consume_copies (Run *run)
+{
+  Copy *copy;
+
+  while ((copy = g_async_queue_timeout_pop (run->copies, CONSUMER_TIMEOUT))) {
+    run->checksum += touch (copy->data, copy->size);
+    consumed (run, copy->received);
+    g_free (copy->data);
+    g_free (copy);
+  }
+  return NULL;
+}
+
+static gpointer
+consume_views (Run *run)
+{
+  const FrameView *view;
+  guint i;
+
+  while ((view = frame_ring_pop (run->ring, CONSUMER_TIMEOUT))) {
+    for (i = 0; i < view->n_planes; i++)
+      run->checksum += touch (view->data[i], (gsize) view->stride[i] * view->height);
+    consumed (run, view->received);
+    frame_view_unref (view);
+  }
+  return NULL;
+}
+
+static void
+run_mode (const gchar *mode)
+{
+  GstElement *pipeline, *appsink;
+  GstMessage *msg;
+  GThread *consumer;
+  GError *error = NULL;
+  Run run = { mode };
+  gchar *description;
+  guint steady;
+
+  description = g_strdup_printf ("videotestsrc num-buffers=%d ! "
+      "video/x-raw,format=YUY2,width=%d,height=%d,framerate=30/1 ! "
+      "appsink name=sink sync=false max-buffers=%d", frames, width, height, ring_size);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  if (!pipeline) {
+    g_print ("{\"mode\":\"%s\",\"status\":\"error\",\"reason\":\"%s\"}\n", mode, error->message);
+    g_clear_error (&error);
+    return;
+  }
+  appsink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  latency_histogram_reset (&run.handoff);
+
+  if (g_str_equal (mode, "copy")) {
+    run.copies = g_async_queue_new ();
+    g_object_set (appsink, "emit-signals", TRUE, NULL);
+    g_signal_connect (appsink, "new-sample", G_CALLBACK (copy_new_sample), &run);
+    consumer = g_thread_new ("consumer", (GThreadFunc) consume_copies, &run);
+  } else {
+    run.ring = frame_ring_new (appsink, ring_size);
+    consumer = g_thread_new ("consumer", (GThreadFunc) consume_views, &run);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline), GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  g_thread_join (consumer);
+
+  steady = run.consumed > WARMUP_FRAMES ? run.consumed - WARMUP_FRAMES : 0;
+  g_print ("{\"mode\":\"%s\",\"status\":\"%s\",\"width\":%d,\"height\":%d,\"frames\":%u"
+      ",\"dropped\":%" G_GUINT64_FORMAT ",\"frames_per_s\":%.1f,\"allocs_per_frame\":%.2f"
+      ",\"handoff_us_p50\":%.1f,\"handoff_us_p99\":%.1f,\"handoff_us_max\":%.1f}\n",
+      mode, GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS ? "ok" : "error", width, height,
+      run.consumed, run.ring ? frame_ring_get_dropped (run.ring) : 0,
+      steady && run.last_time > run.warm_time ?
+      steady / ((run.last_time - run.warm_time) / 1e6) : 0.0,
+      steady ? (gdouble) (run.last_allocations - run.warm_allocations) / steady : 0.0,
+      latency_histogram_percentile (&run.handoff, 50) / 1e3,
+      latency_histogram_percentile (&run.handoff, 99) / 1e3, run.handoff.max / 1e3);
+  /* Keeps the consumer's reads from being optimized away */
+  g_printerr ("%s checksum %" G_GUINT64_FORMAT "\n", mode, run.checksum);
+
+  gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  if (run.ring)
+    frame_ring_free (run.ring);
+  if (run.copies)
+    g_async_queue_unref (run.copies);
+  gst_object_unref (appsink);
+  gst_object_unref (pipeline);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+
+  context = g_option_context_new ("- appsink copy vs. frame ring benchmark");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  gst_init (&argc, &argv);
+
+  run_mode ("copy");
+  run_mode ("ring");
+  return 0;
+}
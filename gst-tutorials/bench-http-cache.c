@@ -0,0 +1,314 @@
+/*
+Build: make bench-http-cache
+Run:   ./bench-http-cache --media=sintel_trailer-480p.webm [--latency=50] [--bandwidth=2000]
+
+Startup and seek latency of playbin reading over HTTP, directly (souphttpsrc)
+and through the range cache (range-cache-src.c), cold and warm.
+
+The media is served by a stand-in HTTP server running in this process on
+127.0.0.1: it honours `Range:` requests and can add a fixed delay per request
+(`--latency`, ms) and cap its throughput (`--bandwidth`, KB/s) to look like a
+remote server. Each run:
+  - sets a playbin (fakesinks) to PAUSED and times it until ASYNC_DONE
+    (startup),
+  - does flushing KEY_UNIT seeks to 10%, 50%, 90% and 30% of the file, timing
+    each until ASYNC_DONE.
+Runs are "direct" (souphttpsrc, skipped if not installed), "cold" (the cache
+starts empty) and "warm" (the same cache again). One JSON line per run with
+the latencies, cache hits/misses and what the server sent.
+*/
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "range-cache-src.h"
+
+static gchar *media = NULL;
+static gint latency_ms = 50;
+static gint bandwidth_kbs = 0;
+
+static GOptionEntry entries[] = {
+  { "media", 'm', 0, G_OPTION_ARG_FILENAME, &media, "Media file the server serves", "FILE" },
+  { "latency", 'l', 0, G_OPTION_ARG_INT, &latency_ms, "Server delay per request (default 50)", "MS" },
+  { "bandwidth", 'b', 0, G_OPTION_ARG_INT, &bandwidth_kbs, "Server throughput cap, 0 = none", "KB/S" },
+  { NULL }
+};
+
+static const gdouble seek_points[] = { 0.1, 0.5, 0.9, 0.3 };
+
+/* What the server sent, since the last reset */
+static GMutex server_lock;
+static guint server_requests = 0;
+static guint64 server_bytes = 0;
+
+/* Handles one request on a worker thread of the threaded socket service */
+static gboolean
+serve (GThreadedSocketService *service, GSocketConnection *conn, GObject *source, gpointer user_data)
+{
+  GDataInputStream *in = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (conn)));
+  GOutputStream *out = g_io_stream_get_output_stream (G_IO_STREAM (conn));
+  guint64 start = 0, end = G_MAXUINT64, size;
+  gboolean ranged = FALSE;
+  gchar *line, *header, buffer[64 * 1024];
+  GStatBuf st;
+  FILE *file;
+
+  g_data_input_stream_set_newline_type (in, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+  while ((line = g_data_input_stream_read_line (in, NULL, NULL, NULL)) && *line) {
+    if (g_ascii_strncasecmp (line, "Range: bytes=", 13) == 0) {
+      gchar *dash;
+
+      start = g_ascii_strtoull (line + 13, &dash, 10);
+      if (*dash == '-' && dash[1])
+        end = g_ascii_strtoull (dash + 1, NULL, 10);
+      ranged = TRUE;
+    }
+    g_free (line);
+  }
+  g_free (line);
+  g_object_unref (in);
+
+  if (g_stat (media, &st) != 0 || !(file = g_fopen (media, "rb")))
+    return TRUE;
+  size = st.st_size;
+  end = MIN (end, size - 1);
+
+  g_mutex_lock (&server_lock);
+  server_requests++;
+  g_mutex_unlock (&server_lock);
+  if (latency_ms > 0)
+    g_usleep (latency_ms * 1000);
+
+  if (start >= size) {
+    header = g_strdup_printf ("HTTP/1.1 416 Range Not Satisfiable\r\n"
+        "Content-Range: bytes */%" G_GUINT64_FORMAT "\r\nConnection: close\r\n\r\n", size);
+  } else if (ranged) {
+    header = g_strdup_printf ("HTTP/1.1 206 Partial Content\r\n"
+        "Content-Range: bytes %" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT "\r\n"
+        "Content-Length: %" G_GUINT64_FORMAT "\r\nAccept-Ranges: bytes\r\n"
+        "Connection: close\r\n\r\n", start, end, size, end - start + 1);
+  } else {
+    header = g_strdup_printf ("HTTP/1.1 200 OK\r\nContent-Length: %" G_GUINT64_FORMAT "\r\n"
+        "Accept-Ranges: bytes\r\nConnection: close\r\n\r\n", size);
+  }
+  g_output_stream_write_all (out, header, strlen (header), NULL, NULL, NULL);
+  g_free (header);
+
+  if (start < size) {
+    guint64 left = end - start + 1;
+
+    fseek (file, start, SEEK_SET);
+    while (left > 0) {
+      gsize n = fread (buffer, 1, MIN (left, sizeof (buffer)), file);
+
+      /* The client hangs up as soon as it has what it wants */
+      if (n == 0 || !g_output_stream_write_all (out, buffer, n, NULL, NULL, NULL))
+        break;
+      g_mutex_lock (&server_lock);
+      server_bytes += n;
+      g_mutex_unlock (&server_lock);
+      left -= n;
+      if (bandwidth_kbs > 0)
+        g_usleep (n * G_USEC_PER_SEC / (bandwidth_kbs * 1024));
+    }
+  }
+  fclose (file);
+  return TRUE;
+}
+
+/* The server gets its own thread and main context; the benchmark blocks on buses */
+static gpointer
+server_thread (GSocketService *service)
+{
+  GMainContext *context = g_main_context_new ();
+  GMainLoop *loop = g_main_loop_new (context, FALSE);
+
+  g_main_context_push_thread_default (context);
+  g_socket_service_start (service);
+  g_main_loop_run (loop);
+  return NULL;
+}
+
+static guint16
+start_server (void)
+{
+  GSocketService *service = g_threaded_socket_service_new (8);
+  GInetAddress *loopback = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  GSocketAddress *address = g_inet_socket_address_new (loopback, 0), *bound = NULL;
+  guint16 port = 0;
+  GError *error = NULL;
+
+  /* Port 0: the kernel picks one, read back from the bound address */
+  if (g_socket_listener_add_address (G_SOCKET_LISTENER (service), address,
+          G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL, &bound, &error)) {
+    port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (bound));
+    g_object_unref (bound);
+  }
+  g_object_unref (address);
+  g_object_unref (loopback);
+  if (port == 0) {
+    g_printerr ("Could not start the server: %s\n", error->message);
+    g_clear_error (&error);
+    g_object_unref (service);
+    return 0;
+  }
+  g_socket_service_stop (service);
+  g_signal_connect (service, "run", G_CALLBACK (serve), NULL);
+  g_thread_new ("http-server", (GThreadFunc) server_thread, service);
+  return port;
+}
+
+static void
+source_setup (GstElement *playbin, GstElement *source, const gchar *cache_dir)
+{
+  if (G_TYPE_CHECK_INSTANCE_TYPE (source, RANGE_CACHE_TYPE_SRC))
+    g_object_set (source, "cache-dir", cache_dir, NULL);
+}
+
+static GstElement *
+make_fakesink (void)
+{
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (sink, "sync", FALSE, NULL);
+  return sink;
+}
+
+/* Blocks until ASYNC_DONE; returns the wait in ms, or -1 on error/timeout */
+static gdouble
+wait_async_done (GstElement *pipeline, guint64 since)
+{
+  GstBus *bus = gst_element_get_bus (pipeline);
+  GstMessage *msg;
+  gdouble ms = -1;
+
+  msg = gst_bus_timed_pop_filtered (bus, 60 * GST_SECOND,
+      GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR);
+  if (msg && GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ASYNC_DONE)
+    ms = (gst_util_get_timestamp () - since) / 1e6;
+  else if (msg) {
+    GError *err;
+
+    gst_message_parse_error (msg, &err, NULL);
+    g_printerr ("Error: %s\n", err->message);
+    g_clear_error (&err);
+  }
+  if (msg)
+    gst_message_unref (msg);
+  gst_object_unref (bus);
+  return ms;
+}
+
+static void
+run (const gchar *mode, const gchar *uri, const gchar *cache_dir)
+{
+  GstElement *playbin = gst_element_factory_make ("playbin", NULL), *source = NULL;
+  gdouble startup, seek_ms, seek_sum = 0, seek_max = 0;
+  guint64 start, hits = 0, misses = 0, bytes;
+  guint requests;
+  gint64 duration = 0;
+  gint seeks = 0;
+  guint i;
+
+  g_mutex_lock (&server_lock);
+  server_requests = 0;
+  server_bytes = 0;
+  g_mutex_unlock (&server_lock);
+
+  g_object_set (playbin, "uri", uri, "video-sink", make_fakesink (),
+      "audio-sink", make_fakesink (), NULL);
+  g_signal_connect (playbin, "source-setup", G_CALLBACK (source_setup), (gpointer) cache_dir);
+
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (playbin, GST_STATE_PAUSED);
+  startup = wait_async_done (playbin, start);
+
+  if (startup >= 0 && gst_element_query_duration (playbin, GST_FORMAT_TIME, &duration)) {
+    for (i = 0; i < G_N_ELEMENTS (seek_points); i++) {
+      start = gst_util_get_timestamp ();
+      if (!gst_element_seek_simple (playbin, GST_FORMAT_TIME,
+              GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, duration * seek_points[i]))
+        continue;
+      seek_ms = wait_async_done (playbin, start);
+      if (seek_ms < 0)
+        break;
+      seek_sum += seek_ms;
+      seek_max = MAX (seek_max, seek_ms);
+      seeks++;
+    }
+  }
+
+  g_mutex_lock (&server_lock);
+  requests = server_requests;
+  bytes = server_bytes;
+  g_mutex_unlock (&server_lock);
+
+  g_object_get (playbin, "source", &source, NULL);
+  if (source && G_TYPE_CHECK_INSTANCE_TYPE (source, RANGE_CACHE_TYPE_SRC))
+    g_object_get (source, "hits", &hits, "misses", &misses, NULL);
+  if (source)
+    gst_object_unref (source);
+
+  g_print ("{\"mode\":\"%s\",\"status\":\"%s\",\"startup_ms\":%.1f,\"seeks\":%d"
+      ",\"seek_ms_avg\":%.1f,\"seek_ms_max\":%.1f,\"hits\":%" G_GUINT64_FORMAT
+      ",\"misses\":%" G_GUINT64_FORMAT ",\"server_requests\":%u,\"server_bytes\":%"
+      G_GUINT64_FORMAT "}\n", mode, startup >= 0 ? "ok" : "error", startup, seeks,
+      seeks ? seek_sum / seeks : 0.0, seek_max, hits, misses, requests, bytes);
+
+  gst_element_set_state (playbin, GST_STATE_NULL);
+  gst_object_unref (playbin);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *base, *http_uri, *cache_uri, *cache_dir;
+  GstElementFactory *soup;
+  guint16 port;
+
+  context = g_option_context_new ("- HTTP range cache benchmark");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+
+  gst_init (&argc, &argv);
+  range_cache_src_register ();
+
+  if (!media || !g_file_test (media, G_FILE_TEST_IS_REGULAR)) {
+    g_printerr ("--media must name an existing file\n");
+    return -1;
+  }
+  port = start_server ();
+  if (port == 0)
+    return -1;
+
+  base = g_path_get_basename (media);
+  http_uri = g_strdup_printf ("http://127.0.0.1:%u/%s", port, base);
+  cache_uri = range_cache_src_wrap_uri (http_uri);
+  cache_dir = g_dir_make_tmp ("range-cache-XXXXXX", NULL);
+
+  soup = gst_element_factory_find ("souphttpsrc");
+  if (soup) {
+    run ("direct", http_uri, cache_dir);
+    gst_object_unref (soup);
+  } else {
+    g_print ("{\"mode\":\"direct\",\"status\":\"skipped\",\"reason\":\"souphttpsrc not installed\"}\n");
+  }
+  run ("cold", cache_uri, cache_dir);
+  run ("warm", cache_uri, cache_dir);
+
+  g_printerr ("Cache left in %s\n", cache_dir);
+  g_free (cache_dir);
+  g_free (cache_uri);
+  g_free (http_uri);
+  g_free (base);
+  return 0;
+}
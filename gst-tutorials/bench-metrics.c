@@ -0,0 +1,182 @@
+/*
+Build: make bench-metrics
+Run:   ./bench-metrics [--buffers=20000] [--stages=10] [--iterations=3] [--intervals=1000,100,10]
+
+Overhead of the metrics exporter (metrics-exporter.c) on a pipeline with
+many pads and small buffers, where a per-buffer cost shows most:
+  videotestsrc ! 320x240 YUY2 ! queue ! identity x `--stages` ! videoconvert
+    ! BGRx ! queue ! fakesink sync=false
+It is run as fast as it goes without the exporter, then with it sampling
+every `--intervals` ms, `--iterations` times each (the run with the least
+CPU time counts). One JSON line per interval with buffers per second, CPU
+time per buffer, the overhead over the run without the exporter, the
+samples taken, the mean time a sample took and the size of its text.
+Scrapes only copy the last sample's text, so they are not measured.
+*/
+#include <gst/gst.h>
+#include <sys/resource.h>
+
+#include "metrics-exporter.h"
+
+static gint buffers = 20000;
+static gint stages = 10;
+static gint iterations = 3;
+static gchar *intervals = NULL;
+
+static GOptionEntry entries[] = {
+  { "buffers", 'b', 0, G_OPTION_ARG_INT, &buffers, "Buffers per run (default 20000)", "N" },
+  { "stages", 's', 0, G_OPTION_ARG_INT, &stages, "identity elements in the pipeline (default 10)", "N" },
+  { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Runs per interval, the cheapest counts (default 3)", "N" },
+  { "intervals", 'i', 0, G_OPTION_ARG_STRING, &intervals, "Sampling intervals to try (default 1000,100,10)", "MS,..." },
+  { NULL }
+};
+
+typedef struct {
+  gdouble wall;
+  gdouble cpu;
+  MetricsExporterStats stats;
+} Run;
+
+static gdouble
+rusage_cpu_seconds (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static GstElement *
+build_pipeline (void)
+{
+  GString *description = g_string_new (NULL);
+  GError *error = NULL;
+  GstElement *pipeline;
+  gint i;
+
+  g_string_append_printf (description, "videotestsrc num-buffers=%d "
+      "! video/x-raw,format=YUY2,width=320,height=240 ! queue", buffers);
+  for (i = 0; i < stages; i++)
+    g_string_append (description, " ! identity");
+  g_string_append (description, " ! videoconvert ! video/x-raw,format=BGRx ! queue "
+      "! fakesink sync=false");
+  pipeline = gst_parse_launch (description->str, &error);
+  g_string_free (description, TRUE);
+  if (!pipeline) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+  }
+  return pipeline;
+}
+
+/* Without the exporter when `interval_ms` is 0 */
+static gboolean
+run_once (guint interval_ms, Run *run)
+{
+  GstElement *pipeline = build_pipeline ();
+  MetricsExporter *exporter = NULL;
+  GstMessage *msg;
+  GstBus *bus;
+  gdouble cpu;
+  gint64 start;
+  gboolean ok;
+
+  if (!pipeline)
+    return FALSE;
+  run->stats = (MetricsExporterStats) { 0 };
+  if (interval_ms)
+    exporter = metrics_exporter_new (pipeline, 0);
+  bus = gst_element_get_bus (pipeline);
+
+  cpu = rusage_cpu_seconds ();
+  start = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  /* Sampling from here instead of a main loop timer */
+  while (!(msg = gst_bus_timed_pop_filtered (bus,
+              interval_ms ? interval_ms * GST_MSECOND : GST_CLOCK_TIME_NONE,
+              GST_MESSAGE_ERROR | GST_MESSAGE_EOS)))
+    metrics_exporter_sample (exporter);
+  run->wall = (g_get_monotonic_time () - start) / 1e6;
+  run->cpu = rusage_cpu_seconds () - cpu;
+  ok = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  if (exporter) {
+    metrics_exporter_get_stats (exporter, &run->stats);
+    metrics_exporter_free (exporter);
+  }
+  gst_object_unref (pipeline);
+  return ok;
+}
+
+/* Prints the interval's line; returns the CPU time per buffer of its cheapest run */
+static gdouble
+measure (guint interval_ms, gdouble baseline)
+{
+  Run run, best = { 0 };
+  gdouble per_buffer;
+  gint i, good = 0;
+
+  for (i = 0; i < iterations; i++) {
+    if (!run_once (interval_ms, &run))
+      continue;
+    if (!good++ || run.cpu < best.cpu)
+      best = run;
+  }
+  if (!good) {
+    g_print ("{\"interval_ms\":%u,\"status\":\"error\"}\n", interval_ms);
+    return 0;
+  }
+
+  per_buffer = best.cpu / buffers;
+  g_print ("{\"exporter\":%s,\"interval_ms\":%u,\"stages\":%d,\"buffers\":%d,\"wall_s\":%.3f"
+      ",\"buffers_per_s\":%.0f,\"cpu_s\":%.3f,\"cpu_ns_per_buffer\":%.0f,\"overhead_pct\":%.2f"
+      ",\"samples\":%" G_GUINT64_FORMAT ",\"sample_us\":%.1f,\"text_bytes\":%" G_GSIZE_FORMAT
+      "}\n", interval_ms ? "true" : "false", interval_ms, stages, buffers, best.wall,
+      best.wall > 0 ? buffers / best.wall : 0.0, best.cpu, per_buffer * 1e9,
+      baseline > 0 ? 100 * (per_buffer - baseline) / baseline : 0.0, best.stats.samples,
+      best.stats.samples ? best.stats.sample_time / 1e3 / best.stats.samples : 0.0,
+      best.stats.size);
+  return per_buffer;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar **interval_list;
+  gdouble baseline;
+  gint i;
+
+  context = g_option_context_new ("- metrics exporter overhead");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (buffers <= 0 || stages < 0 || iterations <= 0) {
+    g_printerr ("--buffers and --iterations must be positive, --stages not negative.\n");
+    return -1;
+  }
+  gst_init (&argc, &argv);
+
+  baseline = measure (0, 0);
+  interval_list = g_strsplit (intervals ? intervals : "1000,100,10", ",", -1);
+  for (i = 0; interval_list[i]; i++) {
+    guint interval_ms = g_ascii_strtoull (interval_list[i], NULL, 10);
+
+    if (interval_ms > 0)
+      measure (interval_ms, baseline);
+  }
+
+  g_strfreev (interval_list);
+  g_free (intervals);
+  return 0;
+}
@@ -0,0 +1,362 @@
+/*
+Build: make bench-pipelines
+Run:   ./bench-pipelines [--media=sintel_trailer-480p.webm] [--iterations=3] [--memory-budget=MB]
+
+Headless throughput benchmark for the pipeline topologies used by the tutorials.
+
+Every tutorial renders to a window or a sound card and pulls its media over the
+network, so none of them can run on a build machine and none of them measures
+anything. Here we rebuild each topology without those dependencies:
+  - autovideosink, ximagesink and autoaudiosink become `fakesink sync=false`,
+    so buffers are consumed as fast as the pipeline can produce them instead of
+    at playback speed.
+  - the freedesktop.org URI becomes a local file (`--media`) and the camera
+    becomes a `videotestsrc` producing what the RealSense color node produces.
+Topologies that need a media file are reported as skipped when none is given.
+
+One JSON object is printed per run (one line each), e.g.
+  {"pipeline":"bt2-gstreamer-concepts","iteration":0,"status":"ok",...}
+with wall time, frames/s (video buffers reaching a sink), buffers/s (all
+buffers reaching a sink), CPU time per frame/buffer and peak RSS so runs can be
+diffed against a baseline when element chains or GStreamer versions change.
+
+With --memory-budget=MB every run is kept within that RSS cap
+(memory-budget.c): queues and buffer pools are sized to fit, the memory
+accounting is printed as a {"memory":...} line every second, and the run's
+line adds whether the run stayed within the cap. The peak RSS is that of the
+run alone: the kernel's peak is reset before each run ("peak_of_run" is false
+where it cannot be, and the peak is the process' so far).
+*/
+#include <gst/gst.h>
+#include <sys/resource.h>
+
+#include "memory-budget.h"
+
+/* One pipeline topology, standing in for one of the tutorial programs */
+typedef struct _Topology {
+  const gchar *name;          /* program it stands in for */
+  const gchar *description;   /* gst_parse_launch description, NULL for playbin */
+  gboolean needs_media;       /* does it read --media? */
+  gint seek_to;               /* seconds to seek to once prerolled, 0 = no seek */
+} Topology;
+
+/*
+ `@URI@` is replaced with the media URI and `@BUFFERS@` with --buffers. playbin
+ is built by hand since its sinks are element properties.
+*/
+static const Topology topologies[] = {
+  { "bt1-hello-world", NULL, TRUE, 0 },
+  { "bt2-gstreamer-concepts",
+    "videotestsrc num-buffers=@BUFFERS@ pattern=0 ! fakesink sync=false", FALSE, 0 },
+  { "bt3-dynamic-pipelines",
+    "uridecodebin uri=@URI@ ! audioconvert ! audioresample ! fakesink sync=false", TRUE, 0 },
+  { "bt4-seeking", NULL, TRUE, 30 },
+  { "bt6-mediaFormats-padCapabilities",
+    "audiotestsrc num-buffers=@BUFFERS@ ! fakesink sync=false", FALSE, 0 },
+  { "gstreamer_realsense",
+    "videotestsrc num-buffers=@BUFFERS@ "
+    "! video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1 "
+    "! videoconvert ! video/x-raw,format=BGRx ! fakesink sync=false", FALSE, 0 },
+};
+
+/* Counts what reaches one sink */
+typedef struct _SinkCounter {
+  gint is_video;              /* -1 until we have seen caps on the pad */
+  guint64 buffers;
+} SinkCounter;
+
+static gchar *media = NULL;
+static gint buffers = 1000;
+static gint iterations = 3;
+static gchar *only = NULL;
+static gint timeout = 120;
+static gint memory_budget = 0;
+
+static GOptionEntry entries[] = {
+  { "media", 'm', 0, G_OPTION_ARG_FILENAME, &media, "Local media file replacing the network URI", "FILE" },
+  { "buffers", 'b', 0, G_OPTION_ARG_INT, &buffers, "Buffers produced by test sources per run", "N" },
+  { "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Runs per topology", "N" },
+  { "only", 'o', 0, G_OPTION_ARG_STRING, &only, "Only run the topology with this name", "NAME" },
+  { "timeout", 0, 0, G_OPTION_ARG_INT, &timeout, "Give up on a run after this many seconds", "SECONDS" },
+  { "memory-budget", 0, 0, G_OPTION_ARG_INT, &memory_budget, "Keep each run within this RSS, 0 = no cap", "MB" },
+  { NULL }
+};
+
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, SinkCounter *counter)
+{
+  if (counter->is_video < 0) {
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+
+    if (caps) {
+      counter->is_video = g_str_has_prefix (
+          gst_structure_get_name (gst_caps_get_structure (caps, 0)), "video/");
+      gst_caps_unref (caps);
+    }
+  }
+  counter->buffers++;
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+attach_counter (GPtrArray *counters, GstElement *sink)
+{
+  GstPad *pad = gst_element_get_static_pad (sink, "sink");
+  SinkCounter *counter;
+
+  if (!pad)
+    return;
+
+  counter = g_new0 (SinkCounter, 1);
+  counter->is_video = -1;
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) sink_probe, counter, NULL);
+  g_ptr_array_add (counters, counter);
+  gst_object_unref (pad);
+}
+
+/* Attach a counter to the sink pad of every sink in the pipeline */
+static GPtrArray *
+attach_counters (GstElement *pipeline, const Topology *topology)
+{
+  GPtrArray *counters = g_ptr_array_new_with_free_func (g_free);
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  if (topology->description == NULL) {
+    /* playbin only adds its sinks to the bin when it prerolls */
+    GstElement *video_sink, *audio_sink;
+
+    g_object_get (pipeline, "video-sink", &video_sink, "audio-sink", &audio_sink, NULL);
+    attach_counter (counters, video_sink);
+    attach_counter (counters, audio_sink);
+    gst_object_unref (video_sink);
+    gst_object_unref (audio_sink);
+    return counters;
+  }
+
+  it = gst_bin_iterate_sinks (GST_BIN (pipeline));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    attach_counter (counters, g_value_get_object (&item));
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  return counters;
+}
+
+static GstElement *
+make_fakesink (void)
+{
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (sink, "sync", FALSE, NULL);
+  return sink;
+}
+
+/* Returns a copy of `str` with every `token` replaced by `value` */
+static gchar *
+replace_token (const gchar *str, const gchar *token, const gchar *value)
+{
+  gchar **parts = g_strsplit (str, token, -1);
+  gchar *result = g_strjoinv (value, parts);
+
+  g_strfreev (parts);
+  return result;
+}
+
+static GstElement *
+build_pipeline (const Topology *topology, const gchar *uri, GError **error)
+{
+  GstElement *pipeline;
+  gchar *description, *with_uri, *count;
+
+  if (topology->description == NULL) {
+    /* playbin: same as the tutorials but with both sinks replaced */
+    pipeline = gst_element_factory_make ("playbin", NULL);
+    if (!pipeline) {
+      g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+          "playbin is not available");
+      return NULL;
+    }
+    g_object_set (pipeline, "uri", uri, "video-sink", make_fakesink (),
+        "audio-sink", make_fakesink (), NULL);
+    return pipeline;
+  }
+
+  count = g_strdup_printf ("%d", buffers);
+  with_uri = replace_token (topology->description, "@URI@", uri ? uri : "");
+  description = replace_token (with_uri, "@BUFFERS@", count);
+  g_free (with_uri);
+  g_free (count);
+  pipeline = gst_parse_launch (description, error);
+  g_free (description);
+  return pipeline;
+}
+
+static gdouble
+rusage_cpu_seconds (const struct rusage *usage)
+{
+  return usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6 +
+      usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+}
+
+/* Runs one topology once and prints its JSON line */
+static void
+run_topology (const Topology *topology, const gchar *uri, gint iteration)
+{
+  GstElement *pipeline;
+  GPtrArray *counters;
+  MemoryBudget *memory = NULL;
+  GError *error = NULL;
+  GstBus *bus;
+  GstMessage *msg;
+  struct rusage before, after;
+  gint64 start, end, deadline;
+  guint64 frames = 0, total = 0, peak;
+  gboolean peak_reset;
+  gchar *reason;
+  gdouble wall, cpu;
+  guint i;
+
+  if (topology->needs_media && !uri) {
+    g_print ("{\"pipeline\":\"%s\",\"iteration\":%d,\"status\":\"skipped\","
+        "\"reason\":\"needs --media\"}\n", topology->name, iteration);
+    return;
+  }
+
+  pipeline = build_pipeline (topology, uri, &error);
+  if (!pipeline || error) {
+    reason = g_strescape (error ? error->message : "could not build pipeline", NULL);
+    g_print ("{\"pipeline\":\"%s\",\"iteration\":%d,\"status\":\"error\","
+        "\"reason\":\"%s\"}\n", topology->name, iteration, reason);
+    g_free (reason);
+    g_clear_error (&error);
+    if (pipeline)
+      gst_object_unref (pipeline);
+    return;
+  }
+  counters = attach_counters (pipeline, topology);
+  bus = gst_element_get_bus (pipeline);
+  /* The peak of this run, not of the ones before it; ru_maxrss never goes down */
+  peak_reset = memory_budget_reset_peak ();
+  if (memory_budget > 0) {
+    memory = memory_budget_attach (pipeline, (guint64) memory_budget * 1024 * 1024);
+  }
+
+  getrusage (RUSAGE_SELF, &before);
+  start = g_get_monotonic_time ();
+
+  if (topology->seek_to > 0) {
+    /* Seeking needs a prerolled pipeline, just like in bt4 */
+    gst_element_set_state (pipeline, GST_STATE_PAUSED);
+    gst_element_get_state (pipeline, NULL, NULL, timeout * GST_SECOND);
+    gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, topology->seek_to * GST_SECOND);
+  }
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* In one second slices, so the memory accounting is seen while it runs */
+  deadline = start + (gint64) timeout * G_USEC_PER_SEC;
+  do {
+    gint64 left = deadline - g_get_monotonic_time ();
+
+    msg = gst_bus_timed_pop_filtered (bus, MIN (left, G_USEC_PER_SEC) * GST_USECOND,
+        GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    if (memory)
+      memory_budget_report (memory);
+  } while (!msg && g_get_monotonic_time () < deadline);
+  end = g_get_monotonic_time ();
+  getrusage (RUSAGE_SELF, &after);
+
+  for (i = 0; i < counters->len; i++) {
+    SinkCounter *counter = g_ptr_array_index (counters, i);
+
+    total += counter->buffers;
+    if (counter->is_video > 0)
+      frames += counter->buffers;
+  }
+
+  wall = (end - start) / 1e6;
+  cpu = rusage_cpu_seconds (&after) - rusage_cpu_seconds (&before);
+
+  if (msg == NULL) {
+    g_print ("{\"pipeline\":\"%s\",\"iteration\":%d,\"status\":\"timeout\"",
+        topology->name, iteration);
+  } else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (msg, &error, NULL);
+    reason = g_strescape (error->message, NULL);
+    g_print ("{\"pipeline\":\"%s\",\"iteration\":%d,\"status\":\"error\","
+        "\"reason\":\"%s\"", topology->name, iteration, reason);
+    g_free (reason);
+    g_clear_error (&error);
+  } else {
+    g_print ("{\"pipeline\":\"%s\",\"iteration\":%d,\"status\":\"ok\"",
+        topology->name, iteration);
+  }
+
+  /* Without the reset (Linux < 4.0) only the process' peak so far is known */
+  peak = peak_reset ? memory_budget_get_peak_rss () : (guint64) after.ru_maxrss * 1024;
+  g_print (",\"wall_s\":%.6f,\"frames\":%" G_GUINT64_FORMAT ",\"buffers\":%"
+      G_GUINT64_FORMAT ",\"frames_per_s\":%.2f,\"buffers_per_s\":%.2f"
+      ",\"cpu_s\":%.6f,\"cpu_us_per_frame\":%.3f,\"cpu_us_per_buffer\":%.3f"
+      ",\"peak_rss_kb\":%" G_GUINT64_FORMAT ",\"peak_of_run\":%s", wall, frames, total,
+      wall > 0 ? frames / wall : 0.0, wall > 0 ? total / wall : 0.0, cpu,
+      frames ? cpu * 1e6 / frames : 0.0, total ? cpu * 1e6 / total : 0.0,
+      peak / 1024, peak_reset ? "true" : "false");
+  if (memory)
+    g_print (",\"memory_budget_kb\":%d,\"within_budget\":%s", memory_budget * 1024,
+        peak <= (guint64) memory_budget * 1024 * 1024 ? "true" : "false");
+  g_print ("}\n");
+
+  if (msg)
+    gst_message_unref (msg);
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  if (memory)
+    memory_budget_free (memory);
+  gst_object_unref (pipeline);
+  g_ptr_array_unref (counters);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *uri = NULL;
+  guint t;
+  gint i;
+
+  context = g_option_context_new ("- headless throughput benchmark for the tutorial pipelines");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+
+  /* Initialize GStreamer */
+  gst_init (&argc, &argv);
+
+  if (media) {
+    uri = gst_filename_to_uri (media, &error);
+    if (!uri) {
+      g_printerr ("Invalid media file: %s\n", error->message);
+      g_clear_error (&error);
+      return -1;
+    }
+  }
+
+  for (t = 0; t < G_N_ELEMENTS (topologies); t++) {
+    if (only && g_strcmp0 (only, topologies[t].name) != 0)
+      continue;
+    for (i = 0; i < iterations; i++)
+      run_topology (&topologies[t], uri, i);
+  }
+
+  g_free (uri);
+  return 0;
+}
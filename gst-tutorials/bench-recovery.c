@@ -0,0 +1,280 @@
+/*
+Build: make bench-recovery
+Run:   ./bench-recovery [--faults=10] [--fault-interval=30] [--start-delay=0]
+       ./bench-recovery --failed-starts=2
+
+Time from a camera error to the next frame on the sink, restarting the
+source alone (source-recovery.c) vs. tearing the pipeline down and building
+it again. The camera is faultsrc (fault-src.c), failing every
+`--fault-interval` frames, in the single-camera topology of
+gstreamer_realsense:
+  faultsrc ! video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1 !
+  videoconvert ! video/x-raw,format=BGRx ! fakesink sync=true
+  - source restart: one pipeline and a supervisor; each fault is timed from
+    the error (on the thread posting it) to the restarted source's first
+    frame reaching the sink,
+  - cold restart: on each error the pipeline goes to NULL and is unreffed
+    and a new one is built from the description and set to PLAYING, which
+    is what the programs had to do; timed from the error to the new
+    pipeline's first frame on the sink.
+`--start-delay` adds the time a real device takes to start streaming to
+every start, in both modes. `--failed-starts` makes that many starts fail
+after each fault, exercising the supervisor's backoff; cold restarts build
+a fresh source that knows nothing of the fault, so it only applies to the
+source restart.
+
+One JSON line per mode with the recovery time percentiles in ms.
+*/
+#include <gst/gst.h>
+
+#include "fault-src.h"
+#include "latency-histogram.h"
+#include "pipeline-runtime.h"
+#include "source-recovery.h"
+
+#define PIPELINE_FORMAT "faultsrc name=source fault-interval=%d faults=%d start-delay=%d " \
+    "failed-starts=%d ! video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1 ! " \
+    "videoconvert ! video/x-raw,format=BGRx ! fakesink name=sink sync=true"
+
+/* Give up on a mode that has not seen all its recoveries by then */
+#define RUN_TIMEOUT (120 * G_USEC_PER_SEC)
+
+static gint faults = 10;
+static gint fault_interval = 30;
+static gint start_delay = 0;
+static gint failed_starts = 0;
+
+static GOptionEntry entries[] = {
+  { "faults", 'n', 0, G_OPTION_ARG_INT, &faults, "Faults per mode (default 10)", "N" },
+  { "fault-interval", 'i', 0, G_OPTION_ARG_INT, &fault_interval, "Frames between faults (default 30)", "N" },
+  { "start-delay", 'd', 0, G_OPTION_ARG_INT, &start_delay, "Time the source takes to start (default 0)", "MS" },
+  { "failed-starts", 'f', 0, G_OPTION_ARG_INT, &failed_starts, "Starts failing after a fault, source restart only", "N" },
+  { NULL }
+};
+
+/* From the error to the next first frame at the sink */
+typedef struct {
+  GMutex lock;
+  guint64 fault_time;         /* 0 when no fault is pending */
+  guint recovered;
+  LatencyHistogram recovery_time;
+} Recovery;
+
+static void
+sync_error (GstBus *bus, GstMessage *msg, Recovery *recovery)
+{
+  g_mutex_lock (&recovery->lock);
+  if (!recovery->fault_time)
+    recovery->fault_time = gst_util_get_timestamp ();
+  g_mutex_unlock (&recovery->lock);
+}
+
+/* faultsrc numbers frames from 0 on every start: frame 0 after a fault is the recovery */
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, Recovery *recovery)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  g_mutex_lock (&recovery->lock);
+  if (recovery->fault_time && GST_BUFFER_OFFSET (buffer) == 0) {
+    latency_histogram_record (&recovery->recovery_time,
+        gst_util_get_timestamp () - recovery->fault_time);
+    recovery->fault_time = 0;
+    recovery->recovered++;
+  }
+  g_mutex_unlock (&recovery->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static guint
+get_recovered (Recovery *recovery)
+{
+  guint recovered;
+
+  g_mutex_lock (&recovery->lock);
+  recovered = recovery->recovered;
+  g_mutex_unlock (&recovery->lock);
+  return recovered;
+}
+
+static GstElement *
+build (Recovery *recovery, gint n_faults, gint n_failed_starts)
+{
+  GstElement *pipeline, *sink;
+  GError *error = NULL;
+  GstBus *bus;
+  GstPad *pad;
+  gchar *description;
+
+  description = g_strdup_printf (PIPELINE_FORMAT, fault_interval, n_faults, start_delay,
+      n_failed_starts);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  if (!pipeline) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return NULL;
+  }
+
+  bus = gst_element_get_bus (pipeline);
+  gst_bus_enable_sync_message_emission (bus);
+  g_signal_connect (bus, "sync-message::error", G_CALLBACK (sync_error), recovery);
+  gst_object_unref (bus);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) sink_probe,
+      recovery, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (sink);
+  return pipeline;
+}
+
+static void
+print_result (const gchar *mode, Recovery *recovery, guint restarts)
+{
+  LatencyHistogram *histogram = &recovery->recovery_time;
+
+  g_print ("{\"mode\":\"%s\",\"faults\":%d,\"recovered\":%u,\"restarts\":%u"
+      ",\"recovery_ms_p50\":%.2f,\"recovery_ms_p99\":%.2f,\"recovery_ms_max\":%.2f"
+      ",\"recovery_ms_mean\":%.2f}\n", mode, faults, recovery->recovered, restarts,
+      latency_histogram_percentile (histogram, 50) / 1e6,
+      latency_histogram_percentile (histogram, 99) / 1e6, histogram->max / 1e6,
+      latency_histogram_mean (histogram) / 1e6);
+}
+
+typedef struct {
+  Recovery *recovery;
+  SourceRecovery *supervisor;
+  gint64 deadline;
+} SourceRun;
+
+static void
+handle_error (PipelineRuntime *runtime, GstMessage *msg, SourceRun *run)
+{
+  if (!source_recovery_handle_error (run->supervisor, msg))
+    pipeline_runtime_handle_error (runtime, msg, NULL);
+}
+
+static void
+check_done (PipelineRuntime *runtime, gint64 position, gint64 duration, SourceRun *run)
+{
+  if (get_recovered (run->recovery) >= (guint) faults ||
+      g_get_monotonic_time () > run->deadline)
+    pipeline_runtime_stop (runtime);
+}
+
+/* One pipeline, the supervisor restarts the source */
+static void
+run_source_restart (void)
+{
+  Recovery recovery = { 0 };
+  SourceRecoveryStats stats;
+  PipelineRuntime *runtime;
+  GstElement *pipeline, *source;
+  SourceRun run;
+
+  g_mutex_init (&recovery.lock);
+  latency_histogram_reset (&recovery.recovery_time);
+  pipeline = build (&recovery, faults, failed_starts);
+  if (!pipeline)
+    return;
+
+  source = gst_bin_get_by_name (GST_BIN (pipeline), "source");
+  run.recovery = &recovery;
+  run.supervisor = source_recovery_new (pipeline, source, 0);
+  run.deadline = g_get_monotonic_time () + RUN_TIMEOUT;
+  gst_object_unref (source);
+
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_ERROR,
+      (PipelineMessageFunc) handle_error, &run);
+  pipeline_runtime_set_position_handler (runtime, 10, (PipelinePositionFunc) check_done, &run);
+  if (pipeline_runtime_start (runtime))
+    pipeline_runtime_run ();
+
+  source_recovery_get_stats (run.supervisor, &stats);
+  pipeline_runtime_free (runtime);
+  source_recovery_free (run.supervisor);
+  gst_object_unref (pipeline);
+  print_result ("source-restart", &recovery, stats.attempts);
+  g_mutex_clear (&recovery.lock);
+}
+
+/* A new pipeline after every fault, each failing once */
+static void
+run_cold_restart (void)
+{
+  Recovery recovery = { 0 };
+  gint64 deadline = g_get_monotonic_time () + RUN_TIMEOUT;
+  guint restarts = 0;
+  gint i;
+
+  g_mutex_init (&recovery.lock);
+  latency_histogram_reset (&recovery.recovery_time);
+
+  /* The last pipeline only has to show its first frame */
+  for (i = 0; i <= faults && g_get_monotonic_time () < deadline; i++) {
+    GstElement *pipeline = build (&recovery, i < faults ? 1 : 0, 0);
+    GstMessage *msg = NULL;
+    GstBus *bus;
+
+    if (!pipeline)
+      break;
+    if (i > 0)
+      restarts++;
+    bus = gst_element_get_bus (pipeline);
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+    if (i < faults) {
+      msg = gst_bus_timed_pop_filtered (bus,
+          MAX (deadline - g_get_monotonic_time (), 0) * GST_USECOND,
+          GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+    } else {
+      while (get_recovered (&recovery) < (guint) faults && g_get_monotonic_time () < deadline)
+        g_usleep (G_TIME_SPAN_MILLISECOND);
+    }
+
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (bus);
+    gst_object_unref (pipeline);
+    if (msg) {
+      gboolean error = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR;
+
+      gst_message_unref (msg);
+      if (!error)
+        break;
+    } else if (i < faults) {
+      break;
+    }
+  }
+
+  print_result ("cold-restart", &recovery, restarts);
+  g_mutex_clear (&recovery.lock);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+
+  context = g_option_context_new ("- source restart vs. cold restart after camera errors");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (faults <= 0 || fault_interval <= 0) {
+    g_printerr ("--faults and --fault-interval must be positive.\n");
+    return -1;
+  }
+  gst_init (&argc, &argv);
+  fault_src_register ();
+
+  run_source_restart ();
+  run_cold_restart ();
+  return 0;
+}
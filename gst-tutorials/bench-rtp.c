@@ -0,0 +1,194 @@
+/*
+Build: make bench-rtp
+Run:   ./bench-rtp [--codec=h264] [--seconds=10] [--latencies=10,20,50,100,200]
+                   [--losses=0,1,5] [--delay=0] [--delay-jitter=10] [--port=5004]
+
+Jitterbuffer latency against robustness for the RTP stream (rtp-stream.c),
+over loopback in one process. The sender is videotestsrc producing what the
+RealSense color node produces, `--seconds` of it; the receiver renders into
+`fakesink sync=true` so frames are held to their render time as on a
+display. For every jitterbuffer latency and loss percentage, netsim drops
+that share of the packets and delays them by `--delay` +/- `--delay-jitter`
+ms, and one JSON line gives the packets sent, received and lost (RFC 3550),
+the interarrival jitter, the packets the jitterbuffer gave up on or got too
+late, the frames rendered and the capture-to-render latency.
+
+A latency below the network's jitter shows up as packets given up and
+frames missing; above it, as latency and nothing else.
+*/
+#include <gst/gst.h>
+
+#include "rtp-stream.h"
+
+#define CAPTURE_CAPS "video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1"
+#define CAPTURE_FPS 30
+
+static gchar *codec_name = NULL;
+static gint seconds = 10;
+static gchar *latencies = NULL;
+static gchar *losses = NULL;
+static gint delay = 0;
+static gint delay_jitter = 10;
+static gint port = 5004;
+
+static GOptionEntry entries[] = {
+  { "codec", 'c', 0, G_OPTION_ARG_STRING, &codec_name, "h264 (default) or raw", "CODEC" },
+  { "seconds", 's', 0, G_OPTION_ARG_INT, &seconds, "Seconds sent per run (default 10)", "S" },
+  { "latencies", 'l', 0, G_OPTION_ARG_STRING, &latencies, "Jitterbuffer latencies to try (default 10,20,50,100,200)", "MS,..." },
+  { "losses", 0, 0, G_OPTION_ARG_STRING, &losses, "Packet loss percentages to try (default 0,1,5)", "PERCENT,..." },
+  { "delay", 'd', 0, G_OPTION_ARG_INT, &delay, "Mean delay added to the packets (default 0)", "MS" },
+  { "delay-jitter", 'j', 0, G_OPTION_ARG_INT, &delay_jitter, "Vary the delay by up to this much either way (default 10)", "MS" },
+  { "port", 'p', 0, G_OPTION_ARG_INT, &port, "UDP port on 127.0.0.1 (default 5004)", "PORT" },
+  { NULL }
+};
+
+/* Sends `seconds` to the receiver, then waits for the receiver to see the end */
+static gboolean
+run_sender (RtpStreamCodec codec, RtpReceiver *receiver, RtpSenderStats *sent)
+{
+  GstElement *pipeline, *capture;
+  RtpSender *sender;
+  GError *error = NULL;
+  GstBus *bus;
+  GstMessage *msg;
+  gchar *description;
+  gboolean ok = TRUE;
+
+  description = g_strdup_printf ("videotestsrc is-live=true num-buffers=%d "
+      "! capsfilter name=capture caps=\"" CAPTURE_CAPS "\"", seconds * CAPTURE_FPS);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  if (!pipeline) {
+    g_printerr ("Sender: %s\n", error->message);
+    g_clear_error (&error);
+    return FALSE;
+  }
+  capture = gst_bin_get_by_name (GST_BIN (pipeline), "capture");
+  sender = rtp_sender_new (pipeline, capture, codec, "127.0.0.1", port, &error);
+  gst_object_unref (capture);
+  if (!sender) {
+    g_printerr ("Sender: %s\n", error->message);
+    g_clear_error (&error);
+    gst_object_unref (pipeline);
+    return FALSE;
+  }
+
+  bus = gst_element_get_bus (pipeline);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (bus, (seconds + 10) * GST_SECOND,
+      GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+  if (!msg || GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    if (msg) {
+      gst_message_parse_error (msg, &error, NULL);
+      g_printerr ("Sender: %s\n", error->message);
+      g_clear_error (&error);
+    }
+    ok = FALSE;
+  }
+  if (msg)
+    gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  /* The last packets are still in the jitterbuffer and the sink */
+  if (ok) {
+    bus = gst_element_get_bus (rtp_receiver_get_pipeline (receiver));
+    while ((msg = gst_bus_timed_pop_filtered (bus, RTP_STREAM_TIMEOUT + GST_SECOND,
+                GST_MESSAGE_ELEMENT | GST_MESSAGE_ERROR))) {
+      gboolean done = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR ||
+          rtp_receiver_stream_ended (receiver, msg);
+
+      gst_message_unref (msg);
+      if (done)
+        break;
+    }
+    gst_object_unref (bus);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  rtp_sender_get_stats (sender, sent);
+  rtp_sender_free (sender);
+  gst_object_unref (pipeline);
+  return ok;
+}
+
+static void
+run (RtpStreamCodec codec, guint latency, gdouble loss)
+{
+  RtpImpairment impairment = { loss / 100, MAX (delay, 0), MAX (delay_jitter, 0) };
+  RtpSenderStats sent = { 0 };
+  RtpReceiverStats stats;
+  RtpReceiver *receiver;
+  GError *error = NULL;
+  GstElement *pipeline;
+  gboolean ok;
+
+  receiver = rtp_receiver_new (port, codec, latency, &impairment, "fakesink sync=true", &error);
+  if (!receiver) {
+    g_printerr ("Receiver: %s\n", error->message);
+    g_clear_error (&error);
+    return;
+  }
+  pipeline = rtp_receiver_get_pipeline (receiver);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  ok = run_sender (codec, receiver, &sent);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  rtp_receiver_get_stats (receiver, &stats);
+  rtp_receiver_free (receiver);
+
+  g_print ("{\"codec\":\"%s\",\"status\":\"%s\",\"jitter_latency_ms\":%u,\"loss_pct\":%.1f"
+      ",\"delay_ms\":%d,\"delay_jitter_ms\":%d,\"sent\":%" G_GUINT64_FORMAT ",\"received\":%"
+      G_GUINT64_FORMAT ",\"lost\":%" G_GINT64_FORMAT ",\"lost_pct\":%.2f,\"jitter_ms\":%.2f"
+      ",\"given_up\":%" G_GUINT64_FORMAT ",\"late\":%" G_GUINT64_FORMAT ",\"frames_sent\":%d"
+      ",\"frames\":%" G_GUINT64_FORMAT ",\"latency_ms_p50\":%.1f,\"latency_ms_p99\":%.1f"
+      ",\"latency_ms_max\":%.1f}\n", codec_name, ok ? "ok" : "error", latency, loss,
+      impairment.delay_ms, impairment.delay_jitter_ms, sent.packets, stats.received, stats.lost,
+      stats.expected ? 100.0 * MAX (stats.lost, 0) / stats.expected : 0.0, stats.jitter / 1e6,
+      stats.given_up, stats.late, seconds * CAPTURE_FPS, stats.frames,
+      latency_histogram_percentile (&stats.latency, 50) / 1e6,
+      latency_histogram_percentile (&stats.latency, 99) / 1e6, stats.latency.max / 1e6);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  RtpStreamCodec codec;
+  gchar **latency_list, **loss_list;
+  gint i, j;
+
+  context = g_option_context_new ("- RTP jitterbuffer latency vs. loss and jitter");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (!codec_name)
+    codec_name = g_strdup ("h264");
+  if (!rtp_stream_codec_from_string (codec_name, &codec)) {
+    g_printerr ("Unknown codec '%s', use h264 or raw.\n", codec_name);
+    return -1;
+  }
+  if (seconds <= 0) {
+    g_printerr ("--seconds must be positive.\n");
+    return -1;
+  }
+  gst_init (&argc, &argv);
+
+  latency_list = g_strsplit (latencies ? latencies : "10,20,50,100,200", ",", -1);
+  loss_list = g_strsplit (losses ? losses : "0,1,5", ",", -1);
+  for (i = 0; loss_list[i]; i++)
+    for (j = 0; latency_list[j]; j++)
+      run (codec, (guint) g_ascii_strtoull (latency_list[j], NULL, 10),
+          g_ascii_strtod (loss_list[i], NULL));
+
+  g_strfreev (latency_list);
+  g_strfreev (loss_list);
+  g_free (codec_name);
+  g_free (latencies);
+  g_free (losses);
+  return 0;
+}
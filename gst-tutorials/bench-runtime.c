@@ -0,0 +1,254 @@
+/*
+Build: make bench-runtime
+Run:   ./bench-runtime --mode=runtime --pipelines=32 --seconds=10
+       ./bench-runtime --mode=polling --pipelines=32 --seconds=10
+
+Compares the event-driven runtime (pipeline-runtime.c) with the loop bt4 and
+bt6 used to have: one thread per pipeline waking up every 100 ms in
+`gst_bus_timed_pop_filtered` to query the position.
+
+Each pipeline is a live 320x240@30 `videotestsrc ! fakesink sync=true`, so it
+runs at real-time speed like a player would. Both modes query position (and
+duration, while unknown) every `--interval` ms while PLAYING; with
+`--interval=0` the runtime does no queries at all, which shows its idle wakeups.
+
+One JSON line is printed with wakeups (bus dispatches/pops + timer ticks),
+queries and their average cost, process CPU time and the thread count.
+*/
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "pipeline-runtime.h"
+
+static gchar *mode = "runtime";
+static gint n_pipelines = 16;
+static gint seconds = 10;
+static gint interval = 100;
+
+static GOptionEntry entries[] = {
+  { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode, "runtime or polling", "MODE" },
+  { "pipelines", 'p', 0, G_OPTION_ARG_INT, &n_pipelines, "Pipelines to run at once", "N" },
+  { "seconds", 's', 0, G_OPTION_ARG_INT, &seconds, "How long to run", "S" },
+  { "interval", 'i', 0, G_OPTION_ARG_INT, &interval, "Position query interval (0 = none, runtime only)", "MS" },
+  { NULL }
+};
+
+/* The per-pipeline state of the polling loop (what bt4 used to do) */
+typedef struct _PollingPipeline {
+  GstElement *pipeline;
+  GThread *thread;
+  gint64 deadline;
+  PipelineRuntimeStats stats;
+} PollingPipeline;
+
+static gint thread_count = 0;
+
+static GstElement *
+make_pipeline (void)
+{
+  return gst_parse_launch ("videotestsrc is-live=true "
+      "! video/x-raw,width=320,height=240,framerate=30/1 ! fakesink sync=true", NULL);
+}
+
+/* Threads in this process right now, from /proc */
+static gint
+count_threads (void)
+{
+  gchar *status = NULL, *line;
+  gint threads = -1;
+
+  if (!g_file_get_contents ("/proc/self/status", &status, NULL, NULL))
+    return -1;
+  line = strstr (status, "Threads:");
+  if (line)
+    threads = atoi (line + strlen ("Threads:"));
+  g_free (status);
+  return threads;
+}
+
+static gdouble
+cpu_seconds (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static gpointer
+polling_thread (PollingPipeline *p)
+{
+  GstBus *bus = gst_element_get_bus (p->pipeline);
+  gboolean playing = FALSE;
+  gint64 duration = -1;
+
+  gst_element_set_state (p->pipeline, GST_STATE_PLAYING);
+  while (g_get_monotonic_time () < p->deadline) {
+    GstMessage *msg = gst_bus_timed_pop_filtered (bus, interval * GST_MSECOND,
+        GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_DURATION_CHANGED);
+
+    p->stats.wakeups++;
+    if (msg != NULL) {
+      p->stats.messages++;
+      if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_STATE_CHANGED &&
+          GST_MESSAGE_SRC (msg) == GST_OBJECT (p->pipeline)) {
+        GstState new_state;
+
+        gst_message_parse_state_changed (msg, NULL, &new_state, NULL);
+        playing = (new_state == GST_STATE_PLAYING);
+      } else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_DURATION_CHANGED) {
+        duration = -1;
+      } else if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STATE_CHANGED) {
+        gst_message_unref (msg);
+        break;
+      }
+      gst_message_unref (msg);
+    } else if (playing) {
+      gint64 current, start = gst_util_get_timestamp ();
+
+      gst_element_query_position (p->pipeline, GST_FORMAT_TIME, &current);
+      p->stats.queries++;
+      if (duration < 0) {
+        if (!gst_element_query_duration (p->pipeline, GST_FORMAT_TIME, &duration))
+          duration = -1;
+        p->stats.queries++;
+      }
+      p->stats.query_time += gst_util_get_timestamp () - start;
+    }
+  }
+  gst_object_unref (bus);
+  return NULL;
+}
+
+static void
+run_polling (PipelineRuntimeStats *total)
+{
+  PollingPipeline *pipelines = g_new0 (PollingPipeline, n_pipelines);
+  gint64 deadline = g_get_monotonic_time () + seconds * G_USEC_PER_SEC;
+  gint i;
+
+  for (i = 0; i < n_pipelines; i++) {
+    pipelines[i].pipeline = make_pipeline ();
+    pipelines[i].deadline = deadline;
+    pipelines[i].thread = g_thread_new ("poll", (GThreadFunc) polling_thread, &pipelines[i]);
+  }
+
+  /* Sample the thread count half-way through */
+  g_usleep (seconds * G_USEC_PER_SEC / 2);
+  thread_count = count_threads ();
+
+  for (i = 0; i < n_pipelines; i++) {
+    g_thread_join (pipelines[i].thread);
+    total->wakeups += pipelines[i].stats.wakeups;
+    total->messages += pipelines[i].stats.messages;
+    total->queries += pipelines[i].stats.queries;
+    total->query_time += pipelines[i].stats.query_time;
+    gst_element_set_state (pipelines[i].pipeline, GST_STATE_NULL);
+    gst_object_unref (pipelines[i].pipeline);
+  }
+  g_free (pipelines);
+}
+
+static void
+noop_position (PipelineRuntime *runtime, gint64 position, gint64 duration, gpointer user_data)
+{
+}
+
+static gboolean
+sample_threads (gpointer user_data)
+{
+  thread_count = count_threads ();
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+stop_all (PipelineRuntime **runtimes)
+{
+  gint i;
+
+  for (i = 0; i < n_pipelines; i++)
+    pipeline_runtime_stop (runtimes[i]);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+run_runtime (PipelineRuntimeStats *total)
+{
+  PipelineRuntime **runtimes = g_new0 (PipelineRuntime *, n_pipelines);
+  PipelineRuntimeStats stats;
+  gint i;
+
+  for (i = 0; i < n_pipelines; i++) {
+    GstElement *pipeline = make_pipeline ();
+
+    runtimes[i] = pipeline_runtime_new (pipeline);
+    gst_object_unref (pipeline);
+    if (interval > 0)
+      pipeline_runtime_set_position_handler (runtimes[i], interval, noop_position, NULL);
+    pipeline_runtime_start (runtimes[i]);
+  }
+
+  g_timeout_add (seconds * 1000 / 2, sample_threads, NULL);
+  g_timeout_add (seconds * 1000, (GSourceFunc) stop_all, runtimes);
+  pipeline_runtime_run ();
+
+  for (i = 0; i < n_pipelines; i++) {
+    pipeline_runtime_get_stats (runtimes[i], &stats);
+    total->wakeups += stats.wakeups;
+    total->messages += stats.messages;
+    total->queries += stats.queries;
+    total->query_time += stats.query_time;
+    pipeline_runtime_free (runtimes[i]);
+  }
+  g_free (runtimes);
+}
+
+int
+main (int argc, char *argv[])
+{
+  PipelineRuntimeStats total = { 0 };
+  GOptionContext *context;
+  GError *error = NULL;
+  gdouble cpu_before, cpu;
+
+  context = g_option_context_new ("- event-driven runtime vs. polling loop");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (seconds <= 0 || n_pipelines <= 0 || interval < 0) {
+    g_printerr ("--seconds and --pipelines must be positive, --interval not negative.\n");
+    return -1;
+  }
+
+  gst_init (&argc, &argv);
+
+  cpu_before = cpu_seconds ();
+  if (g_strcmp0 (mode, "polling") == 0) {
+    if (interval <= 0)
+      interval = 100;
+    run_polling (&total);
+  } else if (g_strcmp0 (mode, "runtime") == 0) {
+    run_runtime (&total);
+  } else {
+    g_printerr ("Unknown mode '%s'\n", mode);
+    return -1;
+  }
+  cpu = cpu_seconds () - cpu_before;
+
+  g_print ("{\"mode\":\"%s\",\"pipelines\":%d,\"seconds\":%d,\"interval_ms\":%d"
+      ",\"wakeups\":%" G_GUINT64_FORMAT ",\"wakeups_per_s\":%.1f"
+      ",\"messages\":%" G_GUINT64_FORMAT ",\"queries\":%" G_GUINT64_FORMAT
+      ",\"query_us_avg\":%.2f,\"cpu_s\":%.3f,\"threads\":%d}\n",
+      mode, n_pipelines, seconds, interval, total.wakeups,
+      (gdouble) total.wakeups / seconds, total.messages, total.queries,
+      total.queries ? total.query_time / 1e3 / total.queries : 0.0, cpu, thread_count);
+  return 0;
+}
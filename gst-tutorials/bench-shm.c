@@ -0,0 +1,310 @@
+/*
+Build: make bench-shm
+Run:   ./bench-shm [--subscribers=4] [--seconds=10] [--policy=drop] [--queue=2] [--slow=MS]
+
+CPU cost of sharing one capture with N local processes (shm-share.c)
+against copying it to each of them. The capture is videotestsrc producing
+what the RealSense color node produces, stamped with frame numbers and
+capture times, and every subscriber is a process of its own running this
+program again, "<source> ! queue ! fakesink sync=false":
+  - shm: the publisher writes each frame once into shmsink's shared memory
+    and the subscribers read it there through shmsrc.
+  - copy: the way it is done without shared memory, one pipe per
+    subscriber: tee ! queue leaky=downstream ! fdsink into the pipe, and
+    fdsrc ! rawvideoparse on the other end. Every frame is copied into each
+    pipe and out of it again.
+Each subscriber prints one JSON line when its publisher goes away: frames
+seen, frames missed, capture-to-consumer latency and its own CPU time. Then
+one JSON line per mode with the publisher's CPU time, the subscribers' and
+the total as a percentage of one core.
+
+`--policy` and `--queue` are the subscribers' policy (shm-share.h);
+`--slow` makes the first subscriber sleep that long on every frame, to see
+a slow subscriber drop (or, blocking, hold) frames without the others
+missing any.
+*/
+#include <gst/gst.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "shm-share.h"
+
+#define CAPTURE_CAPS "video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1"
+#define CAPTURE_FPS 30
+#define COPY_SOURCE "fdsrc fd=0 blocksize=4147200 " \
+    "! rawvideoparse format=yuy2 width=1920 height=1080 framerate=30/1"
+
+static gint subscribers = 4;
+static gint seconds = 10;
+static gchar *policy_name = NULL;
+static gint queue_size = 2;
+static gint slow_ms = 0;
+/* Set when running as one of the subscribers */
+static gchar *child_mode = NULL;
+static gint child_index = 0;
+static gchar *socket_path = NULL;
+
+static GOptionEntry entries[] = {
+  { "subscribers", 'n', 0, G_OPTION_ARG_INT, &subscribers, "Subscriber processes (default 4)", "N" },
+  { "seconds", 's', 0, G_OPTION_ARG_INT, &seconds, "Seconds of capture per mode (default 10)", "S" },
+  { "policy", 'p', 0, G_OPTION_ARG_STRING, &policy_name, "Subscriber policy: drop or block (default drop)", "POLICY" },
+  { "queue", 'q', 0, G_OPTION_ARG_INT, &queue_size, "Frames queued per subscriber (default 2)", "N" },
+  { "slow", 0, 0, G_OPTION_ARG_INT, &slow_ms, "Make the first subscriber take this long per frame", "MS" },
+  { "child", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &child_mode, NULL, NULL },
+  { "index", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &child_index, NULL, NULL },
+  { "socket", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &socket_path, NULL, NULL },
+  { NULL }
+};
+
+static ShmPolicy policy = SHM_POLICY_DROP;
+static gchar *program = NULL;
+
+static gdouble
+rusage_cpu_seconds (gint who)
+{
+  struct rusage usage;
+
+  getrusage (who, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/* One subscriber: runs until its publisher goes away */
+static int
+run_child (void)
+{
+  ShmSubscriber *subscriber;
+  ShmSubscriberStats stats;
+  GError *error = NULL;
+  GstElement *pipeline;
+  GstBus *bus;
+  GstMessage *msg;
+  gchar *source, *consumer;
+
+  if (g_strcmp0 (child_mode, "shm") == 0)
+    source = shm_subscriber_shm_source (socket_path, CAPTURE_CAPS);
+  else
+    source = g_strdup (COPY_SOURCE);
+  if (slow_ms > 0)
+    consumer = g_strdup_printf ("identity sleep-time=%d ! fakesink sync=false", slow_ms * 1000);
+  else
+    consumer = g_strdup ("fakesink sync=false");
+  subscriber = shm_subscriber_new (source, policy, queue_size, consumer, &error);
+  g_free (source);
+  g_free (consumer);
+  if (!subscriber) {
+    g_printerr ("Subscriber %d: %s\n", child_index, error ? error->message : "no pipeline");
+    g_clear_error (&error);
+    return 1;
+  }
+
+  pipeline = shm_subscriber_get_pipeline (subscriber);
+  bus = gst_element_get_bus (pipeline);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  /* shmsrc posts an error when the publisher closes the socket, fdsrc an EOS */
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+
+  shm_subscriber_get_stats (subscriber, &stats);
+  g_print ("{\"mode\":\"%s\",\"subscriber\":%d,\"policy\":\"%s\",\"slow_ms\":%d,\"frames\":%"
+      G_GUINT64_FORMAT ",\"missed\":%" G_GUINT64_FORMAT ",\"latency_ms_p50\":%.2f"
+      ",\"latency_ms_p99\":%.2f,\"latency_ms_max\":%.2f,\"cpu_s\":%.3f}\n", child_mode,
+      child_index, policy_name, slow_ms, stats.frames, stats.missed,
+      latency_histogram_percentile (&stats.latency, 50) / 1e6,
+      latency_histogram_percentile (&stats.latency, 99) / 1e6, stats.latency.max / 1e6,
+      rusage_cpu_seconds (RUSAGE_SELF));
+  shm_subscriber_free (subscriber);
+  return 0;
+}
+
+/* Starts subscriber `index`; with `stdin_fd` its standard input is a pipe from us */
+static gboolean
+spawn_child (const gchar *mode, gint index, GPid *pid, gint *stdin_fd)
+{
+  GError *error = NULL;
+  gchar *argv[8];
+  gint argc = 0;
+  gboolean ok;
+
+  argv[argc++] = program;
+  argv[argc++] = g_strdup_printf ("--child=%s", mode);
+  argv[argc++] = g_strdup_printf ("--index=%d", index);
+  argv[argc++] = g_strdup_printf ("--policy=%s", policy_name);
+  argv[argc++] = g_strdup_printf ("--queue=%d", queue_size);
+  argv[argc++] = g_strdup_printf ("--slow=%d", index == 0 ? slow_ms : 0);
+  argv[argc++] = socket_path ? g_strdup_printf ("--socket=%s", socket_path) : NULL;
+  argv[argc] = NULL;
+
+  ok = g_spawn_async_with_pipes (NULL, argv, NULL,
+      G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH, NULL, NULL, pid, stdin_fd, NULL, NULL,
+      &error);
+  if (!ok) {
+    g_printerr ("Could not start subscriber %d: %s\n", index, error->message);
+    g_clear_error (&error);
+  }
+  for (argc = 1; argv[argc]; argc++)
+    g_free (argv[argc]);
+  return ok;
+}
+
+/* Captures for `seconds` into `mode` ("shm" or "copy") and prints the mode's line */
+static void
+run_mode (const gchar *mode)
+{
+  gboolean shm = g_strcmp0 (mode, "shm") == 0;
+  ShmPublisher *publisher = NULL;
+  GstElement *pipeline, *capture;
+  GPid *pids = g_new0 (GPid, subscribers);
+  gint *fds = g_new (gint, subscribers);
+  GError *error = NULL;
+  GString *description;
+  GstBus *bus;
+  GstMessage *msg;
+  gdouble self_cpu, children_cpu;
+  gint64 start = 0, end = 0;
+  gint i, started = 0;
+
+  self_cpu = rusage_cpu_seconds (RUSAGE_SELF);
+  children_cpu = rusage_cpu_seconds (RUSAGE_CHILDREN);
+
+  description = g_string_new (NULL);
+  g_string_append_printf (description, "videotestsrc is-live=true num-buffers=%d "
+      "! capsfilter name=capture caps=\"" CAPTURE_CAPS "\"", seconds * CAPTURE_FPS);
+  if (!shm) {
+    /* The subscribers must exist before their pipes go into the description */
+    g_string_append (description, " ! tee name=t");
+    for (i = 0; i < subscribers; i++) {
+      if (!spawn_child (mode, i, &pids[started], &fds[started]))
+        break;
+      g_string_append_printf (description, " t. ! queue leaky=downstream max-size-buffers=2 "
+          "max-size-bytes=0 max-size-time=0 ! fdsink fd=%d sync=false", fds[started++]);
+    }
+  }
+  pipeline = gst_parse_launch (description->str, &error);
+  g_string_free (description, TRUE);
+  if (!pipeline) {
+    g_printerr ("%s: %s\n", mode, error->message);
+    g_clear_error (&error);
+    goto reap;
+  }
+  capture = gst_bin_get_by_name (GST_BIN (pipeline), "capture");
+
+  if (shm) {
+    GstCaps *caps = gst_caps_from_string (CAPTURE_CAPS);
+
+    publisher = shm_publisher_new (pipeline, capture, socket_path, caps, SHM_SHARE_FRAMES, TRUE);
+    gst_caps_unref (caps);
+    if (!publisher) {
+      gst_object_unref (capture);
+      gst_object_unref (pipeline);
+      goto reap;
+    }
+    /* shmsink listens from PAUSED on; nothing is captured before PLAYING */
+    gst_element_set_state (pipeline, GST_STATE_PAUSED);
+    for (i = 0; i < subscribers; i++)
+      if (spawn_child (mode, i, &pids[started], NULL))
+        started++;
+    end = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+    while (shm_publisher_get_n_clients (publisher) < (guint) started
+        && g_get_monotonic_time () < end)
+      g_usleep (10000);
+  } else {
+    GstPad *pad = gst_element_get_static_pad (capture, "src");
+
+    shm_share_add_stamp_probe (pad);
+    gst_object_unref (pad);
+    /* Nothing tells when they are reading; their pipes fill up until they do */
+    g_usleep (G_USEC_PER_SEC);
+  }
+  gst_object_unref (capture);
+
+  bus = gst_element_get_bus (pipeline);
+  start = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (bus, (seconds + 10) * GST_SECOND,
+      GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+  end = g_get_monotonic_time ();
+  if (msg && GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (msg, &error, NULL);
+    g_printerr ("%s: %s\n", mode, error->message);
+    g_clear_error (&error);
+  }
+  if (msg)
+    gst_message_unref (msg);
+  gst_object_unref (bus);
+  /* Closes the socket or, below, the pipes: the subscribers finish and report */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  if (publisher)
+    shm_publisher_free (publisher);
+  gst_object_unref (pipeline);
+
+reap:
+  if (!shm)
+    for (i = 0; i < started; i++)
+      close (fds[i]);
+  self_cpu = rusage_cpu_seconds (RUSAGE_SELF) - self_cpu;
+  for (i = 0; i < started; i++) {
+    waitpid (pids[i], NULL, 0);
+    g_spawn_close_pid (pids[i]);
+  }
+  children_cpu = rusage_cpu_seconds (RUSAGE_CHILDREN) - children_cpu;
+
+  if (started) {
+    gdouble wall = (end - start) / 1e6;
+
+    g_print ("{\"mode\":\"%s\",\"subscribers\":%d,\"policy\":\"%s\",\"frames\":%d"
+        ",\"wall_s\":%.2f,\"publisher_cpu_s\":%.3f,\"subscribers_cpu_s\":%.3f"
+        ",\"total_cpu_s\":%.3f,\"total_cpu_pct\":%.1f}\n", mode, started, policy_name,
+        seconds * CAPTURE_FPS, wall, self_cpu, children_cpu, self_cpu + children_cpu,
+        wall > 0 ? (self_cpu + children_cpu) * 100 / wall : 0.0);
+  }
+  g_free (pids);
+  g_free (fds);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+
+  context = g_option_context_new ("- shared memory vs. copies to local subscribers");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (!policy_name)
+    policy_name = g_strdup ("drop");
+  if (!shm_policy_from_string (policy_name, &policy)) {
+    g_printerr ("Unknown policy '%s', use drop or block.\n", policy_name);
+    return -1;
+  }
+  if (subscribers <= 0 || seconds <= 0 || queue_size <= 0) {
+    g_printerr ("--subscribers, --seconds and --queue must be positive.\n");
+    return -1;
+  }
+  gst_init (&argc, &argv);
+
+  if (child_mode)
+    return run_child ();
+
+  /* A subscriber that is gone must fail fdsink, not kill us */
+  signal (SIGPIPE, SIG_IGN);
+  program = argv[0];
+  socket_path = g_strdup_printf ("%s/bench-shm-%d.sock", g_get_tmp_dir (), (gint) getpid ());
+  run_mode ("shm");
+  g_free (socket_path);
+  socket_path = NULL;
+  run_mode ("copy");
+
+  g_free (policy_name);
+  return 0;
+}
@@ -0,0 +1,254 @@
+/*
+Build: make bench-simd-convert
+Run:   ./bench-simd-convert [--min-time=300]
+       ./bench-simd-convert --verify [--tolerance=2]
+
+Throughput of the simdconvert kernels (simd-convert.c) against videoconvert's
+converter (GstVideoConverter, single-threaded), for YUY2 and NV12 to BGRx at
+720p, 1080p and 4K. Each case converts the same random frame repeatedly for
+at least `--min-time` ms and prints one JSON line with ms/frame, Mpixels/s
+and pixels per cycle (TSC cycles, so on CPUs that boost the core runs faster
+than the counter and the figure is an upper bound of the real cost).
+
+`--verify` checks instead, for both formats at each size and at an odd size
+(to exercise the row tails):
+  - every kernel this CPU supports gives exactly the scalar kernel's output,
+  - the output is within `--tolerance` (per channel) of GstVideoConverter
+    set up like simdconvert (nearest chroma, no dithering); videoconvert's
+    8-bit matrix rounds differently, so a difference of 1-2 is expected.
+The exit status is non-zero if any check fails.
+*/
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define read_cycles() __rdtsc ()
+#else
+#define read_cycles() 0
+#endif
+
+#include "simd-convert.h"
+
+static gint min_time = 300;
+static gboolean verify = FALSE;
+static gint tolerance = 2;
+
+static GOptionEntry entries[] = {
+  { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time, "Time per case (default 300)", "MS" },
+  { "verify", 'v', 0, G_OPTION_ARG_NONE, &verify, "Check the kernels instead of timing them", NULL },
+  { "tolerance", 0, 0, G_OPTION_ARG_INT, &tolerance, "Allowed difference from videoconvert (default 2)", "N" },
+  { NULL }
+};
+
+static const struct {
+  gint width;
+  gint height;
+} sizes[] = {
+  { 1280, 720 },
+  { 1920, 1080 },
+  { 3840, 2160 },
+};
+
+static const GstVideoFormat formats[] = { GST_VIDEO_FORMAT_YUY2, GST_VIDEO_FORMAT_NV12 };
+
+/* A frame of random bytes, which are all valid YUV */
+static GstBuffer *
+random_frame (GstVideoInfo *info)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (info), NULL);
+  GstMapInfo map;
+  gsize i;
+
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  for (i = 0; i < map.size; i++)
+    map.data[i] = g_random_int () & 0xff;
+  gst_buffer_unmap (buffer, &map);
+  return buffer;
+}
+
+static GstVideoConverter *
+videoconvert_new (GstVideoInfo *in_info, GstVideoInfo *out_info, gboolean like_simdconvert)
+{
+  GstStructure *config = gst_structure_new ("config",
+      GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT, 1, NULL);
+
+  if (like_simdconvert)
+    gst_structure_set (config,
+        GST_VIDEO_CONVERTER_OPT_CHROMA_RESAMPLER_METHOD, GST_TYPE_VIDEO_RESAMPLER_METHOD,
+        GST_VIDEO_RESAMPLER_METHOD_NEAREST,
+        GST_VIDEO_CONVERTER_OPT_DITHER_METHOD, GST_TYPE_VIDEO_DITHER_METHOD,
+        GST_VIDEO_DITHER_NONE, NULL);
+  return gst_video_converter_new (in_info, out_info, config);
+}
+
+/* `kernel` < 0 means videoconvert */
+static void
+time_case (GstVideoFormat format, gint width, gint height, gint kernel)
+{
+  GstVideoInfo in_info, out_info;
+  GstVideoFrame in, out;
+  GstBuffer *in_buffer, *out_buffer;
+  GstVideoConverter *converter = NULL;
+  SimdConvertMatrix matrix;
+  guint64 start, start_cycles, elapsed, cycles;
+  guint frames = 0;
+
+  gst_video_info_set_format (&in_info, format, width, height);
+  gst_video_info_set_format (&out_info, GST_VIDEO_FORMAT_BGRx, width, height);
+  in_buffer = random_frame (&in_info);
+  out_buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&out_info), NULL);
+  gst_video_frame_map (&in, &in_info, in_buffer, GST_MAP_READ);
+  gst_video_frame_map (&out, &out_info, out_buffer, GST_MAP_WRITE);
+  if (kernel < 0)
+    converter = videoconvert_new (&in_info, &out_info, FALSE);
+  else
+    simd_convert_matrix_init (&matrix, &in_info.colorimetry);
+
+  start = gst_util_get_timestamp ();
+  start_cycles = read_cycles ();
+  do {
+    if (converter)
+      gst_video_converter_frame (converter, &in, &out);
+    else
+      simd_convert_frame (kernel, &matrix, &in, &out);
+    frames++;
+    elapsed = gst_util_get_timestamp () - start;
+  } while (elapsed < (guint64) min_time * GST_MSECOND);
+  cycles = read_cycles () - start_cycles;
+
+  g_print ("{\"format\":\"%s\",\"width\":%d,\"height\":%d,\"kernel\":\"%s\",\"frames\":%u"
+      ",\"ms_per_frame\":%.3f,\"mpixels_per_s\":%.1f,\"pixels_per_cycle\":%.3f}\n",
+      gst_video_format_to_string (format), width, height,
+      kernel < 0 ? "videoconvert" : simd_convert_kernel_name (kernel), frames,
+      elapsed / 1e6 / frames, (gdouble) width * height * frames / (elapsed / 1e3),
+      cycles ? (gdouble) width * height * frames / cycles : 0.0);
+
+  if (converter)
+    gst_video_converter_free (converter);
+  gst_video_frame_unmap (&out);
+  gst_video_frame_unmap (&in);
+  gst_buffer_unref (out_buffer);
+  gst_buffer_unref (in_buffer);
+}
+
+/* Largest per-channel difference between two BGRx frames, ignoring x */
+static gint
+max_difference (GstVideoFrame *a, GstVideoFrame *b, gdouble *identical)
+{
+  gint width = GST_VIDEO_FRAME_WIDTH (a), height = GST_VIDEO_FRAME_HEIGHT (a);
+  guint64 same = 0;
+  gint max = 0, x, y, c;
+
+  for (y = 0; y < height; y++) {
+    const guint8 *pa = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (a, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (a, 0);
+    const guint8 *pb = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (b, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (b, 0);
+
+    for (x = 0; x < width * 4; x += 4) {
+      for (c = 0; c < 3; c++) {
+        gint d = abs (pa[x + c] - pb[x + c]);
+
+        max = MAX (max, d);
+        same += (d == 0);
+      }
+    }
+  }
+  if (identical)
+    *identical = 100.0 * same / ((gdouble) width * height * 3);
+  return max;
+}
+
+static gboolean
+verify_case (GstVideoFormat format, gint width, gint height)
+{
+  GstVideoInfo in_info, out_info;
+  GstVideoFrame in, reference, out;
+  GstBuffer *in_buffer, *reference_buffer, *out_buffer;
+  GstVideoConverter *converter;
+  SimdConvertMatrix matrix;
+  gboolean identical = TRUE;
+  gdouble same;
+  gint kernel, diff;
+
+  gst_video_info_set_format (&in_info, format, width, height);
+  gst_video_info_set_format (&out_info, GST_VIDEO_FORMAT_BGRx, width, height);
+  in_buffer = random_frame (&in_info);
+  reference_buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&out_info), NULL);
+  out_buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&out_info), NULL);
+  gst_video_frame_map (&in, &in_info, in_buffer, GST_MAP_READ);
+  gst_video_frame_map (&reference, &out_info, reference_buffer, GST_MAP_WRITE);
+  gst_video_frame_map (&out, &out_info, out_buffer, GST_MAP_WRITE);
+
+  simd_convert_matrix_init (&matrix, &in_info.colorimetry);
+  simd_convert_frame (SIMD_CONVERT_SCALAR, &matrix, &in, &reference);
+  for (kernel = SIMD_CONVERT_SSE41; kernel <= SIMD_CONVERT_AVX2; kernel++) {
+    if (!simd_convert_kernel_supported (kernel))
+      continue;
+    memset (GST_VIDEO_FRAME_PLANE_DATA (&out, 0), 0, GST_VIDEO_INFO_SIZE (&out_info));
+    simd_convert_frame (kernel, &matrix, &in, &out);
+    if (max_difference (&reference, &out, NULL) != 0) {
+      g_printerr ("%s %dx%d: the %s kernel differs from scalar\n",
+          gst_video_format_to_string (format), width, height, simd_convert_kernel_name (kernel));
+      identical = FALSE;
+    }
+  }
+
+  converter = videoconvert_new (&in_info, &out_info, TRUE);
+  gst_video_converter_frame (converter, &in, &out);
+  gst_video_converter_free (converter);
+  diff = max_difference (&reference, &out, &same);
+
+  g_print ("{\"verify\":\"%s\",\"width\":%d,\"height\":%d,\"kernels_identical\":%s"
+      ",\"videoconvert_max_diff\":%d,\"videoconvert_identical_pct\":%.2f,\"status\":\"%s\"}\n",
+      gst_video_format_to_string (format), width, height, identical ? "true" : "false", diff,
+      same, identical && diff <= tolerance ? "ok" : "fail");
+
+  gst_video_frame_unmap (&out);
+  gst_video_frame_unmap (&reference);
+  gst_video_frame_unmap (&in);
+  gst_buffer_unref (out_buffer);
+  gst_buffer_unref (reference_buffer);
+  gst_buffer_unref (in_buffer);
+  return identical && diff <= tolerance;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gboolean ok = TRUE;
+  guint f, s;
+  gint kernel;
+
+  context = g_option_context_new ("- simdconvert kernels vs. videoconvert");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  gst_init (&argc, &argv);
+
+  for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+    if (verify) {
+      for (s = 0; s < G_N_ELEMENTS (sizes); s++)
+        ok &= verify_case (formats[f], sizes[s].width, sizes[s].height);
+      ok &= verify_case (formats[f], 1283, 721);
+      continue;
+    }
+    for (s = 0; s < G_N_ELEMENTS (sizes); s++) {
+      time_case (formats[f], sizes[s].width, sizes[s].height, -1);
+      for (kernel = SIMD_CONVERT_SCALAR; kernel <= SIMD_CONVERT_AVX2; kernel++)
+        if (simd_convert_kernel_supported (kernel))
+          time_case (formats[f], sizes[s].width, sizes[s].height, kernel);
+    }
+  }
+  return ok ? 0 : 1;
+}
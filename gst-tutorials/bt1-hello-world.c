@@ -1,27 +1,56 @@
 #include <gst/gst.h>
 
+#include "range-cache-src.h"
+
+static gboolean no_cache = FALSE;
+
+static GOptionEntry entries[] = {
+  { "no-cache", 'n', 0, G_OPTION_ARG_NONE, &no_cache, "Stream from the network on every run", NULL },
+  { NULL }
+};
+
 int
 main (int argc, char *argv[])
 {
   GstElement *pipeline;
   GstBus *bus;
   GstMessage *msg;
+  GOptionContext *context;
+  GError *error = NULL;
+  const gchar *uri;
+
+  context = g_option_context_new ("- hello world");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
 
   /* Initialize GStreamer */
   gst_init (&argc, &argv);
 
+  /*
+  Registering `rangecachesrc` makes `cache+https://` URIs work: the file is
+  kept in an on-disk cache (range-cache.c), so only the first run downloads it.
+  */
+  range_cache_src_register ();
+  if (no_cache)
+    uri = "https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm";
+  else
+    uri = "cache+https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm";
+
   /* Build the pipeline */
   /*
-  'gst_parse_launch' is used when the pipeline doesn't need advanced elements
-  and it provides a shortcut. It takes a textual representation of a pipeline.
-  `playbin` helps provide this shortcut and includes both: source and sink and
-  suffices as a complete pipeline. It can take file addresses beginning as `http://`
-  or `file://`
+  `playbin` includes both source and sink and suffices as a complete
+  pipeline, so it is made directly and given the URI to play. It takes
+  addresses beginning with `http://` or `file://`, and `cache+https://`
+  once rangecachesrc is registered.
   */
-  pipeline =
-      gst_parse_launch
-      ("playbin uri=https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm",
-      NULL);
+  pipeline = gst_element_factory_make ("playbin", NULL);
+  g_object_set (pipeline, "uri", uri, NULL);
 
   /* Start playing */
   gst_element_set_state (pipeline, GST_STATE_PLAYING);
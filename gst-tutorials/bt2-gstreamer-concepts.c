@@ -1,5 +1,5 @@
 /*
-Run: gcc bt2-gstreamer-concepts.c -o bt2-gstreamer-concepts `pkg-config --cflags --libs gstreamer-1.0`
+Build: make bt2-gstreamer-concepts
 In this tut, we build a pipeline manually by instatiating each element and linking
 them all together.
 A general pipeline:
@@ -1,5 +1,5 @@
 /*
-Run: gcc bt3-dynamic-pipelines.c -o bt3-dynamic-pipelines `pkg-config --cflags --libs gstreamer-1.0`
+Build: make bt3-dynamic-pipelines
 Aim:
   - How to attain finer control when linking elements
   - How to be notified of interesting events so we can react in time
@@ -31,36 +31,220 @@ A demuxer can have two such pads:
 A demuxer doesn't have a source pad (so not exit port) and hence can't have elements
 next to it; we must terminate the pipeline after a demuxer.
 
-In this example, we only demux the audio stream and not the video.
+The original tutorial linked only the first audio pad and ignored the rest.
+Here a stream router (stream-router.c) gives every stream its own branch,
+chosen by caps. uridecodebin is told to stop in front of the decoders, so
+audio streams go to decodebin ! audioconvert ! audioresample ! autoaudiosink,
+video streams to decodebin ! videoconvert ! autovideosink, anything else to a
+fakesink. Each branch starts with a queue, so with multi-track files every
+stream is decoded, converted and rendered on its own thread. Per-branch throughput is printed at EOS; run with
+`--headless` to replace the sinks with unsynchronised fakesinks and measure how
+fast the streams can go.
 
 Signals in GStreamer: Signal are crucial and allow us to be notified (by means
 of a callback) when something interesting has happened. They are identified with
 a name and each `GObject` has its own signals.
+
+Run with `--trace-latency` to get per-element latency histograms (audioconvert,
+audioresample, and everything uridecodebin plugs in) at EOS or on SIGUSR1, and
+with `--profile-startup` to see how long gst_init, autoplugging (until the first
+pad appears), each state change, caps negotiation and preroll take before the
+first buffer arrives.
+
+Run with `--memory-budget=MB` to keep the process within that RSS on small
+devices (memory-budget.c): the branch queues, uridecodebin's network buffer
+and decodebin's multiqueue are sized to fit, and the memory accounting
+(queue levels, buffer pools, RSS) is printed every second and at the end.
+
+Run with `--batch=LIST` to decode every file or URI listed in LIST (one per
+line) with a pool of `--workers` pipelines (batch-decoder.c, default and
+at most one per core) built like this one, with the headless branches. The
+pipelines are reused from one file to the next: READY, a new URI, PLAYING.
+The media-seconds decoded per wall-second are printed at the end.
+
+Run with `--audio-preset=NAME` (audio-preset.c) to play the audio through a
+chain tuned for lowest-latency, balanced or highest-quality: the format the
+resampler works in, its filter length, dithering and the audio sink's
+buffering are set together. At the end the preset reports the audio's end
+to end latency (resampler delay plus the sink's ring buffer) and the CPU the
+conversions and resampling took per second of audio. With `--headless` it
+shows how cheap each preset is without waiting for playback.
+
+Run with `--metrics-port=PORT` and/or `--metrics-file=PATH` to export
+Prometheus metrics (metrics-exporter.c) every second while it plays, on
+http://127.0.0.1:PORT/metrics or into PATH: buffers per pad, branch queue
+levels, QoS drops, CPU per streaming thread and element states, including
+everything uridecodebin plugs in.
 */
 
 #include <gst/gst.h>
 
+#include "audio-preset.h"
+#include "batch-decoder.h"
+#include "latency-tracer.h"
+#include "memory-budget.h"
+#include "metrics-exporter.h"
+#include "pipeline-runtime.h"
+#include "range-cache-src.h"
+#include "startup-profile.h"
+#include "stream-router.h"
+
 /* Structure to contain all our information, so we can pass it to callbacks */
 typedef struct _CustomData {
   GstElement *pipeline;
   GstElement *source;
-  GstElement *convert;
-  GstElement *resample;
-  GstElement *sink;
+  StreamRouter *router;
 } CustomData;
 
+/*
+ Routing rules, first match wins. The pads are parsed but still encoded (see
+ autoplug_select_handler), so each branch decodes behind its own queue:
+  - `decodebin` plugs the decoder for the stream; a raw stream goes straight
+    through it.
+  - `audioconvert` converts b/w different audio formats, making sure this
+    example works on any platform, since the audio decoder might not be the
+    same that the audio sink expects.
+  - `audioresample` converts b/w different audio sample rates, similarly
+    making sure it works on any platform.
+  - `autoaudiosink` is the equivalent of `autovideosink` for audio.
+*/
+static const StreamRule rules[] = {
+  { "audio/", "decodebin ! audioconvert ! audioresample ! autoaudiosink" },
+  { "video/", "decodebin ! videoconvert ! autovideosink" },
+  { "", "fakesink" },
+};
+
+/* The same branches without rendering, to measure throughput */
+static const StreamRule headless_rules[] = {
+  { "audio/", "decodebin ! audioconvert ! audioresample ! fakesink sync=false" },
+  { "video/", "decodebin ! videoconvert ! fakesink sync=false" },
+  { "", "fakesink sync=false" },
+};
+
+/* For --batch, whose uridecodebin decodes: the branches get raw streams */
+static const StreamRule batch_rules[] = {
+  { "audio/x-raw", "audioconvert ! audioresample ! fakesink sync=false" },
+  { "video/x-raw", "videoconvert ! fakesink sync=false" },
+  { "", "fakesink sync=false" },
+};
+
+/* uridecodebin's autoplug-select results; the enum is not in a public header */
+typedef enum {
+  GST_AUTOPLUG_SELECT_TRY,
+  GST_AUTOPLUG_SELECT_EXPOSE,
+  GST_AUTOPLUG_SELECT_SKIP
+} GstAutoplugSelectResult;
+
+/* Handler for the autoplug-select signal */
+static GstAutoplugSelectResult autoplug_select_handler (GstElement *src, GstPad *pad,
+    GstCaps *caps, GstElementFactory *factory, CustomData *data);
+
 /* Handler for the pad-added signal */
 static void pad_added_handler (GstElement *src, GstPad *pad, CustomData *data);
 
+/* Handler for state-changed bus messages */
+static void state_changed_handler (PipelineRuntime *runtime, GstMessage *msg, CustomData *data);
+
+/* Handler for QoS bus messages, with --metrics-port/--metrics-file */
+static void qos_handler (PipelineRuntime *runtime, GstMessage *msg, MetricsExporter *metrics);
+
+static gboolean trace_latency = FALSE;
+static gboolean headless = FALSE;
+static gboolean no_cache = FALSE;
+static gboolean profile_startup = FALSE;
+static gint memory_budget = -1;
+static gchar *batch_list = NULL;
+static gint workers = 0;
+static gchar *audio_preset = NULL;
+static gint metrics_port = 0;
+static gchar *metrics_file = NULL;
+static gchar *uri = "https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm";
+
+static GOptionEntry entries[] = {
+  { "trace-latency", 'l', 0, G_OPTION_ARG_NONE, &trace_latency, "Report per-element latency histograms", NULL },
+  { "headless", 0, 0, G_OPTION_ARG_NONE, &headless, "Route every stream to a fakesink with sync=false", NULL },
+  { "uri", 'u', 0, G_OPTION_ARG_STRING, &uri, "URI to play", "URI" },
+  { "no-cache", 'n', 0, G_OPTION_ARG_NONE, &no_cache, "Do not cache http(s) URIs on disk", NULL },
+  { "profile-startup", 'p', 0, G_OPTION_ARG_NONE, &profile_startup, "Print where the time to the first buffer went", NULL },
+  { "memory-budget", 0, 0, G_OPTION_ARG_INT, &memory_budget, "Keep the process within this RSS (0 = only account)", "MB" },
+  { "batch", 'b', 0, G_OPTION_ARG_FILENAME, &batch_list, "Decode every file/URI listed in LIST, one per line", "LIST" },
+  { "workers", 'w', 0, G_OPTION_ARG_INT, &workers, "With --batch, pipelines decoding in parallel (default: one per core)", "N" },
+  { "audio-preset", 'a', 0, G_OPTION_ARG_STRING, &audio_preset, "Audio chain preset: lowest-latency, balanced or highest-quality", "NAME" },
+  { "metrics-port", 0, 0, G_OPTION_ARG_INT, &metrics_port, "Serve Prometheus metrics on 127.0.0.1:PORT/metrics", "PORT" },
+  { "metrics-file", 0, 0, G_OPTION_ARG_FILENAME, &metrics_file, "Write Prometheus metrics to PATH every second", "PATH" },
+  { NULL }
+};
+
+/* --batch: the list through a pool of reused pipelines */
+static int
+run_batch (void)
+{
+  BatchDecoder *batch;
+  BatchDecoderStats stats;
+  GError *error = NULL;
+  gchar **uris;
+  gdouble wall;
+
+  uris = batch_decoder_read_list (batch_list, &error);
+  if (!uris) {
+    g_printerr ("Could not read %s: %s\n", batch_list, error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+
+  batch = batch_decoder_new (batch_rules, G_N_ELEMENTS (batch_rules), MAX (workers, 0), TRUE);
+  batch_decoder_set_verbose (batch, TRUE);
+  batch_decoder_run (batch, uris);
+  batch_decoder_get_stats (batch, &stats);
+  wall = stats.wall_time / 1e9;
+  g_print ("\nBatch: %u files decoded, %u failed, by %u workers (%u pipelines built)\n",
+      stats.jobs_done, stats.jobs_failed, stats.workers, stats.pipelines_built);
+  g_print ("  %.1f s of media in %.1f s: %.1f media-seconds per second\n",
+      stats.media_time / 1e9, wall, wall > 0 ? stats.media_time / 1e9 / wall : 0.0);
+
+  batch_decoder_free (batch);
+  g_strfreev (uris);
+  return stats.jobs_failed ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
   CustomData data;
-  GstBus *bus;
-  GstMessage *msg;
-  GstStateChangeReturn ret;
-  gboolean terminate = FALSE;
+  PipelineRuntime *runtime;
+  LatencyTracer *latency_tracer = NULL;
+  MemoryBudget *memory = NULL;
+  const AudioPreset *preset = NULL;
+  AudioPresetChain *audio = NULL;
+  MetricsExporter *metrics = NULL;
+  const StreamRule *branch_rules;
+  StreamRule preset_rules[G_N_ELEMENTS (rules)];
+  gchar *audio_branch = NULL, *audio_chain;
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *source_uri;
+  guint i;
+
+  startup_profile_start ();
+
+  context = g_option_context_new ("- dynamic pipeline tutorial");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (audio_preset && !(preset = audio_preset_find (audio_preset))) {
+    g_printerr ("Unknown audio preset %s (one of %s).\n", audio_preset, audio_preset_names ());
+    return -1;
+  }
 
   /* Initialize GStreamer */
   gst_init (&argc, &argv);
+  startup_profile_mark ("gst_init (registry)");
+
+  if (batch_list)
+    return run_batch ();
 
   // Create the elements
   data.source = gst_element_factory_make ("uridecodebin", "source");
@@ -70,44 +254,43 @@ int main(int argc, char *argv[]) {
   It does half the work that `playbin` does; dince it contains demuxers, source
   pads are not initially available and we will need to link them on the fly.
   */
-  data.convert = gst_element_factory_make ("audioconvert", "convert");
-  /*
-  `audioconvert` is used for converting b/w different audio formats, making sure
-  this example works on any platform, since the audio decoder might not be the
-  same that the audio sink expects.
-  */
-  data.resample = gst_element_factory_make ("audioresample", "resample");
-  /*
-  `audioresample` is used to convert b/w different audio sample rates, similarly
-  making sure it works on any platform.
-  */
-  data.sink = gst_element_factory_make ("autoaudiosink", "sink");
-  /*
-  The `autoaudiosink` is the equivalent of `autovideosink` for video.
-  */
 
   /* Create the empty pipeline */
   data.pipeline = gst_pipeline_new ("test-pipeline");
 
-  if (!data.pipeline || !data.source || !data.convert || !data.resample || !data.sink) {
+  if (!data.pipeline || !data.source) {
     g_printerr ("Not all elements could be created.\n");
     return -1;
   }
 
   // Build the pipeline/Add elements to the bin.
-  gst_bin_add_many (GST_BIN (data.pipeline), data.source, data.convert, data.resample, data.sink, NULL);
+  gst_bin_add (GST_BIN (data.pipeline), data.source);
   /*
   Note that we are NOT linking the source at this point, since
-  it contains no source pads at this point. We will do it later.
+  it contains no source pads at this point. The router will build and link a
+  branch for each of them later.
   */
-  if (!gst_element_link_many (data.convert, data.resample, data.sink, NULL)) {
-    g_printerr ("Elements could not be linked.\n");
-    gst_object_unref (data.pipeline);
-    return -1;
+  branch_rules = headless ? headless_rules : rules;
+  if (preset) {
+    /* The same rules, with the audio going through the preset's chain */
+    for (i = 0; i < G_N_ELEMENTS (rules); i++)
+      preset_rules[i] = branch_rules[i];
+    audio_chain = audio_preset_branch (preset, headless ? "fakesink sync=false" : "autoaudiosink");
+    audio_branch = g_strdup_printf ("decodebin ! %s", audio_chain);
+    g_free (audio_chain);
+    preset_rules[0].branch = audio_branch;
+    branch_rules = preset_rules;
   }
+  data.router = stream_router_new (data.pipeline, branch_rules, G_N_ELEMENTS (rules));
 
-  /* Set the URI to play */
-  g_object_set (data.source, "uri", "https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm", NULL);
+  /*
+  Set the URI to play. Unless `--no-cache` is given, http(s) URIs are read
+  through `rangecachesrc`, so repeat runs and seeks are served from disk.
+  */
+  range_cache_src_register ();
+  source_uri = no_cache ? g_strdup (uri) : range_cache_src_wrap_uri (uri);
+  g_object_set (data.source, "uri", source_uri, NULL);
+  g_free (source_uri);
 
   // Connect to the pad-added signal
   /*
@@ -120,68 +303,111 @@ int main(int argc, char *argv[]) {
   in sharing information b/w the `main` and callback function.
   */
   g_signal_connect (data.source, "pad-added", G_CALLBACK (pad_added_handler), &data);
+  /* Expose a stream instead of plugging its decoder: the branch decodes it */
+  g_signal_connect (data.source, "autoplug-select", G_CALLBACK (autoplug_select_handler), &data);
   /*
   (TBConfirmed) What `g_signal_connect` is indirectly doing is, its creating a signal that
   triggers `pad_added_handler` and passes arguments(`data.source`, `"pad-added"`
   and `data`) in a not-so-common way 😕.
+  */
+
+  startup_profile_mark ("elements created");
+  if (trace_latency)
+    latency_tracer = latency_tracer_attach (data.pipeline);
+  if (profile_startup)
+    startup_profile_attach (data.pipeline);
+  if (memory_budget >= 0) {
+    memory = memory_budget_attach (data.pipeline, (guint64) memory_budget * 1024 * 1024);
+    memory_budget_export (memory, 1000);
+  }
+  if (preset)
+    audio = audio_preset_attach (data.pipeline, preset);
+  if (metrics_port > 0 || metrics_file) {
+    metrics = metrics_exporter_new (data.pipeline, 1000);
+    if (metrics_file)
+      metrics_exporter_write_to (metrics, metrics_file);
+    if (metrics_port > 0 && !metrics_exporter_serve (metrics, metrics_port, &error)) {
+      g_printerr ("Cannot serve metrics on port %d: %s\n", metrics_port, error->message);
+      g_clear_error (&error);
+    }
+  }
+
+  /*
+   Listen to the bus through the event-driven runtime (pipeline-runtime.c):
+   ERROR and EOS are handled by its defaults (print and stop), we only add a
+   handler for state changes.
+  */
+  runtime = pipeline_runtime_new (data.pipeline);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_STATE_CHANGED,
+      (PipelineMessageFunc) state_changed_handler, &data);
+  if (metrics)
+    pipeline_runtime_set_handler (runtime, GST_MESSAGE_QOS,
+        (PipelineMessageFunc) qos_handler, metrics);
 
   /* Start playing */
-  ret = gst_element_set_state (data.pipeline, GST_STATE_PLAYING);
-  if (ret == GST_STATE_CHANGE_FAILURE) {
+  if (!pipeline_runtime_start (runtime)) {
     g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    if (memory)
+      memory_budget_free (memory);
+    if (audio)
+      audio_preset_free (audio);
+    if (metrics)
+      metrics_exporter_free (metrics);
     gst_object_unref (data.pipeline);
+    stream_router_free (data.router);
+    g_free (audio_branch);
     return -1;
   }
 
-  /* Listen to the bus */
-  bus = gst_element_get_bus (data.pipeline);
-  do {
-    msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
-        GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
-
-    /* Parse message */
-    if (msg != NULL) {
-      GError *err;
-      gchar *debug_info;
-
-      switch (GST_MESSAGE_TYPE (msg)) {
-        case GST_MESSAGE_ERROR:
-          gst_message_parse_error (msg, &err, &debug_info);
-          g_printerr ("Error received from element %s: %s\n", GST_OBJECT_NAME (msg->src), err->message);
-          g_printerr ("Debugging information: %s\n", debug_info ? debug_info : "none");
-          g_clear_error (&err);
-          g_free (debug_info);
-          terminate = TRUE;
-          break;
-        case GST_MESSAGE_EOS:
-          g_print ("End-Of-Stream reached.\n");
-          terminate = TRUE;
-          break;
-        case GST_MESSAGE_STATE_CHANGED:
-          /* We are only interested in state-changed messages from the pipeline */
-          if (GST_MESSAGE_SRC (msg) == GST_OBJECT (data.pipeline)) {
-            GstState old_state, new_state, pending_state;
-            gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
-            g_print ("Pipeline state changed from %s to %s:\n",
-                gst_element_state_get_name (old_state), gst_element_state_get_name (new_state));
-          }
-          break;
-        default:
-          /* We should not reach here */
-          g_printerr ("Unexpected message received.\n");
-          break;
-      }
-      gst_message_unref (msg);
-    }
-  } while (!terminate);
+  /* Dispatch bus messages until ERROR or EOS */
+  pipeline_runtime_run ();
+
+  stream_router_dump (data.router);
+  if (latency_tracer)
+    latency_tracer_dump (latency_tracer);
+  if (memory)
+    memory_budget_report (memory);
+  if (audio)
+    audio_preset_report (audio);
 
   /* Free resources */
-  gst_object_unref (bus);
-  gst_element_set_state (data.pipeline, GST_STATE_NULL);
+  pipeline_runtime_free (runtime);
+  if (memory)
+    memory_budget_free (memory);
+  if (audio)
+    audio_preset_free (audio);
+  if (metrics)
+    metrics_exporter_free (metrics);
   gst_object_unref (data.pipeline);
+  stream_router_free (data.router);
+  g_free (audio_branch);
   return 0;
 }
 
+/* We are only interested in state-changed messages from the pipeline */
+static void state_changed_handler (PipelineRuntime *runtime, GstMessage *msg, CustomData *data) {
+  if (GST_MESSAGE_SRC (msg) == GST_OBJECT (data->pipeline)) {
+    GstState old_state, new_state, pending_state;
+    gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
+    g_print ("Pipeline state changed from %s to %s:\n",
+        gst_element_state_get_name (old_state), gst_element_state_get_name (new_state));
+  }
+}
+
+/* Sinks post QoS when they drop late buffers; the exporter keeps their totals */
+static void qos_handler (PipelineRuntime *runtime, GstMessage *msg, MetricsExporter *metrics) {
+  metrics_exporter_handle_message (metrics, msg);
+}
+
+/* Called for every factory uridecodebin is about to plug; decoders are left to the branches */
+static GstAutoplugSelectResult autoplug_select_handler (GstElement *src, GstPad *pad,
+    GstCaps *caps, GstElementFactory *factory, CustomData *data) {
+  if (gst_element_factory_list_is_type (factory, GST_ELEMENT_FACTORY_TYPE_DECODER))
+    return GST_AUTOPLUG_SELECT_EXPOSE;
+  return GST_AUTOPLUG_SELECT_TRY;
+}
+
 /* This function will be called by the 'pad-added' signal */
 static void pad_added_handler (GstElement *src, GstPad *new_pad, CustomData *data) {
   /*
@@ -190,85 +416,28 @@ static void pad_added_handler (GstElement *src, GstPad *new_pad, CustomData *dat
    it will create source pads, and trigger the “pad-added” signal. At this point
    our callback (this function) will be called.
 
-   The part of the architecture where this is implemented is:
-   +-----source-----+     link      +-----converter-----+       +----resample-~~
-   |   |new_pad|    |-- -- -- -- -- |sink|              |-------|
-   +-----------------               +-------------------+       +-------------~~
-   The link b/w source & converter doesn't exist until this (callback) function
-   is called. And its only called when sources get input data and automatically
-   generates a pad. This generates the signal and triggers this function which
-   grabs the sink pad of 'converter' and only connects with (newly generated pad)
-   of source if its of the type "audio/x-raw".
-  */
-  GstPad *sink_pad = gst_element_get_static_pad (data->convert, "sink");
-  /*
-  Above, we extract the converter element and then retreieve *its* sink pad using
-  `gst_element_get_static_pad` (rememeber, all sink filter-type elements have
-  source and sink pads). We want to link this pad with `new_pad` (later).
-  */
-  GstPadLinkReturn ret;
-  GstCaps *new_pad_caps = NULL;
-  GstStructure *new_pad_struct = NULL;
-  const gchar *new_pad_type = NULL;
-
-  g_print ("Received new pad '%s' from '%s':\n", GST_PAD_NAME (new_pad), GST_ELEMENT_NAME (src));
-
-  // If our converter is already linked, we have nothing to do here
-  /*
-   `uridecodebin` can create as many pads as it seems fit and for each one, this
-   callback will be called. The following lines prevent us from trying to link to
-   a new pad once we are already linked.
-  */
-  if (gst_pad_is_linked (sink_pad)) {
-    g_print ("We are already linked. Ignoring.\n");
-    goto exit;
-  }
-
-  // Check the new_pad's type
-  /*
-  Now we check the type of data this new pad is going to output, since we are
-  only interested in audio output.
-  */
-  new_pad_caps = gst_pad_get_current_caps (new_pad);
-  /*
-  `gst_pad_get_current_caps` retreieves the current capabilities of the pad i.e.,
-  the kind of data it outputs, wrapped in `GstCaps` structure.
-  */
-  new_pad_struct = gst_caps_get_structure (new_pad_caps, 0);
-  /*
-  A pad can offer many caps/capabilities(i.e., type of outputs) and
-  correspondingly, many structures. In our case, we know that our pad only had
-  one cap/output: audio, hence we retreieve the first and only structure using `0`.
-  # If there are no caps on a pad yet, we get NULL.
-  */
-  new_pad_type = gst_structure_get_name (new_pad_struct);
-  /*
-  Retrieve the name of the structure using `gst_structure_get_name` and check
-  (below), if the name is `audio/x-raw`.
-  */
-  if (!g_str_has_prefix (new_pad_type, "audio/x-raw")) {
-    g_print ("It has type '%s' which is not raw audio. Ignoring.\n", new_pad_type);
-    goto exit;
-  }
+   `uridecodebin` can create as many pads as it seems fit (one per stream) and
+   for each one, this callback will be called. Each gets a branch of its own:
+   +-----source-----+     link      +-queue-+     +-converter-+     +-sink-~~
+   |   |new_pad|    |-- -- -- -- -- |sink|  |-----|           |-----|
+   +-----------------               +-------+     +-----------+     +------~~
+   The link b/w source & queue doesn't exist until this (callback) function is
+   called. And its only called when sources get input data and automatically
+   generates a pad.
 
-  // (Otherwise) Attempt the link
-  ret = gst_pad_link (new_pad, sink_pad);
-  /*
-  Similar to `gst_element_link`, `gst_pad_link` also accepts source before sink
-  and both pads must reside in the same bin (note that earlier, we added source
-  to the bin but not into the pipeline).
+   To pick the branch, the router checks the type of data the new pad is going
+   to output: `gst_pad_get_current_caps` retreieves the current capabilities of
+   the pad i.e., the kind of data it outputs, wrapped in a `GstCaps` structure.
+   A pad can offer many caps/capabilities and correspondingly, many structures;
+   the name of the first one (`gst_structure_get_name`, e.g. `audio/x-raw`) is
+   matched against the rules' prefixes. The new pad is then linked to the
+   branch with `gst_pad_link`, which, similar to `gst_element_link`, accepts
+   source before sink; both pads must reside in the same bin.
   */
-  if (GST_PAD_LINK_FAILED (ret)) {
-    g_print ("Type is '%s' but link failed.\n", new_pad_type);
-  } else {
-    g_print ("Link succeeded (type '%s').\n", new_pad_type);
-  }
-
-exit:
-  /* Unreference the new pad's caps, if we got them */
-  if (new_pad_caps != NULL)
-    gst_caps_unref (new_pad_caps);
+  g_print ("Received new pad '%s' from '%s':\n", GST_PAD_NAME (new_pad), GST_ELEMENT_NAME (src));
+  /* Typefinding, demuxer and parser autoplugging happen before this; decoders come later */
+  startup_profile_mark ("autoplug (first pad)");
 
-  /* Unreference the sink pad */
-  gst_object_unref (sink_pad);
+  if (!stream_router_route_pad (data->router, new_pad))
+    g_print ("Pad '%s' was not routed.\n", GST_PAD_NAME (new_pad));
 }
@@ -1,15 +1,19 @@
 /*
-Run: gcc bt4-seeking.c -o bt4-seeking `pkg-config --cflags --libs gstreamer-1.0`
+Build: make bt4-seeking
 
 In this tutorial, we ask the pipeline if seeking is allowed (some sources like
 live streams do not allow) and if yes, once the clip has been running for 10
 seconds (this is a requirement), we can skip to a different position using a seek.
 
 In previous tutorials, once the pipeline was setup & running, our main function
-just sat and waited to receive an ERROR or EOS through the bus. Here, we modify
-this function to periodically wake up and query the pipeline for the stream
-position, so we can print it on the screen. This is similar to a media player
-updating the UI periodically.
+just sat and waited to receive an ERROR or EOS through the bus. Here we want to
+query the pipeline for the stream position periodically, so we can print it on
+the screen. This is similar to a media player updating the UI periodically.
+
+Instead of waking up every 100 ms to poll the bus, we hand the pipeline to the
+event-driven runtime (pipeline-runtime.c): bus messages are dispatched to the
+callbacks we register per message type, and position queries run on a timer
+that only exists while the pipeline is PLAYING.
 
 For sake of similplicity, we use `playbin` as the only element.
 
@@ -20,218 +24,529 @@ We implemented the querying part alongwith message parsing. This is why:
   from the pipelime.
   - So we parse the messages and derive the state and if we find state to be PLAY
   or PAUSE, we query 😎.
+
+Keyframe index (`--index`):
+  With `--index` we first load `<file>.kfidx` (or build it with a fast
+  demux-only scan, see keyframe-index.c, and save it) and snap the seek target
+  to the nearest indexed keyframe before issuing a KEY_UNIT seek to its
+  timestamp. The demuxer still locates the keyframe itself; the snap only means
+  we know where playback resumes and the decoder has no frames to skip.
+  The time from issuing the seek until the pipeline has prerolled again
+  (ASYNC_DONE) is printed; run with and without `--index` to compare.
+
+Scrubbing (`--scrub=N`):
+  A review UI dragging the position slider sends seeks much faster than a
+  pipeline can flush and preroll. We simulate that with N seek requests, one
+  every `--scrub-interval` ms, sweeping from start to end of the file with the
+  pipeline PAUSED. Only one flushing seek is in flight at a time: requests that
+  arrive meanwhile replace each other and only the newest is issued on the next
+  ASYNC_DONE, so the picture follows the slider instead of a growing backlog.
+  The seeks are KEY_UNIT | SNAP_NEAREST, so each one decodes a single keyframe.
+
+Trick-mode playback (`--rate=R`, e.g. 8 or -4):
+  Once playing, we seek with rate R and the TRICKMODE_KEY_UNITS and
+  TRICKMODE_NO_AUDIO flags, so decoders only get keyframes and the audio branch
+  is skipped instead of being decoded and dropped. A negative rate plays
+  backwards from the current position.
+
+Both modes print the frames/s delivered to the video sink and the seek latency
+distribution at the end.
+
+Memory budget (`--memory-budget=MB`):
+  playbin's network buffer and its decodebin multiqueues are sized so the
+  process stays within that RSS (memory-budget.c); 0 only accounts. Queue
+  levels, buffer pools and RSS are printed every second and at the end.
 */
 #include <gst/gst.h>
+#include <math.h>
+
+#include "keyframe-index.h"
+#include "latency-histogram.h"
+#include "memory-budget.h"
+#include "pipeline-runtime.h"
 
 /* Structure to contain all our information, so we can pass it around */
 typedef struct _CustomData {
   GstElement *playbin;  /* Our one and only element */
-  gboolean playing;      /* Are we in the PLAYING state? */
-  gboolean terminate;    /* Should we terminate execution? */
   gboolean seek_enabled; /* Is seeking enabled for this media? */
   gboolean seek_done;    /* Have we performed the seek already? */
-  gint64 duration;       /* How long does this media last, in nanoseconds */
+  KeyframeIndex *index;  /* Keyframes of the media, if --index */
+  guint64 seek_started;  /* When the seek was issued, 0 if none is pending */
+
+  /* Scrub and trick-mode sessions */
+  PipelineRuntime *runtime;
+  gboolean session_started;
+  gint64 duration;
+  GstClockTime pending_target; /* Newest request that arrived during a seek, or NONE */
+  guint requested;       /* Seek requests made by the (synthetic) user */
+  guint issued;          /* ... actually sent to the pipeline */
+  guint coalesced;       /* ... replaced by a newer one before they could be sent */
+  LatencyHistogram seek_latency;
+  gint frames;           /* Buffers that reached the video sink (streaming thread) */
+  guint64 session_start;
+  gboolean pausing;      /* The scrub session waits for PAUSED to preroll */
 } CustomData;
 
-/* Forward definition of the message processing function */
-static void handle_message (CustomData *data, GstMessage *msg);
+/* Forward definition of the callbacks the runtime dispatches to */
+static void handle_state_changed (PipelineRuntime *runtime, GstMessage *msg, CustomData *data);
+static void handle_async_done (PipelineRuntime *runtime, GstMessage *msg, CustomData *data);
+static void handle_eos (PipelineRuntime *runtime, GstMessage *msg, CustomData *data);
+static void handle_position (PipelineRuntime *runtime, gint64 current, gint64 duration, CustomData *data);
+
+static gchar *media = "/home/virus/Desktop/media/sintel_trailer-480p.webm";
+static gboolean use_index = FALSE;
+static gint seek_to = 30;
+static gint scrub = 0;
+static gint scrub_interval = 10;
+static gdouble rate = 1.0;
+static gchar *sink_name = "autovideosink";
+static gint memory_budget = -1;
+
+static GOptionEntry entries[] = {
+  { "media", 'm', 0, G_OPTION_ARG_FILENAME, &media, "Media file to play", "FILE" },
+  { "index", 'i', 0, G_OPTION_ARG_NONE, &use_index, "Seek through a persistent keyframe index", NULL },
+  { "seek-to", 's', 0, G_OPTION_ARG_INT, &seek_to, "Position to seek to once 10 s have played", "SECONDS" },
+  { "scrub", 0, 0, G_OPTION_ARG_INT, &scrub, "Run a scrub session of N seek requests instead", "N" },
+  { "scrub-interval", 0, 0, G_OPTION_ARG_INT, &scrub_interval, "Time between scrub requests (default 10)", "MS" },
+  { "rate", 'r', 0, G_OPTION_ARG_DOUBLE, &rate, "Trick-mode playback rate, e.g. 8 or -4", "R" },
+  { "sink", 0, 0, G_OPTION_ARG_STRING, &sink_name, "Video sink (default autovideosink)", "NAME" },
+  { "memory-budget", 0, 0, G_OPTION_ARG_INT, &memory_budget, "Keep the process within this RSS (0 = only account)", "MB" },
+  { NULL }
+};
+
+/* Loads the sidecar index, building and saving it first if there is none */
+static KeyframeIndex *
+load_or_build_index (const gchar *path)
+{
+  KeyframeIndex *index = keyframe_index_load (path);
+  GError *error = NULL;
+  guint64 start;
+
+  if (index) {
+    g_print ("Loaded %u keyframes from the index.\n", keyframe_index_get_size (index));
+    return index;
+  }
+
+  start = gst_util_get_timestamp ();
+  index = keyframe_index_build (path, &error);
+  if (!index) {
+    g_printerr ("Could not index %s: %s\n", path, error->message);
+    g_clear_error (&error);
+    return NULL;
+  }
+  g_print ("Indexed %u keyframes in %.1f ms.\n", keyframe_index_get_size (index),
+      (gst_util_get_timestamp () - start) / 1e6);
+
+  if (!keyframe_index_save (index, path, &error)) {
+    g_printerr ("Could not save the index: %s\n", error->message);
+    g_clear_error (&error);
+  }
+  return index;
+}
+
+/* Counts what reaches the video sink, i.e. the frames the user actually sees */
+static GstPadProbeReturn count_frame (GstPad *pad, GstPadProbeInfo *info, CustomData *data) {
+  g_atomic_int_inc (&data->frames);
+  return GST_PAD_PROBE_OK;
+}
 
 int main(int argc, char *argv[]) {
   CustomData data;
-  GstBus *bus;
-  GstMessage *msg;
-  GstStateChangeReturn ret;
+  MemoryBudget *memory = NULL;
+  PipelineRuntime *runtime;
+  GstElement *video_sink;
+  GstPad *sink_pad;
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *uri;
 
-  data.playing = FALSE;
-  data.terminate = FALSE;
   data.seek_enabled = FALSE;
   data.seek_done = FALSE;
-  data.duration = GST_CLOCK_TIME_NONE;
+  data.index = NULL;
+  data.seek_started = 0;
+  data.session_started = FALSE;
+  data.duration = -1;
+  data.pending_target = GST_CLOCK_TIME_NONE;
+  data.requested = data.issued = data.coalesced = 0;
+  latency_histogram_reset (&data.seek_latency);
+  data.frames = 0;
+  data.session_start = 0;
+  data.pausing = FALSE;
+
+  context = g_option_context_new ("- seeking tutorial");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  /* A seek with rate 0 is invalid; negative rates play backwards */
+  if (rate == 0.0 || !isfinite (rate)) {
+    g_printerr ("--rate must be a non-zero number (negative plays backwards).\n");
+    return -1;
+  }
 
   /* Initialize GStreamer */
   gst_init (&argc, &argv);
 
+  if (use_index)
+    data.index = load_or_build_index (media);
+
   /* Create the elements */
   data.playbin = gst_element_factory_make ("playbin", "playbin");
 
-  if (!data.playbin) {
+  video_sink = gst_element_factory_make (sink_name, NULL);
+
+  if (!data.playbin || !video_sink) {
     g_printerr ("Not all elements could be created.\n");
     return -1;
   }
 
+  /* Our own video sink, so we can count the frames it receives */
+  sink_pad = gst_element_get_static_pad (video_sink, "sink");
+  gst_pad_add_probe (sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) count_frame, &data, NULL);
+  gst_object_unref (sink_pad);
+  g_object_set (data.playbin, "video-sink", video_sink, NULL);
+
+  /* Scrub and trick-mode sessions replace the single seek at 10 s */
+  if (scrub > 0 || rate != 1.0)
+    data.seek_done = TRUE;
+
   /* Set the URI to play */
-  g_object_set (data.playbin, "uri", "file:///home/virus/Desktop/media/sintel_trailer-480p.webm", NULL);
+  uri = gst_filename_to_uri (media, NULL);
+  g_object_set (data.playbin, "uri", uri, NULL);
+  g_free (uri);
+
+  /*
+   The runtime watches the bus for us. ERROR and EOS are handled by its default
+   handlers (print and stop); we only add what this tutorial cares about:
+    - state changes, to check whether seeking is possible once PLAYING,
+    - a position callback every 100 ms. The runtime only runs that timer while
+      the pipeline is PLAYING and also takes care of querying the duration
+      (again whenever a DURATION_CHANGED message says it changed).
+  */
+  runtime = pipeline_runtime_new (data.playbin);
+  data.runtime = runtime;
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_STATE_CHANGED,
+      (PipelineMessageFunc) handle_state_changed, &data);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_ASYNC_DONE,
+      (PipelineMessageFunc) handle_async_done, &data);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_EOS,
+      (PipelineMessageFunc) handle_eos, &data);
+  pipeline_runtime_set_position_handler (runtime, 100,
+      (PipelinePositionFunc) handle_position, &data);
+
+  if (memory_budget >= 0) {
+    memory = memory_budget_attach (data.playbin, (guint64) memory_budget * 1024 * 1024);
+    memory_budget_export (memory, 1000);
+  }
 
   /* Start playing */
-  ret = gst_element_set_state (data.playbin, GST_STATE_PLAYING);
-  if (ret == GST_STATE_CHANGE_FAILURE) {
+  if (!pipeline_runtime_start (runtime)) {
     g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    if (memory)
+      memory_budget_free (memory);
     gst_object_unref (data.playbin);
     return -1;
   }
 
-  /* Listen to the bus */
-  bus = gst_element_get_bus (data.playbin);
-  do {
-    msg = gst_bus_timed_pop_filtered (bus, 100 * GST_MSECOND,
-        GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_DURATION);
-    /*
-     Previously we did not provide a timeout to `gst_bus_timed_pop_filtered` meaning
-     that it didn't return until a message was received. But this time, we use a
-     100ms timeout so that if no message is received during one tenth of a second
-     or 100ms, the function will return NULL meaning that the stream is still
-     playing. This logic will help us update the UI.
-    */
-
-    // Parse message
-    if (msg != NULL) {
-      handle_message (&data, msg);
-    // Otherwise:
-    } else {
-      /*
-       We got no message, this means the timeout expired and the stream is still
-       playing/pipline is still in `PLAYING` state. This is important to figure
-       as we can only extract stats from the stream as long it is playing.
-      */
-      if (data.playing) {
-        gint64 current = -1;
+  /* Dispatch bus messages and position ticks until ERROR or EOS */
+  pipeline_runtime_run ();
+  if (memory)
+    memory_budget_report (memory);
 
-        /* Query the current position of the stream */
-        if (!gst_element_query_position (data.playbin, GST_FORMAT_TIME, &current)) {
-          g_printerr ("Could not query current position.\n");
-        }
+  /* Free resources */
+  pipeline_runtime_free (runtime);
+  if (memory)
+    memory_budget_free (memory);
+  gst_object_unref (data.playbin);
+  if (data.index)
+    keyframe_index_free (data.index);
+  return 0;
+}
 
-        /* If we didn't know it yet, query the stream duration */
-        if (!GST_CLOCK_TIME_IS_VALID (data.duration)) {
-          if (!gst_element_query_duration (data.playbin, GST_FORMAT_TIME, &data.duration)) {
-            g_printerr ("Could not query current duration.\n");
-          }
-        }
+/*
+ Seeks through the keyframe index: snap to the closest keyframe and seek to its
+ timestamp, so the decoder has nothing to skip. The demuxer still searches for
+ that time as for any other.
+*/
+static gboolean seek_indexed (CustomData *data, GstClockTime target, gboolean verbose) {
+  const KeyframeEntry *keyframe = keyframe_index_lookup (data->index, target);
 
-        /* Print current position and total duration */
-        g_print ("Position %" GST_TIME_FORMAT " / %" GST_TIME_FORMAT "\r",
-            GST_TIME_ARGS (current), GST_TIME_ARGS (data.duration));
+  if (!keyframe)
+    return FALSE;
 
-        /* If seeking is enabled, we have not done it yet, and the time is right, seek */
-        if (data.seek_enabled && !data.seek_done && current > 10 * GST_SECOND) {
-          g_print ("\nReached 10s, performing seek...\n");
-          gst_element_seek_simple (data.playbin, GST_FORMAT_TIME,
-              GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, 30 * GST_SECOND);
-          data.seek_done = TRUE;
-        /*
-         A lot of intricacies are hidden behind this function. Lets look the params:
-          - GST_SEEK_FLAG_FLUSH: It discards all data currently in the pipeline
-            before doing the seek. It might pause a bit while the pipeline is
-            refilled and the new data starts to show up but greatly increases the
-            responsiveness of the app. If not provided, stale data might show up
-            for a while until the new position appears at the end of pipeline.
-          - GST_SEEK_FLAG_KEY_UNIT: With most encoded video streams, seeking to
-            arbitrary positions is not possible but only to certain frames called:
-            'Key Frames'. When this flag is used, the seek will move to the closest
-            key frame and start producing data *straight away*. If not used, the
-            pipeline will move (internally) to the closest key frame and data will
-            be show ONLY when it reaches the requested position. The latter is
-            more accurate but might take longer.
-          - GST_SEEK_FLAG_ACCURATE: Some media clips do not provide enough indexing
-            information, meaning that seeking to arbitrary positions is time
-            consuming. In such cases, GStreamer usually estimates the position to
-            seek to and usually works just fine. If more precision is needed, then
-            we provide this flag, which may also be time-consuming.
-          `30 * GST_SECOND` is the time we wish to seek to.
-        */
-        }
-      }
-    }
-  } while (!data.terminate);
+  if (verbose)
+    g_print ("Snapped %" GST_TIME_FORMAT " to keyframe %" GST_TIME_FORMAT "\n",
+        GST_TIME_ARGS (target), GST_TIME_ARGS (keyframe->timestamp));
+  return gst_element_seek_simple (data->playbin, GST_FORMAT_TIME,
+      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, keyframe->timestamp);
+}
 
-  /* Free resources */
-  gst_object_unref (bus);
-  gst_element_set_state (data.playbin, GST_STATE_NULL);
-  gst_object_unref (data.playbin);
-  return 0;
+/*
+ Called every 100 ms while the pipeline is PLAYING. This is important as we can
+ only extract stats from the stream as long as it is playing.
+*/
+static void handle_position (PipelineRuntime *runtime, gint64 current, gint64 duration, CustomData *data) {
+  if (current < 0) {
+    g_printerr ("Could not query current position.\n");
+  }
+  if (duration < 0) {
+    g_printerr ("Could not query current duration.\n");
+  }
+
+  /* Print current position and total duration */
+  g_print ("Position %" GST_TIME_FORMAT " / %" GST_TIME_FORMAT "\r",
+      GST_TIME_ARGS (current), GST_TIME_ARGS (duration));
+
+  /* If seeking is enabled, we have not done it yet, and the time is right, seek */
+  if (data->seek_enabled && !data->seek_done && current > 10 * GST_SECOND) {
+    g_print ("\nReached 10s, performing seek...\n");
+    data->seek_started = gst_util_get_timestamp ();
+    if (!data->index || !seek_indexed (data, seek_to * GST_SECOND, TRUE))
+      gst_element_seek_simple (data->playbin, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, seek_to * GST_SECOND);
+    data->seek_done = TRUE;
+  /*
+   A lot of intricacies are hidden behind this function. Lets look the params:
+    - GST_SEEK_FLAG_FLUSH: It discards all data currently in the pipeline
+      before doing the seek. It might pause a bit while the pipeline is
+      refilled and the new data starts to show up but greatly increases the
+      responsiveness of the app. If not provided, stale data might show up
+      for a while until the new position appears at the end of pipeline.
+    - GST_SEEK_FLAG_KEY_UNIT: With most encoded video streams, seeking to
+      arbitrary positions is not possible but only to certain frames called:
+      'Key Frames'. When this flag is used, the seek will move to the closest
+      key frame and start producing data *straight away*. If not used, the
+      pipeline will move (internally) to the closest key frame and data will
+      be show ONLY when it reaches the requested position. The latter is
+      more accurate but might take longer.
+    - GST_SEEK_FLAG_ACCURATE: Some media clips do not provide enough indexing
+      information, meaning that seeking to arbitrary positions is time
+      consuming. In such cases, GStreamer usually estimates the position to
+      seek to and usually works just fine. If more precision is needed, then
+      we provide this flag, which may also be time-consuming.
+    `seek_to * GST_SECOND` (30 s by default) is the time we wish to seek to.
+  */
+  }
 }
 
-// Had to give the error-handling part a function of its own, as it has grown
-static void handle_message (CustomData *data, GstMessage *msg) {
-  GError *err;
-  gchar *debug_info;
-
-  switch (GST_MESSAGE_TYPE (msg)) {
-    case GST_MESSAGE_ERROR:
-      gst_message_parse_error (msg, &err, &debug_info);
-      g_printerr ("Error received from element %s: %s\n", GST_OBJECT_NAME (msg->src), err->message);
-      g_printerr ("Debugging information: %s\n", debug_info ? debug_info : "none");
-      g_clear_error (&err);
-      g_free (debug_info);
-      data->terminate = TRUE;
-      break;
-    case GST_MESSAGE_EOS:
-      g_print ("\nEnd-Of-Stream reached.\n");
-      data->terminate = TRUE;
-      break;
-    case GST_MESSAGE_DURATION:
-      /*
-       The duration has changed, mark the current one as invalid. This message is
-       posted whenever the duration of the stream changes. We mark it invalid here
-       so it gets re-queried.
-      */
-      data->duration = GST_CLOCK_TIME_NONE;
-      break;
-    case GST_MESSAGE_STATE_CHANGED: {
+/* Sends one scrub seek; the next one waits for its ASYNC_DONE */
+static void issue_scrub_seek (CustomData *data, GstClockTime target) {
+  gboolean ok;
+
+  data->seek_started = gst_util_get_timestamp ();
+  if (data->index)
+    ok = seek_indexed (data, target, FALSE);
+  else
+    ok = gst_element_seek_simple (data->playbin, GST_FORMAT_TIME,
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST, target);
+  if (ok)
+    data->issued++;
+  else
+    data->seek_started = 0;
+}
+
+/*
+ What a slider would call on every motion event. If a seek is still flushing,
+ the request only replaces the pending target: seeking to positions the user has
+ already dragged past would just delay the one they are looking for.
+*/
+static void request_scrub_seek (CustomData *data, GstClockTime target) {
+  data->requested++;
+  if (data->seek_started != 0) {
+    if (GST_CLOCK_TIME_IS_VALID (data->pending_target))
+      data->coalesced++;
+    data->pending_target = target;
+    return;
+  }
+  issue_scrub_seek (data, target);
+}
+
+static void print_session_summary (CustomData *data) {
+  gdouble elapsed = (gst_util_get_timestamp () - data->session_start) / 1e9;
+  gint frames = g_atomic_int_get (&data->frames);
+
+  if (scrub > 0)
+    g_print ("\nScrub: %u requests, %u seeks issued, %u coalesced\n",
+        data->requested, data->issued, data->coalesced);
+  else
+    g_print ("\nTrick mode at rate %.2f\n", rate);
+  g_print ("Frames: %d in %.2f s (%.1f frames/s)\n", frames, elapsed,
+      elapsed > 0 ? frames / elapsed : 0.0);
+  if (data->seek_latency.count > 0)
+    g_print ("Seek latency: p50 %.1f ms, p99 %.1f ms, max %.1f ms (%s)\n",
+        latency_histogram_percentile (&data->seek_latency, 50) / 1e6,
+        latency_histogram_percentile (&data->seek_latency, 99) / 1e6,
+        data->seek_latency.max / 1e6, data->index ? "keyframe index" : "no index");
+}
+
+/* Synthetic drag from start to end of the file, one request per tick */
+static gboolean scrub_tick (CustomData *data) {
+  request_scrub_seek (data, gst_util_uint64_scale (data->duration, data->requested, scrub));
+  if (data->requested < (guint) scrub)
+    return G_SOURCE_CONTINUE;
+
+  /* Normally the last ASYNC_DONE ends the session, unless no seek is left in flight */
+  if (data->seek_started == 0) {
+    print_session_summary (data);
+    pipeline_runtime_stop (data->runtime);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void start_scrub_requests (CustomData *data) {
+  g_atomic_int_set (&data->frames, 0);
+  data->session_start = gst_util_get_timestamp ();
+  g_timeout_add (scrub_interval, (GSourceFunc) scrub_tick, data);
+}
+
+/* Scrubbing happens PAUSED, like a player whose slider is being dragged */
+static void start_scrub_session (PipelineRuntime *runtime, CustomData *data) {
+  if (!gst_element_query_duration (data->playbin, GST_FORMAT_TIME, &data->duration) ||
+      data->duration <= 0) {
+    g_printerr ("Unknown duration, cannot scrub.\n");
+    pipeline_runtime_stop (runtime);
+    return;
+  }
+  g_print ("Scrubbing with %d requests, one every %d ms...\n", scrub, scrub_interval);
+  /* Going to PAUSED prerolls and posts an ASYNC_DONE of its own, which must
+     not be taken for the first seek's: the requests start after it */
+  if (gst_element_set_state (data->playbin, GST_STATE_PAUSED) == GST_STATE_CHANGE_ASYNC)
+    data->pausing = TRUE;
+  else
+    start_scrub_requests (data);
+}
+
+/*
+ Rate-changing seek from the current position. With TRICKMODE_KEY_UNITS the
+ demuxer and decoder skip everything but keyframes, and TRICKMODE_NO_AUDIO lets
+ the audio branch drop out instead of decoding audio nobody hears at 8x.
+ Playing backwards means a segment that ends where we are now.
+*/
+static void start_trick_mode (CustomData *data) {
+  GstSeekFlags flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_TRICKMODE |
+      GST_SEEK_FLAG_TRICKMODE_KEY_UNITS | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
+  gint64 position;
+  gboolean ok;
+
+  if (!gst_element_query_position (data->playbin, GST_FORMAT_TIME, &position))
+    position = 0;
+
+  g_print ("Trick mode: rate %.2f from %" GST_TIME_FORMAT "\n", rate, GST_TIME_ARGS (position));
+  g_atomic_int_set (&data->frames, 0);
+  data->session_start = data->seek_started = gst_util_get_timestamp ();
+  if (rate > 0)
+    ok = gst_element_seek (data->playbin, rate, GST_FORMAT_TIME, flags,
+        GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+  else
+    ok = gst_element_seek (data->playbin, rate, GST_FORMAT_TIME, flags,
+        GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_SET, position);
+  if (!ok) {
+    g_printerr ("Rate seek failed.\n");
+    data->seek_started = 0;
+  }
+}
+
+/* A flushing seek ends with the pipeline prerolling again, which posts ASYNC_DONE */
+static void handle_async_done (PipelineRuntime *runtime, GstMessage *msg, CustomData *data) {
+  guint64 latency;
+
+  if (data->pausing) {
+    data->pausing = FALSE;
+    start_scrub_requests (data);
+    return;
+  }
+  if (data->seek_started == 0)
+    return;
+
+  latency = gst_util_get_timestamp () - data->seek_started;
+  latency_histogram_record (&data->seek_latency, latency);
+  data->seek_started = 0;
+
+  if (scrub == 0) {
+    g_print ("Seek latency: %.1f ms (%s)\n", latency / 1e6,
+        data->index ? "keyframe index" : "no index");
+    return;
+  }
+
+  /* Only now is the newest request worth sending */
+  if (GST_CLOCK_TIME_IS_VALID (data->pending_target)) {
+    GstClockTime target = data->pending_target;
+
+    data->pending_target = GST_CLOCK_TIME_NONE;
+    issue_scrub_seek (data, target);
+  } else if (data->requested >= (guint) scrub) {
+    print_session_summary (data);
+    pipeline_runtime_stop (runtime);
+  }
+}
+
+static void handle_eos (PipelineRuntime *runtime, GstMessage *msg, CustomData *data) {
+  if (rate != 1.0 && data->session_started)
+    print_session_summary (data);
+  pipeline_runtime_handle_eos (runtime, msg, NULL);
+}
+
+// The state-change part of the old message switch; ERROR and EOS are the runtime's defaults
+static void handle_state_changed (PipelineRuntime *runtime, GstMessage *msg, CustomData *data) {
+  /*
+   Seeks and time queries generally only get a valid reply when in the
+   PAUSED or PLAYING state, since all elements have had a chance to receive
+   information and configure themselves. The runtime tracks this for us
+   (`pipeline_runtime_is_playing`) and only queries the position while PLAYING.
+  */
+  GstState old_state, new_state, pending_state;
+  gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
+  if (GST_MESSAGE_SRC (msg) == GST_OBJECT (data->playbin)) {
+    g_print ("Pipeline state changed from %s to %s:\n",
+        gst_element_state_get_name (old_state), gst_element_state_get_name (new_state));
+
+    if (pipeline_runtime_is_playing (runtime)) {
+      /* We just moved to PLAYING. Check if seeking is possible */
+      GstQuery *query;
+      gint64 start, end;
+      query = gst_query_new_seeking (GST_FORMAT_TIME);
       /*
-       Seeks and time queries generally only get a valid reply when in the
-       PAUSED or PLAYING state, since all elements have had a chance to receive
-       information and configure themselves. We track this using `data->playing`.
+       `gst_query_new_seeking()` creates a new object of the "seeking" type,
+       with GST_FORMAT_TIME format. This indicates that we are interested in
+       seeking by specifying the new time to which we want to move. We could
+       also ask for GST_FORMAT_BYTES and then seek to a particular byte
+       position but this is normally less useful.
+
+       This query object is then passed to the pipeline with `gst_element_query`
+       and the result is stored *in the same query* and retreieved using
+       `gst_query_parse_seeking`.
       */
-      GstState old_state, new_state, pending_state;
-      gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
-      if (GST_MESSAGE_SRC (msg) == GST_OBJECT (data->playbin)) {
-        g_print ("Pipeline state changed from %s to %s:\n",
-            gst_element_state_get_name (old_state), gst_element_state_get_name (new_state));
-
-        /* Remember whether we are in the PLAYING state or not */
-        data->playing = (new_state == GST_STATE_PLAYING);
-
-        if (data->playing) {
-          /* We just moved to PLAYING. Check if seeking is possible */
-          GstQuery *query;
-          gint64 start, end;
-          query = gst_query_new_seeking (GST_FORMAT_TIME);
-          /*
-           `gst_query_new_seeking()` creates a new object of the "seeking" type,
-           with GST_FORMAT_TIME format. This indicates that we are interested in
-           seeking by specifying the new time to which we want to move. We could
-           also ask for GST_FORMAT_BYTES and then seek to a particular byte
-           position but this is normally less useful.
-
-           This query object is then passed to the pipeline with `gst_element_query`
-           and the result is stored *in the same query* and retreieved using
-           `gst_query_parse_seeking`.
-          */
-          if (gst_element_query (data->playbin, query)) {
-            gst_query_parse_seeking (query, NULL, &data->seek_enabled, &start, &end);
-            /*
-             `gst_query_parse_seeking` extracts a boolean indicating whether
-             seeking is allowed and the range in which its possible.
-            */
-            if (data->seek_enabled) {
-              g_print ("Seeking is ENABLED from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT "\n",
-                  GST_TIME_ARGS (start), GST_TIME_ARGS (end));
-            } else {
-              g_print ("Seeking is DISABLED for this stream.\n");
-            }
-          }
-          else {
-            g_printerr ("Seeking query failed.");
+      if (gst_element_query (data->playbin, query)) {
+        gst_query_parse_seeking (query, NULL, &data->seek_enabled, &start, &end);
+        /*
+         `gst_query_parse_seeking` extracts a boolean indicating whether
+         seeking is allowed and the range in which its possible.
+        */
+        if (data->seek_enabled) {
+          g_print ("Seeking is ENABLED from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT "\n",
+              GST_TIME_ARGS (start), GST_TIME_ARGS (end));
+
+          if (!data->session_started && (scrub > 0 || rate != 1.0)) {
+            data->session_started = TRUE;
+            if (scrub > 0)
+              start_scrub_session (runtime, data);
+            else
+              start_trick_mode (data);
           }
-          gst_query_unref (query);
+        } else {
+          g_print ("Seeking is DISABLED for this stream.\n");
         }
       }
-    } break;
-    default:
-      /* We should not reach here */
-      g_printerr ("Unexpected message received.\n");
-      break;
+      else {
+        g_printerr ("Seeking query failed.");
+      }
+      gst_query_unref (query);
+    }
   }
-  gst_message_unref (msg);
 }
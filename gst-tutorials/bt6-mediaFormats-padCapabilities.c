@@ -1,5 +1,16 @@
 /*
-Run: gcc bt6-mediaFormats-padCapabilities.c -o bt6 `pkg-config --cflags --libs gstreamer-1.0`
+Build: make bt6-mediaFormats-padCapabilities
+
+Usage:
+  ./bt6-mediaFormats-padCapabilities               # print caps on every state change
+  ./bt6-mediaFormats-padCapabilities --profile-caps --num-buffers=100
+                                                   # count negotiation work per pad
+  ./bt6-mediaFormats-padCapabilities --profile-caps --num-buffers=100 --pin-caps=bt6.pins
+                                                   # first run records, later runs reuse
+  ./bt6-mediaFormats-padCapabilities --audio-preset=lowest-latency --num-buffers=500
+                                                   # tuned audio chain, latency and CPU
+  ./bt6-mediaFormats-padCapabilities --find-elements --num-buffers=10
+                                                   # what else could take the source's caps
 
 Pads allow information to enter and leave an element. The caps/capabilities of a
 pad specify what kind of information can travel through the pad, for e.g., 30fps,
@@ -19,11 +30,44 @@ links them and sets the pipeline to play.
 On each stage change, the caps of the *sink element's pad* are shown, so we can
 observe how the negotiation proceeds until the pad caps are fixed.
 
-This app doesn't terminate as we have taken no action when `msg == NULL` i.e.,
-when timeout occurs.
+The bus is watched by the event-driven runtime (pipeline-runtime.c): we only
+register a handler for state changes, ERROR and EOS use the runtime's defaults.
+This app doesn't terminate on its own, since `audiotestsrc` never sends EOS,
+unless `--num-buffers` is given.
+
+Negotiation profiling:
+  `--profile-caps` (caps-profiler.c) counts, for every pad, the CAPS and
+  ACCEPT_CAPS queries it answered and how long they took, the CAPS events it
+  saw (every one after the first is a renegotiation) and the RECONFIGURE
+  events that triggered them, and prints the table when the pipeline stops.
+  `--pin-caps=FILE` records the caps the run ended up with in FILE. When FILE
+  already exists, the source is linked to the sink through a capsfilter with
+  the pinned caps instead, so there is a single fixed candidate to agree on;
+  compare the query counts of both runs.
+
+Audio presets:
+  `--audio-preset=NAME` (audio-preset.c) puts a converter/resampler chain
+  between the source and the sink, tuned together with the sink's buffering
+  for lowest-latency, balanced or highest-quality, and reports at the end
+  the end-to-end latency (chain plus the sink's ring buffer) and the CPU the
+  chain took per second of audio. The pinned caps, if any, then apply to the
+  link from the source to the chain.
+
+Caps index:
+  `--find-elements` looks the caps the source negotiated up in the caps
+  index (caps-index.c): the pad templates of every installed converter,
+  decoder, demuxer, parser and sink, walked once like above and kept in the
+  user's cache directory. It prints the elements that could have been
+  linked to the source instead of `autoaudiosink`, best ranked first, and
+  how long the lookup took.
 */
 #include <gst/gst.h>
 
+#include "audio-preset.h"
+#include "caps-index.h"
+#include "caps-profiler.h"
+#include "pipeline-runtime.h"
+
 /* Functions below print the Capabilities in a human-friendly format */
 static gboolean print_field (GQuark field, const GValue * value, gpointer pfx) {
   gchar *str = gst_value_serialize (value);
@@ -132,13 +176,97 @@ static void print_pad_capabilities (GstElement *element, gchar *pad_name) {
   gst_object_unref (pad);
 }
 
+/* Looks the caps of `element`'s `pad_name` up in the caps index */
+static void print_compatible_elements (GstElement *element, const gchar *pad_name) {
+  GstPad *pad = gst_element_get_static_pad (element, pad_name);
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  gchar *path = caps_index_default_path ();
+  CapsIndex *index = caps_index_open (path);
+  GPtrArray *matches;
+  guint64 start;
+  guint i;
+
+  gst_object_unref (pad);
+  if (!caps) {
+    g_print ("No caps were negotiated on the %s pad.\n", pad_name);
+    caps_index_free (index);
+    g_free (path);
+    return;
+  }
+
+  start = gst_util_get_timestamp ();
+  matches = caps_index_lookup (index, caps, CAPS_INDEX_ANY_KIND);
+  g_print ("\nElements that can take the %s pad's caps (%.1f us, index in %s):\n", pad_name,
+      (gst_util_get_timestamp () - start) / 1e3, path);
+  for (i = 0; i < matches->len; i++) {
+    CapsIndexEntry *entry = g_ptr_array_index (matches, i);
+
+    g_print ("  %-24s %-10s rank %u\n", entry->factory, caps_index_kind_name (entry->kind),
+        entry->rank);
+  }
+
+  g_ptr_array_unref (matches);
+  gst_caps_unref (caps);
+  caps_index_free (index);
+  g_free (path);
+}
+
+/*
+ We are only interested in state-changed messages from the pipeline. This
+ simply prints the current Pad caps every time the state of the pipeline
+ changes.
+*/
+static void handle_state_changed (PipelineRuntime *runtime, GstMessage *msg, GstElement *sink) {
+  if (GST_MESSAGE_SRC (msg) == GST_OBJECT (pipeline_runtime_get_pipeline (runtime))) {
+    GstState old_state, new_state, pending_state;
+    gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
+    g_print ("\nPipeline state changed from %s to %s:\n",
+        gst_element_state_get_name (old_state), gst_element_state_get_name (new_state));
+    /* Print the current capabilities of the sink element */
+    print_pad_capabilities (sink, "sink");
+  }
+}
+
+static gboolean profile_caps = FALSE;
+static gchar *pin_caps = NULL;
+static gint num_buffers = -1;
+static gchar *audio_preset = NULL;
+static gboolean find_elements = FALSE;
+
+static GOptionEntry entries[] = {
+  { "profile-caps", 'c', 0, G_OPTION_ARG_NONE, &profile_caps, "Count caps queries and renegotiations per pad", NULL },
+  { "pin-caps", 0, 0, G_OPTION_ARG_FILENAME, &pin_caps, "Link with the caps pinned in FILE, or record them there", "FILE" },
+  { "num-buffers", 'n', 0, G_OPTION_ARG_INT, &num_buffers, "Stop after N buffers (default: never)", "N" },
+  { "audio-preset", 'a', 0, G_OPTION_ARG_STRING, &audio_preset, "Audio chain preset: lowest-latency, balanced or highest-quality", "NAME" },
+  { "find-elements", 'f', 0, G_OPTION_ARG_NONE, &find_elements, "List the elements that can take the source's caps", NULL },
+  { NULL }
+};
+
 int main(int argc, char *argv[]) {
-  GstElement *pipeline, *source, *sink;
+  GstElement *pipeline, *source, *sink, *chain = NULL;
   GstElementFactory *source_factory, *sink_factory;
-  GstBus *bus;
-  GstMessage *msg;
-  GstStateChangeReturn ret;
-  gboolean terminate = FALSE;
+  PipelineRuntime *runtime;
+  CapsProfiler *profiler = NULL;
+  const AudioPreset *preset = NULL;
+  AudioPresetChain *audio = NULL;
+  GstCaps *pinned = NULL;
+  GOptionContext *context;
+  GError *error = NULL;
+  gboolean linked, use_pins = FALSE;
+
+  context = g_option_context_new ("- pad capabilities tutorial");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
+  if (audio_preset && !(preset = audio_preset_find (audio_preset))) {
+    g_printerr ("Unknown audio preset %s (one of %s).\n", audio_preset, audio_preset_names ());
+    return -1;
+  }
 
   /* Initialize GStreamer */
   gst_init (&argc, &argv);
@@ -182,75 +310,90 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
+  g_object_set (source, "num-buffers", num_buffers, NULL);
+
+  /* The preset's chain goes in a bin of its own, between the two */
+  if (preset) {
+    gchar *description = audio_preset_branch (preset, NULL);
+
+    chain = gst_parse_bin_from_description (description, TRUE, &error);
+    g_free (description);
+    if (!chain) {
+      g_printerr ("Could not build the audio chain: %s\n", error->message);
+      g_clear_error (&error);
+      gst_object_unref (pipeline);
+      return -1;
+    }
+  }
+
   /* Build the pipeline */
   gst_bin_add_many (GST_BIN (pipeline), source, sink, NULL);
-  if (gst_element_link (source, sink) != TRUE) {
+  if (chain)
+    gst_bin_add (GST_BIN (pipeline), chain);
+  if (pin_caps)
+    pinned = caps_profiler_load_pin (pin_caps, "source", "src");
+  if (pinned) {
+    /* gst_element_link_filtered puts a capsfilter between the two */
+    use_pins = TRUE;
+    g_print ("Using the caps pinned in %s\n", pin_caps);
+    linked = gst_element_link_filtered (source, chain ? chain : sink, pinned);
+    gst_caps_unref (pinned);
+  } else {
+    linked = gst_element_link (source, chain ? chain : sink);
+  }
+  if (linked && chain)
+    linked = gst_element_link (chain, sink);
+  if (linked != TRUE) {
     g_printerr ("Elements could not be linked.\n");
     gst_object_unref (pipeline);
     return -1;
   }
 
+  /* Attach after linking: only negotiation is of interest, not link-time checks */
+  if (profile_caps)
+    profiler = caps_profiler_attach (pipeline);
+  if (preset)
+    audio = audio_preset_attach (pipeline, preset);
+
   /* Print initial negotiated caps (in NULL state) */
   g_print ("In NULL state:\n");
   print_pad_capabilities (sink, "sink");
 
+  /* Watch the bus: state changes are ours, ERROR and EOS the runtime's defaults */
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_STATE_CHANGED,
+      (PipelineMessageFunc) handle_state_changed, sink);
+
   /* Start playing */
-  ret = gst_element_set_state (pipeline, GST_STATE_PLAYING);
-  if (ret == GST_STATE_CHANGE_FAILURE) {
+  if (!pipeline_runtime_start (runtime)) {
     g_printerr ("Unable to set the pipeline to the playing state (check the bus for error messages).\n");
   }
 
-  /* Wait until error, EOS or State Change */
-  bus = gst_element_get_bus (pipeline);
-  do {
-    msg = gst_bus_timed_pop_filtered (bus, 100 * GST_MSECOND,
-        GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_DURATION);
-
-    /* Parse message */
-    if (msg != NULL) {
-      GError *err;
-      gchar *debug_info;
-
-      switch (GST_MESSAGE_TYPE (msg)) {
-        case GST_MESSAGE_ERROR:
-          gst_message_parse_error (msg, &err, &debug_info);
-          g_printerr ("Error received from element %s: %s\n", GST_OBJECT_NAME (msg->src), err->message);
-          g_printerr ("Debugging information: %s\n", debug_info ? debug_info : "none");
-          g_clear_error (&err);
-          g_free (debug_info);
-          terminate = TRUE;
-          break;
-        case GST_MESSAGE_EOS:
-          g_print ("End-Of-Stream reached.\n");
-          terminate = TRUE;
-          break;
-        case GST_MESSAGE_STATE_CHANGED:
-          /*
-           We are only interested in state-changed messages from the pipeline.
-           This simply prints the current Pad caps every time the state of the
-           pipeline changes.
-          */
-          if (GST_MESSAGE_SRC (msg) == GST_OBJECT (pipeline)) {
-            GstState old_state, new_state, pending_state;
-            gst_message_parse_state_changed (msg, &old_state, &new_state, &pending_state);
-            g_print ("\nPipeline state changed from %s to %s:\n",
-                gst_element_state_get_name (old_state), gst_element_state_get_name (new_state));
-            /* Print the current capabilities of the sink element */
-            print_pad_capabilities (sink, "sink");
-          }
-          break;
-        default:
-          /* We should not reach here because we only asked for ERRORs, EOS and STATE_CHANGED */
-          g_printerr ("Unexpected message received.\n");
-          break;
-      }
-      gst_message_unref (msg);
+  /* Wait until error or EOS, printing the caps on every state change */
+  pipeline_runtime_run ();
+
+  if (profiler)
+    caps_profiler_dump (profiler);
+  if (audio)
+    audio_preset_report (audio);
+  if (find_elements)
+    print_compatible_elements (source, "src");
+  /* Record pins only when none were used, so a pinned file is never rewritten */
+  if (pin_caps && !use_pins) {
+    CapsProfiler *pins = profiler ? profiler : caps_profiler_attach (pipeline);
+
+    if (caps_profiler_save_pins (pins, pin_caps, &error))
+      g_print ("Pinned the negotiated caps in %s\n", pin_caps);
+    else {
+      g_printerr ("Could not pin caps: %s\n", error->message);
+      g_clear_error (&error);
     }
-  } while (!terminate);
+  }
 
   /* Free resources */
-  gst_object_unref (bus);
-  gst_element_set_state (pipeline, GST_STATE_NULL);
+  pipeline_runtime_free (runtime);
+  if (audio)
+    audio_preset_free (audio);
   gst_object_unref (pipeline);
   gst_object_unref (source_factory);
   gst_object_unref (sink_factory);
@@ -0,0 +1,278 @@
+#include "camera-array.h"
+
+#include <stdlib.h>
+
+#define DEFAULT_QUEUE_SIZE 2
+#define DEFAULT_MAX_LATENESS (20 * GST_MSECOND)   /* what the video sinks default to */
+
+typedef struct _Camera {
+  gchar *name;
+  GstElement *bin;
+  GstElement *queue;
+  GstElement *sink;
+
+  /* Written from the streaming threads, read from the main loop */
+  gint captured;              /* left the source */
+  gint delivered;             /* left the queue */
+  gint64 first;               /* g_get_monotonic_time () of the first/last capture */
+  gint64 last;
+
+  /* Main loop only */
+  guint64 late;               /* dropped by the sink, from its QoS messages */
+  gint reported_captured;
+  guint64 reported_rendered;
+} Camera;
+
+struct _CameraArray {
+  GstElement *pipeline;       /* not a ref */
+  GPtrArray *cameras;
+  gint64 reported;            /* g_get_monotonic_time () of the previous report */
+};
+
+gboolean
+camera_config_parse (const gchar *spec, CameraConfig *config, GError **error)
+{
+  gchar **fields = g_strsplit (spec, ",", -1);
+  gboolean ret = TRUE;
+  guint i;
+
+  config->device = g_strcmp0 (fields[0], "test") == 0 ? NULL : g_strdup (fields[0]);
+  config->queue_size = DEFAULT_QUEUE_SIZE;
+  config->leaky = TRUE;
+  config->max_lateness = DEFAULT_MAX_LATENESS;
+
+  for (i = 1; fields[i] && ret; i++) {
+    gchar **pair = g_strsplit (fields[i], "=", 2);
+
+    if (!pair[1]) {
+      ret = FALSE;
+    } else if (g_str_equal (pair[0], "queue")) {
+      config->queue_size = MAX (1, atoi (pair[1]));
+    } else if (g_str_equal (pair[0], "leaky")) {
+      config->leaky = g_str_equal (pair[1], "yes") || g_str_equal (pair[1], "true");
+    } else if (g_str_equal (pair[0], "max-lateness")) {
+      if (g_str_equal (pair[1], "none"))
+        config->max_lateness = -1;
+      else
+        config->max_lateness = g_ascii_strtoll (pair[1], NULL, 10) * GST_MSECOND;
+    } else {
+      ret = FALSE;
+    }
+    if (!ret)
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+          "Bad camera option '%s' in '%s' (expected queue=N, leaky=yes|no or max-lateness=MS|none)",
+          fields[i], spec);
+    g_strfreev (pair);
+  }
+
+  g_strfreev (fields);
+  if (!ret)
+    camera_config_clear (config);
+  return ret;
+}
+
+void
+camera_config_clear (CameraConfig *config)
+{
+  g_clear_pointer (&config->device, g_free);
+}
+
+static void
+camera_free (Camera *camera)
+{
+  gst_object_unref (camera->queue);
+  gst_object_unref (camera->sink);
+  g_free (camera->name);
+  g_free (camera);
+}
+
+CameraArray *
+camera_array_new (GstElement *pipeline)
+{
+  CameraArray *array = g_new0 (CameraArray, 1);
+
+  array->pipeline = pipeline;
+  array->cameras = g_ptr_array_new_with_free_func ((GDestroyNotify) camera_free);
+  array->reported = g_get_monotonic_time ();
+  return array;
+}
+
+void
+camera_array_free (CameraArray *array)
+{
+  g_ptr_array_unref (array->cameras);
+  g_free (array);
+}
+
+/* On the camera's source thread */
+static GstPadProbeReturn
+capture_probe (GstPad *pad, GstPadProbeInfo *info, Camera *camera)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (g_atomic_int_add (&camera->captured, 1) == 0)
+    camera->first = now;
+  camera->last = now;
+  return GST_PAD_PROBE_OK;
+}
+
+/* On the camera's queue thread */
+static GstPadProbeReturn
+deliver_probe (GstPad *pad, GstPadProbeInfo *info, Camera *camera)
+{
+  g_atomic_int_inc (&camera->delivered);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+add_probe (GstElement *bin, const gchar *element, const gchar *pad_name,
+    GstPadProbeCallback callback, Camera *camera)
+{
+  GstElement *child = gst_bin_get_by_name (GST_BIN (bin), element);
+  GstPad *pad = gst_element_get_static_pad (child, pad_name);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, callback, camera, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (child);
+}
+
+gboolean
+camera_array_add (CameraArray *array, const CameraConfig *config,
+    const gchar *sink_name, GstCaps *caps, gint num_buffers)
+{
+  Camera *camera;
+  GstElement *bin, *filter;
+  GError *error = NULL;
+  gchar *source, *description;
+
+  if (config->device)
+    source = g_strdup_printf ("v4l2src device=\"%s\"", config->device);
+  else
+    source = g_strdup ("videotestsrc is-live=true");
+  description = g_strdup_printf ("%s name=source num-buffers=%d ! capsfilter name=caps ! "
+      "queue name=queue max-size-buffers=%u max-size-bytes=0 max-size-time=0 ! "
+      "videoconvert ! %s name=sink", source, num_buffers, config->queue_size, sink_name);
+  g_free (source);
+
+  bin = gst_parse_bin_from_description (description, FALSE, &error);
+  g_free (description);
+  if (!bin) {
+    g_printerr ("Could not build the branch for %s: %s\n",
+        config->device ? config->device : "test", error->message);
+    g_clear_error (&error);
+    return FALSE;
+  }
+
+  camera = g_new0 (Camera, 1);
+  camera->bin = bin;
+  camera->queue = gst_bin_get_by_name (GST_BIN (bin), "queue");
+  camera->sink = gst_bin_get_by_name (GST_BIN (bin), "sink");
+  if (config->device)
+    camera->name = g_path_get_basename (config->device);
+  else
+    camera->name = g_strdup_printf ("test%u", array->cameras->len);
+  gst_object_set_name (GST_OBJECT (bin), camera->name);
+
+  if (caps) {
+    filter = gst_bin_get_by_name (GST_BIN (bin), "caps");
+    g_object_set (filter, "caps", caps, NULL);
+    gst_object_unref (filter);
+  }
+  if (config->leaky)
+    gst_util_set_object_arg (G_OBJECT (camera->queue), "leaky", "downstream");
+  /* Auto sinks are bins: the lateness policy needs a real GstBaseSink */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (camera->sink), "max-lateness"))
+    g_object_set (camera->sink, "max-lateness", config->max_lateness, "qos", TRUE, NULL);
+
+  /* Fails when another camera already has this name; the bin is still floating */
+  if (!gst_bin_add (GST_BIN (array->pipeline), bin)) {
+    g_printerr ("Could not add camera %s: the name is taken\n", camera->name);
+    camera_free (camera);
+    gst_object_unref (gst_object_ref_sink (bin));
+    return FALSE;
+  }
+
+  add_probe (bin, "source", "src", (GstPadProbeCallback) capture_probe, camera);
+  add_probe (bin, "queue", "src", (GstPadProbeCallback) deliver_probe, camera);
+  g_ptr_array_add (array->cameras, camera);
+  return TRUE;
+}
+
+guint
+camera_array_get_n_cameras (CameraArray *array)
+{
+  return array->cameras->len;
+}
+
+void
+camera_array_handle_qos (CameraArray *array, GstMessage *msg)
+{
+  guint i;
+
+  for (i = 0; i < array->cameras->len; i++) {
+    Camera *camera = g_ptr_array_index (array->cameras, i);
+
+    if (GST_MESSAGE_SRC (msg) == GST_OBJECT (camera->sink)) {
+      GstFormat format;
+      guint64 dropped;
+
+      /* The counts are totals for the sink, not deltas */
+      gst_message_parse_qos_stats (msg, &format, NULL, &dropped);
+      if (format == GST_FORMAT_BUFFERS && dropped != (guint64) -1)
+        camera->late = dropped;
+      return;
+    }
+  }
+}
+
+void
+camera_array_report (CameraArray *array, gboolean final)
+{
+  gint64 now = g_get_monotonic_time ();
+  gdouble seconds = (now - array->reported) / 1e6;
+  gdouble total_captured = 0, total_rendered = 0;
+  guint i;
+
+  if (final)
+    g_print ("\nPer-camera totals:\n  %-12s %10s %10s %10s %10s %10s %10s\n", "camera",
+        "captured", "rendered", "queue-drop", "late-drop", "capture/s", "render/s");
+  else
+    g_print ("\n  %-12s %10s %10s\n", "camera", "capture/s", "render/s");
+
+  for (i = 0; i < array->cameras->len; i++) {
+    Camera *camera = g_ptr_array_index (array->cameras, i);
+    gint captured = g_atomic_int_get (&camera->captured);
+    gint delivered = g_atomic_int_get (&camera->delivered);
+    guint64 rendered = delivered > (gint64) camera->late ? delivered - camera->late : 0;
+
+    if (final) {
+      gdouble run = (camera->last - camera->first) / 1e6;
+      guint level = 0;
+
+      g_object_get (camera->queue, "current-level-buffers", &level, NULL);
+      g_print ("  %-12s %10d %10" G_GUINT64_FORMAT " %10d %10" G_GUINT64_FORMAT
+          " %10.1f %10.1f\n", camera->name, captured, rendered,
+          MAX (0, captured - delivered - (gint) level), camera->late,
+          run > 0 ? captured / run : 0.0, run > 0 ? rendered / run : 0.0);
+      total_captured += run > 0 ? captured / run : 0.0;
+      total_rendered += run > 0 ? rendered / run : 0.0;
+    } else {
+      gdouble capture_rate = seconds > 0 ? (captured - camera->reported_captured) / seconds : 0.0;
+      gdouble render_rate = seconds > 0 ? ((gdouble) rendered - camera->reported_rendered) / seconds : 0.0;
+
+      g_print ("  %-12s %10.1f %10.1f\n", camera->name, capture_rate, render_rate);
+      total_captured += capture_rate;
+      total_rendered += render_rate;
+    }
+    camera->reported_captured = captured;
+    camera->reported_rendered = rendered;
+  }
+
+  if (final)
+    g_print ("  %-12s %10s %10s %10s %10s %10.1f %10.1f\n", "aggregate", "", "", "", "",
+        total_captured, total_rendered);
+  else
+    g_print ("  %-12s %10.1f %10.1f frames/s over %u cameras\n", "aggregate", total_captured,
+        total_rendered, array->cameras->len);
+  array->reported = now;
+}
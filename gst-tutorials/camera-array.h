@@ -0,0 +1,66 @@
+/*
+Several cameras in one pipeline, each on a branch of its own.
+
+Every camera gets a self-contained bin:
+  source ! capsfilter ! queue ! videoconvert ! sink
+Live sources run their own streaming thread (the GstBaseSrc task) and the
+queue starts a second one for conversion and rendering, so a camera whose
+sink is slow only ever blocks its own capture. All bins live in one pipeline,
+so every camera is timestamped against the same pipeline clock and frames from
+different cameras can be compared directly.
+
+What a camera does when it falls behind is set per camera:
+  - `queue`: frames buffered between capture and display,
+  - `leaky`: when the queue is full, drop the oldest frame (the default)
+    instead of blocking capture, which would make the driver drop frames
+    itself and delay everything after,
+  - `max-lateness`: how late (ms) a frame may reach the sink before it is
+    dropped there instead of rendered; "none" renders everything.
+A spec on the command line is "DEVICE[,key=value...]", where DEVICE is a V4L2
+device or "test" for a videotestsrc stand-in, e.g.
+"/dev/video2,queue=1,max-lateness=10".
+
+Each camera counts frames captured (on the source thread), rendered (on the
+queue thread) and dropped by its queue and its sink; `camera_array_report`
+prints per-camera and aggregate frames/s since the previous report.
+*/
+#ifndef __CAMERA_ARRAY_H__
+#define __CAMERA_ARRAY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _CameraConfig {
+  gchar *device;              /* NULL for a videotestsrc stand-in */
+  guint queue_size;           /* frames */
+  gboolean leaky;
+  gint64 max_lateness;        /* nanoseconds, -1 = never drop late frames */
+} CameraConfig;
+
+typedef struct _CameraArray CameraArray;
+
+/* Fills `config` from a "DEVICE[,key=value...]" spec; free it with camera_config_clear */
+gboolean camera_config_parse (const gchar *spec, CameraConfig *config, GError **error);
+void camera_config_clear (CameraConfig *config);
+
+CameraArray *camera_array_new (GstElement *pipeline);
+void camera_array_free (CameraArray *array);
+
+/*
+ Builds a branch for `config` and adds it to the pipeline. `caps` (may be
+ NULL) restricts what the source produces; `num_buffers` is handed to it.
+*/
+gboolean camera_array_add (CameraArray *array, const CameraConfig *config,
+    const gchar *sink_name, GstCaps *caps, gint num_buffers);
+guint camera_array_get_n_cameras (CameraArray *array);
+
+/* For the application's QoS message handler: picks up frames a sink dropped */
+void camera_array_handle_qos (CameraArray *array, GstMessage *msg);
+
+/* Frames/s since the previous report; `final` reports the whole run instead */
+void camera_array_report (CameraArray *array, gboolean final);
+
+G_END_DECLS
+
+#endif /* __CAMERA_ARRAY_H__ */
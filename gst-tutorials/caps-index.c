@@ -0,0 +1,578 @@
+#include "caps-index.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#define INDEX_MAGIC "CAPSIDX1"
+#define INDEX_TYPE "(sua(suussd)a{sau})"
+
+/* A converter that takes longer than this to measure is given up on */
+#define MEASURE_TIMEOUT (10 * GST_SECOND)
+
+typedef struct {
+  CapsIndexEntry entry;       /* first: the public pointer is the entry's */
+  const gchar *sink_str;      /* in the variant */
+  const gchar *src_str;
+  GstCaps *sink_caps;         /* parsed on first use */
+  GstCaps *src_caps;
+  guint generation;           /* of the last lookup that checked it */
+} Entry;
+
+struct _CapsIndex {
+  GVariant *data;             /* INDEX_TYPE, the strings point into it */
+  guint32 fingerprint;
+  Entry *entries;
+  guint n_entries;
+  GHashTable *media_types;    /* name in data -> GVariant "au" */
+  guint generation;
+};
+
+/*
+ Summed, so the order the registry lists things in does not matter. A plugin
+ rebuilt with the same version changes its file's size or mtime; a rank
+ changed by GST_PLUGIN_FEATURE_RANK or by the application shows in the
+ factory's rank.
+*/
+static guint32
+registry_fingerprint (void)
+{
+  GstRegistry *registry = gst_registry_get ();
+  GList *plugins = gst_registry_get_plugin_list (registry), *l;
+  GList *factories = gst_registry_get_feature_list (registry, GST_TYPE_ELEMENT_FACTORY);
+  guint32 fingerprint = 0;
+  gchar *id;
+
+  for (l = plugins; l; l = l->next) {
+    GstPlugin *plugin = l->data;
+    const gchar *filename = gst_plugin_get_filename (plugin);
+    GStatBuf st = { 0 };
+
+    if (filename)
+      g_stat (filename, &st);
+    id = g_strdup_printf ("%s %s %s %" G_GINT64_FORMAT " %" G_GINT64_FORMAT,
+        gst_plugin_get_name (plugin), gst_plugin_get_version (plugin),
+        GST_STR_NULL (filename), (gint64) st.st_size, (gint64) st.st_mtime);
+    fingerprint += g_str_hash (id);
+    g_free (id);
+  }
+  for (l = factories; l; l = l->next) {
+    GstPluginFeature *feature = l->data;
+
+    id = g_strdup_printf ("%s %u", GST_OBJECT_NAME (feature),
+        gst_plugin_feature_get_rank (feature));
+    fingerprint += g_str_hash (id);
+    g_free (id);
+  }
+  gst_plugin_feature_list_free (factories);
+  gst_plugin_list_free (plugins);
+  return fingerprint;
+}
+
+/* Parsers are often also "Converter"s, so they are checked first */
+CapsIndexKind
+caps_index_factory_kind (GstElementFactory *factory)
+{
+  const gchar *klass = gst_element_factory_get_metadata (factory, GST_ELEMENT_METADATA_KLASS);
+
+  if (!klass)
+    return 0;
+  if (strstr (klass, "Sink"))
+    return CAPS_INDEX_SINK;
+  if (strstr (klass, "Decoder"))
+    return CAPS_INDEX_DECODER;
+  if (strstr (klass, "Demuxer"))
+    return CAPS_INDEX_DEMUXER;
+  if (strstr (klass, "Parser"))
+    return CAPS_INDEX_PARSER;
+  if (strstr (klass, "Converter"))
+    return CAPS_INDEX_CONVERTER;
+  return 0;
+}
+
+/* The union of the factory's templates in one direction */
+static GstCaps *
+template_caps (GstElementFactory *factory, GstPadDirection direction)
+{
+  const GList *l;
+  GstCaps *caps = gst_caps_new_empty ();
+
+  for (l = gst_element_factory_get_static_pad_templates (factory); l; l = l->next) {
+    GstStaticPadTemplate *templ = l->data;
+
+    if (templ->direction == direction)
+      caps = gst_caps_merge (caps, gst_static_pad_template_get_caps (templ));
+  }
+  return caps;
+}
+
+static void
+add_id (GHashTable *ids_by_type, const gchar *media_type, guint32 id)
+{
+  GArray *ids = g_hash_table_lookup (ids_by_type, media_type);
+
+  if (!ids) {
+    ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+    g_hash_table_insert (ids_by_type, g_strdup (media_type), ids);
+  }
+  /* A template may list a media type several times, with different features */
+  if (ids->len == 0 || g_array_index (ids, guint32, ids->len - 1) != id)
+    g_array_append_val (ids, id);
+}
+
+static CapsIndex *
+index_from_variant (GVariant *data)
+{
+  CapsIndex *index = g_new0 (CapsIndex, 1);
+  GVariant *entries, *media_types, *ids;
+  GVariantIter iter;
+  const gchar *name;
+  guint i;
+
+  index->data = data;
+  g_variant_get_child (data, 1, "u", &index->fingerprint);
+
+  entries = g_variant_get_child_value (data, 2);
+  index->n_entries = g_variant_n_children (entries);
+  index->entries = g_new0 (Entry, index->n_entries);
+  for (i = 0; i < index->n_entries; i++) {
+    Entry *entry = &index->entries[i];
+    guint32 kind;
+
+    g_variant_get_child (entries, i, "(&suu&s&sd)", &entry->entry.factory, &kind,
+        &entry->entry.rank, &entry->sink_str, &entry->src_str, &entry->entry.throughput);
+    entry->entry.kind = kind;
+  }
+  g_variant_unref (entries);
+
+  index->media_types = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) g_variant_unref);
+  media_types = g_variant_get_child_value (data, 3);
+  g_variant_iter_init (&iter, media_types);
+  while (g_variant_iter_next (&iter, "{&s@au}", &name, &ids))
+    g_hash_table_insert (index->media_types, (gpointer) name, ids);
+  g_variant_unref (media_types);
+  return index;
+}
+
+CapsIndex *
+caps_index_build (void)
+{
+  GList *factories, *l;
+  GHashTable *ids_by_type;
+  GHashTableIter iter;
+  GVariantBuilder entries, media_types;
+  gpointer media_type, ids;
+  guint32 n = 0;
+
+  /* gst_element_factory_list_get_elements has no type for converters */
+  factories = gst_registry_get_feature_list (gst_registry_get (), GST_TYPE_ELEMENT_FACTORY);
+  ids_by_type = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_array_unref);
+  g_variant_builder_init (&entries, G_VARIANT_TYPE ("a(suussd)"));
+  for (l = factories; l; l = l->next) {
+    GstElementFactory *factory = l->data;
+    CapsIndexKind kind = caps_index_factory_kind (factory);
+    GstCaps *sink, *src;
+    gchar *sink_str, *src_str;
+    guint i;
+
+    if (!kind)
+      continue;
+    sink = template_caps (factory, GST_PAD_SINK);
+    if (gst_caps_is_empty (sink)) {
+      gst_caps_unref (sink);
+      continue;
+    }
+    src = template_caps (factory, GST_PAD_SRC);
+    sink_str = gst_caps_to_string (sink);
+    src_str = gst_caps_to_string (src);
+    g_variant_builder_add (&entries, "(suussd)", GST_OBJECT_NAME (factory), (guint32) kind,
+        gst_plugin_feature_get_rank (GST_PLUGIN_FEATURE (factory)), sink_str, src_str, 0.0);
+
+    if (gst_caps_is_any (sink))
+      add_id (ids_by_type, "", n);
+    for (i = 0; !gst_caps_is_any (sink) && i < gst_caps_get_size (sink); i++)
+      add_id (ids_by_type, gst_structure_get_name (gst_caps_get_structure (sink, i)), n);
+    n++;
+
+    g_free (sink_str);
+    g_free (src_str);
+    gst_caps_unref (sink);
+    gst_caps_unref (src);
+  }
+  gst_plugin_feature_list_free (factories);
+
+  g_variant_builder_init (&media_types, G_VARIANT_TYPE ("a{sau}"));
+  g_hash_table_iter_init (&iter, ids_by_type);
+  while (g_hash_table_iter_next (&iter, &media_type, &ids)) {
+    g_variant_builder_add (&media_types, "{s@au}", media_type,
+        g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, ((GArray *) ids)->data,
+            ((GArray *) ids)->len, sizeof (guint32)));
+  }
+  g_hash_table_unref (ids_by_type);
+
+  return index_from_variant (g_variant_ref_sink (g_variant_new ("(su@a(suussd)@a{sau})",
+              INDEX_MAGIC, registry_fingerprint (), g_variant_builder_end (&entries),
+              g_variant_builder_end (&media_types))));
+}
+
+CapsIndex *
+caps_index_load (const gchar *path)
+{
+  GMappedFile *file = g_mapped_file_new (path, FALSE, NULL);
+  GVariant *data;
+  GBytes *bytes;
+  const gchar *magic;
+  guint32 fingerprint;
+
+  if (!file)
+    return NULL;
+  /* Saving replaces the file, so the mapping stays valid; unmapped with the last string */
+  bytes = g_mapped_file_get_bytes (file);
+  g_mapped_file_unref (file);
+  /* GVariant checks the serialized data as it reads it; garbage reads as empty values */
+  data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (INDEX_TYPE), bytes, FALSE));
+  g_bytes_unref (bytes);
+  g_variant_get_child (data, 0, "&s", &magic);
+  g_variant_get_child (data, 1, "u", &fingerprint);
+  if (strcmp (magic, INDEX_MAGIC) != 0 || fingerprint != registry_fingerprint ()) {
+    g_variant_unref (data);
+    return NULL;
+  }
+  return index_from_variant (data);
+}
+
+CapsIndex *
+caps_index_open (const gchar *path)
+{
+  CapsIndex *index = caps_index_load (path);
+  GError *error = NULL;
+
+  if (index)
+    return index;
+  index = caps_index_build ();
+  if (!caps_index_save (index, path, &error)) {
+    g_printerr ("Could not save the caps index: %s\n", error->message);
+    g_clear_error (&error);
+  }
+  return index;
+}
+
+/* Written again from the entries, for the throughputs measured since */
+gboolean
+caps_index_save (CapsIndex *index, const gchar *path, GError **error)
+{
+  GVariantBuilder entries;
+  GVariant *media_types, *data;
+  gchar *dir;
+  gboolean ret;
+  guint i;
+
+  g_variant_builder_init (&entries, G_VARIANT_TYPE ("a(suussd)"));
+  for (i = 0; i < index->n_entries; i++) {
+    Entry *entry = &index->entries[i];
+
+    g_variant_builder_add (&entries, "(suussd)", entry->entry.factory,
+        (guint32) entry->entry.kind, entry->entry.rank, entry->sink_str, entry->src_str,
+        entry->entry.throughput);
+  }
+  media_types = g_variant_get_child_value (index->data, 3);
+  data = g_variant_ref_sink (g_variant_new ("(su@a(suussd)@a{sau})", INDEX_MAGIC,
+          index->fingerprint, g_variant_builder_end (&entries), media_types));
+  g_variant_unref (media_types);
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+  ret = g_file_set_contents (path, g_variant_get_data (data), g_variant_get_size (data), error);
+  g_variant_unref (data);
+  return ret;
+}
+
+void
+caps_index_free (CapsIndex *index)
+{
+  guint i;
+
+  for (i = 0; i < index->n_entries; i++) {
+    if (index->entries[i].sink_caps)
+      gst_caps_unref (index->entries[i].sink_caps);
+    if (index->entries[i].src_caps)
+      gst_caps_unref (index->entries[i].src_caps);
+  }
+  g_free (index->entries);
+  g_hash_table_unref (index->media_types);
+  g_variant_unref (index->data);
+  g_free (index);
+}
+
+gchar *
+caps_index_default_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "gst-tutorials", "caps-index.gvariant", NULL);
+}
+
+guint
+caps_index_get_n_entries (CapsIndex *index)
+{
+  return index->n_entries;
+}
+
+static GstCaps *
+parse_caps (const gchar *str)
+{
+  GstCaps *caps = gst_caps_from_string (str);
+
+  return caps ? caps : gst_caps_new_empty ();
+}
+
+static void
+check_entries (CapsIndex *index, GVariant *ids, const GstCaps *caps, guint kinds,
+    GPtrArray *matches)
+{
+  const guint32 *id;
+  gsize n, i;
+
+  if (!ids)
+    return;
+  id = g_variant_get_fixed_array (ids, &n, sizeof (guint32));
+  for (i = 0; i < n; i++) {
+    Entry *entry;
+
+    if (id[i] >= index->n_entries)
+      continue;
+    entry = &index->entries[id[i]];
+    /* Listed under several of the caps' media types */
+    if (entry->generation == index->generation || !(entry->entry.kind & kinds))
+      continue;
+    entry->generation = index->generation;
+    if (!entry->sink_caps)
+      entry->sink_caps = parse_caps (entry->sink_str);
+    if (gst_caps_can_intersect (entry->sink_caps, caps))
+      g_ptr_array_add (matches, entry);
+  }
+}
+
+static gint
+compare_entries (const CapsIndexEntry **a, const CapsIndexEntry **b)
+{
+  if ((*a)->rank != (*b)->rank)
+    return (*a)->rank > (*b)->rank ? -1 : 1;
+  if ((*a)->throughput != (*b)->throughput)
+    return (*a)->throughput > (*b)->throughput ? -1 : 1;
+  return strcmp ((*a)->factory, (*b)->factory);
+}
+
+GPtrArray *
+caps_index_lookup (CapsIndex *index, const GstCaps *caps, guint kinds)
+{
+  GPtrArray *matches = g_ptr_array_new ();
+  guint i;
+
+  index->generation++;
+  if (gst_caps_is_any (caps)) {
+    GHashTableIter iter;
+    gpointer ids;
+
+    g_hash_table_iter_init (&iter, index->media_types);
+    while (g_hash_table_iter_next (&iter, NULL, &ids))
+      check_entries (index, ids, caps, kinds, matches);
+  } else {
+    for (i = 0; i < gst_caps_get_size (caps); i++) {
+      const gchar *media_type = gst_structure_get_name (gst_caps_get_structure (caps, i));
+
+      check_entries (index, g_hash_table_lookup (index->media_types, media_type), caps,
+          kinds, matches);
+    }
+    check_entries (index, g_hash_table_lookup (index->media_types, ""), caps, kinds, matches);
+  }
+  g_ptr_array_sort (matches, (GCompareFunc) compare_entries);
+  return matches;
+}
+
+const GstCaps *
+caps_index_get_src_caps (CapsIndex *index, const CapsIndexEntry *entry)
+{
+  Entry *own = (Entry *) entry;
+
+  if (!own->src_caps)
+    own->src_caps = parse_caps (own->src_str);
+  return own->src_caps;
+}
+
+/* Seconds for `n_buffers` through "source ! caps [! element ! target] ! fakesink",
+   -1 on failure */
+static gdouble
+run_time (const gchar *source, guint n_buffers, const gchar *caps, const gchar *element,
+    const gchar *target)
+{
+  GstElement *pipeline;
+  GstMessage *msg;
+  gchar *description;
+  guint64 start;
+  gdouble elapsed;
+  gboolean ok;
+
+  if (element)
+    description = g_strdup_printf ("%s num-buffers=%u ! %s ! %s ! %s ! fakesink sync=false",
+        source, n_buffers, caps, element, target);
+  else
+    description = g_strdup_printf ("%s num-buffers=%u ! %s ! fakesink sync=false", source,
+        n_buffers, caps);
+  pipeline = gst_parse_launch (description, NULL);
+  g_free (description);
+  if (!pipeline)
+    return -1;
+
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline), MEASURE_TIMEOUT,
+      GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+  elapsed = (gst_util_get_timestamp () - start) / 1e9;
+  ok = msg && GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+  if (msg)
+    gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  return ok ? elapsed : -1;
+}
+
+/* Adds `fixed` with `field` set to `value` if `src_caps` allow it */
+static void
+add_target (GPtrArray *targets, const GstCaps *fixed, const GstCaps *src_caps,
+    const gchar *field, ...)
+{
+  GstCaps *target = gst_caps_copy (fixed);
+  GstStructure *structure = gst_caps_get_structure (target, 0);
+  va_list args;
+
+  va_start (args, field);
+  gst_structure_set_valist (structure, field, args);
+  va_end (args);
+  /* A new channel count needs a new mask */
+  if (g_str_equal (field, "channels"))
+    gst_structure_remove_field (structure, "channel-mask");
+  if (gst_caps_can_intersect (target, src_caps))
+    g_ptr_array_add (targets, gst_caps_to_string (target));
+  gst_caps_unref (target);
+}
+
+/*
+ What a converter can be made to convert `fixed` into, most telling first:
+ the same caps with one field changed to something its src templates take.
+ A fakesink alone takes whatever comes, so without one of these downstream a
+ converter passes the caps through and there is nothing to measure.
+*/
+static GPtrArray *
+conversion_targets (const GstCaps *fixed, const GstCaps *src_caps)
+{
+  GPtrArray *targets = g_ptr_array_new_with_free_func (g_free);
+  const GstStructure *structure = gst_caps_get_structure (fixed, 0);
+  const gchar *media_type = gst_structure_get_name (structure);
+  const gchar *format = gst_structure_get_string (structure, "format");
+  gint width, height, rate, channels;
+  guint i, j;
+
+  /* Every other format the src templates list */
+  for (i = 0; format && i < gst_caps_get_size (src_caps); i++) {
+    const GstStructure *src = gst_caps_get_structure (src_caps, i);
+    const GValue *formats = gst_structure_get_value (src, "format");
+
+    if (!gst_structure_has_name (src, media_type) || !formats)
+      continue;
+    if (G_VALUE_HOLDS_STRING (formats)) {
+      if (!g_str_equal (g_value_get_string (formats), format))
+        add_target (targets, fixed, src_caps, "format", G_TYPE_STRING,
+            g_value_get_string (formats), NULL);
+    } else if (GST_VALUE_HOLDS_LIST (formats)) {
+      for (j = 0; j < gst_value_list_get_size (formats); j++) {
+        const GValue *value = gst_value_list_get_value (formats, j);
+
+        if (G_VALUE_HOLDS_STRING (value) && !g_str_equal (g_value_get_string (value), format))
+          add_target (targets, fixed, src_caps, "format", G_TYPE_STRING,
+              g_value_get_string (value), NULL);
+      }
+    }
+  }
+  if (gst_structure_get_int (structure, "width", &width) &&
+      gst_structure_get_int (structure, "height", &height) && width > 1 && height > 1)
+    add_target (targets, fixed, src_caps, "width", G_TYPE_INT, width / 2,
+        "height", G_TYPE_INT, height / 2, NULL);
+  if (gst_structure_get_int (structure, "rate", &rate))
+    add_target (targets, fixed, src_caps, "rate", G_TYPE_INT,
+        rate == 48000 ? 44100 : 48000, NULL);
+  if (gst_structure_get_int (structure, "channels", &channels))
+    add_target (targets, fixed, src_caps, "channels", G_TYPE_INT, channels == 2 ? 1 : 2,
+        NULL);
+  return targets;
+}
+
+guint
+caps_index_measure (CapsIndex *index, const GstCaps *caps, guint n_buffers)
+{
+  GstCaps *fixed;
+  GPtrArray *matches;
+  const gchar *media_type, *source = NULL;
+  gchar *caps_str;
+  gdouble base;
+  guint i, measured = 0;
+
+  if (gst_caps_is_empty (caps) || gst_caps_is_any (caps))
+    return 0;
+  fixed = gst_caps_fixate (gst_caps_copy (caps));
+  media_type = gst_structure_get_name (gst_caps_get_structure (fixed, 0));
+  if (g_str_equal (media_type, "video/x-raw"))
+    source = "videotestsrc";
+  else if (g_str_equal (media_type, "audio/x-raw"))
+    source = "audiotestsrc";
+
+  caps_str = gst_caps_to_string (fixed);
+  base = source ? run_time (source, n_buffers, caps_str, NULL, NULL) : -1;
+  if (base >= 0) {
+    matches = caps_index_lookup (index, fixed, CAPS_INDEX_CONVERTER);
+    for (i = 0; i < matches->len; i++) {
+      CapsIndexEntry *entry = g_ptr_array_index (matches, i);
+      GPtrArray *targets = conversion_targets (fixed, caps_index_get_src_caps (index, entry));
+      gdouble elapsed = -1;
+      guint j;
+
+      /* A converter only does some conversions (videoscale keeps the format) */
+      for (j = 0; j < targets->len && elapsed < 0; j++)
+        elapsed = run_time (source, n_buffers, caps_str, entry->factory,
+            g_ptr_array_index (targets, j));
+
+      /* Never cheaper than 0.1 us per buffer, whatever the noise */
+      if (elapsed >= 0) {
+        entry->throughput = n_buffers / MAX (elapsed - base, n_buffers * 1e-7);
+        measured++;
+        g_print ("{\"measured\":\"%s\",\"from\":\"%s\",\"to\":\"%s\",\"buffers_per_s\":%.0f}\n",
+            entry->factory, caps_str, (gchar *) g_ptr_array_index (targets, j - 1),
+            entry->throughput);
+      }
+      g_ptr_array_unref (targets);
+    }
+    g_ptr_array_unref (matches);
+  }
+  g_free (caps_str);
+  gst_caps_unref (fixed);
+  return measured;
+}
+
+const gchar *
+caps_index_kind_name (CapsIndexKind kind)
+{
+  switch (kind) {
+    case CAPS_INDEX_CONVERTER:
+      return "converter";
+    case CAPS_INDEX_DECODER:
+      return "decoder";
+    case CAPS_INDEX_DEMUXER:
+      return "demuxer";
+    case CAPS_INDEX_PARSER:
+      return "parser";
+    case CAPS_INDEX_SINK:
+      return "sink";
+  }
+  return "other";
+}
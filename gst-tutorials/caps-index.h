@@ -0,0 +1,88 @@
+/*
+Persistent index of the pad-template caps of every installed element.
+
+bt6 prints a factory's pad templates one at a time; playbin and
+uridecodebin do much the same on every start, listing the registry's
+factories and intersecting caps with each one's templates to find what to
+plug next. The index does that walk once: for every converter, decoder,
+demuxer, parser and sink (from the factory's klass) it keeps the name, the
+rank, the union of its sink templates and of its src templates, serialized,
+plus a list of factories per media type (the structure names of their sink
+templates; ANY templates go in a list that is always checked).
+
+It is saved as a GVariant, `(sua(suussd)a{sau})`:
+  magic, registry fingerprint,
+  entries: factory, kind, rank, sink caps, src caps, measured throughput,
+  media type -> entry numbers.
+Loading maps the strings in place and only parses the caps of a media
+type's entries the first time it is looked up. The fingerprint is a hash of
+every plugin's name, version, file and the file's size and mtime, and of
+every element factory's rank; an index built for another set of plugins or
+ranks is not loaded.
+
+`caps_index_lookup` returns the entries of the requested kinds whose sink
+templates can take the given caps, ranked by rank, then by throughput, then
+by name. `caps_index_measure` fills in the throughput of the converters for
+raw audio/video caps: buffers per second through "testsrc ! caps !
+converter ! target caps ! fakesink", less the time the pipeline takes
+without the converter. The target is the input with one field changed to
+something the converter's src templates take (another format, half the
+size, another rate or channel count, the first one it negotiates), so it
+has to convert; one JSON line per converter says which conversion was
+timed.
+
+Not thread safe: caps are parsed on lookup.
+*/
+#ifndef __CAPS_INDEX_H__
+#define __CAPS_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  CAPS_INDEX_CONVERTER = 1 << 0,
+  CAPS_INDEX_DECODER = 1 << 1,
+  CAPS_INDEX_DEMUXER = 1 << 2,
+  CAPS_INDEX_PARSER = 1 << 3,
+  CAPS_INDEX_SINK = 1 << 4,
+} CapsIndexKind;
+
+#define CAPS_INDEX_ANY_KIND 0x1f
+
+typedef struct _CapsIndexEntry {
+  const gchar *factory;
+  CapsIndexKind kind;
+  guint rank;
+  gdouble throughput;         /* buffers per second, 0 if not measured */
+} CapsIndexEntry;
+
+typedef struct _CapsIndex CapsIndex;
+
+/* Walks the registry */
+CapsIndex *caps_index_build (void);
+/* NULL if `path` is missing, not an index or was built for other plugins */
+CapsIndex *caps_index_load (const gchar *path);
+/* Loads `path`, or builds the index and saves it there */
+CapsIndex *caps_index_open (const gchar *path);
+gboolean caps_index_save (CapsIndex *index, const gchar *path, GError **error);
+void caps_index_free (CapsIndex *index);
+
+/* In the user's cache directory */
+gchar *caps_index_default_path (void);
+guint caps_index_get_n_entries (CapsIndex *index);
+
+/* CapsIndexEntry pointers owned by the index, best first; free with g_ptr_array_unref */
+GPtrArray *caps_index_lookup (CapsIndex *index, const GstCaps *caps, guint kinds);
+const GstCaps *caps_index_get_src_caps (CapsIndex *index, const CapsIndexEntry *entry);
+
+/* Measures the converters `caps` (raw audio or video) can go into; returns how many */
+guint caps_index_measure (CapsIndex *index, const GstCaps *caps, guint n_buffers);
+
+/* From the factory's klass, 0 if it is none of the kinds */
+CapsIndexKind caps_index_factory_kind (GstElementFactory *factory);
+const gchar *caps_index_kind_name (CapsIndexKind kind);
+
+G_END_DECLS
+
+#endif /* __CAPS_INDEX_H__ */
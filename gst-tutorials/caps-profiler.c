@@ -0,0 +1,323 @@
+#include "caps-profiler.h"
+
+/* Nested queries in flight on one thread; deeper ones that failed are dropped */
+#define STACK_DEPTH 64
+#define PINS_GROUP "pins"
+
+typedef struct _PadStats {
+  CapsProfiler *profiler;
+  GstPad *pad;                /* a ref: request pads can go before the pipeline */
+  gchar *name;                /* element:pad */
+  guint64 caps_queries;
+  guint64 caps_time;          /* nanoseconds, answered queries only */
+  guint64 accept_queries;
+  guint64 accept_time;
+  guint64 accept_refused;
+  guint64 caps_events;
+  guint64 reconfigures;
+} PadStats;
+
+struct _CapsProfiler {
+  GstElement *pipeline;       /* not a ref: the pipeline owns us */
+  GMutex lock;                /* protects the stats and the array */
+  GPtrArray *pads;            /* PadStats */
+};
+
+typedef struct _QueryStack {
+  struct {
+    GstQuery *query;
+    GstPad *pad;
+    guint64 start;
+  } entries[STACK_DEPTH];
+  guint depth;
+} QueryStack;
+
+static GQuark stats_quark;
+static GPrivate query_stack = G_PRIVATE_INIT (g_free);
+
+static QueryStack *
+get_query_stack (void)
+{
+  QueryStack *stack = g_private_get (&query_stack);
+
+  if (!stack) {
+    stack = g_new0 (QueryStack, 1);
+    g_private_set (&query_stack, stack);
+  }
+  return stack;
+}
+
+/* Returns how long the matching pre-phase is ago, or -1 if it was never seen */
+static gint64
+pop_query (GstPad *pad, GstQuery *query, guint64 now)
+{
+  QueryStack *stack = get_query_stack ();
+
+  /* Queries that failed never come back through the post-phase: skip over them */
+  while (stack->depth > 0) {
+    stack->depth--;
+    if (stack->entries[stack->depth].query == query && stack->entries[stack->depth].pad == pad)
+      return now - stack->entries[stack->depth].start;
+  }
+  return -1;
+}
+
+static void
+push_query (GstPad *pad, GstQuery *query)
+{
+  QueryStack *stack = get_query_stack ();
+
+  /* Overflowing means a lot of unanswered queries piled up; start over */
+  if (stack->depth == STACK_DEPTH)
+    stack->depth = 0;
+  stack->entries[stack->depth].query = query;
+  stack->entries[stack->depth].pad = pad;
+  stack->entries[stack->depth].start = gst_util_get_timestamp ();
+  stack->depth++;
+}
+
+static GstPadProbeReturn
+query_probe (GstPad *pad, GstPadProbeInfo *info, PadStats *stats)
+{
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+  CapsProfiler *profiler = stats->profiler;
+  gboolean accept_caps = (GST_QUERY_TYPE (query) == GST_QUERY_ACCEPT_CAPS);
+  gint64 elapsed;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_CAPS && !accept_caps)
+    return GST_PAD_PROBE_OK;
+
+  if (info->type & GST_PAD_PROBE_TYPE_PUSH) {
+    push_query (pad, query);
+    g_mutex_lock (&profiler->lock);
+    if (accept_caps)
+      stats->accept_queries++;
+    else
+      stats->caps_queries++;
+    g_mutex_unlock (&profiler->lock);
+    return GST_PAD_PROBE_OK;
+  }
+
+  elapsed = pop_query (pad, query, gst_util_get_timestamp ());
+  if (elapsed < 0)
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&profiler->lock);
+  if (accept_caps) {
+    gboolean result = FALSE;
+
+    gst_query_parse_accept_caps_result (query, &result);
+    stats->accept_time += elapsed;
+    if (!result)
+      stats->accept_refused++;
+  } else {
+    stats->caps_time += elapsed;
+  }
+  g_mutex_unlock (&profiler->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+event_probe (GstPad *pad, GstPadProbeInfo *info, PadStats *stats)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  CapsProfiler *profiler = stats->profiler;
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+    g_mutex_lock (&profiler->lock);
+    stats->caps_events++;
+    g_mutex_unlock (&profiler->lock);
+  } else if (GST_EVENT_TYPE (event) == GST_EVENT_RECONFIGURE) {
+    g_mutex_lock (&profiler->lock);
+    stats->reconfigures++;
+    g_mutex_unlock (&profiler->lock);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+pad_stats_free (PadStats *stats)
+{
+  gst_object_unref (stats->pad);
+  g_free (stats->name);
+  g_free (stats);
+}
+
+static void
+attach_pad (CapsProfiler *profiler, GstPad *pad)
+{
+  PadStats *stats;
+
+  if (g_object_get_qdata (G_OBJECT (pad), stats_quark))
+    return;
+
+  stats = g_new0 (PadStats, 1);
+  stats->profiler = profiler;
+  stats->pad = gst_object_ref (pad);
+  stats->name = g_strdup_printf ("%s:%s", GST_DEBUG_PAD_NAME (pad));
+  g_object_set_qdata (G_OBJECT (pad), stats_quark, stats);
+
+  g_mutex_lock (&profiler->lock);
+  g_ptr_array_add (profiler->pads, stats);
+  g_mutex_unlock (&profiler->lock);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_QUERY_BOTH,
+      (GstPadProbeCallback) query_probe, stats, NULL);
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_BOTH,
+      (GstPadProbeCallback) event_probe, stats, NULL);
+}
+
+static void
+pad_added_cb (GstElement *element, GstPad *pad, CapsProfiler *profiler)
+{
+  attach_pad (profiler, pad);
+}
+
+static void
+attach_element (CapsProfiler *profiler, GstElement *element)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  /* A bin's ghost pads only proxy its children's pads, which we see anyway */
+  if (GST_IS_BIN (element))
+    return;
+
+  it = gst_element_iterate_pads (element);
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    attach_pad (profiler, g_value_get_object (&item));
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  g_signal_connect (element, "pad-added", G_CALLBACK (pad_added_cb), profiler);
+}
+
+static void
+deep_element_added_cb (GstBin *bin, GstBin *sub_bin, GstElement *element, CapsProfiler *profiler)
+{
+  attach_element (profiler, element);
+}
+
+static void
+caps_profiler_free (CapsProfiler *profiler)
+{
+  g_ptr_array_unref (profiler->pads);
+  g_mutex_clear (&profiler->lock);
+  g_free (profiler);
+}
+
+CapsProfiler *
+caps_profiler_attach (GstElement *pipeline)
+{
+  CapsProfiler *profiler = g_new0 (CapsProfiler, 1);
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  if (!stats_quark)
+    stats_quark = g_quark_from_static_string ("caps-profiler-stats");
+
+  profiler->pipeline = pipeline;
+  g_mutex_init (&profiler->lock);
+  profiler->pads = g_ptr_array_new_with_free_func ((GDestroyNotify) pad_stats_free);
+  g_object_set_data_full (G_OBJECT (pipeline), "caps-profiler", profiler,
+      (GDestroyNotify) caps_profiler_free);
+
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    attach_element (profiler, g_value_get_object (&item));
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  g_signal_connect (pipeline, "deep-element-added", G_CALLBACK (deep_element_added_cb), profiler);
+  return profiler;
+}
+
+void
+caps_profiler_dump (CapsProfiler *profiler)
+{
+  guint64 caps_queries = 0, accept_queries = 0, renegotiations = 0;
+  guint i;
+
+  g_print ("\nCaps negotiation for %s (time in microseconds):\n",
+      GST_OBJECT_NAME (profiler->pipeline));
+  g_print ("  %-28s %8s %10s %8s %10s %8s %8s %8s\n", "pad", "caps-q", "time",
+      "accept-q", "time", "refused", "caps-ev", "reconf");
+
+  g_mutex_lock (&profiler->lock);
+  for (i = 0; i < profiler->pads->len; i++) {
+    PadStats *stats = g_ptr_array_index (profiler->pads, i);
+
+    if (stats->caps_queries + stats->accept_queries + stats->caps_events + stats->reconfigures == 0)
+      continue;
+    g_print ("  %-28s %8" G_GUINT64_FORMAT " %10.1f %8" G_GUINT64_FORMAT " %10.1f %8"
+        G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT "\n", stats->name,
+        stats->caps_queries, stats->caps_time / 1e3, stats->accept_queries,
+        stats->accept_time / 1e3, stats->accept_refused, stats->caps_events,
+        stats->reconfigures);
+
+    caps_queries += stats->caps_queries;
+    accept_queries += stats->accept_queries;
+    if (stats->caps_events > 1)
+      renegotiations += stats->caps_events - 1;
+  }
+  g_mutex_unlock (&profiler->lock);
+
+  /* Nested queries count at every pad they pass, so times are not summed here */
+  g_print ("  total: %" G_GUINT64_FORMAT " caps queries, %" G_GUINT64_FORMAT
+      " accept-caps queries, %" G_GUINT64_FORMAT " renegotiations\n",
+      caps_queries, accept_queries, renegotiations);
+}
+
+gboolean
+caps_profiler_save_pins (CapsProfiler *profiler, const gchar *path, GError **error)
+{
+  GKeyFile *pins = g_key_file_new ();
+  gboolean ret;
+  guint i;
+
+  g_mutex_lock (&profiler->lock);
+  for (i = 0; i < profiler->pads->len; i++) {
+    PadStats *stats = g_ptr_array_index (profiler->pads, i);
+    GstCaps *caps;
+    gchar *str;
+
+    if (GST_PAD_DIRECTION (stats->pad) != GST_PAD_SRC || !gst_pad_is_linked (stats->pad))
+      continue;
+    caps = gst_pad_get_current_caps (stats->pad);
+    if (!caps)
+      continue;
+    str = gst_caps_to_string (caps);
+    g_key_file_set_string (pins, PINS_GROUP, stats->name, str);
+    g_free (str);
+    gst_caps_unref (caps);
+  }
+  g_mutex_unlock (&profiler->lock);
+
+  ret = g_key_file_save_to_file (pins, path, error);
+  g_key_file_free (pins);
+  return ret;
+}
+
+GstCaps *
+caps_profiler_load_pin (const gchar *path, const gchar *element, const gchar *pad)
+{
+  GKeyFile *pins = g_key_file_new ();
+  GstCaps *caps = NULL;
+  gchar *key, *str;
+
+  if (!g_key_file_load_from_file (pins, path, G_KEY_FILE_NONE, NULL)) {
+    g_key_file_free (pins);
+    return NULL;
+  }
+
+  key = g_strdup_printf ("%s:%s", element, pad);
+  str = g_key_file_get_string (pins, PINS_GROUP, key, NULL);
+  if (str)
+    caps = gst_caps_from_string (str);
+  g_free (str);
+  g_free (key);
+  g_key_file_free (pins);
+  return caps;
+}
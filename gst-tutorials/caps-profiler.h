@@ -0,0 +1,40 @@
+/*
+Caps negotiation profiler.
+
+Attached to a pipeline, it puts query and event probes on every pad of every
+element (including elements and pads added later) and counts, per pad:
+  - CAPS queries ("what can you do?") and the time spent answering them,
+  - ACCEPT_CAPS queries ("can you take exactly this?") and their time,
+  - CAPS events: the first one is the negotiation, every later one a
+    renegotiation,
+  - RECONFIGURE events, which ask upstream to negotiate again.
+A query's time is measured from the probe before it is handled to the probe
+after, so it includes whatever the pad forwarded to its peers; the pad that
+started a negotiation therefore shows the cost of the whole round.
+
+Pinning: `caps_profiler_save_pins` writes the caps every linked src pad ended
+up with to a key file; `caps_profiler_load_pin` reads one back so the next run
+can link with those exact caps as a filter, leaving negotiation nothing to
+search.
+*/
+#ifndef __CAPS_PROFILER_H__
+#define __CAPS_PROFILER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _CapsProfiler CapsProfiler;
+
+/* Owned by the pipeline, like the latency tracer */
+CapsProfiler *caps_profiler_attach (GstElement *pipeline);
+void caps_profiler_dump (CapsProfiler *profiler);
+
+gboolean caps_profiler_save_pins (CapsProfiler *profiler, const gchar *path, GError **error);
+
+/* The caps pinned for `element`'s `pad`, or NULL */
+GstCaps *caps_profiler_load_pin (const gchar *path, const gchar *element, const gchar *pad);
+
+G_END_DECLS
+
+#endif /* __CAPS_PROFILER_H__ */
@@ -0,0 +1,502 @@
+#include "depth-proc.h"
+
+#include <string.h>
+
+/* Row bands are small (a 424x240 frame is 240 rows); more than this many
+ * only adds synchronization */
+#define MAX_BANDS 16
+
+/* The temporal filter is built twice, for AVX2 and for baseline x86-64, and
+ * the loader picks one (ifunc). Elsewhere the vector code is built once for
+ * the target's own vector unit. */
+#if defined(__x86_64__) && defined(__gnu_linux__)
+#define VECTOR_CLONES __attribute__ ((target_clones ("avx2", "default")))
+#else
+#define VECTOR_CLONES
+#endif
+
+typedef guint16 v8u16 __attribute__ ((vector_size (16)));
+typedef gint32 v8i32 __attribute__ ((vector_size (32)));
+
+enum {
+  PROP_0,
+  PROP_DECIMATION,
+  PROP_ALPHA,
+  PROP_DELTA,
+  PROP_HOLE_FILL,
+  PROP_MIN_DEPTH,
+  PROP_MAX_DEPTH,
+  PROP_THREADS,
+};
+
+typedef struct {
+  DepthProc *self;
+  const GstVideoFrame *in;
+  GstVideoFrame *out;
+  gint first;                 /* output rows [first, last) */
+  gint last;
+} DepthBand;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("GRAY16_LE")));
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("BGRx")));
+
+G_DEFINE_TYPE (DepthProc, depth_proc, GST_TYPE_VIDEO_FILTER);
+
+/* Blue (near) -> cyan -> green -> yellow -> red (far), as BGRx */
+static void
+palette_init (guint32 *palette)
+{
+  gint i;
+
+  for (i = 0; i < 256; i++) {
+    gint r, g, b, t = i * 4;
+
+    if (t < 256) {
+      r = 0, g = t, b = 255;
+    } else if (t < 512) {
+      r = 0, g = 255, b = 511 - t;
+    } else if (t < 768) {
+      r = t - 512, g = 255, b = 0;
+    } else {
+      r = 255, g = 1023 - t, b = 0;
+    }
+    palette[i] = GUINT32_TO_LE (b | g << 8 | r << 16);
+  }
+}
+
+/* Mean of the valid samples of each `factor` x `factor` block */
+static void
+decimate_row (const guint8 *in, gint stride, gint factor, guint16 *out, gint width)
+{
+  gint x, i, j;
+
+  if (factor == 1) {
+    memcpy (out, in, width * sizeof (guint16));
+    return;
+  }
+
+  for (x = 0; x < width; x++) {
+    guint sum = 0, count = 0;
+
+    for (j = 0; j < factor; j++) {
+      const guint16 *row = (const guint16 *) (in + j * stride) + x * factor;
+
+      for (i = 0; i < factor; i++) {
+        guint16 depth = GUINT16_FROM_LE (row[i]);
+
+        sum += depth;
+        count += (depth != 0);
+      }
+    }
+    out[x] = count ? (sum + count / 2) / count : 0;
+  }
+}
+
+/* history += (row - history) * alpha, except where the depth jumped by more
+ * than `delta` or there was no history (take the new depth) or the new
+ * depth is a hole (keep the history). Both `row` and `history` get the
+ * result. `alpha` has 8 fractional bits. */
+VECTOR_CLONES static void
+temporal_row (guint16 *row, guint16 *history, gint width, gint alpha, gint delta)
+{
+  const v8i32 zero = { 0 };
+  const v8i32 alpha_v = zero + alpha, delta_v = zero + delta, round_v = zero + 128;
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    v8u16 cur16, prev16;
+    v8i32 cur, prev, diff, sign, reset, hole, result;
+
+    memcpy (&cur16, row + x, sizeof (cur16));
+    memcpy (&prev16, history + x, sizeof (prev16));
+    cur = __builtin_convertvector (cur16, v8i32);
+    prev = __builtin_convertvector (prev16, v8i32);
+
+    diff = cur - prev;
+    sign = diff >> 31;
+    reset = (((diff ^ sign) - sign) > delta_v) | (prev == zero);
+    hole = (cur == zero);
+    result = prev + ((diff * alpha_v + round_v) >> 8);
+    result = (cur & reset) | (result & ~reset);
+    result = (prev & hole) | (result & ~hole);
+
+    cur16 = __builtin_convertvector (result, v8u16);
+    memcpy (row + x, &cur16, sizeof (cur16));
+    memcpy (history + x, &cur16, sizeof (cur16));
+  }
+
+  /* Same arithmetic for the last few pixels */
+  for (; x < width; x++) {
+    gint cur = row[x], prev = history[x], diff = cur - prev, result;
+
+    if (cur == 0)
+      result = prev;
+    else if (ABS (diff) > delta || prev == 0)
+      result = cur;
+    else
+      result = prev + ((diff * alpha + 128) >> 8);
+    row[x] = history[x] = result;
+  }
+}
+
+static void
+hole_fill_row (guint16 *row, gint width)
+{
+  guint16 last = 0;
+  gint x;
+
+  for (x = 0; x < width; x++) {
+    if (row[x] == 0)
+      row[x] = last;
+    else
+      last = row[x];
+  }
+}
+
+static void
+colorize_row (const guint16 *row, gint width, const guint32 *palette, gint min_depth,
+    gint scale, guint32 *out)
+{
+  gint x;
+
+  for (x = 0; x < width; x++) {
+    /* Up to 65535 * (255 << 16) with a range of one: 64-bit */
+    gint64 index = ((gint64) (row[x] - min_depth) * scale) >> 16;
+
+    out[x] = row[x] ? palette[CLAMP (index, 0, 255)] : 0;
+  }
+}
+
+static void
+process_band (DepthBand *band)
+{
+  DepthProc *self = band->self;
+  gint factor = self->factor;
+  gint width = GST_VIDEO_FRAME_WIDTH (band->out);
+  gint in_stride = GST_VIDEO_FRAME_PLANE_STRIDE (band->in, 0);
+  gint out_stride = GST_VIDEO_FRAME_PLANE_STRIDE (band->out, 0);
+  const guint8 *in = GST_VIDEO_FRAME_PLANE_DATA (band->in, 0);
+  guint8 *out = GST_VIDEO_FRAME_PLANE_DATA (band->out, 0);
+  gint alpha = self->alpha * 256 + 0.5;
+  gint min_depth = MIN (self->min_depth, self->max_depth - 1);
+  gint scale = (255 << 16) / MAX ((gint) self->max_depth - min_depth, 1);
+  guint16 *row = g_alloca (width * sizeof (guint16));
+  gint y;
+
+  for (y = band->first; y < band->last; y++) {
+    guint16 *history = self->history + (gsize) y * width;
+
+    decimate_row (in + (gsize) y * factor * in_stride, in_stride, factor, row, width);
+    if (self->history_valid)
+      temporal_row (row, history, width, alpha, self->delta);
+    else
+      memcpy (history, row, width * sizeof (guint16));
+    if (self->hole_fill)
+      hole_fill_row (row, width);
+    colorize_row (row, width, self->palette, min_depth, scale,
+        (guint32 *) (out + (gsize) y * out_stride));
+  }
+}
+
+static void
+band_thread (gpointer data, gpointer user_data)
+{
+  DepthProc *self = user_data;
+
+  process_band (data);
+
+  g_mutex_lock (&self->lock);
+  if (--self->pending == 0)
+    g_cond_signal (&self->done);
+  g_mutex_unlock (&self->lock);
+}
+
+/* Output size for an input size, or the input sizes for an output size;
+ * anything but a fixed size becomes any size */
+static void
+scale_dimension (GstStructure *structure, const gchar *field, gint factor, gboolean to_output)
+{
+  gint size;
+
+  if (!gst_structure_get_int (structure, field, &size))
+    gst_structure_set (structure, field, GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+  else if (to_output)
+    gst_structure_set (structure, field, G_TYPE_INT, MAX (size / factor, 1), NULL);
+  else if (factor == 1)
+    gst_structure_set (structure, field, G_TYPE_INT, size, NULL);
+  else
+    gst_structure_set (structure, field, GST_TYPE_INT_RANGE, size * factor,
+        size * factor + factor - 1, NULL);
+}
+
+static GstCaps *
+depth_proc_transform_caps (GstBaseTransform *trans, GstPadDirection direction,
+    GstCaps *caps, GstCaps *filter)
+{
+  DepthProc *self = DEPTH_PROC (trans);
+  GstCaps *result = gst_caps_new_empty ();
+  guint i;
+
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    GstStructure *structure = gst_structure_copy (gst_caps_get_structure (caps, i));
+    gboolean to_output = (direction == GST_PAD_SINK);
+
+    gst_structure_set (structure, "format", G_TYPE_STRING, to_output ? "BGRx" : "GRAY16_LE",
+        NULL);
+    scale_dimension (structure, "width", self->decimation, to_output);
+    scale_dimension (structure, "height", self->decimation, to_output);
+    gst_structure_remove_fields (structure, "colorimetry", "chroma-site", NULL);
+    result = gst_caps_merge_structure (result, structure);
+  }
+
+  if (filter) {
+    GstCaps *intersection = gst_caps_intersect_full (filter, result, GST_CAPS_INTERSECT_FIRST);
+
+    gst_caps_unref (result);
+    result = intersection;
+  }
+  return result;
+}
+
+static gboolean
+depth_proc_set_info (GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info,
+    GstCaps *outcaps, GstVideoInfo *out_info)
+{
+  DepthProc *self = DEPTH_PROC (filter);
+  gint width = GST_VIDEO_INFO_WIDTH (out_info), height = GST_VIDEO_INFO_HEIGHT (out_info);
+  guint n_bands;
+
+  if (width * self->decimation > GST_VIDEO_INFO_WIDTH (in_info) ||
+      height * self->decimation > GST_VIDEO_INFO_HEIGHT (in_info)) {
+    GST_ERROR_OBJECT (self, "%dx%d is too large for %dx%d decimated by %u", width, height,
+        GST_VIDEO_INFO_WIDTH (in_info), GST_VIDEO_INFO_HEIGHT (in_info), self->decimation);
+    return FALSE;
+  }
+
+  self->factor = self->decimation;
+  g_free (self->history);
+  self->history = g_new (guint16, (gsize) width * height);
+  self->history_valid = FALSE;
+
+  n_bands = self->threads ? self->threads : g_get_num_processors ();
+  n_bands = CLAMP (n_bands, 1, MIN (MAX_BANDS, (guint) height));
+  if (n_bands != self->n_bands) {
+    if (self->pool)
+      g_thread_pool_free (self->pool, FALSE, TRUE);
+    /* Exclusive threads: they stay around between frames */
+    self->pool = n_bands > 1 ?
+        g_thread_pool_new (band_thread, self, n_bands - 1, TRUE, NULL) : NULL;
+    self->n_bands = n_bands;
+  }
+  GST_INFO_OBJECT (self, "%dx%d -> %dx%d in %u bands", GST_VIDEO_INFO_WIDTH (in_info),
+      GST_VIDEO_INFO_HEIGHT (in_info), width, height, n_bands);
+  return TRUE;
+}
+
+static GstFlowReturn
+depth_proc_transform_frame (GstVideoFilter *filter, GstVideoFrame *in, GstVideoFrame *out)
+{
+  DepthProc *self = DEPTH_PROC (filter);
+  DepthBand bands[MAX_BANDS];
+  gint height = GST_VIDEO_FRAME_HEIGHT (out);
+  gint rows = (height + self->n_bands - 1) / self->n_bands;
+  guint i, n_bands = 0;
+
+  for (i = 0; i < self->n_bands && (gint) i * rows < height; i++, n_bands++) {
+    bands[i].self = self;
+    bands[i].in = in;
+    bands[i].out = out;
+    bands[i].first = i * rows;
+    bands[i].last = MIN ((gint) (i + 1) * rows, height);
+  }
+
+  /* The pool takes all bands but the first, which this thread does */
+  self->pending = n_bands - 1;
+  for (i = 1; i < n_bands; i++)
+    g_thread_pool_push (self->pool, &bands[i], NULL);
+  process_band (&bands[0]);
+
+  g_mutex_lock (&self->lock);
+  while (self->pending > 0)
+    g_cond_wait (&self->done, &self->lock);
+  g_mutex_unlock (&self->lock);
+
+  self->history_valid = TRUE;
+  return GST_FLOW_OK;
+}
+
+static gboolean
+depth_proc_sink_event (GstBaseTransform *trans, GstEvent *event)
+{
+  /* After a seek the previous frames say nothing about the next one */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    DEPTH_PROC (trans)->history_valid = FALSE;
+  return GST_BASE_TRANSFORM_CLASS (depth_proc_parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+depth_proc_stop (GstBaseTransform *trans)
+{
+  DEPTH_PROC (trans)->history_valid = FALSE;
+  return TRUE;
+}
+
+static void
+depth_proc_set_property (GObject *object, guint prop_id, const GValue *value,
+    GParamSpec *pspec)
+{
+  DepthProc *self = DEPTH_PROC (object);
+
+  switch (prop_id) {
+    case PROP_DECIMATION:
+      self->decimation = g_value_get_uint (value);
+      /* The output size changes */
+      gst_base_transform_reconfigure_src (GST_BASE_TRANSFORM (self));
+      break;
+    case PROP_ALPHA:
+      self->alpha = g_value_get_double (value);
+      break;
+    case PROP_DELTA:
+      self->delta = g_value_get_uint (value);
+      break;
+    case PROP_HOLE_FILL:
+      self->hole_fill = g_value_get_boolean (value);
+      break;
+    case PROP_MIN_DEPTH:
+      self->min_depth = g_value_get_uint (value);
+      break;
+    case PROP_MAX_DEPTH:
+      self->max_depth = g_value_get_uint (value);
+      break;
+    case PROP_THREADS:
+      self->threads = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+depth_proc_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  DepthProc *self = DEPTH_PROC (object);
+
+  switch (prop_id) {
+    case PROP_DECIMATION:
+      g_value_set_uint (value, self->decimation);
+      break;
+    case PROP_ALPHA:
+      g_value_set_double (value, self->alpha);
+      break;
+    case PROP_DELTA:
+      g_value_set_uint (value, self->delta);
+      break;
+    case PROP_HOLE_FILL:
+      g_value_set_boolean (value, self->hole_fill);
+      break;
+    case PROP_MIN_DEPTH:
+      g_value_set_uint (value, self->min_depth);
+      break;
+    case PROP_MAX_DEPTH:
+      g_value_set_uint (value, self->max_depth);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, self->threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+depth_proc_finalize (GObject *object)
+{
+  DepthProc *self = DEPTH_PROC (object);
+
+  if (self->pool)
+    g_thread_pool_free (self->pool, FALSE, TRUE);
+  g_free (self->history);
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->done);
+
+  G_OBJECT_CLASS (depth_proc_parent_class)->finalize (object);
+}
+
+static void
+depth_proc_class_init (DepthProcClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+  gobject_class->set_property = depth_proc_set_property;
+  gobject_class->get_property = depth_proc_get_property;
+  gobject_class->finalize = depth_proc_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_DECIMATION,
+      g_param_spec_uint ("decimation", "Decimation",
+          "Input pixels per output pixel, in each direction", 1, 8, 2,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_ALPHA,
+      g_param_spec_double ("alpha", "Alpha",
+          "Weight of the new frame in the temporal average (1 = no smoothing)", 0.0, 1.0, 0.4,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DELTA,
+      g_param_spec_uint ("delta", "Delta",
+          "Depth change that resets the temporal average", 0, G_MAXUINT16, 20,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HOLE_FILL,
+      g_param_spec_boolean ("hole-fill", "Hole fill",
+          "Fill holes with the depth to their left", TRUE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MIN_DEPTH,
+      g_param_spec_uint ("min-depth", "Minimum depth",
+          "Depth at the blue end of the color ramp", 0, G_MAXUINT16, 300,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_DEPTH,
+      g_param_spec_uint ("max-depth", "Maximum depth",
+          "Depth at the red end of the color ramp", 1, G_MAXUINT16, 4000,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Row bands processed in parallel (0 = one per core)", 0, MAX_BANDS, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class, "Depth processing",
+      "Filter/Effect/Video", "Decimates, smooths, hole-fills and colorizes 16-bit depth",
+      "gst-tutorials");
+
+  transform_class->transform_caps = GST_DEBUG_FUNCPTR (depth_proc_transform_caps);
+  transform_class->sink_event = GST_DEBUG_FUNCPTR (depth_proc_sink_event);
+  transform_class->stop = GST_DEBUG_FUNCPTR (depth_proc_stop);
+  filter_class->set_info = GST_DEBUG_FUNCPTR (depth_proc_set_info);
+  filter_class->transform_frame = GST_DEBUG_FUNCPTR (depth_proc_transform_frame);
+}
+
+static void
+depth_proc_init (DepthProc *self)
+{
+  self->decimation = 2;
+  self->alpha = 0.4;
+  self->delta = 20;
+  self->hole_fill = TRUE;
+  self->min_depth = 300;
+  self->max_depth = 4000;
+  palette_init (self->palette);
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->done);
+}
+
+gboolean
+depth_proc_register (void)
+{
+  /* Registered without a plugin and with no rank: only used when asked for by name */
+  return gst_element_register (NULL, "depthproc", GST_RANK_NONE, DEPTH_TYPE_PROC);
+}
@@ -0,0 +1,85 @@
+/*
+`depthproc`: RealSense depth (Z16) post-processing and colorization.
+
+The depth node of a RealSense camera streams 16-bit depth values
+(v4l2src calls the format GRAY16_LE; 0 means "no depth here"). This element
+turns them into a BGRx image, applying the usual filters on the way:
+  - decimation: every `decimation` x `decimation` block becomes one pixel,
+    the mean of the block's valid (non-zero) samples,
+  - temporal smoothing: an exponential moving average per pixel (`alpha`),
+    reset where the depth jumps by more than `delta` (an edge moved) and
+    kept where the new frame has a hole,
+  - hole filling: a remaining hole takes the depth to its left,
+  - colorization: depths between `min-depth` and `max-depth` go through a
+    blue-to-red ramp, holes are black.
+
+Properties:
+  decimation   1-8 (default 2); the output is the input size divided by it
+  alpha        temporal smoothing weight of the new frame, 0-1 (default 0.4);
+               1 disables smoothing
+  delta        depth change that resets the average (default 20 units)
+  hole-fill    fill the remaining holes from the left (default true)
+  min-depth    depth shown as blue (default 300 units, 0.3 m at 1 mm/unit)
+  max-depth    depth shown as red (default 4000)
+  threads      row bands processed in parallel, 0 = one per core (default);
+               applied at the next caps
+
+The stages are fused per output row, so a row is read once and written once,
+and the frame is split into bands of rows processed in parallel by a pool of
+`threads` threads (the streaming thread takes a band too). The temporal
+filter, the heaviest stage, is written with GCC vector extensions and built
+for AVX2 and baseline x86-64 (`target_clones`), picked at load time.
+*/
+#ifndef __DEPTH_PROC_H__
+#define __DEPTH_PROC_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+
+G_BEGIN_DECLS
+
+#define DEPTH_TYPE_PROC (depth_proc_get_type ())
+#define DEPTH_PROC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), DEPTH_TYPE_PROC, DepthProc))
+
+typedef struct _DepthProc DepthProc;
+typedef struct _DepthProcClass DepthProcClass;
+
+struct _DepthProc {
+  GstVideoFilter parent;
+
+  /* Properties */
+  guint decimation;
+  gdouble alpha;
+  guint delta;
+  gboolean hole_fill;
+  guint min_depth;
+  guint max_depth;
+  guint threads;
+
+  /* Set up in set_info */
+  gint factor;                /* negotiated decimation */
+  guint32 palette[256];       /* BGRx */
+  guint16 *history;           /* temporal filter state, one value per output pixel */
+  gboolean history_valid;
+  guint n_bands;
+  GThreadPool *pool;          /* n_bands - 1 threads, NULL when single-threaded */
+
+  /* Per frame: bands still being processed by the pool */
+  GMutex lock;
+  GCond done;
+  guint pending;
+};
+
+struct _DepthProcClass {
+  GstVideoFilterClass parent_class;
+};
+
+GType depth_proc_get_type (void);
+
+/* Registers the element for this process; call once after gst_init */
+gboolean depth_proc_register (void);
+
+G_END_DECLS
+
+#endif /* __DEPTH_PROC_H__ */
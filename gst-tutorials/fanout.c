@@ -0,0 +1,169 @@
+#include "fanout.h"
+
+typedef struct _Branch {
+  GstElement *bin;            /* owned by the pipeline */
+  GstElement *queue;
+
+  /* Written from the capture thread (in) and the branch's thread (out) */
+  gint in;
+  gint out;
+
+  /* Main loop only */
+  gint reported_out;
+} Branch;
+
+struct _FanOut {
+  GstElement *pipeline;       /* not a ref */
+  GstElement *tee;
+  GPtrArray *branches;
+
+  gint captured;              /* entered the tee */
+  gint64 first;               /* g_get_monotonic_time () of the first/last frame */
+  gint64 last;
+
+  gint reported_captured;
+  gint64 reported;            /* g_get_monotonic_time () of the previous report */
+};
+
+static void
+branch_free (Branch *branch)
+{
+  gst_object_unref (branch->queue);
+  g_free (branch);
+}
+
+static GstPadProbeReturn
+capture_probe (GstPad *pad, GstPadProbeInfo *info, FanOut *fanout)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (g_atomic_int_add (&fanout->captured, 1) == 0)
+    fanout->first = now;
+  fanout->last = now;
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+count_probe (GstPad *pad, GstPadProbeInfo *info, gint *counter)
+{
+  g_atomic_int_inc (counter);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+add_count_probe (GstElement *element, const gchar *pad_name, gint *counter)
+{
+  GstPad *pad = gst_element_get_static_pad (element, pad_name);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) count_probe,
+      counter, NULL);
+  gst_object_unref (pad);
+}
+
+FanOut *
+fanout_new (GstElement *pipeline, GstElement *upstream)
+{
+  FanOut *fanout = g_new0 (FanOut, 1);
+  GstPad *pad;
+
+  fanout->pipeline = pipeline;
+  fanout->branches = g_ptr_array_new_with_free_func ((GDestroyNotify) branch_free);
+  fanout->reported = g_get_monotonic_time ();
+
+  /* Without allow-not-linked, a branch unlinked at runtime would stop capture */
+  fanout->tee = gst_element_factory_make ("tee", "fanout");
+  g_object_set (fanout->tee, "allow-not-linked", TRUE, NULL);
+  gst_bin_add (GST_BIN (pipeline), fanout->tee);
+  if (!gst_element_link (upstream, fanout->tee))
+    g_printerr ("Could not link %s to the tee.\n", GST_OBJECT_NAME (upstream));
+
+  pad = gst_element_get_static_pad (fanout->tee, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) capture_probe,
+      fanout, NULL);
+  gst_object_unref (pad);
+  return fanout;
+}
+
+void
+fanout_free (FanOut *fanout)
+{
+  g_ptr_array_unref (fanout->branches);
+  g_free (fanout);
+}
+
+GstElement *
+fanout_add_branch (FanOut *fanout, const gchar *name, const gchar *description,
+    guint queue_size)
+{
+  Branch *branch;
+  GstElement *bin;
+  GstPad *tee_pad, *sink_pad;
+  GError *error = NULL;
+  gchar *full;
+
+  full = g_strdup_printf ("queue name=queue leaky=downstream max-size-buffers=%u "
+      "max-size-bytes=0 max-size-time=0 ! %s", queue_size, description);
+  bin = gst_parse_bin_from_description (full, TRUE, &error);
+  g_free (full);
+  if (!bin) {
+    g_printerr ("Could not build the %s branch: %s\n", name, error->message);
+    g_clear_error (&error);
+    return NULL;
+  }
+  gst_object_set_name (GST_OBJECT (bin), name);
+
+  branch = g_new0 (Branch, 1);
+  branch->bin = bin;
+  branch->queue = gst_bin_get_by_name (GST_BIN (bin), "queue");
+  add_count_probe (branch->queue, "sink", &branch->in);
+  add_count_probe (branch->queue, "src", &branch->out);
+  g_ptr_array_add (fanout->branches, branch);
+
+  gst_bin_add (GST_BIN (fanout->pipeline), bin);
+  tee_pad = gst_element_request_pad_simple (fanout->tee, "src_%u");
+  sink_pad = gst_element_get_static_pad (bin, "sink");
+  if (GST_PAD_LINK_FAILED (gst_pad_link (tee_pad, sink_pad)))
+    g_printerr ("Could not link the %s branch to the tee.\n", name);
+  gst_object_unref (sink_pad);
+  gst_object_unref (tee_pad);
+
+  /* Branches added to a running pipeline catch up with it */
+  gst_element_sync_state_with_parent (bin);
+  return bin;
+}
+
+void
+fanout_report (FanOut *fanout, gboolean final)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint captured = g_atomic_int_get (&fanout->captured);
+  gdouble seconds;
+  guint i;
+
+  if (final) {
+    seconds = (fanout->last - fanout->first) / 1e6;
+    g_print ("\nFan-out totals: %d frames captured, %.1f frames/s\n", captured,
+        seconds > 0 ? captured / seconds : 0.0);
+  } else {
+    seconds = (now - fanout->reported) / 1e6;
+    g_print ("\nCapture: %.1f frames/s\n",
+        seconds > 0 ? (captured - fanout->reported_captured) / seconds : 0.0);
+  }
+  g_print ("  %-12s %10s %10s %10s\n", "branch", "frames", "frames/s", "dropped");
+
+  for (i = 0; i < fanout->branches->len; i++) {
+    Branch *branch = g_ptr_array_index (fanout->branches, i);
+    gint in = g_atomic_int_get (&branch->in);
+    gint out = g_atomic_int_get (&branch->out);
+    guint level = 0;
+
+    g_object_get (branch->queue, "current-level-buffers", &level, NULL);
+    g_print ("  %-12s %10d %10.1f %10d\n", GST_OBJECT_NAME (branch->bin), out,
+        seconds > 0 ? (final ? out : out - branch->reported_out) / seconds : 0.0,
+        MAX (0, in - out - (gint) level));
+    branch->reported_out = out;
+  }
+
+  fanout->reported_captured = captured;
+  fanout->reported = now;
+}
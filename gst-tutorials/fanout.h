@@ -0,0 +1,44 @@
+/*
+Fan-out of one live stream to several consumers that cannot hold each other up.
+
+A `tee` pushes every frame into each of its branches in turn, on the
+source's streaming thread, so a single branch that blocks (a full encoder, a
+slow analytics callback, a display waiting for vsync) stalls capture and with
+it every other branch. Here every branch starts with a leaky queue:
+  tee ! queue leaky=downstream max-size-buffers=N ! <branch>
+The queue moves the branch onto a thread of its own and, when that thread
+falls behind, drops the oldest frame instead of blocking the tee. Capture
+then keeps running at the sensor rate whatever the consumers do, and a
+lagging consumer loses frames in its own branch only.
+
+Frames entering the tee and entering/leaving each queue are counted; what
+went in but neither came out nor is still queued was dropped.
+`fanout_report` prints capture frames/s and per-branch frames/s and drops.
+*/
+#ifndef __FANOUT_H__
+#define __FANOUT_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _FanOut FanOut;
+
+/* Adds a tee to `pipeline` and links `upstream`'s src pad to it */
+FanOut *fanout_new (GstElement *pipeline, GstElement *upstream);
+void fanout_free (FanOut *fanout);
+
+/*
+ Builds "queue ! `description`" as a bin named `name`, adds it and links it
+ to the tee. Returns the bin (owned by the pipeline) so callers can look up
+ elements in it, or NULL if `description` does not parse.
+*/
+GstElement *fanout_add_branch (FanOut *fanout, const gchar *name, const gchar *description,
+    guint queue_size);
+
+/* Frames/s and drops since the previous report; `final` reports the whole run */
+void fanout_report (FanOut *fanout, gboolean final);
+
+G_END_DECLS
+
+#endif /* __FANOUT_H__ */
@@ -0,0 +1,64 @@
+#include "fast-start.h"
+
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+/* Set by the Makefile from `pkg-config --variable=pluginsdir gstreamer-1.0` */
+#ifndef GST_PLUGINS_DIR
+#define GST_PLUGINS_DIR "/usr/lib/x86_64-linux-gnu/gstreamer-1.0"
+#endif
+
+gboolean
+fast_start_requested (gint argc, gchar **argv, const gchar *flag)
+{
+  gint i;
+
+  for (i = 1; i < argc; i++)
+    if (g_strcmp0 (argv[i], flag) == 0)
+      return TRUE;
+  return FALSE;
+}
+
+gboolean
+fast_start_setup (const gchar *name, const gchar *const *plugins)
+{
+  gchar *dir, *plugin_dir, *registry;
+  guint linked = 0;
+
+  dir = g_build_filename (g_get_user_cache_dir (), "gst-tutorials", "fast-start", name, NULL);
+  plugin_dir = g_build_filename (dir, "plugins", NULL);
+  registry = g_build_filename (dir, "registry.bin", NULL);
+  g_mkdir_with_parents (plugin_dir, 0755);
+
+  for (; *plugins; plugins++) {
+    gchar *file = g_strdup_printf ("libgst%s.so", *plugins);
+    gchar *target = g_build_filename (GST_PLUGINS_DIR, file, NULL);
+    gchar *link = g_build_filename (plugin_dir, file, NULL);
+
+    /* Plugins get renamed between releases (videoconvert -> videoconvertscale) */
+    if (g_file_test (target, G_FILE_TEST_EXISTS)) {
+      if (g_file_test (link, G_FILE_TEST_EXISTS) || symlink (target, link) == 0)
+        linked++;
+    } else {
+      g_unlink (link);
+    }
+    g_free (link);
+    g_free (target);
+    g_free (file);
+  }
+
+  if (linked > 0) {
+    g_setenv ("GST_PLUGIN_SYSTEM_PATH_1_0", plugin_dir, TRUE);
+    g_setenv ("GST_PLUGIN_PATH_1_0", "", TRUE);
+    g_setenv ("GST_REGISTRY_1_0", registry, TRUE);
+    /* Scanning a few plugins in-process is cheaper than forking gst-plugin-scanner */
+    g_setenv ("GST_REGISTRY_FORK", "no", TRUE);
+  } else {
+    g_printerr ("Fast start: no plugins found in %s, using the full registry.\n", GST_PLUGINS_DIR);
+  }
+
+  g_free (registry);
+  g_free (plugin_dir);
+  g_free (dir);
+  return linked > 0;
+}
@@ -0,0 +1,32 @@
+/*
+Fast start: a minimal plugin registry for programs that know their elements.
+
+gst_init loads (and, when plugins changed, rebuilds) a registry describing
+every installed plugin, typically a few hundred of them. A program that
+builds its pipeline from explicitly named elements needs only a handful.
+`fast_start_setup` points GStreamer at a private directory holding symlinks to
+just those plugins, with its own registry file next to it, so gst_init reads
+a registry of a few entries. The first fast run builds that registry (scanning
+only the linked plugins, in-process); later runs just load it.
+
+It works through environment variables, so it must be called before gst_init
+and before parsing options with gst_init_get_option_group (whose post-parse
+hook runs gst_init); `fast_start_requested` looks for the flag in argv for
+that reason.
+*/
+#ifndef __FAST_START_H__
+#define __FAST_START_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* `plugins` are file names without "libgst" and ".so"; missing ones are skipped */
+gboolean fast_start_setup (const gchar *name, const gchar *const *plugins);
+
+/* Whether `flag` (e.g. "--fast-start") is on the command line */
+gboolean fast_start_requested (gint argc, gchar **argv, const gchar *flag);
+
+G_END_DECLS
+
+#endif /* __FAST_START_H__ */
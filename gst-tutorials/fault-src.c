@@ -0,0 +1,296 @@
+#include "fault-src.h"
+
+#define DEFAULT_FAULT_INTERVAL 0
+#define DEFAULT_FAULTS -1
+#define DEFAULT_FAILED_STARTS 0
+#define DEFAULT_START_DELAY 0
+
+/* Without a frame rate (0/1) frames still come at the camera's 30/s */
+#define FALLBACK_DURATION (GST_SECOND / 30)
+
+enum {
+  PROP_0,
+  PROP_FAULT_INTERVAL,
+  PROP_FAULTS,
+  PROP_FAILED_STARTS,
+  PROP_START_DELAY,
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ YUY2, GRAY16_LE, BGRx }")));
+
+G_DEFINE_TYPE (FaultSrc, fault_src, GST_TYPE_PUSH_SRC);
+
+static GstCaps *
+fault_src_fixate (GstBaseSrc *src, GstCaps *caps)
+{
+  GstStructure *structure;
+
+  caps = gst_caps_truncate (gst_caps_make_writable (caps));
+  structure = gst_caps_get_structure (caps, 0);
+  gst_structure_fixate_field_string (structure, "format", "YUY2");
+  gst_structure_fixate_field_nearest_int (structure, "width", 1920);
+  gst_structure_fixate_field_nearest_int (structure, "height", 1080);
+  gst_structure_fixate_field_nearest_fraction (structure, "framerate", 30, 1);
+  return GST_BASE_SRC_CLASS (fault_src_parent_class)->fixate (src, caps);
+}
+
+static gboolean
+fault_src_set_caps (GstBaseSrc *src, GstCaps *caps)
+{
+  FaultSrc *self = FAULT_SRC (src);
+
+  if (!gst_video_info_from_caps (&self->info, caps))
+    return FALSE;
+  if (GST_VIDEO_INFO_FPS_N (&self->info) > 0)
+    self->duration = gst_util_uint64_scale_int (GST_SECOND, GST_VIDEO_INFO_FPS_D (&self->info),
+        GST_VIDEO_INFO_FPS_N (&self->info));
+  else
+    self->duration = FALLBACK_DURATION;
+  return TRUE;
+}
+
+/* A camera's latency: the frame has been exposed for one frame time when it is captured */
+static gboolean
+fault_src_query (GstBaseSrc *src, GstQuery *query)
+{
+  FaultSrc *self = FAULT_SRC (src);
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_LATENCY && GST_CLOCK_TIME_IS_VALID (self->duration)) {
+    gst_query_set_latency (query, TRUE, self->duration, self->duration);
+    return TRUE;
+  }
+  return GST_BASE_SRC_CLASS (fault_src_parent_class)->query (src, query);
+}
+
+static gboolean
+fault_src_start (GstBaseSrc *src)
+{
+  FaultSrc *self = FAULT_SRC (src);
+
+  if (self->start_delay)
+    g_usleep (self->start_delay * G_TIME_SPAN_MILLISECOND);
+  if (self->starts_to_fail) {
+    self->starts_to_fail--;
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ, ("Injected start failure."),
+        ("%u more starts will fail", self->starts_to_fail));
+    return FALSE;
+  }
+  self->frames = 0;
+  self->next = GST_CLOCK_TIME_NONE;
+  return TRUE;
+}
+
+static gboolean
+fault_src_stop (GstBaseSrc *src)
+{
+  return TRUE;
+}
+
+static gboolean
+fault_src_unlock (GstBaseSrc *src)
+{
+  FaultSrc *self = FAULT_SRC (src);
+
+  g_mutex_lock (&self->lock);
+  self->flushing = TRUE;
+  if (self->clock_id)
+    gst_clock_id_unschedule (self->clock_id);
+  g_mutex_unlock (&self->lock);
+  return TRUE;
+}
+
+static gboolean
+fault_src_unlock_stop (GstBaseSrc *src)
+{
+  FaultSrc *self = FAULT_SRC (src);
+
+  g_mutex_lock (&self->lock);
+  self->flushing = FALSE;
+  g_mutex_unlock (&self->lock);
+  return TRUE;
+}
+
+/* Waits until `self->next` on `clock`; FALSE if unlock() interrupted */
+static gboolean
+wait_for_capture (FaultSrc *self, GstClock *clock)
+{
+  GstClockReturn ret;
+
+  g_mutex_lock (&self->lock);
+  if (self->flushing) {
+    g_mutex_unlock (&self->lock);
+    return FALSE;
+  }
+  self->clock_id = gst_clock_new_single_shot_id (clock, self->next);
+  g_mutex_unlock (&self->lock);
+
+  ret = gst_clock_id_wait (self->clock_id, NULL);
+
+  g_mutex_lock (&self->lock);
+  gst_clock_id_unref (self->clock_id);
+  self->clock_id = NULL;
+  g_mutex_unlock (&self->lock);
+  return ret != GST_CLOCK_UNSCHEDULED;
+}
+
+static GstFlowReturn
+fault_src_create (GstPushSrc *src, GstBuffer **out)
+{
+  FaultSrc *self = FAULT_SRC (src);
+  GstClock *clock = gst_element_get_clock (GST_ELEMENT (self));
+  GstBuffer *buffer;
+  gboolean captured;
+
+  if (!clock)
+    return GST_FLOW_FLUSHING;
+
+  /* The first frame is captured right away, then one every frame time */
+  if (GST_CLOCK_TIME_IS_VALID (self->next))
+    self->next += self->duration;
+  else
+    self->next = gst_clock_get_time (clock);
+  captured = wait_for_capture (self, clock);
+  gst_object_unref (clock);
+  if (!captured)
+    return GST_FLOW_FLUSHING;
+
+  if (self->fault_interval && self->frames == self->fault_interval &&
+      (self->faults < 0 || self->injected < self->faults)) {
+    self->injected++;
+    self->starts_to_fail = self->failed_starts;
+    GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Injected fault."),
+        ("fault %d, after %" G_GUINT64_FORMAT " frames", self->injected, self->frames));
+    return GST_FLOW_ERROR;
+  }
+
+  buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&self->info), NULL);
+  gst_buffer_memset (buffer, 0, 16 + self->frames % 200, GST_VIDEO_INFO_SIZE (&self->info));
+  GST_BUFFER_PTS (buffer) = self->next - gst_element_get_base_time (GST_ELEMENT (self));
+  GST_BUFFER_DURATION (buffer) = self->duration;
+  GST_BUFFER_OFFSET (buffer) = self->frames++;
+  *out = buffer;
+  return GST_FLOW_OK;
+}
+
+static void
+fault_src_set_property (GObject *object, guint prop_id, const GValue *value,
+    GParamSpec *pspec)
+{
+  FaultSrc *self = FAULT_SRC (object);
+
+  switch (prop_id) {
+    case PROP_FAULT_INTERVAL:
+      self->fault_interval = g_value_get_uint (value);
+      break;
+    case PROP_FAULTS:
+      self->faults = g_value_get_int (value);
+      break;
+    case PROP_FAILED_STARTS:
+      self->failed_starts = g_value_get_uint (value);
+      break;
+    case PROP_START_DELAY:
+      self->start_delay = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+fault_src_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  FaultSrc *self = FAULT_SRC (object);
+
+  switch (prop_id) {
+    case PROP_FAULT_INTERVAL:
+      g_value_set_uint (value, self->fault_interval);
+      break;
+    case PROP_FAULTS:
+      g_value_set_int (value, self->faults);
+      break;
+    case PROP_FAILED_STARTS:
+      g_value_set_uint (value, self->failed_starts);
+      break;
+    case PROP_START_DELAY:
+      g_value_set_uint (value, self->start_delay);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+fault_src_finalize (GObject *object)
+{
+  FaultSrc *self = FAULT_SRC (object);
+
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (fault_src_parent_class)->finalize (object);
+}
+
+static void
+fault_src_class_init (FaultSrcClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *base_class = GST_BASE_SRC_CLASS (klass);
+  GstPushSrcClass *push_class = GST_PUSH_SRC_CLASS (klass);
+
+  gobject_class->set_property = fault_src_set_property;
+  gobject_class->get_property = fault_src_get_property;
+  gobject_class->finalize = fault_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_FAULT_INTERVAL,
+      g_param_spec_uint ("fault-interval", "Fault interval",
+          "Frames between injected faults, 0 = never", 0, G_MAXUINT, DEFAULT_FAULT_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FAULTS,
+      g_param_spec_int ("faults", "Faults", "Faults to inject, -1 = no limit", -1, G_MAXINT,
+          DEFAULT_FAULTS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FAILED_STARTS,
+      g_param_spec_uint ("failed-starts", "Failed starts",
+          "Starts that fail after each fault", 0, G_MAXUINT, DEFAULT_FAILED_STARTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_START_DELAY,
+      g_param_spec_uint ("start-delay", "Start delay", "Time a start takes (ms)", 0, G_MAXUINT,
+          DEFAULT_START_DELAY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class, "Faulty camera stand-in",
+      "Source/Video", "Live test frames with injected read and start failures",
+      "gst-tutorials");
+
+  base_class->fixate = GST_DEBUG_FUNCPTR (fault_src_fixate);
+  base_class->set_caps = GST_DEBUG_FUNCPTR (fault_src_set_caps);
+  base_class->query = GST_DEBUG_FUNCPTR (fault_src_query);
+  base_class->start = GST_DEBUG_FUNCPTR (fault_src_start);
+  base_class->stop = GST_DEBUG_FUNCPTR (fault_src_stop);
+  base_class->unlock = GST_DEBUG_FUNCPTR (fault_src_unlock);
+  base_class->unlock_stop = GST_DEBUG_FUNCPTR (fault_src_unlock_stop);
+  push_class->create = GST_DEBUG_FUNCPTR (fault_src_create);
+}
+
+static void
+fault_src_init (FaultSrc *self)
+{
+  self->fault_interval = DEFAULT_FAULT_INTERVAL;
+  self->faults = DEFAULT_FAULTS;
+  self->failed_starts = DEFAULT_FAILED_STARTS;
+  self->start_delay = DEFAULT_START_DELAY;
+  self->duration = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&self->lock);
+  gst_base_src_set_live (GST_BASE_SRC (self), TRUE);
+  gst_base_src_set_format (GST_BASE_SRC (self), GST_FORMAT_TIME);
+}
+
+gboolean
+fault_src_register (void)
+{
+  /* Registered without a plugin and with no rank: only used when asked for by name */
+  return gst_element_register (NULL, "faultsrc", GST_RANK_NONE, FAULT_TYPE_SRC);
+}
@@ -0,0 +1,80 @@
+/*
+`faultsrc`: a live camera stand-in that fails on purpose.
+
+A camera hiccups by failing a buffer dequeue (v4l2src posts a RESOURCE READ
+error and returns GST_FLOW_ERROR) and sometimes by refusing to start again
+for a while. This source does the same on a schedule, so recovery can be
+exercised and timed without unplugging anything:
+  - it produces frames like a camera: live, paced by the pipeline clock at
+    the negotiated frame rate, timestamped with the running time at capture,
+    so timestamps stay valid across a restart,
+  - after every `fault-interval` frames it posts a RESOURCE READ error and
+    returns GST_FLOW_ERROR, up to `faults` times,
+  - after a fault its next `failed-starts` starts fail (RESOURCE OPEN_READ),
+    and every start takes `start-delay` (stream-on, sensor warm-up).
+
+Properties:
+  fault-interval   frames between faults, 0 = never (default 0)
+  faults           faults to inject, -1 = no limit (default -1)
+  failed-starts    starts that fail after each fault (default 0)
+  start-delay      time a start takes, in ms (default 0)
+
+Caps are YUY2, GRAY16_LE or BGRx, fixated to 1920x1080@30 (what the
+RealSense color node produces) unless downstream asks for something else.
+Frames are a flat gray changing with the frame number; only their timing
+is realistic.
+*/
+#ifndef __FAULT_SRC_H__
+#define __FAULT_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+#define FAULT_TYPE_SRC (fault_src_get_type ())
+#define FAULT_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), FAULT_TYPE_SRC, FaultSrc))
+
+typedef struct _FaultSrc FaultSrc;
+typedef struct _FaultSrcClass FaultSrcClass;
+
+struct _FaultSrc {
+  GstPushSrc parent;
+
+  /* Properties */
+  guint fault_interval;
+  gint faults;
+  guint failed_starts;
+  guint start_delay;
+
+  /* Set up in set_caps */
+  GstVideoInfo info;
+  GstClockTime duration;      /* of a frame */
+
+  /* Survive restarts: the schedule runs over the element's lifetime */
+  gint injected;
+  guint starts_to_fail;
+
+  /* Per start */
+  guint64 frames;
+  GstClockTime next;          /* clock time of the next capture, NONE before the first */
+
+  /* unlock() cancels the wait for the next capture */
+  GMutex lock;
+  GstClockID clock_id;
+  gboolean flushing;
+};
+
+struct _FaultSrcClass {
+  GstPushSrcClass parent_class;
+};
+
+GType fault_src_get_type (void);
+
+/* Registers the element for this process; call once after gst_init */
+gboolean fault_src_register (void);
+
+G_END_DECLS
+
+#endif /* __FAULT_SRC_H__ */
@@ -0,0 +1,245 @@
+#include "frame-ring.h"
+
+typedef struct _Slot {
+  FrameView view;             /* first, so a view is its slot */
+  FrameRing *ring;
+  gint refcount;
+  GstSample *sample;
+  GstVideoFrame frame;
+} Slot;
+
+struct _FrameRing {
+  GstElement *appsink;        /* not a ref */
+  gulong new_sample_id;
+  gulong eos_id;
+
+  Slot *slots;
+  guint capacity;
+
+  GMutex lock;                /* protects everything below */
+  GCond cond;
+  guint *free;                /* stack of free slot indices */
+  guint n_free;
+  guint *queued;              /* circular FIFO of queued slot indices */
+  guint head;
+  guint n_queued;
+  gboolean eos;
+  guint64 dropped;
+
+  /* Streaming thread only: caps are parsed again only when they change */
+  GstCaps *caps;
+  GstVideoInfo info;
+};
+
+/* Unmaps and releases the frame in `slot`; the slot itself is not freed */
+static void
+slot_clear (Slot *slot)
+{
+  gst_video_frame_unmap (&slot->frame);
+  gst_sample_unref (slot->sample);
+  slot->sample = NULL;
+}
+
+static void
+put_free (FrameRing *ring, guint index)
+{
+  ring->free[ring->n_free++] = index;
+}
+
+static GstFlowReturn
+new_sample_cb (GstElement *appsink, FrameRing *ring)
+{
+  gint64 received = g_get_monotonic_time ();
+  GstSample *sample = NULL;
+  GstBuffer *buffer;
+  GstCaps *caps;
+  Slot *slot, *evicted = NULL;
+  guint index;
+  guint i;
+
+  g_signal_emit_by_name (appsink, "pull-sample", &sample);
+  if (!sample)
+    return GST_FLOW_EOS;
+  buffer = gst_sample_get_buffer (sample);
+  caps = gst_sample_get_caps (sample);
+  if (caps != ring->caps) {
+    if (!caps || !gst_video_info_from_caps (&ring->info, caps)) {
+      gst_sample_unref (sample);
+      return GST_FLOW_NOT_NEGOTIATED;
+    }
+    gst_caps_replace (&ring->caps, caps);
+  }
+
+  g_mutex_lock (&ring->lock);
+  if (ring->n_free > 0) {
+    index = ring->free[--ring->n_free];
+  } else if (ring->n_queued > 0) {
+    /* The consumer is behind: the oldest queued frame makes room */
+    index = ring->queued[ring->head];
+    ring->head = (ring->head + 1) % ring->capacity;
+    ring->n_queued--;
+    ring->dropped++;
+    evicted = &ring->slots[index];
+  } else {
+    /* Every slot is held by the consumer */
+    ring->dropped++;
+    g_mutex_unlock (&ring->lock);
+    gst_sample_unref (sample);
+    return GST_FLOW_OK;
+  }
+  g_mutex_unlock (&ring->lock);
+
+  /* The slot is ours now: unmap and map outside the lock */
+  if (evicted)
+    slot_clear (evicted);
+  slot = &ring->slots[index];
+  if (!gst_video_frame_map (&slot->frame, &ring->info, buffer, GST_MAP_READ)) {
+    gst_sample_unref (sample);
+    g_mutex_lock (&ring->lock);
+    put_free (ring, index);
+    g_mutex_unlock (&ring->lock);
+    return GST_FLOW_ERROR;
+  }
+
+  slot->sample = sample;
+  slot->refcount = 1;
+  slot->view.format = GST_VIDEO_FRAME_FORMAT (&slot->frame);
+  slot->view.width = GST_VIDEO_FRAME_WIDTH (&slot->frame);
+  slot->view.height = GST_VIDEO_FRAME_HEIGHT (&slot->frame);
+  slot->view.n_planes = GST_VIDEO_FRAME_N_PLANES (&slot->frame);
+  for (i = 0; i < slot->view.n_planes; i++) {
+    slot->view.data[i] = GST_VIDEO_FRAME_PLANE_DATA (&slot->frame, i);
+    slot->view.stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE (&slot->frame, i);
+  }
+  slot->view.pts = GST_BUFFER_PTS (buffer);
+  slot->view.duration = GST_BUFFER_DURATION (buffer);
+  slot->view.received = received;
+
+  g_mutex_lock (&ring->lock);
+  ring->queued[(ring->head + ring->n_queued) % ring->capacity] = index;
+  ring->n_queued++;
+  g_cond_signal (&ring->cond);
+  g_mutex_unlock (&ring->lock);
+  return GST_FLOW_OK;
+}
+
+static void
+eos_cb (GstElement *appsink, FrameRing *ring)
+{
+  g_mutex_lock (&ring->lock);
+  ring->eos = TRUE;
+  g_cond_broadcast (&ring->cond);
+  g_mutex_unlock (&ring->lock);
+}
+
+FrameRing *
+frame_ring_new (GstElement *appsink, guint capacity)
+{
+  FrameRing *ring = g_new0 (FrameRing, 1);
+  guint i;
+
+  ring->appsink = appsink;
+  ring->capacity = MAX (capacity, 1);
+  ring->slots = g_new0 (Slot, ring->capacity);
+  ring->free = g_new (guint, ring->capacity);
+  ring->queued = g_new (guint, ring->capacity);
+  for (i = 0; i < ring->capacity; i++) {
+    ring->slots[i].ring = ring;
+    put_free (ring, ring->capacity - 1 - i);
+  }
+  g_mutex_init (&ring->lock);
+  g_cond_init (&ring->cond);
+
+  g_object_set (appsink, "emit-signals", TRUE, NULL);
+  ring->new_sample_id = g_signal_connect (appsink, "new-sample", G_CALLBACK (new_sample_cb), ring);
+  ring->eos_id = g_signal_connect (appsink, "eos", G_CALLBACK (eos_cb), ring);
+  return ring;
+}
+
+void
+frame_ring_free (FrameRing *ring)
+{
+  g_signal_handler_disconnect (ring->appsink, ring->new_sample_id);
+  g_signal_handler_disconnect (ring->appsink, ring->eos_id);
+
+  /* Frames nobody popped */
+  while (ring->n_queued > 0) {
+    slot_clear (&ring->slots[ring->queued[ring->head]]);
+    ring->head = (ring->head + 1) % ring->capacity;
+    ring->n_queued--;
+  }
+  gst_caps_replace (&ring->caps, NULL);
+  g_cond_clear (&ring->cond);
+  g_mutex_clear (&ring->lock);
+  g_free (ring->queued);
+  g_free (ring->free);
+  g_free (ring->slots);
+  g_free (ring);
+}
+
+const FrameView *
+frame_ring_pop (FrameRing *ring, gint64 timeout_us)
+{
+  gint64 end_time = g_get_monotonic_time () + timeout_us;
+  Slot *slot = NULL;
+
+  g_mutex_lock (&ring->lock);
+  while (ring->n_queued == 0 && !ring->eos) {
+    if (timeout_us < 0)
+      g_cond_wait (&ring->cond, &ring->lock);
+    else if (!g_cond_wait_until (&ring->cond, &ring->lock, end_time))
+      break;
+  }
+  if (ring->n_queued > 0) {
+    slot = &ring->slots[ring->queued[ring->head]];
+    ring->head = (ring->head + 1) % ring->capacity;
+    ring->n_queued--;
+  }
+  g_mutex_unlock (&ring->lock);
+
+  return slot ? &slot->view : NULL;
+}
+
+gboolean
+frame_ring_is_done (FrameRing *ring)
+{
+  gboolean done;
+
+  g_mutex_lock (&ring->lock);
+  done = ring->eos && ring->n_queued == 0;
+  g_mutex_unlock (&ring->lock);
+  return done;
+}
+
+const FrameView *
+frame_view_ref (const FrameView *view)
+{
+  g_atomic_int_inc (&((Slot *) view)->refcount);
+  return view;
+}
+
+void
+frame_view_unref (const FrameView *view)
+{
+  Slot *slot = (Slot *) view;
+  FrameRing *ring = slot->ring;
+
+  if (!g_atomic_int_dec_and_test (&slot->refcount))
+    return;
+
+  slot_clear (slot);
+  g_mutex_lock (&ring->lock);
+  put_free (ring, slot - ring->slots);
+  g_mutex_unlock (&ring->lock);
+}
+
+guint64
+frame_ring_get_dropped (FrameRing *ring)
+{
+  guint64 dropped;
+
+  g_mutex_lock (&ring->lock);
+  dropped = ring->dropped;
+  g_mutex_unlock (&ring->lock);
+  return dropped;
+}
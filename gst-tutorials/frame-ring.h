@@ -0,0 +1,66 @@
+/*
+Zero-copy access to the frames an appsink receives.
+
+`frame_ring_new` connects to an appsink's new-sample signal. Every sample it
+pulls is mapped in place with gst_video_frame_map (for system memory that is
+just a pointer; nothing is copied) into one of `capacity` slots allocated up
+front, and queued for the consumer. The consumer pops `FrameView`s: plane
+pointers, strides, size, format and timestamps pointing straight into the
+GstBuffer's memory. A view is reference counted; once the last reference is
+dropped its buffer is unmapped and released back to the pipeline (usually to
+the upstream buffer pool), and the slot is reused.
+
+The ring never grows: when the consumer falls behind and every slot is
+queued, the oldest queued frame is dropped to make room, and when every slot
+is held by the consumer the new frame is dropped. So memory is bounded and,
+in the steady state, the ring itself allocates nothing per frame (appsink
+still allocates one small GstSample per frame).
+*/
+#ifndef __FRAME_RING_H__
+#define __FRAME_RING_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+typedef struct _FrameView {
+  GstVideoFormat format;
+  gint width;
+  gint height;
+  guint n_planes;
+  const guint8 *data[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+  GstClockTime pts;
+  GstClockTime duration;
+  gint64 received;            /* g_get_monotonic_time () when the appsink had it */
+} FrameView;
+
+typedef struct _FrameRing FrameRing;
+
+/* The appsink must outlive the ring; emit-signals is turned on here */
+FrameRing *frame_ring_new (GstElement *appsink, guint capacity);
+
+/* All views must have been released */
+void frame_ring_free (FrameRing *ring);
+
+/*
+ The oldest queued frame, waiting up to `timeout_us` (-1 = forever) for one.
+ Returns NULL on timeout or once the appsink reached EOS and the ring is empty.
+ The caller owns one reference.
+*/
+const FrameView *frame_ring_pop (FrameRing *ring, gint64 timeout_us);
+
+const FrameView *frame_view_ref (const FrameView *view);
+void frame_view_unref (const FrameView *view);
+
+/* The appsink reached EOS and every frame has been popped: pop returns NULL
+   from now on, without waiting */
+gboolean frame_ring_is_done (FrameRing *ring);
+
+/* Frames dropped because the consumer was behind */
+guint64 frame_ring_get_dropped (FrameRing *ring);
+
+G_END_DECLS
+
+#endif /* __FRAME_RING_H__ */
@@ -1,90 +1,1360 @@
 /*
-Run: gcc gstreamer_realsense.c -o reals `pkg-config --cflags --libs gstreamer-1.0`
+Build: make gstreamer_realsense
+
+Usage:
+  ./gstreamer_realsense                            # /dev/video2 ! videoconvert ! ximagesink
+  ./gstreamer_realsense --zero-copy --io-mode=dmabuf
+                                                   # skip videoconvert when caps match
+  ./gstreamer_realsense --zero-copy --test-src --sink=fakesink --num-buffers=300
+                                                   # no camera needed (videotestsrc stand-in)
+  ./gstreamer_realsense --zero-copy --device=/dev/video10
+                                                   # v4l2loopback stand-in
+  ./gstreamer_realsense --profile-startup --fast-start
+                                                   # time to first frame, minimal registry
+  ./gstreamer_realsense --camera=/dev/video2 --camera=/dev/video4,queue=1,max-lateness=10
+                                                   # several cameras, one pipeline
+  ./gstreamer_realsense --test-cameras=8 --sink=fakesink --num-buffers=300
+                                                   # eight videotestsrc stand-ins
+  ./gstreamer_realsense --fanout --record=out.mkv --analytics-delay=100
+                                                   # display + recorder + slow analytics
+  ./gstreamer_realsense --simd-convert             # simdconvert instead of videoconvert
+  ./gstreamer_realsense --depth --device=/dev/video0
+                                                   # colorized depth stream
+  ./gstreamer_realsense --low-latency --latency-budget=50
+                                                   # live tuning, capture-to-render histogram
+  ./gstreamer_realsense --segments=rec-%05d.mkv --segment-time=60
+                                                   # continuous recording, 1 min segments
+  ./gstreamer_realsense --recover --test-src --inject-faults=90
+                                                   # restart the camera alone on errors
+  ./gstreamer_realsense --publish=/tmp/rs.sock --measure-latency
+  ./gstreamer_realsense --subscribe=/tmp/rs.sock --policy=drop --sink=fakesink
+                                                   # one capture, frames shared with other processes
+  ./gstreamer_realsense --rtp-send=127.0.0.1:5000 --test-src
+  ./gstreamer_realsense --rtp-receive=5000 --jitter-latency=50 --rtp-loss=1 --rtp-delay-jitter=10
+                                                   # RTP/UDP to another machine, loss/jitter/latency
+  ./gstreamer_realsense --metrics-port=9464 --metrics-file=/tmp/realsense.prom
+                                                   # Prometheus metrics while it runs
+
+Zero-copy mode:
+  By default every frame is copied at least twice: `v4l2src` hands out system
+  memory (or reads into it with io-mode=rw) and `videoconvert` writes a new
+  frame in the sink's format. With `--zero-copy` we bring the source and the
+  sink to READY, ask both for the caps they can handle and, if they have a
+  common format, link them directly with that format as a filter so the
+  camera's native format is negotiated end to end. Only when there is no common
+  format do we fall back to `videoconvert`.
+  `--io-mode` is handed to v4l2src ("mmap" keeps frames in the driver's
+  buffers, "dmabuf" exports them as dmabuf fds) so the first copy goes away too.
+
+  `--simd-convert` replaces videoconvert with simdconvert (simd-convert.c),
+  which only converts YUY2/NV12 to BGRx, with AVX2/SSE4.1 kernels.
+
+  To confirm zero-copy is in effect, we count copies per frame: a probe on the
+  source's src pad remembers the GstMemory each frame left the camera in and
+  every pad further downstream checks whether the frame still lives in the same
+  memory. Each time it does not, someone made a copy.
+
+Low-latency mode:
+  By default the sink keeps its defaults (20 ms processing deadline, QoS as
+  the sink sets it) and nothing decouples rendering from capture.
+  `--low-latency` tunes the single-camera pipeline for live display:
+    - the sink synchronizes to the clock with QoS on, drops frames more than
+      LOW_LATENCY_MAX_LATENESS late and has a LOW_LATENCY_DEADLINE processing
+      deadline, which is what it adds to the pipeline latency,
+    - a one-frame leaky queue in front of the sink drops the oldest frame
+      when rendering falls behind, instead of stalling capture,
+  It also measures capture-to-render latency per frame (live-latency.c,
+  `--measure-latency` does only that, to compare with the defaults): the
+  percentiles every second and the distribution at the end, against
+  `--latency-budget` (default 50 ms). Either option also acts on LATENCY
+  messages (the pipeline latency is recalculated) and prints the new latency.
+
+Source recovery:
+  By default any ERROR stops the program. With `--recover` errors from the
+  camera are handled by restarting the source element alone
+  (source-recovery.c): it goes through READY (NULL from the second try on)
+  and back to PLAYING with exponential backoff between tries, while the
+  converter and the sink stay in PLAYING with their caps. After
+  `--max-retries` tries in a row without a frame the error stops the program
+  as before. Faults, restarts and the time from error to the first new frame
+  are printed at the end. `--inject-faults=N` (with --test-src) replaces
+  videotestsrc by faultsrc (fault-src.c), which fails every N frames the way
+  v4l2src does. A restarted source counts --num-buffers afresh.
+
+Shared memory:
+  `--publish=SOCKET` captures the color stream (YUY2 1080p30, also from a
+  camera) and shares it with other processes through shmsink (shm-share.c):
+  the frames are written once into shared memory, SHM_SHARE_FRAMES of them,
+  and every subscriber maps them in place. A leaky queue in front of shmsink
+  drops frames rather than stalling capture when the shared memory is full.
+  `--subscribe=SOCKET` is such a process: shmsrc ! queue ! videoconvert !
+  sink, its queue of `--subscriber-queue` frames following `--policy`
+  ("drop": leaky, a slow subscriber loses its own frames; "block": sees
+  every frame, holding its blocks in shared memory until it does). Both
+  sides report frames/s every second; with `--measure-latency` the publisher
+  stamps every frame and subscribers also report capture-to-consumer latency
+  and the frames they missed.
+
+RTP streaming:
+  `--rtp-send=HOST:PORT` sends the color stream (YUY2 1080p30, also from a
+  camera) over RTP/UDP (rtp-stream.c), `--rtp-codec` h264 (x264enc
+  zerolatency, the default) or raw (UYVY, ~1 Gbit/s). Every packet carries
+  the frame's capture time in a header extension. `--rtp-receive=PORT` is
+  the other end: udpsrc ! rtpjitterbuffer ! depayloader/decoder !
+  videoconvert ! sink, with a `--jitter-latency` ms jitterbuffer (default
+  50). It reports frames/s, packet loss and interarrival jitter (RFC 3550),
+  the packets the jitterbuffer gave up on or got too late, and
+  capture-to-render latency (over loopback, where both ends share the
+  clock) every second and at the end, which comes when no packet arrived
+  for RTP_STREAM_TIMEOUT. `--rtp-loss` (percent), `--rtp-delay` and
+  `--rtp-delay-jitter` (ms) put netsim behind udpsrc to see which latency a
+  lossy or jittery network needs.
+
+Metrics:
+  `--metrics-port=PORT` serves Prometheus metrics of the single-camera
+  pipeline on http://127.0.0.1:PORT/metrics and `--metrics-file=PATH`
+  writes them to PATH (metrics-exporter.c), sampled every second: buffers
+  and bytes per pad and their rate, queue levels and drops, QoS drops,
+  CPU time per streaming thread and element states. Nothing is sampled
+  under a streaming lock.
+
+Latency tracing:
+  `--trace-latency` attaches the per-element latency tracer (latency-tracer.c)
+  and prints p50/p99/max per element at EOS, or at any time with
+  `kill -USR1 <pid>`.
+
+Multiple cameras:
+  `--camera=SPEC` (repeatable) and `--test-cameras=N` build one pipeline with
+  a branch per camera (camera-array.c): every camera captures on its own
+  streaming thread, renders from its own queue thread and follows its own
+  drop policy, all on the pipeline's clock. Frames/s per camera and in total
+  are printed every second, and the totals (with queue and sink drops) at the
+  end. --device, --zero-copy and --io-mode apply to the single-camera mode.
+
+Fan-out:
+  `--fanout` puts a tee after the camera (fanout.c) with three consumers:
+  the display, an analytics thread and, with `--record=FILE`, an x264
+  recorder. Every branch starts with a leaky queue, so a consumer that lags
+  drops frames in its own branch while capture stays at the sensor rate;
+  capture frames/s and per-branch frames/s and drops are printed every second.
+  The analytics thread reads frames in place from its appsink through a small
+  frame ring (frame-ring.c), which drops the oldest frame itself when the
+  thread is busy (`--analytics-delay` makes it slow on purpose).
+
+Depth:
+  `--depth` shows the depth node (`--device`, Z16 which v4l2src calls
+  GRAY16_LE) through depthproc (depth-proc.c): decimated, smoothed,
+  hole-filled and colorized on all cores. Frames/s out of depthproc are
+  printed every second. With --test-src a GRAY16_LE 848x480@90 videotestsrc
+  stands in.
+
+Segmented recording:
+  `--segments=PATTERN` records continuously into Matroska/H.264 segments
+  (segment-recorder.c) of `--segment-time` seconds and/or `--segment-size`
+  MB: x264enc (zero latency) behind a queue, splitmuxsink with
+  async-finalize, and asyncfilesink (async-file-sink.c) writing and
+  fsyncing from a thread of its own through a bounded queue. Encode
+  frames/s, write throughput and the worst capture-thread stall, overall
+  and around segment rollovers, are printed every second; captured vs.
+  recorded frames at the end. Ctrl-C (or SIGTERM) sends EOS, so the last
+  segment is finalized and the totals printed before the program exits.
+
+Startup:
+  Camera nodes restart often, so time to first frame matters.
+  `--profile-startup` (startup-profile.c) prints, once the first frame reaches
+  the sink, how long gst_init, element creation, linking (including the
+  zero-copy caps query), each state change, caps negotiation and preroll took.
+  `--fast-start` (fast-start.c) makes gst_init load a registry holding only the
+  plugins this program uses instead of every installed one; the pipeline is
+  already built from explicitly named elements, so nothing is autoplugged.
 */
 
 #include <gst/gst.h>
+#include <glib-unix.h>
+
+#include "camera-array.h"
+#include "depth-proc.h"
+#include "fanout.h"
+#include "fast-start.h"
+#include "fault-src.h"
+#include "frame-ring.h"
+#include "latency-tracer.h"
+#include "live-latency.h"
+#include "metrics-exporter.h"
+#include "pipeline-runtime.h"
+#include "rtp-stream.h"
+#include "segment-recorder.h"
+#include "shm-share.h"
+#include "simd-convert.h"
+#include "source-recovery.h"
+#include "startup-profile.h"
+
+/* Frames we are tracking at the same time (more than enough without queues) */
+#define COPY_TRACKER_SLOTS 8
+
+/* What the videotestsrc stand-in produces: the camera's color stream */
+#define TEST_SRC_CAPS "video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1"
+/* ... and its depth stream */
+#define TEST_DEPTH_CAPS "video/x-raw,format=GRAY16_LE,width=848,height=480,framerate=90/1"
+
+/* Sink tuning for --low-latency: the video sinks' default lateness, half their deadline */
+#define LOW_LATENCY_MAX_LATENESS (20 * GST_MSECOND)
+#define LOW_LATENCY_DEADLINE (10 * GST_MSECOND)
+
+/* How often --metrics-port/--metrics-file sample the pipeline */
+#define METRICS_INTERVAL_MS 1000
+
+/* Remembers which memory each in-flight frame currently lives in */
+typedef struct _CopyTracker {
+  GMutex lock;
+  struct {
+    GstClockTime pts;
+    GstMemory *mem;           /* only compared, never dereferenced */
+  } slots[COPY_TRACKER_SLOTS];
+  guint next_slot;
+  gboolean from_camera;       /* is the source a real v4l2 device? */
+  gboolean kernel_copy;       /* did the source already hand out a copy? */
+  guint64 frames;
+  guint64 copies;
+} CopyTracker;
+
+static gchar *device = "/dev/video2";
+static gchar *io_mode = NULL;
+static gchar *sink_name = "ximagesink";
+static gboolean zero_copy = FALSE;
+static gboolean test_src = FALSE;
+static gint num_buffers = -1;
+static gboolean trace_latency = FALSE;
+static gboolean profile_startup = FALSE;
+static gboolean fast_start = FALSE;
+static gchar **camera_specs = NULL;
+static gint test_cameras = 0;
+static gboolean fanout_mode = FALSE;
+static gchar *record_location = NULL;
+static gint analytics_delay = 0;
+static gboolean use_simd_convert = FALSE;
+static gboolean depth_mode = FALSE;
+static gboolean low_latency = FALSE;
+static gboolean measure_latency = FALSE;
+static gint latency_budget = 50;
+static gchar *segments_location = NULL;
+static gint segment_time = 60;
+static gint segment_size = 0;
+static gboolean recover = FALSE;
+static gint max_retries = 10;
+static gint inject_faults = 0;
+static gchar *publish_socket = NULL;
+static gchar *subscribe_socket = NULL;
+static gchar *policy_name = "drop";
+static gint subscriber_queue = 2;
+static gchar *rtp_send = NULL;
+static gint rtp_receive = 0;
+static gchar *rtp_codec = "h264";
+static gint jitter_latency = 50;
+static gdouble rtp_loss = 0;
+static gint rtp_delay = 0;
+static gint rtp_delay_jitter = 0;
+static gint metrics_port = 0;
+static gchar *metrics_file = NULL;
+
+/* Everything --fast-start lets gst_init know about: the elements we may create */
+static const gchar *const fast_start_plugins[] = {
+  "coreelements",             /* fakesink, capsfilter, queue */
+  "video4linux2",             /* v4l2src */
+  "videotestsrc",
+  "videoconvertscale",        /* videoconvert, GStreamer >= 1.22 */
+  "videoconvert",             /* videoconvert, older releases */
+  "ximagesink",
+  "xvimagesink",
+  "app",                      /* appsink, for --fanout */
+  "x264",                     /* x264enc, for --record */
+  "matroska",
+  "multifile",                /* splitmuxsink, for --segments */
+  "shm",                      /* shmsink/shmsrc, for --publish and --subscribe */
+  "rtp",                      /* payloaders and depayloaders, for --rtp-send/--rtp-receive */
+  "rtpmanager",               /* rtpjitterbuffer */
+  "udp",
+  "libav",                    /* avdec_h264 */
+  "netsim",
+  NULL
+};
+
+static GOptionEntry entries[] = {
+  { "device", 'd', 0, G_OPTION_ARG_STRING, &device, "V4L2 device to capture from", "PATH" },
+  { "io-mode", 'i', 0, G_OPTION_ARG_STRING, &io_mode, "v4l2src io-mode (auto, rw, mmap, userptr, dmabuf)", "MODE" },
+  { "sink", 's', 0, G_OPTION_ARG_STRING, &sink_name, "Video sink to render to", "NAME" },
+  { "zero-copy", 'z', 0, G_OPTION_ARG_NONE, &zero_copy, "Negotiate the native format and skip videoconvert if possible", NULL },
+  { "test-src", 't', 0, G_OPTION_ARG_NONE, &test_src, "Use a live videotestsrc (YUY2 1080p30) instead of a camera", NULL },
+  { "num-buffers", 'n', 0, G_OPTION_ARG_INT, &num_buffers, "Stop after this many frames (-1 = run forever)", "N" },
+  { "trace-latency", 'l', 0, G_OPTION_ARG_NONE, &trace_latency, "Report per-element latency histograms", NULL },
+  { "profile-startup", 'p', 0, G_OPTION_ARG_NONE, &profile_startup, "Print where the time to the first frame went", NULL },
+  { "fast-start", 'f', 0, G_OPTION_ARG_NONE, &fast_start, "Load a registry with only the plugins we use", NULL },
+  { "camera", 'c', 0, G_OPTION_ARG_STRING_ARRAY, &camera_specs, "Add a camera: DEVICE[,queue=N][,leaky=yes|no][,max-lateness=MS|none]", "SPEC" },
+  { "test-cameras", 0, 0, G_OPTION_ARG_INT, &test_cameras, "Add N videotestsrc cameras", "N" },
+  { "fanout", 'F', 0, G_OPTION_ARG_NONE, &fanout_mode, "Feed display, analytics and recorder from one capture", NULL },
+  { "record", 'r', 0, G_OPTION_ARG_FILENAME, &record_location, "With --fanout, also record to FILE (Matroska, H.264)", "FILE" },
+  { "simd-convert", 0, 0, G_OPTION_ARG_NONE, &use_simd_convert, "Convert YUY2/NV12 to BGRx with simdconvert instead of videoconvert", NULL },
+  { "analytics-delay", 0, 0, G_OPTION_ARG_INT, &analytics_delay, "With --fanout, spend MS on every analytics frame", "MS" },
+  { "low-latency", 'L', 0, G_OPTION_ARG_NONE, &low_latency, "Tune sink and queueing for live display and measure capture-to-render latency", NULL },
+  { "measure-latency", 'm', 0, G_OPTION_ARG_NONE, &measure_latency, "Measure capture-to-render latency without tuning anything", NULL },
+  { "latency-budget", 0, 0, G_OPTION_ARG_INT, &latency_budget, "Capture-to-render budget to report against (default 50)", "MS" },
+  { "segments", 0, 0, G_OPTION_ARG_FILENAME, &segments_location, "Record into segments named PATTERN (with a %d, e.g. rec-%05d.mkv)", "PATTERN" },
+  { "segment-time", 0, 0, G_OPTION_ARG_INT, &segment_time, "With --segments, seconds per segment (default 60, 0 = no limit)", "S" },
+  { "segment-size", 0, 0, G_OPTION_ARG_INT, &segment_size, "With --segments, megabytes per segment (default 0 = no limit)", "MB" },
+  { "depth", 'D', 0, G_OPTION_ARG_NONE, &depth_mode, "Show --device as a depth stream, colorized by depthproc", NULL },
+  { "recover", 'R', 0, G_OPTION_ARG_NONE, &recover, "Restart the camera alone when it fails instead of stopping", NULL },
+  { "max-retries", 0, 0, G_OPTION_ARG_INT, &max_retries, "With --recover, restarts in a row before giving up (default 10, 0 = no limit)", "N" },
+  { "inject-faults", 0, 0, G_OPTION_ARG_INT, &inject_faults, "With --test-src, use faultsrc failing every N frames", "N" },
+  { "publish", 'P', 0, G_OPTION_ARG_FILENAME, &publish_socket, "Share the frames with other processes through shared memory", "SOCKET" },
+  { "subscribe", 'S', 0, G_OPTION_ARG_FILENAME, &subscribe_socket, "Show the frames a --publish process shares", "SOCKET" },
+  { "policy", 0, 0, G_OPTION_ARG_STRING, &policy_name, "With --subscribe, drop (default) or block when behind", "POLICY" },
+  { "subscriber-queue", 0, 0, G_OPTION_ARG_INT, &subscriber_queue, "With --subscribe, frames it may be behind (default 2)", "N" },
+  { "rtp-send", 0, 0, G_OPTION_ARG_STRING, &rtp_send, "Send the frames over RTP/UDP", "HOST:PORT" },
+  { "rtp-receive", 0, 0, G_OPTION_ARG_INT, &rtp_receive, "Show the frames a --rtp-send process sends to PORT", "PORT" },
+  { "rtp-codec", 0, 0, G_OPTION_ARG_STRING, &rtp_codec, "h264 (default) or raw, on both ends", "CODEC" },
+  { "jitter-latency", 0, 0, G_OPTION_ARG_INT, &jitter_latency, "With --rtp-receive, jitterbuffer latency (default 50)", "MS" },
+  { "rtp-loss", 0, 0, G_OPTION_ARG_DOUBLE, &rtp_loss, "With --rtp-receive, drop this percentage of the packets", "PERCENT" },
+  { "rtp-delay", 0, 0, G_OPTION_ARG_INT, &rtp_delay, "With --rtp-receive, delay the packets this long", "MS" },
+  { "rtp-delay-jitter", 0, 0, G_OPTION_ARG_INT, &rtp_delay_jitter, "With --rtp-receive, vary the delay by up to this much either way", "MS" },
+  { "metrics-port", 0, 0, G_OPTION_ARG_INT, &metrics_port, "Serve Prometheus metrics on 127.0.0.1:PORT/metrics", "PORT" },
+  { "metrics-file", 0, 0, G_OPTION_ARG_FILENAME, &metrics_file, "Write Prometheus metrics to PATH every second", "PATH" },
+  { NULL }
+};
+
+/* Probe on the source's src pad: a new frame enters the pipeline */
+static GstPadProbeReturn
+source_probe (GstPad *pad, GstPadProbeInfo *info, CopyTracker *tracker)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstMemory *mem;
+
+  if (gst_buffer_n_memory (buffer) == 0)
+    return GST_PAD_PROBE_OK;
+  mem = gst_buffer_peek_memory (buffer, 0);
+
+  g_mutex_lock (&tracker->lock);
+  tracker->slots[tracker->next_slot].pts = GST_BUFFER_PTS (buffer);
+  tracker->slots[tracker->next_slot].mem = mem;
+  tracker->next_slot = (tracker->next_slot + 1) % COPY_TRACKER_SLOTS;
+  tracker->frames++;
+  /*
+   With io-mode=rw the driver copies each frame into memory we read() into, and
+   in mmap/dmabuf mode v4l2src falls back to copying into plain system memory
+   when downstream can't take its buffers. Either way the frame reaches us in
+   "SystemMemory" instead of the driver's own memory.
+  */
+  if (tracker->from_camera &&
+      (tracker->kernel_copy || gst_memory_is_type (mem, GST_ALLOCATOR_SYSMEM)))
+    tracker->copies++;
+  g_mutex_unlock (&tracker->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Probe on every pad downstream of the source: is the frame still in the same memory? */
+static GstPadProbeReturn
+downstream_probe (GstPad *pad, GstPadProbeInfo *info, CopyTracker *tracker)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstMemory *mem;
+  guint i;
+
+  if (gst_buffer_n_memory (buffer) == 0)
+    return GST_PAD_PROBE_OK;
+  mem = gst_buffer_peek_memory (buffer, 0);
+
+  g_mutex_lock (&tracker->lock);
+  for (i = 0; i < COPY_TRACKER_SLOTS; i++) {
+    if (tracker->slots[i].pts == GST_BUFFER_PTS (buffer)) {
+      if (tracker->slots[i].mem != mem) {
+        tracker->copies++;
+        tracker->slots[i].mem = mem;
+      }
+      break;
+    }
+  }
+  g_mutex_unlock (&tracker->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+add_probe (GstElement *element, const gchar *pad_name, GstPadProbeCallback callback,
+    CopyTracker *tracker)
+{
+  GstPad *pad = gst_element_get_static_pad (element, pad_name);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, callback, tracker, NULL);
+  gst_object_unref (pad);
+}
+
+/*
+ Returns the caps both the source and the sink can handle, or NULL if they have
+ nothing in common. Both elements are brought to READY first: that is when
+ v4l2src opens the device and a video sink opens its display, so the caps they
+ report are the real hardware ones and not just their pad templates.
+ `source_filter` (may be NULL) restricts what the source is allowed to produce.
+*/
+static GstCaps *
+query_native_caps (GstElement *source, GstElement *sink, GstCaps *source_filter)
+{
+  GstPad *src_pad, *sink_pad;
+  GstCaps *src_caps, *sink_caps, *common = NULL;
+
+  if (gst_element_set_state (source, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE ||
+      gst_element_set_state (sink, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE)
+    return NULL;
+
+  src_pad = gst_element_get_static_pad (source, "src");
+  sink_pad = gst_element_get_static_pad (sink, "sink");
+  src_caps = gst_pad_query_caps (src_pad, source_filter);
+  sink_caps = gst_pad_query_caps (sink_pad, NULL);
+
+  /* Prefer the source's order: its first format is the camera's native one */
+  common = gst_caps_intersect_full (src_caps, sink_caps, GST_CAPS_INTERSECT_FIRST);
+  if (gst_caps_is_empty (common)) {
+    gst_caps_unref (common);
+    common = NULL;
+  }
+
+  gst_caps_unref (src_caps);
+  gst_caps_unref (sink_caps);
+  gst_object_unref (src_pad);
+  gst_object_unref (sink_pad);
+  return common;
+}
+
+static void
+handle_qos (PipelineRuntime *runtime, GstMessage *msg, CameraArray *cameras)
+{
+  camera_array_handle_qos (cameras, msg);
+}
+
+static void
+report_cameras (PipelineRuntime *runtime, gint64 position, gint64 duration,
+    CameraArray *cameras)
+{
+  camera_array_report (cameras, FALSE);
+}
+
+/* --camera / --test-cameras: one pipeline, one branch per camera */
+static int
+run_cameras (void)
+{
+  GstElement *pipeline = gst_pipeline_new ("realsense-cameras");
+  CameraArray *cameras = camera_array_new (pipeline);
+  LatencyTracer *latency_tracer = NULL;
+  PipelineRuntime *runtime;
+  GstCaps *test_caps = gst_caps_from_string (TEST_SRC_CAPS);
+  CameraConfig config;
+  GError *error = NULL;
+  gboolean added = TRUE;
+  gint i, n_specs = camera_specs ? g_strv_length (camera_specs) : 0;
+
+  /* The --camera specs first, then --test-cameras stand-ins */
+  for (i = 0; added && i < n_specs + test_cameras; i++) {
+    if (!camera_config_parse (i < n_specs ? camera_specs[i] : "test", &config, &error)) {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      added = FALSE;
+      break;
+    }
+    added = camera_array_add (cameras, &config, sink_name,
+        config.device ? NULL : test_caps, num_buffers);
+    camera_config_clear (&config);
+  }
+  gst_caps_unref (test_caps);
+  if (!added) {
+    camera_array_free (cameras);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+  g_print ("Capturing from %u cameras\n", camera_array_get_n_cameras (cameras));
+
+  if (trace_latency)
+    latency_tracer = latency_tracer_attach (pipeline);
+
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_QOS,
+      (PipelineMessageFunc) handle_qos, cameras);
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_cameras, cameras);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    camera_array_free (cameras);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+
+  /* Wait until error or EOS (all cameras must finish for EOS) */
+  pipeline_runtime_run ();
+
+  if (latency_tracer)
+    latency_tracer_dump (latency_tracer);
+  camera_array_report (cameras, TRUE);
+
+  pipeline_runtime_free (runtime);
+  camera_array_free (cameras);
+  gst_object_unref (pipeline);
+  return 0;
+}
+
+/* The analytics consumer, on a thread of its own, reading frames in place */
+typedef struct _Analytics {
+  FrameRing *ring;
+  GThread *thread;
+  gint stop;
+  guint64 frames;
+  guint64 bytes;              /* what it looked at, through the views */
+} Analytics;
+
+static gpointer
+analytics_thread (Analytics *analytics)
+{
+  const FrameView *view;
+  guint i;
+
+  while (!g_atomic_int_get (&analytics->stop)) {
+    view = frame_ring_pop (analytics->ring, 100 * G_TIME_SPAN_MILLISECOND);
+    /* After EOS pop no longer waits: nothing more is coming */
+    if (!view && frame_ring_is_done (analytics->ring))
+      break;
+    if (!view)
+      continue;
+    for (i = 0; i < view->n_planes; i++)
+      analytics->bytes += (guint64) view->stride[i] * view->height;
+    analytics->frames++;
+    /* Stand-in for real work; while we are busy the ring drops the oldest frames */
+    if (analytics_delay > 0)
+      g_usleep (analytics_delay * G_TIME_SPAN_MILLISECOND);
+    frame_view_unref (view);
+  }
+  return NULL;
+}
+
+static void
+report_fanout (PipelineRuntime *runtime, gint64 position, gint64 duration, FanOut *fanout)
+{
+  fanout_report (fanout, FALSE);
+}
+
+/* --fanout: camera ! tee, with a leaky queue in front of every consumer */
+static int
+run_fanout (void)
+{
+  GstElement *pipeline, *source, *filter, *branch;
+  Analytics analytics = { 0 };
+  LatencyTracer *latency_tracer = NULL;
+  PipelineRuntime *runtime;
+  FanOut *fanout;
+  gchar *description;
+
+  pipeline = gst_pipeline_new ("realsense-fanout");
+  source = gst_element_factory_make (test_src ? "videotestsrc" : "v4l2src", "source");
+  filter = gst_element_factory_make ("capsfilter", "capture");
+  if (!pipeline || !source || !filter) {
+    g_printerr ("Not all elements could be created.\n");
+    return -1;
+  }
+  if (test_src) {
+    GstCaps *caps = gst_caps_from_string (TEST_SRC_CAPS);
+
+    g_object_set (source, "is-live", TRUE, NULL);
+    g_object_set (filter, "caps", caps, NULL);
+    gst_caps_unref (caps);
+  } else {
+    g_object_set (source, "device", device, NULL);
+    if (io_mode)
+      gst_util_set_object_arg (G_OBJECT (source), "io-mode", io_mode);
+  }
+  g_object_set (source, "num-buffers", num_buffers, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), source, filter, NULL);
+  gst_element_link (source, filter);
+
+  fanout = fanout_new (pipeline, filter);
+
+  description = g_strdup_printf ("videoconvert ! %s", sink_name);
+  fanout_add_branch (fanout, "display", description, 2);
+  g_free (description);
+
+  /* Two frames of slack: analytics wants the newest frame, not a backlog */
+  branch = fanout_add_branch (fanout, "analytics", "appsink name=appsink sync=false", 2);
+  if (branch) {
+    GstElement *appsink = gst_bin_get_by_name (GST_BIN (branch), "appsink");
+
+    analytics.ring = frame_ring_new (appsink, 2);
+    analytics.thread = g_thread_new ("analytics", (GThreadFunc) analytics_thread, &analytics);
+    gst_object_unref (appsink);
+  }
+
+  /* The encoder may take a few frames at once (keyframes), give it more slack */
+  if (record_location) {
+    description = g_strdup_printf ("videoconvert ! x264enc tune=zerolatency "
+        "speed-preset=ultrafast ! matroskamux ! filesink location=\"%s\"", record_location);
+    fanout_add_branch (fanout, "record", description, 8);
+    g_free (description);
+  }
+
+  if (trace_latency)
+    latency_tracer = latency_tracer_attach (pipeline);
+
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_fanout, fanout);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    fanout_free (fanout);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+
+  /* Wait until error or EOS; EOS also finalizes the recording */
+  pipeline_runtime_run ();
+
+  if (latency_tracer)
+    latency_tracer_dump (latency_tracer);
+  fanout_report (fanout, TRUE);
+  if (analytics.thread) {
+    g_atomic_int_set (&analytics.stop, TRUE);
+    g_thread_join (analytics.thread);
+    g_print ("Analytics: %" G_GUINT64_FORMAT " frames (%.1f MB read in place), %"
+        G_GUINT64_FORMAT " dropped by the frame ring\n", analytics.frames,
+        analytics.bytes / 1e6, frame_ring_get_dropped (analytics.ring));
+  }
+
+  pipeline_runtime_free (runtime);
+  fanout_free (fanout);
+  /* Before the pipeline: the ring disconnects from the appsink */
+  if (analytics.ring)
+    frame_ring_free (analytics.ring);
+  gst_object_unref (pipeline);
+  return 0;
+}
+
+static void
+handle_live_latency (PipelineRuntime *runtime, GstMessage *msg, LiveLatency *latency)
+{
+  live_latency_handle_message (latency, msg);
+}
+
+/* --low-latency and the metrics both want the QOS messages */
+typedef struct {
+  LiveLatency *live_latency;
+  MetricsExporter *metrics;
+} QosListeners;
+
+static void
+handle_pipeline_qos (PipelineRuntime *runtime, GstMessage *msg, QosListeners *listeners)
+{
+  if (listeners->live_latency)
+    live_latency_handle_message (listeners->live_latency, msg);
+  if (listeners->metrics)
+    metrics_exporter_handle_message (listeners->metrics, msg);
+}
+
+static void
+report_live_latency (PipelineRuntime *runtime, gint64 position, gint64 duration,
+    LiveLatency *latency)
+{
+  live_latency_report (latency, FALSE);
+}
+
+/* Errors the supervisor does not take stop the pipeline as usual */
+static void
+handle_error (PipelineRuntime *runtime, GstMessage *msg, SourceRecovery *recovery)
+{
+  if (!source_recovery_handle_error (recovery, msg))
+    pipeline_runtime_handle_error (runtime, msg, NULL);
+}
+
+static void
+handle_segment_message (PipelineRuntime *runtime, GstMessage *msg, SegmentRecorder *recorder)
+{
+  segment_recorder_handle_message (recorder, msg);
+}
+
+static void
+report_segments (PipelineRuntime *runtime, gint64 position, gint64 duration,
+    SegmentRecorder *recorder)
+{
+  segment_recorder_report (recorder, FALSE);
+}
+
+/* From the main loop: EOS drains the encoder and closes the last segment */
+static gboolean
+send_eos (GstElement *pipeline)
+{
+  g_print ("\nStopping, finishing the current segment...\n");
+  gst_element_send_event (pipeline, gst_event_new_eos ());
+  return G_SOURCE_CONTINUE;
+}
+
+/* --segments: camera ! queue ! x264enc ! splitmuxsink */
+static int
+run_record (void)
+{
+  GstElement *pipeline, *source, *filter;
+  LatencyTracer *latency_tracer = NULL;
+  PipelineRuntime *runtime;
+  SegmentRecorder *recorder;
+  guint sigint, sigterm;
+
+  pipeline = gst_pipeline_new ("realsense-record");
+  source = gst_element_factory_make (test_src ? "videotestsrc" : "v4l2src", "source");
+  filter = gst_element_factory_make ("capsfilter", "capture");
+  if (!pipeline || !source || !filter) {
+    g_printerr ("Not all elements could be created.\n");
+    return -1;
+  }
+  if (test_src) {
+    GstCaps *caps = gst_caps_from_string (TEST_SRC_CAPS);
+
+    g_object_set (source, "is-live", TRUE, NULL);
+    g_object_set (filter, "caps", caps, NULL);
+    gst_caps_unref (caps);
+  } else {
+    g_object_set (source, "device", device, NULL);
+    if (io_mode)
+      gst_util_set_object_arg (G_OBJECT (source), "io-mode", io_mode);
+  }
+  g_object_set (source, "num-buffers", num_buffers, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), source, filter, NULL);
+  gst_element_link (source, filter);
+
+  recorder = segment_recorder_new (pipeline, source, filter, segments_location,
+      (GstClockTime) MAX (segment_time, 0) * GST_SECOND,
+      (guint64) MAX (segment_size, 0) * 1000 * 1000);
+  if (!recorder) {
+    gst_object_unref (pipeline);
+    return -1;
+  }
+
+  if (trace_latency)
+    latency_tracer = latency_tracer_attach (pipeline);
+
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_ELEMENT,
+      (PipelineMessageFunc) handle_segment_message, recorder);
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_segments, recorder);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    segment_recorder_free (recorder);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+
+  /* Wait until error or EOS; EOS closes the last segment */
+  sigint = g_unix_signal_add (SIGINT, (GSourceFunc) send_eos, pipeline);
+  sigterm = g_unix_signal_add (SIGTERM, (GSourceFunc) send_eos, pipeline);
+  pipeline_runtime_run ();
+  g_source_remove (sigint);
+  g_source_remove (sigterm);
+
+  if (latency_tracer)
+    latency_tracer_dump (latency_tracer);
+  /* Frees the runtime and takes the pipeline to NULL, which fsyncs the last segment */
+  pipeline_runtime_free (runtime);
+  segment_recorder_report (recorder, TRUE);
+  segment_recorder_free (recorder);
+  gst_object_unref (pipeline);
+  return 0;
+}
+
+static void
+report_publisher (PipelineRuntime *runtime, gint64 position, gint64 duration,
+    ShmPublisher *publisher)
+{
+  shm_publisher_report (publisher, FALSE);
+}
+
+/* --publish: camera ! queue leaky ! shmsink */
+static int
+run_publish (void)
+{
+  GstElement *pipeline, *source, *filter;
+  PipelineRuntime *runtime;
+  ShmPublisher *publisher;
+  GstCaps *caps;
+
+  pipeline = gst_pipeline_new ("realsense-publish");
+  source = gst_element_factory_make (test_src ? "videotestsrc" : "v4l2src", "source");
+  filter = gst_element_factory_make ("capsfilter", "capture");
+  if (!pipeline || !source || !filter) {
+    g_printerr ("Not all elements could be created.\n");
+    return -1;
+  }
+  /* Subscribers are told these caps, the camera's color stream, so they are fixed */
+  caps = gst_caps_from_string (TEST_SRC_CAPS);
+  g_object_set (filter, "caps", caps, NULL);
+  if (test_src) {
+    g_object_set (source, "is-live", TRUE, NULL);
+  } else {
+    g_object_set (source, "device", device, NULL);
+    if (io_mode)
+      gst_util_set_object_arg (G_OBJECT (source), "io-mode", io_mode);
+  }
+  g_object_set (source, "num-buffers", num_buffers, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), source, filter, NULL);
+  gst_element_link (source, filter);
+
+  publisher = shm_publisher_new (pipeline, filter, publish_socket, caps, SHM_SHARE_FRAMES,
+      measure_latency);
+  gst_caps_unref (caps);
+  if (!publisher) {
+    gst_object_unref (pipeline);
+    return -1;
+  }
+
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_publisher, publisher);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    shm_publisher_free (publisher);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+  g_print ("Sharing frames on %s\n", publish_socket);
+
+  pipeline_runtime_run ();
+
+  shm_publisher_report (publisher, TRUE);
+  pipeline_runtime_free (runtime);
+  shm_publisher_free (publisher);
+  gst_object_unref (pipeline);
+  return 0;
+}
+
+static void
+report_subscriber (PipelineRuntime *runtime, gint64 position, gint64 duration,
+    ShmSubscriber *subscriber)
+{
+  shm_subscriber_report (subscriber, FALSE);
+}
+
+/* --subscribe: shmsrc ! queue (the policy) ! videoconvert ! sink */
+static int
+run_subscribe (void)
+{
+  PipelineRuntime *runtime;
+  ShmSubscriber *subscriber;
+  ShmPolicy policy;
+  GError *error = NULL;
+  gchar *source, *consumer;
+
+  if (!shm_policy_from_string (policy_name, &policy)) {
+    g_printerr ("Unknown policy %s (drop or block).\n", policy_name);
+    return -1;
+  }
+  source = shm_subscriber_shm_source (subscribe_socket, TEST_SRC_CAPS);
+  consumer = g_strdup_printf ("videoconvert ! %s", sink_name);
+  subscriber = shm_subscriber_new (source, policy, MAX (subscriber_queue, 1), consumer, &error);
+  g_free (source);
+  g_free (consumer);
+  if (!subscriber) {
+    g_printerr ("Unable to build the subscriber: %s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+
+  /* The publisher going away is an error from shmsrc, which ends the run */
+  runtime = pipeline_runtime_new (shm_subscriber_get_pipeline (subscriber));
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_subscriber, subscriber);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    shm_subscriber_free (subscriber);
+    return -1;
+  }
+
+  pipeline_runtime_run ();
+
+  shm_subscriber_report (subscriber, TRUE);
+  pipeline_runtime_free (runtime);
+  shm_subscriber_free (subscriber);
+  return 0;
+}
+
+static void
+report_rtp_sender (PipelineRuntime *runtime, gint64 position, gint64 duration,
+    RtpSender *sender)
+{
+  rtp_sender_report (sender, FALSE);
+}
+
+/* --rtp-send: camera ! encoder ! payloader ! udpsink */
+static int
+run_rtp_send (void)
+{
+  GstElement *pipeline, *source, *filter;
+  PipelineRuntime *runtime;
+  RtpStreamCodec codec;
+  RtpSender *sender;
+  GError *error = NULL;
+  GstCaps *caps;
+  gchar *host, *colon, *end = NULL;
+  gint64 value = 0;
+  gint port;
+
+  /* Parsed wide and to the end, so "5000x" or a port past 65535 is refused */
+  colon = g_strrstr (rtp_send, ":");
+  if (colon)
+    value = g_ascii_strtoll (colon + 1, &end, 10);
+  if (!colon || colon == rtp_send || *end != '\0' || value <= 0 || value > 65535) {
+    g_printerr ("Bad --rtp-send '%s': use HOST:PORT with a port from 1 to 65535.\n", rtp_send);
+    return -1;
+  }
+  port = value;
+  if (!rtp_stream_codec_from_string (rtp_codec, &codec)) {
+    g_printerr ("Unknown codec %s (h264 or raw).\n", rtp_codec);
+    return -1;
+  }
+  host = g_strndup (rtp_send, colon - rtp_send);
+
+  pipeline = gst_pipeline_new ("realsense-rtp-send");
+  source = gst_element_factory_make (test_src ? "videotestsrc" : "v4l2src", "source");
+  filter = gst_element_factory_make ("capsfilter", "capture");
+  if (!pipeline || !source || !filter) {
+    g_printerr ("Not all elements could be created.\n");
+    g_free (host);
+    return -1;
+  }
+  /* The receiver is told these caps for raw video */
+  caps = gst_caps_from_string (TEST_SRC_CAPS);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  if (test_src) {
+    g_object_set (source, "is-live", TRUE, NULL);
+  } else {
+    g_object_set (source, "device", device, NULL);
+    if (io_mode)
+      gst_util_set_object_arg (G_OBJECT (source), "io-mode", io_mode);
+  }
+  g_object_set (source, "num-buffers", num_buffers, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), source, filter, NULL);
+  gst_element_link (source, filter);
+
+  sender = rtp_sender_new (pipeline, filter, codec, host, port, &error);
+  if (!sender) {
+    g_printerr ("Unable to build the RTP sender: %s\n", error->message);
+    g_clear_error (&error);
+    g_free (host);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_rtp_sender, sender);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    rtp_sender_free (sender);
+    g_free (host);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+  g_print ("Sending %s RTP to %s:%d\n", rtp_codec, host, port);
+
+  pipeline_runtime_run ();
+
+  rtp_sender_report (sender, TRUE);
+  pipeline_runtime_free (runtime);
+  rtp_sender_free (sender);
+  g_free (host);
+  gst_object_unref (pipeline);
+  return 0;
+}
+
+static void
+report_rtp_receiver (PipelineRuntime *runtime, gint64 position, gint64 duration,
+    RtpReceiver *receiver)
+{
+  rtp_receiver_report (receiver, FALSE);
+}
+
+/* UDP never says the sender stopped: udpsrc's timeout does */
+static void
+handle_rtp_element (PipelineRuntime *runtime, GstMessage *msg, RtpReceiver *receiver)
+{
+  if (rtp_receiver_stream_ended (receiver, msg)) {
+    g_print ("No packets for %.0f s, stopping.\n", RTP_STREAM_TIMEOUT / 1e9);
+    pipeline_runtime_stop (runtime);
+  }
+}
+
+/* --rtp-receive: udpsrc [! netsim] ! rtpjitterbuffer ! depayloader ! videoconvert ! sink */
+static int
+run_rtp_receive (void)
+{
+  RtpImpairment impairment = { rtp_loss / 100, MAX (rtp_delay, 0), MAX (rtp_delay_jitter, 0) };
+  PipelineRuntime *runtime;
+  RtpStreamCodec codec;
+  RtpReceiver *receiver;
+  GError *error = NULL;
+
+  if (rtp_receive <= 0 || rtp_receive > 65535) {
+    g_printerr ("Bad --rtp-receive %d: the port must be from 1 to 65535.\n", rtp_receive);
+    return -1;
+  }
+  if (!rtp_stream_codec_from_string (rtp_codec, &codec)) {
+    g_printerr ("Unknown codec %s (h264 or raw).\n", rtp_codec);
+    return -1;
+  }
+  receiver = rtp_receiver_new (rtp_receive, codec, MAX (jitter_latency, 0), &impairment,
+      sink_name, &error);
+  if (!receiver) {
+    g_printerr ("Unable to build the RTP receiver: %s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+
+  runtime = pipeline_runtime_new (rtp_receiver_get_pipeline (receiver));
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_ELEMENT,
+      (PipelineMessageFunc) handle_rtp_element, receiver);
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_rtp_receiver, receiver);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    rtp_receiver_free (receiver);
+    return -1;
+  }
+  g_print ("Receiving %s RTP on port %d, jitterbuffer latency %d ms\n", rtp_codec,
+      rtp_receive, jitter_latency);
+
+  pipeline_runtime_run ();
+
+  rtp_receiver_report (receiver, TRUE);
+  pipeline_runtime_free (runtime);
+  rtp_receiver_free (receiver);
+  return 0;
+}
+
+/* Frames out of depthproc, counted on its streaming thread */
+typedef struct {
+  gint frames;
+  gint reported;
+} DepthCounter;
+
+static GstPadProbeReturn
+depth_probe (GstPad *pad, GstPadProbeInfo *info, DepthCounter *counter)
+{
+  g_atomic_int_inc (&counter->frames);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+report_depth (PipelineRuntime *runtime, gint64 position, gint64 duration, DepthCounter *counter)
+{
+  gint frames = g_atomic_int_get (&counter->frames);
+
+  g_print ("Depth: %d frames/s\n", frames - counter->reported);
+  counter->reported = frames;
+}
+
+/* --depth: depth node ! depthproc ! videoconvert ! sink */
+static int
+run_depth (void)
+{
+  GstElement *pipeline, *depth;
+  LatencyTracer *latency_tracer = NULL;
+  PipelineRuntime *runtime;
+  GError *error = NULL;
+  GstPad *pad;
+  gchar *description;
+  DepthCounter counter = { 0 };
+
+  if (!depth_proc_register ()) {
+    g_printerr ("Unable to register depthproc.\n");
+    return -1;
+  }
+  if (test_src)
+    description = g_strdup_printf ("videotestsrc is-live=true num-buffers=%d ! %s ! "
+        "depthproc name=depth ! videoconvert ! %s", num_buffers, TEST_DEPTH_CAPS, sink_name);
+  else
+    description = g_strdup_printf ("v4l2src device=\"%s\" num-buffers=%d ! "
+        "video/x-raw,format=GRAY16_LE ! depthproc name=depth ! videoconvert ! %s", device,
+        num_buffers, sink_name);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+  if (!pipeline) {
+    g_printerr ("Unable to build the depth pipeline: %s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+
+  depth = gst_bin_get_by_name (GST_BIN (pipeline), "depth");
+  pad = gst_element_get_static_pad (depth, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) depth_probe,
+      &counter, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (depth);
+
+  if (trace_latency)
+    latency_tracer = latency_tracer_attach (pipeline);
+
+  runtime = pipeline_runtime_new (pipeline);
+  pipeline_runtime_set_position_handler (runtime, 1000,
+      (PipelinePositionFunc) report_depth, &counter);
+  if (!pipeline_runtime_start (runtime)) {
+    g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    gst_object_unref (pipeline);
+    return -1;
+  }
+
+  pipeline_runtime_run ();
+
+  if (latency_tracer)
+    latency_tracer_dump (latency_tracer);
+  g_print ("Depth: %d frames\n", g_atomic_int_get (&counter.frames));
+  pipeline_runtime_free (runtime);
+  gst_object_unref (pipeline);
+  return 0;
+}
 
 int
 main (int argc, char *argv[])
 {
-  GstElement *pipeline, *source, *convert, *sink;
-  GstBus *bus;
-  GstMessage *msg;
-  GstStateChangeReturn ret;
+  GstElement *pipeline, *source, *convert = NULL, *sink, *render;
+  GstCaps *native_caps = NULL, *camera_caps = NULL;
+  CopyTracker tracker = { 0 };
+  LatencyTracer *latency_tracer = NULL;
+  LiveLatency *live_latency = NULL;
+  SourceRecovery *recovery = NULL;
+  MetricsExporter *metrics = NULL;
+  QosListeners qos_listeners;
+  GOptionContext *context;
+  GError *error = NULL;
+  PipelineRuntime *runtime;
+
+  startup_profile_start ();
+
+  /* Must happen before the GStreamer option group runs gst_init */
+  if (fast_start_requested (argc, argv, "--fast-start") || fast_start_requested (argc, argv, "-f"))
+    fast_start_setup ("gstreamer_realsense", fast_start_plugins);
+
+  /* Parse our own options; GStreamer adds its own (--gst-debug etc.) */
+  context = g_option_context_new ("- RealSense color stream viewer");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    return -1;
+  }
+  g_option_context_free (context);
 
   /* Initialize GStreamer */
   gst_init (&argc, &argv);
+  startup_profile_mark ("gst_init (registry)");
+
+  if (camera_specs || test_cameras > 0)
+    return run_cameras ();
+  if (fanout_mode)
+    return run_fanout ();
+  if (depth_mode)
+    return run_depth ();
+  if (segments_location)
+    return run_record ();
+  if (publish_socket)
+    return run_publish ();
+  if (subscribe_socket)
+    return run_subscribe ();
+  if (rtp_send)
+    return run_rtp_send ();
+  if (rtp_receive != 0)
+    return run_rtp_receive ();
+  g_mutex_init (&tracker.lock);
 
   /* Create elements */
-  source = gst_element_factory_make ("v4l2src", "source"); // source
-  convert = gst_element_factory_make("videoconvert","convert"); // filter
-  sink = gst_element_factory_make ("ximagesink", "sink");    // sink
+  if (test_src && inject_faults > 0 && fault_src_register ())
+    source = gst_element_factory_make ("faultsrc", "source"); // a camera that fails
+  else if (test_src)
+    source = gst_element_factory_make ("videotestsrc", "source"); // stand-in for the camera
+  else
+    source = gst_element_factory_make ("v4l2src", "source"); // source
+  sink = gst_element_factory_make (sink_name, "sink");    // sink
 
   /* Create the empty pipeline */
   pipeline = gst_pipeline_new ("realsense-pipeline");
 
-  if (!pipeline || !source || !convert || !sink) {
+  if (!pipeline || !source || !sink) {
     g_printerr ("Not all elements could be created.\n");
+    if (fast_start)
+      g_printerr ("Is '%s' in the --fast-start plugin list?\n", sink_name);
     return -1;
   }
+  startup_profile_mark ("elements created");
+
+  // Modify the source's properties to fetch frames from camera
+  if (test_src) {
+    /* Behave like the camera: live, timestamped by the clock, 1080p30 YUY2 */
+    if (inject_faults > 0)
+      g_object_set (source, "fault-interval", inject_faults, NULL);
+    else
+      g_object_set (source, "is-live", TRUE, NULL);
+    camera_caps = gst_caps_from_string (TEST_SRC_CAPS);
+  } else {
+    g_object_set (source, "device", device, NULL);
+    tracker.from_camera = TRUE;
+    if (io_mode)
+      gst_util_set_object_arg (G_OBJECT (source), "io-mode", io_mode);
+    tracker.kernel_copy = (g_strcmp0 (io_mode, "rw") == 0);
+  }
+  g_object_set (source, "num-buffers", num_buffers, NULL);
 
   // Build the pipeline
-  gst_bin_add_many (GST_BIN (pipeline), source, convert, sink, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), source, sink, NULL);
+
+  /* Whatever comes before the sink links to `render` */
+  render = sink;
+  if (low_latency) {
+    GstElement *queue = gst_element_factory_make ("queue", "render-queue");
+
+    live_latency_tune_sink (sink, LOW_LATENCY_MAX_LATENESS, LOW_LATENCY_DEADLINE);
+    /* One frame, and the oldest one goes when a new one arrives */
+    g_object_set (queue, "max-size-buffers", 1, "max-size-bytes", 0, "max-size-time",
+        (guint64) 0, NULL);
+    gst_util_set_object_arg (G_OBJECT (queue), "leaky", "downstream");
+    gst_bin_add (GST_BIN (pipeline), queue);
+    gst_element_link (queue, sink);
+    render = queue;
+  }
+
+  if (zero_copy)
+    native_caps = query_native_caps (source, sink, camera_caps);
 
   // Link all elements
-  if (gst_element_link (source, convert) != TRUE ||
-  gst_element_link (convert, sink) != TRUE) {
-    g_printerr ("Elements could not be linked.\n");
-    gst_object_unref (pipeline);
-    return -1;
+  if (native_caps) {
+    gchar *str = gst_caps_to_string (native_caps);
+    g_print ("Source and sink share a format, skipping videoconvert: %s\n", str);
+    g_free (str);
+
+    if (gst_element_link_filtered (source, render, native_caps) != TRUE) {
+      g_printerr ("Elements could not be linked.\n");
+      gst_caps_unref (native_caps);
+      if (camera_caps)
+        gst_caps_unref (camera_caps);
+      gst_object_unref (pipeline);
+      return -1;
+    }
+    gst_caps_unref (native_caps);
+  } else {
+    if (zero_copy)
+      g_print ("Source and sink have no format in common, videoconvert is needed.\n");
+
+    if (use_simd_convert && simd_convert_register ())
+      convert = gst_element_factory_make ("simdconvert", "convert");
+    else
+      convert = gst_element_factory_make ("videoconvert", "convert"); // filter
+    if (!convert) {
+      g_printerr ("Not all elements could be created.\n");
+      if (camera_caps)
+        gst_caps_unref (camera_caps);
+      gst_object_unref (pipeline);
+      return -1;
+    }
+    gst_bin_add (GST_BIN (pipeline), convert);
+    if (gst_element_link_filtered (source, convert, camera_caps) != TRUE ||
+    gst_element_link (convert, render) != TRUE) {
+      g_printerr ("Elements could not be linked.\n");
+      if (camera_caps)
+        gst_caps_unref (camera_caps);
+      gst_object_unref (pipeline);
+      return -1;
+    }
   }
 
-  // Modify the source's properties to fetch frames from camera
-  g_object_set (source, "device", "/dev/video2", NULL); // Changing 0 to 1,2,etc changes pattern
+  if (camera_caps)
+    gst_caps_unref (camera_caps);
+  startup_profile_mark ("linked");
 
-  /* Start playing */
-  ret = gst_element_set_state (pipeline, GST_STATE_PLAYING);
-  if (ret == GST_STATE_CHANGE_FAILURE) {
+  /* Count copies: where the frame is born, after the converter and at the sink */
+  add_probe (source, "src", (GstPadProbeCallback) source_probe, &tracker);
+  if (convert)
+    add_probe (convert, "src", (GstPadProbeCallback) downstream_probe, &tracker);
+  add_probe (sink, "sink", (GstPadProbeCallback) downstream_probe, &tracker);
+
+  if (trace_latency)
+    latency_tracer = latency_tracer_attach (pipeline);
+  if (profile_startup)
+    startup_profile_attach (pipeline);
+  if (low_latency || measure_latency)
+    live_latency = live_latency_attach (pipeline, source, sink, latency_budget * GST_MSECOND);
+  if (recover)
+    recovery = source_recovery_new (pipeline, source, MAX (max_retries, 0));
+  if (metrics_port > 0 || metrics_file) {
+    metrics = metrics_exporter_new (pipeline, METRICS_INTERVAL_MS);
+    if (metrics_file)
+      metrics_exporter_write_to (metrics, metrics_file);
+    if (metrics_port > 0 && !metrics_exporter_serve (metrics, metrics_port, &error)) {
+      g_printerr ("Cannot serve metrics on port %d: %s\n", metrics_port, error->message);
+      g_clear_error (&error);
+    }
+  }
+
+  /* Start playing; the runtime prints ERROR/EOS and stops on either */
+  runtime = pipeline_runtime_new (pipeline);
+  if (recovery)
+    pipeline_runtime_set_handler (runtime, GST_MESSAGE_ERROR,
+        (PipelineMessageFunc) handle_error, recovery);
+  qos_listeners.live_latency = live_latency;
+  qos_listeners.metrics = metrics;
+  if (live_latency || metrics)
+    pipeline_runtime_set_handler (runtime, GST_MESSAGE_QOS,
+        (PipelineMessageFunc) handle_pipeline_qos, &qos_listeners);
+  if (live_latency) {
+    pipeline_runtime_set_handler (runtime, GST_MESSAGE_LATENCY,
+        (PipelineMessageFunc) handle_live_latency, live_latency);
+    pipeline_runtime_set_position_handler (runtime, 1000,
+        (PipelinePositionFunc) report_live_latency, live_latency);
+  }
+  if (!pipeline_runtime_start (runtime)) {
     g_printerr ("Unable to set the pipeline to the playing state.\n");
+    pipeline_runtime_free (runtime);
+    if (metrics)
+      metrics_exporter_free (metrics);
+    if (live_latency)
+      live_latency_free (live_latency);
+    if (recovery)
+      source_recovery_free (recovery);
     gst_object_unref (pipeline);
     return -1;
   }
 
   /* Wait until error or EOS */
-  bus = gst_element_get_bus (pipeline);
-  msg =
-      gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
-      GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
-
-  /* Parse message */
-  if (msg != NULL) {
-    GError *err;
-    gchar *debug_info;
-
-    switch (GST_MESSAGE_TYPE (msg)) {
-      case GST_MESSAGE_ERROR:
-        gst_message_parse_error (msg, &err, &debug_info);
-        g_printerr ("Error received from element %s: %s\n",
-            GST_OBJECT_NAME (msg->src), err->message);
-        g_printerr ("Debugging information: %s\n",
-            debug_info ? debug_info : "none");
-        g_clear_error (&err);
-        g_free (debug_info);
-        break;
-      case GST_MESSAGE_EOS:
-        g_print ("End-Of-Stream reached.\n");
-        break;
-      default:
-        /* We should not reach here because we only asked for ERRORs and EOS */
-        g_printerr ("Unexpected message received.\n");
-        break;
-    }
-    gst_message_unref (msg);
-  }
+  pipeline_runtime_run ();
+
+  if (latency_tracer)
+    latency_tracer_dump (latency_tracer);
+  if (live_latency)
+    live_latency_report (live_latency, TRUE);
+  if (recovery)
+    source_recovery_report (recovery);
+
+  /* Report how many times each frame was copied on its way to the sink */
+  if (tracker.frames > 0)
+    g_print ("Frames: %" G_GUINT64_FORMAT ", copies: %" G_GUINT64_FORMAT
+        " (%.2f copies/frame)\n", tracker.frames, tracker.copies,
+        (gdouble) tracker.copies / tracker.frames);
 
   /* Free resources */
-  gst_object_unref (bus);
-  gst_element_set_state (pipeline, GST_STATE_NULL);
+  pipeline_runtime_free (runtime);
+  if (metrics)
+    metrics_exporter_free (metrics);
+  if (live_latency)
+    live_latency_free (live_latency);
+  if (recovery)
+    source_recovery_free (recovery);
   gst_object_unref (pipeline);
+  g_mutex_clear (&tracker.lock);
   return 0;
 }
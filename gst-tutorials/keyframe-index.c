@@ -0,0 +1,264 @@
+#include "keyframe-index.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define SIDECAR_MAGIC "KFIDX002"
+
+struct _KeyframeIndex {
+  guint64 file_size;          /* of the media, to detect a stale sidecar */
+  gint64 file_mtime;
+  GArray *entries;            /* KeyframeEntry, sorted by timestamp */
+};
+
+/* On-disk layout: header followed by `count` entries, all little endian */
+typedef struct _SidecarHeader {
+  gchar magic[8];
+  guint64 file_size;
+  gint64 file_mtime;
+  guint32 count;
+  guint32 reserved;
+} SidecarHeader;
+
+/* State of a running scan */
+typedef struct _ScanData {
+  GstElement *pipeline;
+  KeyframeIndex *index;
+  GstPad *video_pad;          /* the one parsebin pad we index */
+} ScanData;
+
+static KeyframeIndex *
+keyframe_index_new (const gchar *media_path)
+{
+  KeyframeIndex *index = g_new0 (KeyframeIndex, 1);
+  GStatBuf st;
+
+  if (g_stat (media_path, &st) == 0) {
+    index->file_size = st.st_size;
+    index->file_mtime = st.st_mtime;
+  }
+  index->entries = g_array_new (FALSE, FALSE, sizeof (KeyframeEntry));
+  return index;
+}
+
+void
+keyframe_index_free (KeyframeIndex *index)
+{
+  g_array_unref (index->entries);
+  g_free (index);
+}
+
+gchar *
+keyframe_index_sidecar_path (const gchar *media_path)
+{
+  return g_strconcat (media_path, ".kfidx", NULL);
+}
+
+guint
+keyframe_index_get_size (KeyframeIndex *index)
+{
+  return index->entries->len;
+}
+
+static GstPadProbeReturn
+video_probe (GstPad *pad, GstPadProbeInfo *info, ScanData *scan)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  KeyframeEntry entry;
+  GstClockTime ts;
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    return GST_PAD_PROBE_OK;
+
+  ts = GST_BUFFER_PTS_IS_VALID (buffer) ? GST_BUFFER_PTS (buffer) : GST_BUFFER_DTS (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    return GST_PAD_PROBE_OK;
+
+  entry.timestamp = ts;
+  g_array_append_val (scan->index->entries, entry);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Every parsed stream goes to a fakesink; only the first video one is indexed */
+static void
+pad_added_cb (GstElement *parsebin, GstPad *pad, ScanData *scan)
+{
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+  GstPad *sink_pad;
+  GstCaps *caps;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (!caps)
+    caps = gst_pad_query_caps (pad, NULL);
+  if (!scan->video_pad && gst_caps_get_size (caps) > 0 && g_str_has_prefix (
+          gst_structure_get_name (gst_caps_get_structure (caps, 0)), "video/")) {
+    scan->video_pad = pad;
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+        (GstPadProbeCallback) video_probe, scan, NULL);
+  }
+  gst_caps_unref (caps);
+
+  g_object_set (sink, "sync", FALSE, NULL);
+  gst_bin_add (GST_BIN (scan->pipeline), sink);
+  gst_element_sync_state_with_parent (sink);
+  sink_pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_link (pad, sink_pad);
+  gst_object_unref (sink_pad);
+}
+
+static gint
+compare_entries (gconstpointer a, gconstpointer b)
+{
+  const KeyframeEntry *ea = a, *eb = b;
+
+  return (ea->timestamp > eb->timestamp) - (ea->timestamp < eb->timestamp);
+}
+
+KeyframeIndex *
+keyframe_index_build (const gchar *media_path, GError **error)
+{
+  GstElement *source, *parsebin;
+  ScanData scan = { 0 };
+  GstMessage *msg;
+  GstBus *bus;
+
+  source = gst_element_factory_make ("filesrc", NULL);
+  parsebin = gst_element_factory_make ("parsebin", NULL);
+  scan.pipeline = gst_pipeline_new ("keyframe-scan");
+  if (!source || !parsebin || !scan.pipeline) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+        "filesrc or parsebin is not available");
+    if (source)
+      gst_object_unref (source);
+    if (parsebin)
+      gst_object_unref (parsebin);
+    if (scan.pipeline)
+      gst_object_unref (scan.pipeline);
+    return NULL;
+  }
+
+  scan.index = keyframe_index_new (media_path);
+  g_object_set (source, "location", media_path, NULL);
+  gst_bin_add_many (GST_BIN (scan.pipeline), source, parsebin, NULL);
+  gst_element_link (source, parsebin);
+  g_signal_connect (parsebin, "pad-added", G_CALLBACK (pad_added_cb), &scan);
+
+  /* Nothing is decoded or synchronised, so this runs as fast as the disk allows */
+  gst_element_set_state (scan.pipeline, GST_STATE_PLAYING);
+  bus = gst_element_get_bus (scan.pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_ERROR | GST_MESSAGE_EOS);
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error (msg, error, NULL);
+    keyframe_index_free (scan.index);
+    scan.index = NULL;
+  }
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+  gst_element_set_state (scan.pipeline, GST_STATE_NULL);
+  gst_object_unref (scan.pipeline);
+
+  if (scan.index)
+    g_array_sort (scan.index->entries, compare_entries);
+  return scan.index;
+}
+
+gboolean
+keyframe_index_save (KeyframeIndex *index, const gchar *media_path, GError **error)
+{
+  gsize size = sizeof (SidecarHeader) + index->entries->len * sizeof (guint64);
+  gchar *data = g_malloc (size), *path;
+  SidecarHeader *header = (SidecarHeader *) data;
+  guint64 *out = (guint64 *) (data + sizeof (SidecarHeader));
+  gboolean ret;
+  guint i;
+
+  memcpy (header->magic, SIDECAR_MAGIC, sizeof (header->magic));
+  header->file_size = GUINT64_TO_LE (index->file_size);
+  header->file_mtime = GINT64_TO_LE (index->file_mtime);
+  header->count = GUINT32_TO_LE (index->entries->len);
+  header->reserved = 0;
+  for (i = 0; i < index->entries->len; i++) {
+    KeyframeEntry *entry = &g_array_index (index->entries, KeyframeEntry, i);
+
+    *out++ = GUINT64_TO_LE (entry->timestamp);
+  }
+
+  path = keyframe_index_sidecar_path (media_path);
+  ret = g_file_set_contents (path, data, size, error);
+  g_free (path);
+  g_free (data);
+  return ret;
+}
+
+/* Returns NULL if there is no sidecar or it no longer matches the media */
+KeyframeIndex *
+keyframe_index_load (const gchar *media_path)
+{
+  KeyframeIndex *index = keyframe_index_new (media_path);
+  gchar *path = keyframe_index_sidecar_path (media_path), *data = NULL;
+  SidecarHeader header;
+  const guint64 *in;
+  gsize size = 0;
+  guint32 count, i;
+
+  if (!g_file_get_contents (path, &data, &size, NULL) || size < sizeof (header))
+    goto invalid;
+
+  memcpy (&header, data, sizeof (header));
+  count = GUINT32_FROM_LE (header.count);
+  if (memcmp (header.magic, SIDECAR_MAGIC, sizeof (header.magic)) != 0 ||
+      GUINT64_FROM_LE (header.file_size) != index->file_size ||
+      GINT64_FROM_LE (header.file_mtime) != index->file_mtime ||
+      size != sizeof (header) + (gsize) count * sizeof (guint64))
+    goto invalid;
+
+  in = (const guint64 *) (data + sizeof (header));
+  g_array_set_size (index->entries, count);
+  for (i = 0; i < count; i++) {
+    KeyframeEntry *entry = &g_array_index (index->entries, KeyframeEntry, i);
+
+    entry->timestamp = GUINT64_FROM_LE (in[i]);
+  }
+  g_free (data);
+  g_free (path);
+  return index;
+
+invalid:
+  g_free (data);
+  g_free (path);
+  keyframe_index_free (index);
+  return NULL;
+}
+
+const KeyframeEntry *
+keyframe_index_lookup (KeyframeIndex *index, GstClockTime target)
+{
+  GArray *entries = index->entries;
+  guint lo = 0, hi;
+
+  if (entries->len == 0)
+    return NULL;
+
+  /* Binary search for the first keyframe after target */
+  hi = entries->len;
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (entries, KeyframeEntry, mid).timestamp <= target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return &g_array_index (entries, KeyframeEntry, 0);
+  if (lo == entries->len)
+    return &g_array_index (entries, KeyframeEntry, lo - 1);
+
+  /* Whichever neighbour is closer */
+  if (g_array_index (entries, KeyframeEntry, lo).timestamp - target <
+      target - g_array_index (entries, KeyframeEntry, lo - 1).timestamp)
+    return &g_array_index (entries, KeyframeEntry, lo);
+  return &g_array_index (entries, KeyframeEntry, lo - 1);
+}
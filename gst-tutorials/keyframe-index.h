@@ -0,0 +1,39 @@
+/*
+Persistent keyframe index for a media file.
+
+`keyframe_index_build` runs a demux-only scan of the file (filesrc ! parsebin,
+no decoding) and records the timestamp of every video keyframe.
+
+The index is saved next to the media as `<file>.kfidx` and is only loaded back
+if the media's size and modification time still match. With it, a seek target
+can be snapped to a known keyframe before the seek is issued, so the position
+the player lands on is known up front and the decoder has nothing to skip to
+reach it. The demuxer still locates the keyframe by time.
+*/
+#ifndef __KEYFRAME_INDEX_H__
+#define __KEYFRAME_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KeyframeEntry {
+  GstClockTime timestamp;
+} KeyframeEntry;
+
+typedef struct _KeyframeIndex KeyframeIndex;
+
+KeyframeIndex *keyframe_index_build (const gchar *media_path, GError **error);
+KeyframeIndex *keyframe_index_load (const gchar *media_path);
+gboolean keyframe_index_save (KeyframeIndex *index, const gchar *media_path, GError **error);
+void keyframe_index_free (KeyframeIndex *index);
+
+/* The keyframe closest to `target` (either side), or NULL for an empty index */
+const KeyframeEntry *keyframe_index_lookup (KeyframeIndex *index, GstClockTime target);
+guint keyframe_index_get_size (KeyframeIndex *index);
+
+gchar *keyframe_index_sidecar_path (const gchar *media_path);
+
+G_END_DECLS
+
+#endif /* __KEYFRAME_INDEX_H__ */
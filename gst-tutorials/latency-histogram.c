@@ -0,0 +1,105 @@
+#include "latency-histogram.h"
+
+#include <string.h>
+
+#define SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BITS)
+
+static guint
+bucket_index (guint64 value)
+{
+  guint exp;
+
+  if (value < SUB_BUCKETS)
+    return value;
+
+  /* Position of the highest set bit, then the next SUB_BITS bits below it */
+  exp = 63 - __builtin_clzll (value);
+  return ((exp - LATENCY_HISTOGRAM_SUB_BITS + 1) << LATENCY_HISTOGRAM_SUB_BITS) |
+      ((value >> (exp - LATENCY_HISTOGRAM_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+static guint64
+bucket_upper_bound (guint index)
+{
+  guint exp, shift;
+
+  if (index < SUB_BUCKETS)
+    return index;
+
+  exp = (index >> LATENCY_HISTOGRAM_SUB_BITS) + LATENCY_HISTOGRAM_SUB_BITS - 1;
+  shift = exp - LATENCY_HISTOGRAM_SUB_BITS;
+  return ((((guint64) SUB_BUCKETS | (index & (SUB_BUCKETS - 1))) + 1) << shift) - 1;
+}
+
+void
+latency_histogram_reset (LatencyHistogram *histogram)
+{
+  memset (histogram, 0, sizeof (*histogram));
+}
+
+void
+latency_histogram_record (LatencyHistogram *histogram, guint64 value)
+{
+  histogram->buckets[bucket_index (value)]++;
+  histogram->count++;
+  histogram->sum += value;
+  if (value > histogram->max)
+    histogram->max = value;
+}
+
+void
+latency_histogram_merge (LatencyHistogram *dest, const LatencyHistogram *src)
+{
+  guint i;
+
+  for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    dest->buckets[i] += src->buckets[i];
+  dest->count += src->count;
+  dest->sum += src->sum;
+  if (src->max > dest->max)
+    dest->max = src->max;
+}
+
+guint64
+latency_histogram_percentile (const LatencyHistogram *histogram, gdouble percentile)
+{
+  guint64 rank, seen = 0;
+  guint i;
+
+  if (histogram->count == 0)
+    return 0;
+
+  /* Smallest value such that `percentile` % of the samples are <= it */
+  rank = (guint64) (percentile / 100.0 * histogram->count + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank)
+      return MIN (bucket_upper_bound (i), histogram->max);
+  }
+  return histogram->max;
+}
+
+gdouble
+latency_histogram_mean (const LatencyHistogram *histogram)
+{
+  return histogram->count ? (gdouble) histogram->sum / histogram->count : 0.0;
+}
+
+gdouble
+latency_histogram_fraction_below (const LatencyHistogram *histogram, guint64 value)
+{
+  guint64 below = 0;
+  guint i, last;
+
+  if (histogram->count == 0)
+    return 0.0;
+
+  /* Buckets are counted whole, so this is exact only on bucket boundaries */
+  last = bucket_index (value);
+  for (i = 0; i <= last; i++)
+    below += histogram->buckets[i];
+  return (gdouble) below / histogram->count;
+}
@@ -0,0 +1,43 @@
+/*
+Log-linear latency histogram.
+
+Values (nanoseconds) are bucketed by their power of two and then linearly into
+16 sub-buckets, so any percentile we report is within ~6% of the real value
+while the whole histogram stays a fixed 4 KB with no allocation on record.
+
+A histogram has a single writer: `latency_histogram_record` does plain
+increments, so give each streaming thread its own histogram and merge them
+with `latency_histogram_merge` when reporting. Readers may see a slightly
+stale histogram, which is fine for statistics.
+*/
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define LATENCY_HISTOGRAM_SUB_BITS 4
+#define LATENCY_HISTOGRAM_BUCKETS ((64 - LATENCY_HISTOGRAM_SUB_BITS + 1) << LATENCY_HISTOGRAM_SUB_BITS)
+
+typedef struct _LatencyHistogram {
+  guint32 buckets[LATENCY_HISTOGRAM_BUCKETS];
+  guint64 count;
+  guint64 sum;
+  guint64 max;
+} LatencyHistogram;
+
+void latency_histogram_reset (LatencyHistogram *histogram);
+void latency_histogram_record (LatencyHistogram *histogram, guint64 value);
+void latency_histogram_merge (LatencyHistogram *dest, const LatencyHistogram *src);
+
+/* `percentile` is in [0, 100]; returns the upper bound of the matching bucket */
+guint64 latency_histogram_percentile (const LatencyHistogram *histogram, gdouble percentile);
+gdouble latency_histogram_mean (const LatencyHistogram *histogram);
+
+/* Fraction (0..1) of recorded values that are <= `value` */
+gdouble latency_histogram_fraction_below (const LatencyHistogram *histogram, guint64 value);
+
+G_END_DECLS
+
+#endif /* __LATENCY_HISTOGRAM_H__ */
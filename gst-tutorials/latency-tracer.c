@@ -0,0 +1,344 @@
+#include "latency-tracer.h"
+#include "latency-histogram.h"
+
+#include <glib-unix.h>
+
+/*
+ Input buffers remembered per element, to start with. A queue starts with room
+ for its max-size-buffers (200 by default); any ring grows when it would
+ overwrite an input that has not come out yet, up to ENTRY_SLOTS_MAX.
+*/
+#define ENTRY_SLOTS 64
+#define ENTRY_SLOTS_MAX 8192
+
+typedef struct _Entry {
+  GstClockTime pts;
+  guint64 arrival;            /* gst_util_get_timestamp () */
+} Entry;
+
+typedef struct _ElementStats ElementStats;
+
+/* One per src pad, so each histogram has a single writer (that pad's thread) */
+typedef struct _SrcPadStats {
+  ElementStats *element;
+  LatencyHistogram histogram;
+} SrcPadStats;
+
+struct _ElementStats {
+  LatencyTracer *tracer;
+  gchar *name;
+  gint sink_pads;             /* more than one: mixer/muxer, not traced */
+
+  GMutex lock;                /* protects the entry ring */
+  Entry *entries;
+  guint n_slots;
+  guint next;
+  guint filled;
+  GstClockTime last_out;      /* PTS of the newest output, to see what is still inside */
+};
+
+struct _LatencyTracer {
+  GstElement *pipeline;       /* not a ref: the pipeline owns us */
+  GMutex lock;                /* protects the two arrays */
+  GPtrArray *elements;        /* ElementStats */
+  GPtrArray *src_pads;        /* SrcPadStats */
+  guint sigusr1;              /* source on the default main context */
+};
+
+static GQuark stats_quark;
+
+static void attach_element (LatencyTracer *tracer, GstElement *element);
+
+/* From the main loop, so a stalled or idle pipeline still dumps */
+static gboolean
+dump_on_signal (LatencyTracer *tracer)
+{
+  latency_tracer_dump (tracer);
+  return G_SOURCE_CONTINUE;
+}
+
+static GstBuffer *
+probe_buffer (GstPadProbeInfo *info)
+{
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    return GST_PAD_PROBE_INFO_BUFFER (info);
+
+  /* For a buffer list, the first buffer stands in for the whole list */
+  if (gst_buffer_list_length (GST_PAD_PROBE_INFO_BUFFER_LIST (info)) > 0)
+    return gst_buffer_list_get (GST_PAD_PROBE_INFO_BUFFER_LIST (info), 0);
+  return NULL;
+}
+
+/* Called with the lock held: the input in `slot` has not come out yet */
+static gboolean
+still_inside (ElementStats *stats, guint slot)
+{
+  GstClockTime pts = stats->entries[slot].pts;
+
+  return GST_CLOCK_TIME_IS_VALID (pts) &&
+      (!GST_CLOCK_TIME_IS_VALID (stats->last_out) || pts > stats->last_out);
+}
+
+/* Called with the lock held on a full ring: doubles it, oldest entry first */
+static void
+grow_entries (ElementStats *stats)
+{
+  guint n_slots = MIN (stats->n_slots * 2, ENTRY_SLOTS_MAX), i;
+  Entry *entries;
+
+  if (n_slots == stats->n_slots)
+    return;
+  entries = g_new (Entry, n_slots);
+  for (i = 0; i < stats->filled; i++)
+    entries[i] = stats->entries[(stats->next + i) % stats->n_slots];
+  g_free (stats->entries);
+  stats->entries = entries;
+  stats->n_slots = n_slots;
+  stats->next = stats->filled;
+}
+
+/* A buffer enters the element */
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, ElementStats *stats)
+{
+  GstBuffer *buffer = probe_buffer (info);
+  guint64 now = gst_util_get_timestamp ();
+
+  if (buffer == NULL)
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&stats->lock);
+  if (stats->filled == stats->n_slots && still_inside (stats, stats->next))
+    grow_entries (stats);
+  stats->entries[stats->next].pts = GST_BUFFER_PTS (buffer);
+  stats->entries[stats->next].arrival = now;
+  stats->next = (stats->next + 1) % stats->n_slots;
+  if (stats->filled < stats->n_slots)
+    stats->filled++;
+  g_mutex_unlock (&stats->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* A buffer leaves the element: charge it from the input that carried its media time */
+static GstPadProbeReturn
+src_probe (GstPad *pad, GstPadProbeInfo *info, SrcPadStats *pad_stats)
+{
+  ElementStats *stats = pad_stats->element;
+  GstBuffer *buffer = probe_buffer (info);
+  guint64 now = gst_util_get_timestamp (), arrival = 0;
+  GstClockTime pts;
+  guint i, slot;
+
+  if (buffer == NULL || g_atomic_int_get (&stats->sink_pads) != 1)
+    return GST_PAD_PROBE_OK;
+  pts = GST_BUFFER_PTS (buffer);
+
+  g_mutex_lock (&stats->lock);
+  if (GST_CLOCK_TIME_IS_VALID (pts))
+    stats->last_out = pts;
+  for (i = 1; i <= stats->filled; i++) {
+    slot = (stats->next + stats->n_slots - i) % stats->n_slots;
+    /* Without timestamps on either side, fall back to the newest input */
+    if (!GST_CLOCK_TIME_IS_VALID (pts) ||
+        !GST_CLOCK_TIME_IS_VALID (stats->entries[slot].pts) ||
+        stats->entries[slot].pts <= pts) {
+      arrival = stats->entries[slot].arrival;
+      break;
+    }
+  }
+  g_mutex_unlock (&stats->lock);
+
+  if (arrival != 0 && now >= arrival)
+    latency_histogram_record (&pad_stats->histogram, now - arrival);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+attach_pad (ElementStats *stats, GstPad *pad)
+{
+  LatencyTracer *tracer = stats->tracer;
+  GstPadProbeType type = GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST;
+
+  if (GST_PAD_IS_SINK (pad)) {
+    g_atomic_int_inc (&stats->sink_pads);
+    gst_pad_add_probe (pad, type, (GstPadProbeCallback) sink_probe, stats, NULL);
+  } else if (GST_PAD_IS_SRC (pad)) {
+    SrcPadStats *pad_stats = g_new0 (SrcPadStats, 1);
+
+    pad_stats->element = stats;
+    g_mutex_lock (&tracer->lock);
+    g_ptr_array_add (tracer->src_pads, pad_stats);
+    g_mutex_unlock (&tracer->lock);
+    gst_pad_add_probe (pad, type, (GstPadProbeCallback) src_probe, pad_stats, NULL);
+  }
+}
+
+static gboolean
+attach_existing_pad (GstElement *element, GstPad *pad, gpointer stats)
+{
+  attach_pad (stats, pad);
+  return TRUE;
+}
+
+static void
+pad_added_cb (GstElement *element, GstPad *pad, ElementStats *stats)
+{
+  attach_pad (stats, pad);
+}
+
+static void
+attach_leaf (LatencyTracer *tracer, GstElement *element)
+{
+  ElementStats *stats;
+
+  /* Already traced (an element can be announced both directly and through a bin) */
+  if (g_object_get_qdata (G_OBJECT (element), stats_quark))
+    return;
+
+  stats = g_new0 (ElementStats, 1);
+  stats->tracer = tracer;
+  stats->name = gst_object_get_name (GST_OBJECT (element));
+  stats->n_slots = ENTRY_SLOTS;
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (element), "max-size-buffers")) {
+    guint max_buffers = 0;
+
+    g_object_get (element, "max-size-buffers", &max_buffers, NULL);
+    stats->n_slots = CLAMP (max_buffers + 1, ENTRY_SLOTS, ENTRY_SLOTS_MAX);
+  }
+  stats->entries = g_new (Entry, stats->n_slots);
+  stats->last_out = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&stats->lock);
+  g_object_set_qdata (G_OBJECT (element), stats_quark, stats);
+
+  g_mutex_lock (&tracer->lock);
+  g_ptr_array_add (tracer->elements, stats);
+  g_mutex_unlock (&tracer->lock);
+
+  g_signal_connect (element, "pad-added", G_CALLBACK (pad_added_cb), stats);
+  gst_element_foreach_pad (element, attach_existing_pad, stats);
+}
+
+/*
+ Bins are not traced themselves (their ghost pads only proxy the pads of the
+ elements inside, which are), but everything already inside them is.
+*/
+static void
+attach_element (LatencyTracer *tracer, GstElement *element)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  if (!GST_IS_BIN (element)) {
+    attach_leaf (tracer, element);
+    return;
+  }
+
+  it = gst_bin_iterate_recurse (GST_BIN (element));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstElement *child = g_value_get_object (&item);
+
+    if (!GST_IS_BIN (child))
+      attach_leaf (tracer, child);
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+static void
+element_added_cb (GstBin *bin, GstElement *element, LatencyTracer *tracer)
+{
+  attach_element (tracer, element);
+}
+
+static void
+deep_element_added_cb (GstBin *bin, GstBin *sub_bin, GstElement *element,
+    LatencyTracer *tracer)
+{
+  attach_element (tracer, element);
+}
+
+static void
+element_stats_free (ElementStats *stats)
+{
+  g_mutex_clear (&stats->lock);
+  g_free (stats->entries);
+  g_free (stats->name);
+  g_free (stats);
+}
+
+static void
+latency_tracer_free (LatencyTracer *tracer)
+{
+  g_source_remove (tracer->sigusr1);
+  g_ptr_array_unref (tracer->src_pads);
+  g_ptr_array_unref (tracer->elements);
+  g_mutex_clear (&tracer->lock);
+  g_free (tracer);
+}
+
+LatencyTracer *
+latency_tracer_attach (GstElement *pipeline)
+{
+  static gsize initialized = 0;
+  LatencyTracer *tracer;
+
+  if (g_once_init_enter (&initialized)) {
+    stats_quark = g_quark_from_static_string ("latency-tracer-stats");
+    g_once_init_leave (&initialized, 1);
+  }
+
+  tracer = g_new0 (LatencyTracer, 1);
+  tracer->pipeline = pipeline;
+  g_mutex_init (&tracer->lock);
+  tracer->elements = g_ptr_array_new_with_free_func ((GDestroyNotify) element_stats_free);
+  tracer->src_pads = g_ptr_array_new_with_free_func (g_free);
+  tracer->sigusr1 = g_unix_signal_add (SIGUSR1, (GSourceFunc) dump_on_signal, tracer);
+
+  /* Freed with the pipeline, after all its elements (and our probes) are gone */
+  g_object_set_data_full (G_OBJECT (pipeline), "latency-tracer", tracer,
+      (GDestroyNotify) latency_tracer_free);
+
+  g_signal_connect (pipeline, "element-added", G_CALLBACK (element_added_cb), tracer);
+  g_signal_connect (pipeline, "deep-element-added", G_CALLBACK (deep_element_added_cb), tracer);
+  attach_element (tracer, pipeline);
+
+  return tracer;
+}
+
+void
+latency_tracer_dump (LatencyTracer *tracer)
+{
+  LatencyHistogram *merged = g_new (LatencyHistogram, 1);
+  guint e, p;
+
+  g_print ("\nPer-element latency for %s (microseconds):\n",
+      GST_OBJECT_NAME (tracer->pipeline));
+  g_print ("  %-28s %10s %10s %10s %10s\n", "element", "buffers", "p50", "p99", "max");
+
+  g_mutex_lock (&tracer->lock);
+  for (e = 0; e < tracer->elements->len; e++) {
+    ElementStats *stats = g_ptr_array_index (tracer->elements, e);
+
+    latency_histogram_reset (merged);
+    for (p = 0; p < tracer->src_pads->len; p++) {
+      SrcPadStats *pad_stats = g_ptr_array_index (tracer->src_pads, p);
+
+      if (pad_stats->element == stats)
+        latency_histogram_merge (merged, &pad_stats->histogram);
+    }
+    /* Sources and sinks have no in->out latency of their own */
+    if (merged->count == 0)
+      continue;
+
+    g_print ("  %-28s %10" G_GUINT64_FORMAT " %10.1f %10.1f %10.1f\n", stats->name,
+        merged->count,
+        latency_histogram_percentile (merged, 50) / 1e3,
+        latency_histogram_percentile (merged, 99) / 1e3,
+        merged->max / 1e3);
+  }
+  g_mutex_unlock (&tracer->lock);
+
+  g_free (merged);
+}
@@ -0,0 +1,37 @@
+/*
+Per-element buffer latency tracer.
+
+Attach it to a pipeline built the usual way (gst_bin_add_many + gst_element_link)
+and it puts pad probes on every element, including the ones added later by
+uridecodebin/playbin or in a pad-added handler:
+  - a buffer entering an element (sink pad) is timestamped,
+  - when a buffer leaves the element (src pad), it is matched to the newest
+    input buffer whose PTS is <= its own and the difference goes into that
+    element's latency histogram.
+Matching by PTS also works for elements that produce new buffers (videoconvert,
+audioresample): the output is charged from the moment the input that carried
+that media time arrived. Elements with more than one sink pad (mixers, muxers)
+are not traced.
+
+Histograms are printed (p50/p99/max per element) by `latency_tracer_dump`, which
+the application calls at EOS, and whenever the process receives SIGUSR1 (from
+a source on the default main context, so the program must run a main loop). The tracer lives as long as the pipeline, there is nothing to free.
+
+The hot path is two probes per element doing a clock read, an uncontended
+mutex and a histogram increment, cheap enough to leave enabled.
+*/
+#ifndef __LATENCY_TRACER_H__
+#define __LATENCY_TRACER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LatencyTracer LatencyTracer;
+
+LatencyTracer *latency_tracer_attach (GstElement *pipeline);
+void latency_tracer_dump (LatencyTracer *tracer);
+
+G_END_DECLS
+
+#endif /* __LATENCY_TRACER_H__ */
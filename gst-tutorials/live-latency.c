@@ -0,0 +1,266 @@
+#include "live-latency.h"
+
+#include "latency-histogram.h"
+
+/* Names our GstReferenceTimestampMeta among any others on the buffer */
+#define CAPTURE_CAPS "timestamp/x-capture-clock"
+
+struct _LiveLatency {
+  GstElement *pipeline;       /* not a ref */
+  GstElement *sink;           /* not a ref */
+  GstCaps *reference;
+  GstClockTime budget;
+  gboolean sync;
+  GstPad *source_pad;
+  GstPad *sink_pad;
+  gulong source_probe;
+  gulong sink_probe;
+
+  /* Sink streaming thread only */
+  GstSegment segment;
+
+  /* Written by the sink streaming thread, read by the report; the latency is
+     set from the main loop on LATENCY and read by the sink streaming thread */
+  GMutex lock;
+  LatencyHistogram histogram;
+  guint64 over_budget;
+  guint64 unstamped;
+  GstClockTime pipeline_latency;
+
+  /* Main loop only */
+  guint64 late;               /* dropped by the sink, from its QoS messages */
+  guint64 reported;           /* histogram count at the previous report */
+};
+
+static GstPadProbeReturn
+source_probe (GstPad *pad, GstPadProbeInfo *info, LiveLatency *latency)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstElement *element = GST_PAD_PARENT_ELEMENT (pad);
+  GstClock *clock = gst_element_get_clock (element);
+  GstClockTime now, capture;
+
+  if (!clock)
+    return GST_PAD_PROBE_OK;
+  now = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  /* Live sources timestamp in running time, at capture */
+  capture = now;
+  if (GST_BUFFER_PTS_IS_VALID (buffer))
+    capture = MIN (now, gst_element_get_base_time (element) + GST_BUFFER_PTS (buffer));
+
+  buffer = gst_buffer_make_writable (buffer);
+  gst_buffer_add_reference_timestamp_meta (buffer, latency->reference, capture,
+      GST_CLOCK_TIME_NONE);
+  GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, LiveLatency *latency)
+{
+  GstReferenceTimestampMeta *meta;
+  GstBuffer *buffer;
+  GstClock *clock;
+  GstClockTime render;
+  guint64 running_time;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT)
+      gst_event_copy_segment (event, &latency->segment);
+    return GST_PAD_PROBE_OK;
+  }
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  meta = gst_buffer_get_reference_timestamp_meta (buffer, latency->reference);
+  clock = gst_element_get_clock (latency->sink);
+  if (!meta || !clock) {
+    g_mutex_lock (&latency->lock);
+    latency->unstamped++;
+    g_mutex_unlock (&latency->lock);
+    if (clock)
+      gst_object_unref (clock);
+    return GST_PAD_PROBE_OK;
+  }
+  render = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  /* With sync the sink waits for the frame's time, unless it is already late */
+  running_time = gst_segment_to_running_time (&latency->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  g_mutex_lock (&latency->lock);
+  if (latency->sync && GST_CLOCK_TIME_IS_VALID (running_time))
+    render = MAX (render,
+        gst_element_get_base_time (latency->sink) + running_time + latency->pipeline_latency);
+
+  if (render > meta->timestamp) {
+    latency_histogram_record (&latency->histogram, render - meta->timestamp);
+    if (render - meta->timestamp > latency->budget)
+      latency->over_budget++;
+  }
+  g_mutex_unlock (&latency->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+LiveLatency *
+live_latency_attach (GstElement *pipeline, GstElement *source, GstElement *sink,
+    GstClockTime budget)
+{
+  LiveLatency *latency = g_new0 (LiveLatency, 1);
+
+  latency->pipeline = pipeline;
+  latency->sink = sink;
+  latency->reference = gst_caps_new_empty_simple (CAPTURE_CAPS);
+  latency->budget = budget;
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (sink), "sync"))
+    g_object_get (sink, "sync", &latency->sync, NULL);
+  gst_segment_init (&latency->segment, GST_FORMAT_TIME);
+  latency_histogram_reset (&latency->histogram);
+  g_mutex_init (&latency->lock);
+
+  latency->source_pad = gst_element_get_static_pad (source, "src");
+  latency->source_probe = gst_pad_add_probe (latency->source_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) source_probe, latency, NULL);
+  latency->sink_pad = gst_element_get_static_pad (sink, "sink");
+  latency->sink_probe = gst_pad_add_probe (latency->sink_pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) sink_probe, latency, NULL);
+  return latency;
+}
+
+void
+live_latency_free (LiveLatency *latency)
+{
+  gst_pad_remove_probe (latency->source_pad, latency->source_probe);
+  gst_pad_remove_probe (latency->sink_pad, latency->sink_probe);
+  gst_object_unref (latency->source_pad);
+  gst_object_unref (latency->sink_pad);
+  gst_caps_unref (latency->reference);
+  g_mutex_clear (&latency->lock);
+  g_free (latency);
+}
+
+/* The pipeline's latency as it stands; the sink probe needs the minimum */
+static gboolean
+query_latency (LiveLatency *latency, gboolean *live, GstClockTime *min, GstClockTime *max)
+{
+  GstQuery *query = gst_query_new_latency ();
+  gboolean ret;
+
+  ret = gst_element_query (latency->pipeline, query);
+  if (ret) {
+    gst_query_parse_latency (query, live, min, max);
+    g_mutex_lock (&latency->lock);
+    latency->pipeline_latency = *min;
+    g_mutex_unlock (&latency->lock);
+  }
+  gst_query_unref (query);
+  return ret;
+}
+
+void
+live_latency_handle_message (LiveLatency *latency, GstMessage *msg)
+{
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_LATENCY) {
+    GstClockTime min, max;
+    gboolean live;
+
+    /* An element's latency changed: redistribute it, then see what it is now */
+    gst_bin_recalculate_latency (GST_BIN (latency->pipeline));
+    if (query_latency (latency, &live, &min, &max)) {
+      if (GST_CLOCK_TIME_IS_VALID (max))
+        g_print ("Pipeline latency (from %s): %s, min %.1f ms, max %.1f ms\n",
+            GST_MESSAGE_SRC_NAME (msg), live ? "live" : "not live", min / 1e6, max / 1e6);
+      else
+        g_print ("Pipeline latency (from %s): %s, min %.1f ms, no max\n",
+            GST_MESSAGE_SRC_NAME (msg), live ? "live" : "not live", min / 1e6);
+    }
+  } else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_QOS &&
+      GST_MESSAGE_SRC (msg) == GST_OBJECT (latency->sink)) {
+    GstFormat format;
+    guint64 dropped;
+
+    /* The counts are totals for the sink, not deltas */
+    gst_message_parse_qos_stats (msg, &format, NULL, &dropped);
+    if (format == GST_FORMAT_BUFFERS && dropped != (guint64) -1)
+      latency->late = dropped;
+  }
+}
+
+void
+live_latency_report (LiveLatency *latency, gboolean final)
+{
+  LatencyHistogram snapshot;
+  const LatencyHistogram *histogram = &snapshot;
+  guint64 count, over_budget, unstamped;
+  GstClockTime min, max;
+  gboolean live;
+  gint step;
+
+  /* A copy, so the streaming thread is not held up while we print */
+  g_mutex_lock (&latency->lock);
+  snapshot = latency->histogram;
+  over_budget = latency->over_budget;
+  unstamped = latency->unstamped;
+  g_mutex_unlock (&latency->lock);
+  count = histogram->count;
+
+  if (!final) {
+    /* The pipeline sets its latency going to PLAYING without a message; pick it up */
+    query_latency (latency, &live, &min, &max);
+    g_print ("Capture-to-render: %" G_GUINT64_FORMAT " frames/s, p50 %.1f ms, p99 %.1f ms,"
+        " max %.1f ms, %" G_GUINT64_FORMAT " over %.0f ms\n", count - latency->reported,
+        latency_histogram_percentile (histogram, 50) / 1e6,
+        latency_histogram_percentile (histogram, 99) / 1e6, histogram->max / 1e6,
+        over_budget, latency->budget / 1e6);
+    latency->reported = count;
+    return;
+  }
+
+  g_print ("\nCapture-to-render latency, %" G_GUINT64_FORMAT " frames (%s):\n", count,
+      latency->sync ? "sink synchronized to the clock" : "sink renders on arrival");
+  if (count == 0)
+    return;
+  g_print ("  mean %.1f ms, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, p99.9 %.1f ms, max %.1f ms\n",
+      latency_histogram_mean (histogram) / 1e6,
+      latency_histogram_percentile (histogram, 50) / 1e6,
+      latency_histogram_percentile (histogram, 90) / 1e6,
+      latency_histogram_percentile (histogram, 99) / 1e6,
+      latency_histogram_percentile (histogram, 99.9) / 1e6, histogram->max / 1e6);
+
+  /* Cumulative, in fifths of the budget up to twice the budget */
+  for (step = 1; step <= 10; step++) {
+    GstClockTime bound = latency->budget * step / 5;
+    gdouble fraction = latency_histogram_fraction_below (histogram, bound);
+
+    g_print ("  <= %5.1f ms %6.2f%% %s\n", bound / 1e6, 100 * fraction,
+        step == 5 ? "<- budget" : "");
+    if (fraction >= 1.0)
+      break;
+  }
+  g_print ("  %s the %.0f ms budget: %" G_GUINT64_FORMAT " frames over, %" G_GUINT64_FORMAT
+      " dropped late by the sink, %" G_GUINT64_FORMAT " without a capture stamp\n",
+      over_budget ? "MISSED" : "met", latency->budget / 1e6, over_budget,
+      latency->late, unstamped);
+}
+
+void
+live_latency_tune_sink (GstElement *sink, GstClockTime max_lateness,
+    GstClockTime processing_deadline)
+{
+  GObjectClass *klass = G_OBJECT_GET_CLASS (sink);
+
+  /* Not every sink is a GstBaseSink; set what this one has */
+  if (g_object_class_find_property (klass, "sync"))
+    g_object_set (sink, "sync", TRUE, NULL);
+  if (g_object_class_find_property (klass, "qos"))
+    g_object_set (sink, "qos", TRUE, NULL);
+  if (g_object_class_find_property (klass, "max-lateness"))
+    g_object_set (sink, "max-lateness", (gint64) max_lateness, NULL);
+  /* GStreamer >= 1.16; the sink adds it to the pipeline latency */
+  if (g_object_class_find_property (klass, "processing-deadline"))
+    g_object_set (sink, "processing-deadline", (guint64) processing_deadline, NULL);
+}
@@ -0,0 +1,48 @@
+/*
+Capture-to-render latency of a live pipeline.
+
+Every frame gets its capture time written into it as it leaves the source
+(a GstReferenceTimestampMeta, which converters and queues carry along):
+the buffer's timestamp in clock time, which v4l2src takes from the driver
+when the frame was captured, or the moment it leaves the source if that is
+earlier or there is no timestamp. At the sink's pad the frame's render time is
+worked out the way the sink itself does it: with sync, the clock wait ends at
+base time + running time + the pipeline latency, or immediately if the frame
+is already late; without sync it is rendered on arrival. The difference goes
+into a histogram, against a budget.
+
+`live_latency_handle_message` takes the pipeline's LATENCY and QOS messages:
+on LATENCY it recalculates the pipeline latency (what the application is
+expected to do) and prints the new value from a latency query, on QOS it
+keeps the sink's count of frames dropped for being too late.
+`live_latency_report` prints the percentiles so far every second (and
+queries the pipeline latency again, which the pipeline sets on its own when
+it starts) and, at the end, the whole distribution.
+
+`live_latency_tune_sink` is the sink side of the low-latency setup: sync on
+(a steady frame pace), QoS on, late frames dropped after `max_lateness` and
+a short processing deadline, so the latency the sink adds is small.
+*/
+#ifndef __LIVE_LATENCY_H__
+#define __LIVE_LATENCY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LiveLatency LiveLatency;
+
+/* Stamps on `source`'s src pad, measures on `sink`'s sink pad */
+LiveLatency *live_latency_attach (GstElement *pipeline, GstElement *source, GstElement *sink,
+    GstClockTime budget);
+void live_latency_free (LiveLatency *latency);
+
+void live_latency_handle_message (LiveLatency *latency, GstMessage *msg);
+void live_latency_report (LiveLatency *latency, gboolean final);
+
+void live_latency_tune_sink (GstElement *sink, GstClockTime max_lateness,
+    GstClockTime processing_deadline);
+
+G_END_DECLS
+
+#endif /* __LIVE_LATENCY_H__ */
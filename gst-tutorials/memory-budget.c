@@ -0,0 +1,467 @@
+#include "memory-budget.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef enum {
+  KIND_OTHER,
+  KIND_QUEUE,                 /* queue and queue2: current-level-* on the element */
+  KIND_MULTIQUEUE,            /* current-level-* on each pad */
+  KIND_DECODEBIN,             /* sizes its own multiqueue */
+  KIND_URIDECODEBIN,          /* uridecodebin and playbin: network buffer */
+} ElementKind;
+
+typedef struct {
+  GstElement *element;
+  ElementKind kind;
+  guint64 max_bytes;          /* the limit we set, 0 if none */
+
+  gboolean pool_candidate;    /* may ask for a pool: not a bin, not a sink */
+  GSList *probes;             /* PadProbe, under the lock */
+
+  /* From the ALLOCATION queries on its src pads, under the lock */
+  guint pool_size;
+  guint pool_buffers;
+  gboolean pool_bounded;
+  guint64 pool_committed;     /* bytes of the pool budget this pool holds */
+} Tracked;
+
+typedef struct {
+  GstPad *pad;
+  gulong id;
+} PadProbe;
+
+struct _MemoryBudget {
+  GstElement *pipeline;       /* not a ref */
+  guint64 budget;
+  guint64 queue_budget;
+  guint64 pool_budget;
+  gulong added_id;
+  guint export_id;
+
+  /* Elements are added from streaming threads too */
+  GMutex lock;
+  GPtrArray *tracked;
+  guint n_queues;
+  guint n_candidates;
+  guint n_pools;              /* candidates whose pool has been sized */
+  guint64 pool_committed;
+};
+
+static guint64
+proc_status_kb (const gchar *field)
+{
+  gchar *contents = NULL, *line;
+  guint64 kb = 0;
+
+  if (!g_file_get_contents ("/proc/self/status", &contents, NULL, NULL))
+    return 0;
+  line = strstr (contents, field);
+  if (line)
+    kb = g_ascii_strtoull (line + strlen (field), NULL, 10);
+  g_free (contents);
+  return kb;
+}
+
+guint64
+memory_budget_get_rss (void)
+{
+  return proc_status_kb ("VmRSS:") * 1024;
+}
+
+guint64
+memory_budget_get_peak_rss (void)
+{
+  return proc_status_kb ("VmHWM:") * 1024;
+}
+
+gboolean
+memory_budget_reset_peak (void)
+{
+  return g_file_set_contents ("/proc/self/clear_refs", "5", 1, NULL);
+}
+
+static ElementKind
+element_kind (GstElement *element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *name;
+
+  if (!factory)
+    return KIND_OTHER;
+  name = GST_OBJECT_NAME (factory);
+  if (g_str_equal (name, "queue") || g_str_equal (name, "queue2"))
+    return KIND_QUEUE;
+  if (g_str_equal (name, "multiqueue"))
+    return KIND_MULTIQUEUE;
+  if (g_str_equal (name, "decodebin"))
+    return KIND_DECODEBIN;
+  if (g_str_equal (name, "uridecodebin") || g_str_equal (name, "playbin"))
+    return KIND_URIDECODEBIN;
+  return KIND_OTHER;
+}
+
+/* Every queue gets the same share. The limits are worked out under the lock
+   and set after it: setting a queue's property takes the queue's lock, which
+   its streaming thread may hold while adding elements */
+static void
+rebalance (MemoryBudget *memory)
+{
+  GPtrArray *elements;
+  guint64 share = 0;
+  guint i;
+
+  g_mutex_lock (&memory->lock);
+  if (!memory->budget || !memory->n_queues) {
+    g_mutex_unlock (&memory->lock);
+    return;
+  }
+  share = memory->queue_budget / memory->n_queues;
+  elements = g_ptr_array_new_with_free_func (gst_object_unref);
+  for (i = 0; i < memory->tracked->len; i++) {
+    Tracked *tracked = g_ptr_array_index (memory->tracked, i);
+
+    if (tracked->kind != KIND_OTHER) {
+      tracked->max_bytes = share;
+      g_ptr_array_add (elements, gst_object_ref (tracked->element));
+    }
+  }
+  g_mutex_unlock (&memory->lock);
+
+  for (i = 0; i < elements->len; i++) {
+    GstElement *element = g_ptr_array_index (elements, i);
+
+    switch (element_kind (element)) {
+      case KIND_QUEUE:
+      case KIND_MULTIQUEUE:
+        /* Buffer and time limits stay as the application set them: a short
+           leaky queue keeps its latency bound, the bytes only ever cap it */
+        g_object_set (element, "max-size-bytes", (guint) MIN (share, G_MAXUINT), NULL);
+        break;
+      case KIND_DECODEBIN:
+        /* decodebin resets its multiqueue from these when it reconfigures */
+        g_object_set (element, "max-size-bytes", (guint) MIN (share, G_MAXUINT), NULL);
+        break;
+      case KIND_URIDECODEBIN:
+        g_object_set (element, "buffer-size", (gint) MIN (share, G_MAXINT), NULL);
+        break;
+      default:
+        break;
+    }
+  }
+  g_ptr_array_unref (elements);
+}
+
+static Tracked *
+find_tracked (MemoryBudget *memory, GstElement *element)
+{
+  guint i;
+
+  for (i = 0; i < memory->tracked->len; i++) {
+    Tracked *tracked = g_ptr_array_index (memory->tracked, i);
+
+    if (tracked->element == element)
+      return tracked;
+  }
+  return NULL;
+}
+
+/* After the ALLOCATION query on an element's src pad has been answered */
+static GstPadProbeReturn
+allocation_probe (GstPad *pad, GstPadProbeInfo *info, MemoryBudget *memory)
+{
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+  GstElement *element = GST_PAD_PARENT_ELEMENT (pad);
+  guint total_size = 0, total_buffers = 0, i;
+  gboolean bounded = TRUE;
+  Tracked *tracked;
+
+  if (!(GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_PULL) ||
+      GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION)
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&memory->lock);
+  tracked = find_tracked (memory, element);
+  /* Renegotiating: what the element's previous pool held is free again */
+  if (tracked && tracked->pool_committed) {
+    memory->pool_committed -= tracked->pool_committed;
+    memory->n_pools--;
+    tracked->pool_committed = 0;
+  }
+
+  for (i = 0; i < gst_query_get_n_allocation_pools (query); i++) {
+    GstBufferPool *pool;
+    guint size, min, max;
+
+    gst_query_parse_nth_allocation_pool (query, i, &pool, &size, &min, &max);
+    if (max == 0 && memory->budget && size > 0) {
+      /* What is left, split between the candidates still to ask; only a
+         minimum above that share takes a pool past it */
+      guint64 left = memory->pool_budget > memory->pool_committed ?
+          memory->pool_budget - memory->pool_committed : 0;
+      guint waiting = memory->n_candidates > memory->n_pools ?
+          memory->n_candidates - memory->n_pools : 1;
+
+      max = MAX (min, left / waiting / size);
+      gst_query_set_nth_allocation_pool (query, i, pool, size, min, max);
+    }
+    if (max == 0)
+      bounded = FALSE;
+    /* The element uses the first pool; the others are alternatives */
+    if (i == 0) {
+      total_size = size;
+      total_buffers = max ? max : min;
+    }
+    if (pool)
+      gst_object_unref (pool);
+  }
+
+  if (tracked) {
+    tracked->pool_size = total_size;
+    tracked->pool_buffers = total_buffers;
+    tracked->pool_bounded = bounded;
+    if (total_size && memory->budget) {
+      tracked->pool_committed = (guint64) total_size * total_buffers;
+      memory->pool_committed += tracked->pool_committed;
+      memory->n_pools++;
+    }
+  }
+  g_mutex_unlock (&memory->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+pad_probe_free (PadProbe *probe)
+{
+  gst_pad_remove_probe (probe->pad, probe->id);
+  gst_object_unref (probe->pad);
+  g_free (probe);
+}
+
+static void
+watch_pad (GstElement *element, GstPad *pad, MemoryBudget *memory)
+{
+  PadProbe *probe;
+  Tracked *tracked;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SRC)
+    return;
+  probe = g_new (PadProbe, 1);
+  probe->pad = gst_object_ref (pad);
+  probe->id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM,
+      (GstPadProbeCallback) allocation_probe, memory, NULL);
+
+  /* Kept so memory_budget_free can take the probes off */
+  g_mutex_lock (&memory->lock);
+  tracked = find_tracked (memory, element);
+  if (tracked) {
+    tracked->probes = g_slist_prepend (tracked->probes, probe);
+    probe = NULL;
+  }
+  g_mutex_unlock (&memory->lock);
+  if (probe)
+    pad_probe_free (probe);
+}
+
+static gboolean
+watch_existing_pad (GstElement *element, GstPad *pad, MemoryBudget *memory)
+{
+  watch_pad (element, pad, memory);
+  return TRUE;
+}
+
+static void
+track_element (MemoryBudget *memory, GstElement *element)
+{
+  Tracked *tracked;
+
+  g_mutex_lock (&memory->lock);
+  if (find_tracked (memory, element)) {
+    g_mutex_unlock (&memory->lock);
+    return;
+  }
+  tracked = g_new0 (Tracked, 1);
+  tracked->element = gst_object_ref (element);
+  tracked->kind = element_kind (element);
+  tracked->pool_candidate = !GST_IS_BIN (element) &&
+      !GST_OBJECT_FLAG_IS_SET (element, GST_ELEMENT_FLAG_SINK);
+  g_ptr_array_add (memory->tracked, tracked);
+  if (tracked->kind == KIND_QUEUE || tracked->kind == KIND_MULTIQUEUE)
+    memory->n_queues++;
+  if (tracked->pool_candidate)
+    memory->n_candidates++;
+  g_mutex_unlock (&memory->lock);
+  rebalance (memory);
+
+  /* Bins only pass queries between their children; watch the children */
+  if (!GST_IS_BIN (element)) {
+    gst_element_foreach_src_pad (element, (GstElementForeachPadFunc) watch_existing_pad, memory);
+    g_signal_connect (element, "pad-added", G_CALLBACK (watch_pad), memory);
+  }
+}
+
+static void
+deep_element_added (GstBin *bin, GstBin *sub_bin, GstElement *element, MemoryBudget *memory)
+{
+  track_element (memory, element);
+}
+
+static void
+tracked_free (Tracked *tracked)
+{
+  g_signal_handlers_disconnect_matched (tracked->element, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+      (gpointer) watch_pad, NULL);
+  g_slist_free_full (tracked->probes, (GDestroyNotify) pad_probe_free);
+  gst_object_unref (tracked->element);
+  g_free (tracked);
+}
+
+MemoryBudget *
+memory_budget_attach (GstElement *pipeline, guint64 budget)
+{
+  MemoryBudget *memory = g_new0 (MemoryBudget, 1);
+  guint64 base = memory_budget_get_rss ();
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  memory->pipeline = pipeline;
+  memory->budget = budget;
+  if (budget > base) {
+    memory->queue_budget = (budget - base) * MEMORY_BUDGET_QUEUE_SHARE;
+    memory->pool_budget = (budget - base) * MEMORY_BUDGET_POOL_SHARE;
+  } else if (budget) {
+    g_printerr ("The process already uses %" G_GUINT64_FORMAT " kB of the %" G_GUINT64_FORMAT
+        " kB budget.\n", base / 1024, budget / 1024);
+  }
+  memory->tracked = g_ptr_array_new_with_free_func ((GDestroyNotify) tracked_free);
+  g_mutex_init (&memory->lock);
+
+  /* playbin is the pipeline itself */
+  track_element (memory, pipeline);
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    track_element (memory, g_value_get_object (&item));
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  memory->added_id = g_signal_connect (pipeline, "deep-element-added",
+      G_CALLBACK (deep_element_added), memory);
+  return memory;
+}
+
+void
+memory_budget_free (MemoryBudget *memory)
+{
+  if (memory->export_id)
+    g_source_remove (memory->export_id);
+  g_signal_handler_disconnect (memory->pipeline, memory->added_id);
+  g_ptr_array_unref (memory->tracked);
+  g_mutex_clear (&memory->lock);
+  g_free (memory);
+}
+
+/* Bytes and buffers queued in a queue/queue2 or on the pads of a multiqueue;
+   not with the lock, the properties take the queue's */
+static void
+queue_level (Tracked *tracked, guint64 *bytes, guint *buffers)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  *bytes = 0;
+  *buffers = 0;
+  if (tracked->kind == KIND_QUEUE) {
+    guint level_bytes;
+
+    g_object_get (tracked->element, "current-level-bytes", &level_bytes,
+        "current-level-buffers", buffers, NULL);
+    *bytes = level_bytes;
+    return;
+  }
+
+  /* GStreamer >= 1.18 has the levels on multiqueue's sink pads */
+  it = gst_element_iterate_sink_pads (tracked->element);
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GObject *pad = g_value_get_object (&item);
+    guint level_bytes = 0, level_buffers = 0;
+
+    if (g_object_class_find_property (G_OBJECT_GET_CLASS (pad), "current-level-bytes"))
+      g_object_get (pad, "current-level-bytes", &level_bytes,
+          "current-level-buffers", &level_buffers, NULL);
+    *bytes += level_bytes;
+    *buffers += level_buffers;
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+void
+memory_budget_report (MemoryBudget *memory)
+{
+  GString *elements = g_string_new (NULL);
+  GArray *snapshot = g_array_new (FALSE, FALSE, sizeof (Tracked));
+  guint64 queued = 0, pooled = 0;
+  guint i;
+
+  /* Copied under the lock and read after it, as rebalance does */
+  g_mutex_lock (&memory->lock);
+  for (i = 0; i < memory->tracked->len; i++) {
+    Tracked copy = *(Tracked *) g_ptr_array_index (memory->tracked, i);
+
+    gst_object_ref (copy.element);
+    copy.probes = NULL;
+    g_array_append_val (snapshot, copy);
+  }
+  g_mutex_unlock (&memory->lock);
+
+  for (i = 0; i < snapshot->len; i++) {
+    Tracked *tracked = &g_array_index (snapshot, Tracked, i);
+    const gchar *name = GST_OBJECT_NAME (tracked->element);
+
+    if (tracked->kind == KIND_QUEUE || tracked->kind == KIND_MULTIQUEUE) {
+      guint64 bytes;
+      guint buffers;
+
+      queue_level (tracked, &bytes, &buffers);
+      queued += bytes;
+      g_string_append_printf (elements, "%s{\"element\":\"%s\",\"queued_bytes\":%"
+          G_GUINT64_FORMAT ",\"queued_buffers\":%u,\"max_bytes\":%" G_GUINT64_FORMAT "}",
+          elements->len ? "," : "", name, bytes, buffers, tracked->max_bytes);
+    }
+    if (tracked->pool_size) {
+      guint64 bytes = (guint64) tracked->pool_size * tracked->pool_buffers;
+
+      pooled += bytes;
+      g_string_append_printf (elements, "%s{\"element\":\"%s\",\"pool_bytes\":%"
+          G_GUINT64_FORMAT ",\"pool_buffers\":%u,\"buffer_size\":%u,\"bounded\":%s}",
+          elements->len ? "," : "", name, bytes, tracked->pool_buffers, tracked->pool_size,
+          tracked->pool_bounded ? "true" : "false");
+    }
+    gst_object_unref (tracked->element);
+  }
+  g_array_unref (snapshot);
+
+  g_print ("{\"memory\":{\"rss_kb\":%" G_GUINT64_FORMAT ",\"peak_rss_kb\":%" G_GUINT64_FORMAT
+      ",\"budget_kb\":%" G_GUINT64_FORMAT ",\"queued_kb\":%" G_GUINT64_FORMAT
+      ",\"pool_kb\":%" G_GUINT64_FORMAT ",\"elements\":[%s]}}\n",
+      memory_budget_get_rss () / 1024, memory_budget_get_peak_rss () / 1024,
+      memory->budget / 1024, queued / 1024, pooled / 1024, elements->str);
+  g_string_free (elements, TRUE);
+}
+
+static gboolean
+export_tick (MemoryBudget *memory)
+{
+  memory_budget_report (memory);
+  return G_SOURCE_CONTINUE;
+}
+
+void
+memory_budget_export (MemoryBudget *memory, guint interval_ms)
+{
+  if (memory->export_id)
+    g_source_remove (memory->export_id);
+  memory->export_id = g_timeout_add (interval_ms, (GSourceFunc) export_tick, memory);
+}
@@ -0,0 +1,64 @@
+/*
+Memory accounting for a pipeline, and a mode that keeps it within a budget.
+
+Left alone, a pipeline's memory is whatever its queues and buffer pools
+default to: every queue may hold 10 MB, decodebin's multiqueue 2 MB per
+stream, uridecodebin/playbin's network buffer 2 MB or more, and pools
+without a maximum grow as long as someone holds buffers. Attached to a
+pipeline, this follows every element it contains, including the ones
+decodebin and playbin plug in later (deep-element-added), and accounts:
+  - queues (queue, queue2, multiqueue): bytes and buffers queued now,
+    against their byte limit,
+  - buffer pools: what each element got for its output in the ALLOCATION
+    query (buffer size x buffers; a pool with no maximum counts its minimum
+    and is marked unbounded),
+  - the process: resident set size now and its peak (VmRSS/VmHWM).
+
+With a budget (the RSS cap, in bytes), what the process already used when
+the budget was attached is taken as the base, and of what is left:
+  - MEMORY_BUDGET_QUEUE_SHARE goes to queues, split evenly between the
+    queues seen so far (rebalanced as new ones appear) and set as their
+    byte limit, their buffer and time limits left as they are (whichever is
+    reached first holds the queue); decodebin gets the same
+    limit for its multiqueue and uridecodebin/playbin for their network
+    buffer,
+  - MEMORY_BUDGET_POOL_SHARE goes to pools: a pool with no maximum gets
+    one, what is left of the share split between the elements that may
+    still ask for a pool (any that is neither a bin nor a sink), never
+    below its minimum,
+  - the rest is headroom for what cannot be bounded from outside (decoder
+    reference frames, demuxer indexes, the heap).
+
+`memory_budget_report` prints one JSON line with the totals and per-element
+figures; `memory_budget_export` does that on a timer of the default main
+context. `memory_budget_reset_peak` resets the kernel's peak RSS so that
+successive pipelines in one process each get their own peak.
+*/
+#ifndef __MEMORY_BUDGET_H__
+#define __MEMORY_BUDGET_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define MEMORY_BUDGET_QUEUE_SHARE 0.5
+#define MEMORY_BUDGET_POOL_SHARE 0.25
+
+typedef struct _MemoryBudget MemoryBudget;
+
+/* `budget` 0 only accounts. Attach before PLAYING, free once back in NULL. */
+MemoryBudget *memory_budget_attach (GstElement *pipeline, guint64 budget);
+void memory_budget_free (MemoryBudget *memory);
+
+void memory_budget_report (MemoryBudget *memory);
+void memory_budget_export (MemoryBudget *memory, guint interval_ms);
+
+/* Bytes, from /proc/self/status; 0 if unavailable */
+guint64 memory_budget_get_rss (void);
+guint64 memory_budget_get_peak_rss (void);
+/* Starts a new peak from the current RSS (Linux >= 4.0) */
+gboolean memory_budget_reset_peak (void);
+
+G_END_DECLS
+
+#endif /* __MEMORY_BUDGET_H__ */
@@ -0,0 +1,750 @@
+#include "metrics-exporter.h"
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <gio/gio.h>
+
+/* Threads serving scrapes at the same time */
+#define SCRAPE_THREADS 2
+
+typedef struct {
+  MetricsExporter *exporter;
+  GstPad *pad;
+  gulong probe;
+  gchar *labels;              /* pipeline="..",element="..",pad=".." */
+
+  /* Streaming thread only */
+  guint64 buffers;
+  guint64 bytes;
+  GThread *thread;
+
+  /* Sampler only */
+  guint64 sampled_buffers;
+  gdouble rate;
+} PadCounter;
+
+/* Freed with its overrun handler, so a running handler never sees it go */
+typedef struct {
+  GstElement *element;        /* not a ref: the exporter holds one */
+  gchar *labels;
+  gint dropped;               /* atomic, bumped by the overrun handler */
+} QueueLevel;
+
+/* A queue as the sampler reads it, outside the lock */
+typedef struct {
+  GstElement *element;
+  gchar *labels;
+  guint dropped;
+  guint level;
+  guint max_buffers;          /* 0: no limit in buffers */
+} QueueSample;
+
+typedef struct {
+  pid_t tid;
+  clockid_t clock;
+  gboolean has_clock;
+  gchar name[17];             /* PR_GET_NAME, at most 16 bytes */
+  gdouble cpu;                /* sampler only: last reading */
+} ThreadCpu;
+
+typedef struct {
+  guint64 processed;
+  guint64 dropped;
+} QosCount;
+
+struct _MetricsExporter {
+  GstElement *pipeline;
+  gchar *pipeline_label;
+  guint timer;
+  gchar *path;
+  GSocketService *service;
+
+  /* Not taken on the buffer path: new elements, pads and threads */
+  GMutex lock;
+  GPtrArray *elements;        /* refs */
+  GPtrArray *counters;        /* PadCounter, freed with its probe */
+  GPtrArray *queues;          /* QueueLevel, not owned */
+  GHashTable *threads;        /* GThread -> ThreadCpu */
+
+  /* Main loop only */
+  GHashTable *qos;            /* element name -> QosCount */
+  gint64 sampled;
+
+  /* The last sample, read by the scrape threads */
+  GMutex text_lock;
+  GString *text;
+  MetricsExporterStats stats;
+};
+
+/* Prometheus label values escape backslash, double quote and newline */
+static gchar *
+escape_label (const gchar *value)
+{
+  GString *escaped = g_string_new (NULL);
+
+  for (; *value; value++) {
+    if (*value == '\\' || *value == '"')
+      g_string_append_c (escaped, '\\');
+    if (*value == '\n')
+      g_string_append (escaped, "\\n");
+    else
+      g_string_append_c (escaped, *value);
+  }
+  return g_string_free (escaped, FALSE);
+}
+
+static gchar *
+element_labels (MetricsExporter *exporter, GstElement *element)
+{
+  gchar *name = escape_label (GST_OBJECT_NAME (element));
+  gchar *labels = g_strdup_printf ("%s,element=\"%s\"", exporter->pipeline_label, name);
+
+  g_free (name);
+  return labels;
+}
+
+/* First buffer of this pad on this thread: the only time the counting path locks */
+static void
+note_thread (PadCounter *counter)
+{
+  MetricsExporter *exporter = counter->exporter;
+  GThread *self = g_thread_self ();
+
+  g_mutex_lock (&exporter->lock);
+  if (!g_hash_table_contains (exporter->threads, self)) {
+    ThreadCpu *thread = g_new0 (ThreadCpu, 1);
+
+    thread->tid = syscall (SYS_gettid);
+    thread->has_clock = pthread_getcpuclockid (pthread_self (), &thread->clock) == 0;
+    prctl (PR_GET_NAME, thread->name);
+    g_hash_table_insert (exporter->threads, self, thread);
+  }
+  g_mutex_unlock (&exporter->lock);
+  counter->thread = self;
+}
+
+static GstPadProbeReturn
+count_probe (GstPad *pad, GstPadProbeInfo *info, PadCounter *counter)
+{
+  if (G_UNLIKELY (counter->thread != g_thread_self ()))
+    note_thread (counter);
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+
+    counter->buffers += gst_buffer_list_length (list);
+    counter->bytes += gst_buffer_list_calculate_size (list);
+  } else {
+    counter->buffers++;
+    counter->bytes += gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+is_queue (GstElement *element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  return factory && g_strcmp0 (GST_OBJECT_NAME (factory), "queue") == 0;
+}
+
+/*
+ On the queue's upstream thread, with the queue unlocked: it is full. A leaky
+ queue then drops what it holds until it is not, which is one buffer when the
+ limit is in buffers; any other queue blocks instead. A silent queue does not
+ emit the signal and shows no drops.
+*/
+static void
+queue_overrun (GstElement *element, QueueLevel *queue)
+{
+  gint leaky;
+
+  g_object_get (element, "leaky", &leaky, NULL);
+  if (leaky != 0)
+    g_atomic_int_inc (&queue->dropped);
+}
+
+static void
+queue_level_free (QueueLevel *queue, GClosure *closure)
+{
+  g_free (queue->labels);
+  g_free (queue);
+}
+
+/* Called with the lock */
+static void
+add_queue (MetricsExporter *exporter, GstElement *element)
+{
+  QueueLevel *queue = g_new0 (QueueLevel, 1);
+
+  queue->element = element;
+  queue->labels = element_labels (exporter, element);
+  g_ptr_array_add (exporter->queues, queue);
+  g_signal_connect_data (element, "overrun", G_CALLBACK (queue_overrun), queue,
+      (GClosureNotify) queue_level_free, 0);
+}
+
+/* Once the probe is removed and not running */
+static void
+pad_counter_free (PadCounter *counter)
+{
+  gst_object_unref (counter->pad);
+  g_free (counter->labels);
+  g_free (counter);
+}
+
+static void
+add_pad (MetricsExporter *exporter, GstElement *element, GstPad *pad)
+{
+  PadCounter *counter;
+  gchar *labels, *name;
+  guint i;
+
+  if (GST_PAD_IS_SINK (pad))
+    return;
+
+  g_mutex_lock (&exporter->lock);
+  for (i = 0; i < exporter->counters->len; i++) {
+    if (((PadCounter *) g_ptr_array_index (exporter->counters, i))->pad == pad) {
+      g_mutex_unlock (&exporter->lock);
+      return;
+    }
+  }
+  counter = g_new0 (PadCounter, 1);
+  counter->exporter = exporter;
+  counter->pad = gst_object_ref (pad);
+  labels = element_labels (exporter, element);
+  name = escape_label (GST_OBJECT_NAME (pad));
+  counter->labels = g_strdup_printf ("%s,pad=\"%s\"", labels, name);
+  g_free (labels);
+  g_free (name);
+  g_ptr_array_add (exporter->counters, counter);
+  g_mutex_unlock (&exporter->lock);
+
+  counter->probe = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_BUFFER_LIST, (GstPadProbeCallback) count_probe, counter,
+      (GDestroyNotify) pad_counter_free);
+}
+
+static gboolean
+add_pad_foreach (GstElement *element, GstPad *pad, MetricsExporter *exporter)
+{
+  add_pad (exporter, element, pad);
+  return TRUE;
+}
+
+static void
+pad_added (GstElement *element, GstPad *pad, MetricsExporter *exporter)
+{
+  add_pad (exporter, element, pad);
+}
+
+static void
+watch_element (MetricsExporter *exporter, GstElement *element)
+{
+  /* A bin's ghost pads would count its children's buffers twice */
+  if (GST_IS_BIN (element))
+    return;
+
+  g_mutex_lock (&exporter->lock);
+  if (g_ptr_array_find (exporter->elements, element, NULL)) {
+    g_mutex_unlock (&exporter->lock);
+    return;
+  }
+  g_ptr_array_add (exporter->elements, gst_object_ref (element));
+  if (is_queue (element))
+    add_queue (exporter, element);
+  g_mutex_unlock (&exporter->lock);
+
+  g_signal_connect (element, "pad-added", G_CALLBACK (pad_added), exporter);
+  gst_element_foreach_pad (element, (GstElementForeachPadFunc) add_pad_foreach, exporter);
+}
+
+/* A branch taken out at runtime: its series go with it */
+static void
+unwatch_element (MetricsExporter *exporter, GstElement *element)
+{
+  GPtrArray *counters = g_ptr_array_new ();
+  QueueLevel *queue = NULL;
+  guint i;
+
+  g_mutex_lock (&exporter->lock);
+  if (!g_ptr_array_find (exporter->elements, element, &i)) {
+    g_mutex_unlock (&exporter->lock);
+    g_ptr_array_unref (counters);
+    return;
+  }
+  gst_object_ref (element);
+  g_ptr_array_remove_index_fast (exporter->elements, i);
+  for (i = exporter->counters->len; i > 0; i--) {
+    PadCounter *counter = g_ptr_array_index (exporter->counters, i - 1);
+
+    if (GST_OBJECT_PARENT (counter->pad) == GST_OBJECT (element))
+      g_ptr_array_add (counters, g_ptr_array_remove_index (exporter->counters, i - 1));
+  }
+  for (i = 0; i < exporter->queues->len; i++) {
+    if (((QueueLevel *) g_ptr_array_index (exporter->queues, i))->element == element) {
+      queue = g_ptr_array_remove_index (exporter->queues, i);
+      break;
+    }
+  }
+  g_mutex_unlock (&exporter->lock);
+
+  g_signal_handlers_disconnect_by_data (element, exporter);
+  if (queue)
+    g_signal_handlers_disconnect_by_data (element, queue);
+  /* Each counter is freed once its probe is not running */
+  for (i = 0; i < counters->len; i++) {
+    PadCounter *counter = g_ptr_array_index (counters, i);
+
+    gst_pad_remove_probe (counter->pad, counter->probe);
+  }
+  g_ptr_array_unref (counters);
+  gst_object_unref (element);
+}
+
+static void
+deep_element_added (GstBin *bin, GstBin *sub_bin, GstElement *element,
+    MetricsExporter *exporter)
+{
+  watch_element (exporter, element);
+}
+
+static void
+deep_element_removed (GstBin *bin, GstBin *sub_bin, GstElement *element,
+    MetricsExporter *exporter)
+{
+  unwatch_element (exporter, element);
+}
+
+static void
+watch_item (const GValue *item, MetricsExporter *exporter)
+{
+  watch_element (exporter, g_value_get_object (item));
+}
+
+static gboolean
+sample_tick (MetricsExporter *exporter)
+{
+  metrics_exporter_sample (exporter);
+  return G_SOURCE_CONTINUE;
+}
+
+MetricsExporter *
+metrics_exporter_new (GstElement *pipeline, guint interval_ms)
+{
+  MetricsExporter *exporter = g_new0 (MetricsExporter, 1);
+  GstIterator *it;
+  gchar *name;
+
+  exporter->pipeline = gst_object_ref (pipeline);
+  name = escape_label (GST_OBJECT_NAME (pipeline));
+  exporter->pipeline_label = g_strdup_printf ("pipeline=\"%s\"", name);
+  g_free (name);
+  g_mutex_init (&exporter->lock);
+  g_mutex_init (&exporter->text_lock);
+  exporter->elements = g_ptr_array_new_with_free_func (gst_object_unref);
+  exporter->counters = g_ptr_array_new ();
+  exporter->queues = g_ptr_array_new ();
+  exporter->threads = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  exporter->qos = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  exporter->text = g_string_new (NULL);
+
+  g_signal_connect (pipeline, "deep-element-added", G_CALLBACK (deep_element_added), exporter);
+  g_signal_connect (pipeline, "deep-element-removed", G_CALLBACK (deep_element_removed),
+      exporter);
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+  while (gst_iterator_foreach (it, (GstIteratorForeachFunction) watch_item, exporter)
+      == GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+
+  if (interval_ms > 0)
+    exporter->timer = g_timeout_add (interval_ms, (GSourceFunc) sample_tick, exporter);
+  return exporter;
+}
+
+void
+metrics_exporter_free (MetricsExporter *exporter)
+{
+  guint i;
+
+  if (exporter->timer)
+    g_source_remove (exporter->timer);
+  if (exporter->service) {
+    g_socket_service_stop (exporter->service);
+    g_socket_listener_close (G_SOCKET_LISTENER (exporter->service));
+    g_signal_handlers_disconnect_by_data (exporter->service, exporter);
+    g_object_unref (exporter->service);
+  }
+  g_signal_handlers_disconnect_by_data (exporter->pipeline, exporter);
+  for (i = 0; i < exporter->elements->len; i++)
+    g_signal_handlers_disconnect_by_data (g_ptr_array_index (exporter->elements, i), exporter);
+
+  /* Each counter is freed once its probe is not running */
+  for (i = 0; i < exporter->counters->len; i++) {
+    PadCounter *counter = g_ptr_array_index (exporter->counters, i);
+
+    gst_pad_remove_probe (counter->pad, counter->probe);
+  }
+  /* A probe already running on a streaming thread may still register its
+     thread; going to NULL deactivates every pad, which waits for those threads */
+  if (GST_STATE (exporter->pipeline) != GST_STATE_NULL ||
+      GST_STATE_PENDING (exporter->pipeline) != GST_STATE_VOID_PENDING)
+    gst_element_set_state (exporter->pipeline, GST_STATE_NULL);
+
+  /* Frees each QueueLevel once its handler is no longer running */
+  for (i = 0; i < exporter->queues->len; i++) {
+    QueueLevel *queue = g_ptr_array_index (exporter->queues, i);
+
+    g_signal_handlers_disconnect_by_data (queue->element, queue);
+  }
+  g_ptr_array_unref (exporter->counters);
+  g_ptr_array_unref (exporter->queues);
+  g_ptr_array_unref (exporter->elements);
+  g_hash_table_unref (exporter->threads);
+  g_hash_table_unref (exporter->qos);
+  g_string_free (exporter->text, TRUE);
+  g_mutex_clear (&exporter->lock);
+  g_mutex_clear (&exporter->text_lock);
+  g_free (exporter->pipeline_label);
+  g_free (exporter->path);
+  gst_object_unref (exporter->pipeline);
+  g_free (exporter);
+}
+
+/* One request per connection, HTTP/1.0; runs on a thread of the service */
+static gboolean
+serve_scrape (GThreadedSocketService *service, GSocketConnection *connection,
+    GObject *source, MetricsExporter *exporter)
+{
+  GInputStream *in = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+  GOutputStream *out = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+  gchar request[4096];
+  gchar *response;
+  gsize len = 0;
+  gssize n;
+
+  /* The request line and headers; a GET has no body */
+  while (len < sizeof (request) - 1 &&
+      (n = g_input_stream_read (in, request + len, sizeof (request) - 1 - len, NULL,
+              NULL)) > 0) {
+    len += n;
+    request[len] = '\0';
+    if (strstr (request, "\r\n\r\n"))
+      break;
+  }
+  request[len] = '\0';
+
+  if (g_str_has_prefix (request, "GET /metrics ") || g_str_has_prefix (request, "GET / ")) {
+    g_mutex_lock (&exporter->text_lock);
+    response = g_strdup_printf ("HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %" G_GSIZE_FORMAT "\r\n\r\n%s", exporter->text->len, exporter->text->str);
+    exporter->stats.scrapes++;
+    g_mutex_unlock (&exporter->text_lock);
+  } else {
+    response = g_strdup ("HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+  }
+  g_output_stream_write_all (out, response, strlen (response), NULL, NULL, NULL);
+  g_free (response);
+  return TRUE;
+}
+
+gboolean
+metrics_exporter_serve (MetricsExporter *exporter, guint16 port, GError **error)
+{
+  GSocketService *service = g_threaded_socket_service_new (SCRAPE_THREADS);
+  GSocketAddress *address = g_inet_socket_address_new_from_string ("127.0.0.1", port);
+  gboolean ok;
+
+  ok = g_socket_listener_add_address (G_SOCKET_LISTENER (service), address,
+      G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL, NULL, error);
+  g_object_unref (address);
+  if (!ok) {
+    g_object_unref (service);
+    return FALSE;
+  }
+  g_signal_connect (service, "run", G_CALLBACK (serve_scrape), exporter);
+  g_socket_service_start (service);
+  exporter->service = service;
+  return TRUE;
+}
+
+void
+metrics_exporter_write_to (MetricsExporter *exporter, const gchar *path)
+{
+  g_free (exporter->path);
+  exporter->path = g_strdup (path);
+}
+
+void
+metrics_exporter_handle_message (MetricsExporter *exporter, GstMessage *msg)
+{
+  QosCount *count;
+  GstFormat format;
+  guint64 processed, dropped;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_QOS)
+    return;
+  /* Totals for the element, not deltas */
+  gst_message_parse_qos_stats (msg, &format, &processed, &dropped);
+  if (format != GST_FORMAT_BUFFERS)
+    return;
+  count = g_hash_table_lookup (exporter->qos, GST_MESSAGE_SRC_NAME (msg));
+  if (!count) {
+    count = g_new0 (QosCount, 1);
+    g_hash_table_insert (exporter->qos, g_strdup (GST_MESSAGE_SRC_NAME (msg)), count);
+  }
+  if (processed != (guint64) -1)
+    count->processed = processed;
+  if (dropped != (guint64) -1)
+    count->dropped = dropped;
+}
+
+static void
+append_family (GString *out, const gchar *name, const gchar *type, const gchar *help)
+{
+  g_string_append_printf (out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* Called with the lock */
+static void
+append_pads (MetricsExporter *exporter, GString *out, gdouble seconds)
+{
+  guint i;
+
+  for (i = 0; i < exporter->counters->len; i++) {
+    PadCounter *counter = g_ptr_array_index (exporter->counters, i);
+    guint64 buffers = counter->buffers;
+
+    if (seconds > 0)
+      counter->rate = (buffers - counter->sampled_buffers) / seconds;
+    counter->sampled_buffers = buffers;
+  }
+
+  append_family (out, "gst_pad_buffers_total", "counter", "Buffers pushed through the pad.");
+  for (i = 0; i < exporter->counters->len; i++) {
+    PadCounter *counter = g_ptr_array_index (exporter->counters, i);
+
+    g_string_append_printf (out, "gst_pad_buffers_total{%s} %" G_GUINT64_FORMAT "\n",
+        counter->labels, counter->sampled_buffers);
+  }
+  append_family (out, "gst_pad_bytes_total", "counter", "Bytes pushed through the pad.");
+  for (i = 0; i < exporter->counters->len; i++) {
+    PadCounter *counter = g_ptr_array_index (exporter->counters, i);
+
+    g_string_append_printf (out, "gst_pad_bytes_total{%s} %" G_GUINT64_FORMAT "\n",
+        counter->labels, counter->bytes);
+  }
+  append_family (out, "gst_pad_buffer_rate", "gauge",
+      "Buffers per second through the pad since the previous sample.");
+  for (i = 0; i < exporter->counters->len; i++) {
+    PadCounter *counter = g_ptr_array_index (exporter->counters, i);
+
+    g_string_append_printf (out, "gst_pad_buffer_rate{%s} %.2f\n", counter->labels,
+        counter->rate);
+  }
+}
+
+/* Not with the lock: a queue's properties take the queue's own lock */
+static void
+append_queues (MetricsExporter *exporter, GString *out)
+{
+  GArray *samples = g_array_new (FALSE, FALSE, sizeof (QueueSample));
+  QueueSample *sample;
+  guint i;
+
+  g_mutex_lock (&exporter->lock);
+  for (i = 0; i < exporter->queues->len; i++) {
+    QueueLevel *queue = g_ptr_array_index (exporter->queues, i);
+    QueueSample snapshot = { 0 };
+
+    snapshot.element = gst_object_ref (queue->element);
+    snapshot.labels = g_strdup (queue->labels);
+    snapshot.dropped = g_atomic_int_get (&queue->dropped);
+    g_array_append_val (samples, snapshot);
+  }
+  g_mutex_unlock (&exporter->lock);
+
+  /* Read as they stand: flushes and limits changed at runtime need no bookkeeping */
+  for (i = 0; i < samples->len; i++) {
+    sample = &g_array_index (samples, QueueSample, i);
+    g_object_get (sample->element, "current-level-buffers", &sample->level,
+        "max-size-buffers", &sample->max_buffers, NULL);
+  }
+
+  if (samples->len > 0) {
+    append_family (out, "gst_queue_level_buffers", "gauge", "Buffers in the queue.");
+    for (i = 0; i < samples->len; i++) {
+      sample = &g_array_index (samples, QueueSample, i);
+      g_string_append_printf (out, "gst_queue_level_buffers{%s} %u\n", sample->labels,
+          sample->level);
+    }
+    append_family (out, "gst_queue_max_buffers", "gauge",
+        "The queue's max-size-buffers, 0 for no limit.");
+    for (i = 0; i < samples->len; i++) {
+      sample = &g_array_index (samples, QueueSample, i);
+      g_string_append_printf (out, "gst_queue_max_buffers{%s} %u\n", sample->labels,
+          sample->max_buffers);
+    }
+    append_family (out, "gst_queue_dropped_total", "counter",
+        "Buffers a leaky queue dropped, one per overrun.");
+    for (i = 0; i < samples->len; i++) {
+      sample = &g_array_index (samples, QueueSample, i);
+      g_string_append_printf (out, "gst_queue_dropped_total{%s} %u\n", sample->labels,
+          sample->dropped);
+    }
+  }
+
+  for (i = 0; i < samples->len; i++) {
+    sample = &g_array_index (samples, QueueSample, i);
+    gst_object_unref (sample->element);
+    g_free (sample->labels);
+  }
+  g_array_unref (samples);
+}
+
+static void
+append_qos (MetricsExporter *exporter, GString *out)
+{
+  GHashTableIter iter;
+  gpointer name, value;
+  gchar *escaped;
+
+  if (g_hash_table_size (exporter->qos) == 0)
+    return;
+
+  append_family (out, "gst_element_qos_processed_total", "counter",
+      "Buffers the element processed, from its QOS messages.");
+  g_hash_table_iter_init (&iter, exporter->qos);
+  while (g_hash_table_iter_next (&iter, &name, &value)) {
+    escaped = escape_label (name);
+    g_string_append_printf (out, "gst_element_qos_processed_total{%s,element=\"%s\"} %"
+        G_GUINT64_FORMAT "\n", exporter->pipeline_label, escaped,
+        ((QosCount *) value)->processed);
+    g_free (escaped);
+  }
+  append_family (out, "gst_element_qos_dropped_total", "counter",
+      "Buffers the element dropped for being late, from its QOS messages.");
+  g_hash_table_iter_init (&iter, exporter->qos);
+  while (g_hash_table_iter_next (&iter, &name, &value)) {
+    escaped = escape_label (name);
+    g_string_append_printf (out, "gst_element_qos_dropped_total{%s,element=\"%s\"} %"
+        G_GUINT64_FORMAT "\n", exporter->pipeline_label, escaped,
+        ((QosCount *) value)->dropped);
+    g_free (escaped);
+  }
+}
+
+/* Called with the lock */
+static void
+append_threads (MetricsExporter *exporter, GString *out)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  append_family (out, "gst_thread_cpu_seconds_total", "counter",
+      "CPU time of a thread that streams through the pipeline.");
+  g_hash_table_iter_init (&iter, exporter->threads);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    ThreadCpu *thread = value;
+    struct timespec ts;
+    gchar *name;
+
+    /* A thread that has exited keeps its last reading */
+    if (thread->has_clock && clock_gettime (thread->clock, &ts) == 0)
+      thread->cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+    name = escape_label (thread->name);
+    g_string_append_printf (out, "gst_thread_cpu_seconds_total{%s,tid=\"%d\",name=\"%s\"} %.6f\n",
+        exporter->pipeline_label, (gint) thread->tid, name, thread->cpu);
+    g_free (name);
+  }
+}
+
+/* Called with the lock */
+static void
+append_states (MetricsExporter *exporter, GString *out)
+{
+  guint i;
+
+  append_family (out, "gst_pipeline_state", "gauge",
+      "Current state: 1 NULL, 2 READY, 3 PAUSED, 4 PLAYING.");
+  g_string_append_printf (out, "gst_pipeline_state{%s} %d\n", exporter->pipeline_label,
+      GST_STATE (exporter->pipeline));
+  append_family (out, "gst_pipeline_state_pending", "gauge",
+      "State the pipeline is changing to, 0 when it is not changing.");
+  g_string_append_printf (out, "gst_pipeline_state_pending{%s} %d\n", exporter->pipeline_label,
+      GST_STATE_PENDING (exporter->pipeline));
+  append_family (out, "gst_element_state", "gauge",
+      "Current state: 1 NULL, 2 READY, 3 PAUSED, 4 PLAYING.");
+  for (i = 0; i < exporter->elements->len; i++) {
+    GstElement *element = g_ptr_array_index (exporter->elements, i);
+    gchar *labels = element_labels (exporter, element);
+
+    g_string_append_printf (out, "gst_element_state{%s} %d\n", labels, GST_STATE (element));
+    g_free (labels);
+  }
+}
+
+const gchar *
+metrics_exporter_sample (MetricsExporter *exporter)
+{
+  guint64 start = gst_util_get_timestamp ();
+  gint64 now = g_get_monotonic_time ();
+  gdouble seconds = exporter->sampled ? (now - exporter->sampled) / 1e6 : 0;
+  GError *error = NULL;
+  GString *out, *previous;
+  MetricsExporterStats stats;
+
+  out = g_string_sized_new (exporter->text->len + 1024);
+  g_mutex_lock (&exporter->lock);
+  append_pads (exporter, out, seconds);
+  append_threads (exporter, out);
+  append_states (exporter, out);
+  g_mutex_unlock (&exporter->lock);
+  append_queues (exporter, out);
+  append_qos (exporter, out);
+  exporter->sampled = now;
+
+  metrics_exporter_get_stats (exporter, &stats);
+  append_family (out, "gst_exporter_samples_total", "counter", "Samples taken.");
+  g_string_append_printf (out, "gst_exporter_samples_total{%s} %" G_GUINT64_FORMAT "\n",
+      exporter->pipeline_label, stats.samples + 1);
+  append_family (out, "gst_exporter_sample_seconds_total", "counter",
+      "Time spent sampling, up to the previous sample.");
+  g_string_append_printf (out, "gst_exporter_sample_seconds_total{%s} %.6f\n",
+      exporter->pipeline_label, stats.sample_time / 1e9);
+  append_family (out, "gst_exporter_scrapes_total", "counter", "HTTP scrapes served.");
+  g_string_append_printf (out, "gst_exporter_scrapes_total{%s} %" G_GUINT64_FORMAT "\n",
+      exporter->pipeline_label, stats.scrapes);
+
+  /* Replaced whole, so a file reader never sees half a sample */
+  if (exporter->path && !g_file_set_contents (exporter->path, out->str, out->len, &error)) {
+    g_printerr ("Could not write metrics to %s: %s\n", exporter->path, error->message);
+    g_clear_error (&error);
+  }
+
+  g_mutex_lock (&exporter->text_lock);
+  previous = exporter->text;
+  exporter->text = out;
+  exporter->stats.samples++;
+  exporter->stats.sample_time += gst_util_get_timestamp () - start;
+  exporter->stats.size = out->len;
+  g_mutex_unlock (&exporter->text_lock);
+  g_string_free (previous, TRUE);
+  return out->str;
+}
+
+void
+metrics_exporter_get_stats (MetricsExporter *exporter, MetricsExporterStats *stats)
+{
+  g_mutex_lock (&exporter->text_lock);
+  *stats = exporter->stats;
+  g_mutex_unlock (&exporter->text_lock);
+}
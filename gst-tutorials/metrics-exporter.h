@@ -0,0 +1,69 @@
+/*
+Prometheus metrics for a running pipeline.
+
+The programs only say what went wrong through g_printerr from their bus
+switch. The exporter samples the whole pipeline on a timer instead and
+keeps the result as Prometheus text (exposition format 0.0.4), served on
+http://127.0.0.1:PORT/metrics by a threaded socket service and/or written to
+a file (atomically, as node_exporter's textfile collector reads it):
+  - gst_pad_buffers_total, gst_pad_bytes_total and gst_pad_buffer_rate for
+    every src pad (a sink pad sees what its peer sent), counted by a probe,
+  - gst_queue_level_buffers, gst_queue_max_buffers and
+    gst_queue_dropped_total per queue,
+  - gst_element_qos_processed_total/dropped_total, from QOS messages,
+  - gst_thread_cpu_seconds_total per streaming thread,
+  - gst_pipeline_state, gst_element_state per element and the exporter's
+    own cost.
+
+Nothing on the streaming threads takes a lock. Each counter has one writer,
+the pad's streaming thread, which increments it plainly; the sampler reads
+it a little stale, which is fine for rates. A thread is registered (under
+the exporter's lock) the first time it pushes through a pad, and its CPU
+clock (pthread_getcpuclockid) is read from the sampler. Queue levels and
+limits are read from the queue's properties by the sampler, outside the
+exporter's lock, so flushes and limits changed at runtime show as they are.
+Drops are counted from the queue's overrun signal, and only while it is
+leaky: a full queue that is not leaky blocks instead.
+
+Element states are read without the state lock (GST_STATE), which is what
+a monitor wants: the state as it stands, even in the middle of a change.
+An element removed from the pipeline (deep-element-removed) takes its
+series with it.
+*/
+#ifndef __METRICS_EXPORTER_H__
+#define __METRICS_EXPORTER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MetricsExporter MetricsExporter;
+
+typedef struct _MetricsExporterStats {
+  guint64 samples;
+  guint64 sample_time;        /* nanoseconds spent sampling */
+  guint64 scrapes;            /* HTTP requests served */
+  gsize size;                 /* bytes of text in the last sample */
+} MetricsExporterStats;
+
+/* Counts every pad of `pipeline`, present and future; samples every
+   `interval_ms` on the default main context, or only on demand with 0 */
+MetricsExporter *metrics_exporter_new (GstElement *pipeline, guint interval_ms);
+/* Once the pipeline is back in NULL; takes it there if it is not */
+void metrics_exporter_free (MetricsExporter *exporter);
+
+/* Serves the last sample on 127.0.0.1:`port` */
+gboolean metrics_exporter_serve (MetricsExporter *exporter, guint16 port, GError **error);
+/* Writes every sample to `path` */
+void metrics_exporter_write_to (MetricsExporter *exporter, const gchar *path);
+
+/* Takes QOS messages from the pipeline's bus */
+void metrics_exporter_handle_message (MetricsExporter *exporter, GstMessage *msg);
+
+/* Samples now; returns the text, owned by the exporter until the next sample */
+const gchar *metrics_exporter_sample (MetricsExporter *exporter);
+void metrics_exporter_get_stats (MetricsExporter *exporter, MetricsExporterStats *stats);
+
+G_END_DECLS
+
+#endif /* __METRICS_EXPORTER_H__ */
@@ -0,0 +1,271 @@
+#include "pipeline-runtime.h"
+
+/* One slot per GstMessageType bit below GST_MESSAGE_EXTENDED */
+#define HANDLER_SLOTS 31
+/* Extended types are GST_MESSAGE_EXTENDED + n, not bits: one slot per n */
+#define EXTENDED_SLOTS 16
+
+typedef struct _Handler {
+  PipelineMessageFunc func;
+  gpointer user_data;
+} Handler;
+
+struct _PipelineRuntime {
+  GstElement *pipeline;
+  GstBus *bus;
+  Handler handlers[HANDLER_SLOTS];
+  Handler extended[EXTENDED_SLOTS];
+
+  /* Position reporting; the timer only exists while PLAYING */
+  guint interval_ms;
+  PipelinePositionFunc position_func;
+  gpointer position_data;
+  guint timer;
+  gint64 duration;
+
+  gboolean playing;
+  gboolean running;           /* counted in `running_pipelines` */
+  PipelineRuntimeStats stats;
+};
+
+/* The loop all pipelines share, and how many of them still run on it */
+static GMainLoop *loop = NULL;
+static guint running_pipelines = 0;
+
+void
+pipeline_runtime_handle_error (PipelineRuntime *runtime, GstMessage *msg,
+    gpointer user_data)
+{
+  GError *err;
+  gchar *debug_info;
+
+  gst_message_parse_error (msg, &err, &debug_info);
+  g_printerr ("Error received from element %s: %s\n", GST_OBJECT_NAME (msg->src), err->message);
+  g_printerr ("Debugging information: %s\n", debug_info ? debug_info : "none");
+  g_clear_error (&err);
+  g_free (debug_info);
+  pipeline_runtime_stop (runtime);
+}
+
+void
+pipeline_runtime_handle_eos (PipelineRuntime *runtime, GstMessage *msg,
+    gpointer user_data)
+{
+  g_print ("\nEnd-Of-Stream reached.\n");
+  pipeline_runtime_stop (runtime);
+}
+
+static gboolean
+position_tick (PipelineRuntime *runtime)
+{
+  gint64 position = -1;
+  guint64 start;
+
+  runtime->stats.wakeups++;
+  if (!runtime->playing) {
+    runtime->timer = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  start = gst_util_get_timestamp ();
+  if (!gst_element_query_position (runtime->pipeline, GST_FORMAT_TIME, &position))
+    position = -1;
+  runtime->stats.queries++;
+
+  /* The duration only needs asking for once, until a DURATION_CHANGED message */
+  if (runtime->duration < 0) {
+    if (!gst_element_query_duration (runtime->pipeline, GST_FORMAT_TIME, &runtime->duration))
+      runtime->duration = -1;
+    runtime->stats.queries++;
+  }
+  runtime->stats.query_time += gst_util_get_timestamp () - start;
+
+  runtime->position_func (runtime, position, runtime->duration, runtime->position_data);
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+update_timer (PipelineRuntime *runtime)
+{
+  gboolean wanted = runtime->playing && runtime->running && runtime->position_func;
+
+  if (wanted && runtime->timer == 0) {
+    runtime->timer = g_timeout_add (runtime->interval_ms, (GSourceFunc) position_tick, runtime);
+  } else if (!wanted && runtime->timer != 0) {
+    g_source_remove (runtime->timer);
+    runtime->timer = 0;
+  }
+}
+
+/* The slot for one message type, or NULL if it has none */
+static Handler *
+lookup_handler (PipelineRuntime *runtime, GstMessageType type)
+{
+  if (type & GST_MESSAGE_EXTENDED) {
+    guint n = type & ~GST_MESSAGE_EXTENDED;
+
+    return n < EXTENDED_SLOTS ? &runtime->extended[n] : NULL;
+  }
+  /* Exactly one bit */
+  if (type == 0 || (type & (type - 1)) != 0)
+    return NULL;
+  return &runtime->handlers[g_bit_nth_lsf (type, -1)];
+}
+
+static gboolean
+bus_cb (GstBus *bus, GstMessage *msg, PipelineRuntime *runtime)
+{
+  GstMessageType type = GST_MESSAGE_TYPE (msg);
+  Handler *handler;
+
+  runtime->stats.wakeups++;
+  runtime->stats.messages++;
+
+  /* Bookkeeping the runtime needs, whatever the application registered */
+  if (type == GST_MESSAGE_STATE_CHANGED &&
+      GST_MESSAGE_SRC (msg) == GST_OBJECT (runtime->pipeline)) {
+    GstState new_state;
+
+    gst_message_parse_state_changed (msg, NULL, &new_state, NULL);
+    runtime->playing = (new_state == GST_STATE_PLAYING);
+    update_timer (runtime);
+  } else if (type == GST_MESSAGE_DURATION_CHANGED) {
+    runtime->duration = -1;
+  }
+
+  handler = lookup_handler (runtime, type);
+  if (handler && handler->func)
+    handler->func (runtime, msg, handler->user_data);
+
+  return G_SOURCE_CONTINUE;
+}
+
+PipelineRuntime *
+pipeline_runtime_new (GstElement *pipeline)
+{
+  PipelineRuntime *runtime = g_new0 (PipelineRuntime, 1);
+
+  runtime->pipeline = gst_object_ref (pipeline);
+  runtime->bus = gst_element_get_bus (pipeline);
+  runtime->duration = -1;
+
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_ERROR, pipeline_runtime_handle_error, NULL);
+  pipeline_runtime_set_handler (runtime, GST_MESSAGE_EOS, pipeline_runtime_handle_eos, NULL);
+
+  /* Messages are dispatched from the default main context, i.e. the shared loop */
+  gst_bus_add_watch (runtime->bus, (GstBusFunc) bus_cb, runtime);
+  return runtime;
+}
+
+void
+pipeline_runtime_free (PipelineRuntime *runtime)
+{
+  pipeline_runtime_stop (runtime);
+  gst_bus_remove_watch (runtime->bus);
+  gst_element_set_state (runtime->pipeline, GST_STATE_NULL);
+  gst_object_unref (runtime->bus);
+  gst_object_unref (runtime->pipeline);
+  g_free (runtime);
+}
+
+/* `type` may have several bits set; the handler is registered for each of them.
+   An extended type is one type, and GST_MESSAGE_ANY covers the extended ones too */
+void
+pipeline_runtime_set_handler (PipelineRuntime *runtime, GstMessageType type,
+    PipelineMessageFunc func, gpointer user_data)
+{
+  gint bit = -1;
+  guint n;
+
+  if (type != GST_MESSAGE_ANY && (type & GST_MESSAGE_EXTENDED)) {
+    Handler *handler = lookup_handler (runtime, type);
+
+    if (handler) {
+      handler->func = func;
+      handler->user_data = user_data;
+    }
+    return;
+  }
+
+  while ((bit = g_bit_nth_lsf (type, bit)) >= 0 && bit < HANDLER_SLOTS) {
+    runtime->handlers[bit].func = func;
+    runtime->handlers[bit].user_data = user_data;
+  }
+  if (type == GST_MESSAGE_ANY) {
+    for (n = 0; n < EXTENDED_SLOTS; n++) {
+      runtime->extended[n].func = func;
+      runtime->extended[n].user_data = user_data;
+    }
+  }
+}
+
+void
+pipeline_runtime_set_position_handler (PipelineRuntime *runtime,
+    guint interval_ms, PipelinePositionFunc func, gpointer user_data)
+{
+  runtime->interval_ms = interval_ms;
+  runtime->position_func = func;
+  runtime->position_data = user_data;
+
+  /* Re-arm with the new interval if we are already ticking */
+  if (runtime->timer != 0) {
+    g_source_remove (runtime->timer);
+    runtime->timer = 0;
+  }
+  update_timer (runtime);
+}
+
+gboolean
+pipeline_runtime_start (PipelineRuntime *runtime)
+{
+  if (gst_element_set_state (runtime->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    return FALSE;
+
+  if (!runtime->running) {
+    runtime->running = TRUE;
+    running_pipelines++;
+  }
+  return TRUE;
+}
+
+/* Stops dispatching position ticks; the loop quits once no pipeline is running */
+void
+pipeline_runtime_stop (PipelineRuntime *runtime)
+{
+  if (!runtime->running)
+    return;
+
+  runtime->running = FALSE;
+  update_timer (runtime);
+  if (--running_pipelines == 0 && loop)
+    g_main_loop_quit (loop);
+}
+
+void
+pipeline_runtime_run (void)
+{
+  if (running_pipelines == 0)
+    return;
+
+  if (!loop)
+    loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+}
+
+GstElement *
+pipeline_runtime_get_pipeline (PipelineRuntime *runtime)
+{
+  return runtime->pipeline;
+}
+
+gboolean
+pipeline_runtime_is_playing (PipelineRuntime *runtime)
+{
+  return runtime->playing;
+}
+
+void
+pipeline_runtime_get_stats (PipelineRuntime *runtime, PipelineRuntimeStats *stats)
+{
+  *stats = runtime->stats;
+}
@@ -0,0 +1,67 @@
+/*
+Event-driven runtime for one or more pipelines.
+
+The tutorials wait for the bus with `gst_bus_timed_pop_filtered`, either forever
+or waking up every 100 ms to query the position, and each has its own copy of
+the message switch. Here every pipeline gets a bus watch on one shared GMainLoop
+instead:
+  - bus messages are dispatched through a per-type callback table
+    (`pipeline_runtime_set_handler`); ERROR and EOS have defaults that print
+    the message and stop the pipeline,
+  - position/duration are queried on a timer that only exists while the
+    pipeline is PLAYING (`pipeline_runtime_set_position_handler`),
+  - any number of pipelines share the loop, with no thread of our own per
+    pipeline; `pipeline_runtime_run` returns once all of them have stopped.
+
+Wakeups and time spent in queries are counted so they can be compared with the
+polling loop (see bench-runtime.c).
+*/
+#ifndef __PIPELINE_RUNTIME_H__
+#define __PIPELINE_RUNTIME_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PipelineRuntime PipelineRuntime;
+
+/* Called for each bus message of the type it was registered for */
+typedef void (*PipelineMessageFunc) (PipelineRuntime *runtime, GstMessage *msg,
+    gpointer user_data);
+
+/* Called on every position tick while PLAYING; both values may be -1 if unknown */
+typedef void (*PipelinePositionFunc) (PipelineRuntime *runtime, gint64 position,
+    gint64 duration, gpointer user_data);
+
+typedef struct _PipelineRuntimeStats {
+  guint64 wakeups;            /* bus dispatches + timer ticks */
+  guint64 messages;
+  guint64 queries;            /* position + duration queries */
+  guint64 query_time;         /* nanoseconds spent in those queries */
+} PipelineRuntimeStats;
+
+PipelineRuntime *pipeline_runtime_new (GstElement *pipeline);
+void pipeline_runtime_free (PipelineRuntime *runtime);
+
+void pipeline_runtime_set_handler (PipelineRuntime *runtime, GstMessageType type,
+    PipelineMessageFunc func, gpointer user_data);
+void pipeline_runtime_set_position_handler (PipelineRuntime *runtime,
+    guint interval_ms, PipelinePositionFunc func, gpointer user_data);
+
+gboolean pipeline_runtime_start (PipelineRuntime *runtime);
+void pipeline_runtime_stop (PipelineRuntime *runtime);
+void pipeline_runtime_run (void);
+
+GstElement *pipeline_runtime_get_pipeline (PipelineRuntime *runtime);
+gboolean pipeline_runtime_is_playing (PipelineRuntime *runtime);
+void pipeline_runtime_get_stats (PipelineRuntime *runtime, PipelineRuntimeStats *stats);
+
+/* The default ERROR and EOS handlers, for custom handlers that want to chain up */
+void pipeline_runtime_handle_error (PipelineRuntime *runtime, GstMessage *msg,
+    gpointer user_data);
+void pipeline_runtime_handle_eos (PipelineRuntime *runtime, GstMessage *msg,
+    gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __PIPELINE_RUNTIME_H__ */
@@ -0,0 +1,297 @@
+#include "range-cache-src.h"
+
+#include <string.h>
+
+#define DEFAULT_MAX_SIZE (512 * G_GUINT64_CONSTANT (1024) * 1024)
+#define CACHE_PREFIX "cache+"
+
+enum {
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CACHE_DIR,
+  PROP_MAX_SIZE,
+  PROP_HITS,
+  PROP_MISSES,
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static void range_cache_src_uri_handler_init (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (RangeCacheSrc, range_cache_src, GST_TYPE_BASE_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER, range_cache_src_uri_handler_init));
+
+static gboolean
+set_location (RangeCacheSrc *self, const gchar *uri, GError **error)
+{
+  if (g_str_has_prefix (uri, CACHE_PREFIX))
+    uri += strlen (CACHE_PREFIX);
+  if (!g_str_has_prefix (uri, "http://") && !g_str_has_prefix (uri, "https://")) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_UNSUPPORTED_PROTOCOL,
+        "Not an http(s) URI: %s", uri);
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (self);
+  g_free (self->uri);
+  self->uri = g_strdup (uri);
+  GST_OBJECT_UNLOCK (self);
+  return TRUE;
+}
+
+static void
+range_cache_src_set_property (GObject *object, guint prop_id, const GValue *value,
+    GParamSpec *pspec)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      set_location (self, g_value_get_string (value), NULL);
+      break;
+    case PROP_CACHE_DIR:
+      g_free (self->cache_dir);
+      self->cache_dir = g_value_dup_string (value);
+      break;
+    case PROP_MAX_SIZE:
+      self->max_size = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+range_cache_src_get_property (GObject *object, guint prop_id, GValue *value,
+    GParamSpec *pspec)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (object);
+  RangeCacheStats stats = { 0 };
+
+  if ((prop_id == PROP_HITS || prop_id == PROP_MISSES) && self->cache)
+    range_cache_get_stats (self->cache, &stats);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->uri);
+      break;
+    case PROP_CACHE_DIR:
+      g_value_set_string (value, self->cache_dir);
+      break;
+    case PROP_MAX_SIZE:
+      g_value_set_uint64 (value, self->max_size);
+      break;
+    case PROP_HITS:
+      g_value_set_uint64 (value, stats.hits);
+      break;
+    case PROP_MISSES:
+      g_value_set_uint64 (value, stats.misses);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static gboolean
+range_cache_src_start (GstBaseSrc *src)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (src);
+  GError *error = NULL;
+
+  if (!self->uri) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND, ("No URI set"), (NULL));
+    return FALSE;
+  }
+
+  /* Stats are kept across restarts, so keep the cache too */
+  if (!self->cache)
+    self->cache = range_cache_new (self->cache_dir, self->max_size);
+
+  self->file = range_cache_open (self->cache, self->uri, &error);
+  if (!self->file) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ, ("Could not open %s", self->uri),
+        ("%s", error->message));
+    g_clear_error (&error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+range_cache_src_stop (GstBaseSrc *src)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (src);
+
+  if (self->file) {
+    range_cache_file_close (self->file);
+    self->file = NULL;
+  }
+  return TRUE;
+}
+
+static gboolean
+range_cache_src_get_size (GstBaseSrc *src, guint64 *size)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (src);
+
+  if (!self->file)
+    return FALSE;
+  *size = range_cache_file_get_size (self->file);
+  return TRUE;
+}
+
+static gboolean
+range_cache_src_is_seekable (GstBaseSrc *src)
+{
+  return TRUE;
+}
+
+static GstFlowReturn
+range_cache_src_fill (GstBaseSrc *src, guint64 offset, guint length, GstBuffer *buf)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (src);
+  GError *error = NULL;
+  GstMapInfo map;
+  gssize read;
+
+  if (offset >= range_cache_file_get_size (self->file))
+    return GST_FLOW_EOS;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  read = range_cache_file_read (self->file, offset, map.data, length, &error);
+  gst_buffer_unmap (buf, &map);
+
+  if (read < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, READ, (NULL), ("%s", error->message));
+    g_clear_error (&error);
+    return GST_FLOW_ERROR;
+  }
+  if (read == 0)
+    return GST_FLOW_EOS;
+
+  gst_buffer_set_size (buf, read);
+  GST_BUFFER_OFFSET (buf) = offset;
+  GST_BUFFER_OFFSET_END (buf) = offset + read;
+  return GST_FLOW_OK;
+}
+
+static void
+range_cache_src_finalize (GObject *object)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (object);
+
+  if (self->cache)
+    range_cache_free (self->cache);
+  g_free (self->uri);
+  g_free (self->cache_dir);
+
+  G_OBJECT_CLASS (range_cache_src_parent_class)->finalize (object);
+}
+
+static void
+range_cache_src_class_init (RangeCacheSrcClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+
+  gobject_class->set_property = range_cache_src_set_property;
+  gobject_class->get_property = range_cache_src_get_property;
+  gobject_class->finalize = range_cache_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "Location", "URI to read", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CACHE_DIR,
+      g_param_spec_string ("cache-dir", "Cache directory", "Root of the on-disk cache", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE,
+      g_param_spec_uint64 ("max-size", "Maximum size", "Bytes the cache may use on disk",
+          RANGE_CACHE_SEGMENT_SIZE, G_MAXUINT64, DEFAULT_MAX_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HITS,
+      g_param_spec_uint64 ("hits", "Hits", "Segments read from disk",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MISSES,
+      g_param_spec_uint64 ("misses", "Misses", "Segments fetched from the network",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class, "HTTP range cache source",
+      "Source/Network", "Reads HTTP(S) resources through an on-disk range cache",
+      "gst-tutorials");
+
+  basesrc_class->start = GST_DEBUG_FUNCPTR (range_cache_src_start);
+  basesrc_class->stop = GST_DEBUG_FUNCPTR (range_cache_src_stop);
+  basesrc_class->get_size = GST_DEBUG_FUNCPTR (range_cache_src_get_size);
+  basesrc_class->is_seekable = GST_DEBUG_FUNCPTR (range_cache_src_is_seekable);
+  basesrc_class->fill = GST_DEBUG_FUNCPTR (range_cache_src_fill);
+}
+
+static void
+range_cache_src_init (RangeCacheSrc *self)
+{
+  self->cache_dir = range_cache_default_root ();
+  self->max_size = DEFAULT_MAX_SIZE;
+}
+
+static GstURIType
+range_cache_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+range_cache_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "cache+http", "cache+https", NULL };
+
+  return protocols;
+}
+
+static gchar *
+range_cache_src_uri_get_uri (GstURIHandler *handler)
+{
+  RangeCacheSrc *self = RANGE_CACHE_SRC (handler);
+  gchar *uri;
+
+  GST_OBJECT_LOCK (self);
+  uri = self->uri ? g_strconcat (CACHE_PREFIX, self->uri, NULL) : NULL;
+  GST_OBJECT_UNLOCK (self);
+  return uri;
+}
+
+static gboolean
+range_cache_src_uri_set_uri (GstURIHandler *handler, const gchar *uri, GError **error)
+{
+  return set_location (RANGE_CACHE_SRC (handler), uri, error);
+}
+
+static void
+range_cache_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = range_cache_src_uri_get_type;
+  iface->get_protocols = range_cache_src_uri_get_protocols;
+  iface->get_uri = range_cache_src_uri_get_uri;
+  iface->set_uri = range_cache_src_uri_set_uri;
+}
+
+gboolean
+range_cache_src_register (void)
+{
+  /* Registered without a plugin, so it is only visible to this process */
+  return gst_element_register (NULL, "rangecachesrc", GST_RANK_PRIMARY, RANGE_CACHE_TYPE_SRC);
+}
+
+gchar *
+range_cache_src_wrap_uri (const gchar *uri)
+{
+  if (g_str_has_prefix (uri, "http://") || g_str_has_prefix (uri, "https://"))
+    return g_strconcat (CACHE_PREFIX, uri, NULL);
+  return g_strdup (uri);
+}
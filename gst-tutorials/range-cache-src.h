@@ -0,0 +1,62 @@
+/*
+`rangecachesrc`: a random-access source reading HTTP(S) resources through the
+on-disk range cache (range-cache.c).
+
+It handles `cache+http://` and `cache+https://` URIs, so after
+`range_cache_src_register ()` any playbin/uridecodebin picks it up:
+  playbin uri=cache+https://www.freedesktop.org/.../sintel_trailer-480p.webm
+The first run fetches what playback reads, segment by segment; later runs and
+seeks are served from disk and only fetch segments that were never read.
+
+Being seekable with a known size, it runs in pull mode, so demuxers read (and
+the cache fetches) only the byte ranges they need.
+
+Properties:
+  location   URI to read (http:// or https://, with or without "cache+")
+  cache-dir  cache root (default: $XDG_CACHE_HOME/gst-tutorials/range-cache)
+  max-size   bytes the cache may use on disk before evicting (default 512 MiB)
+  hits       segments read from disk (read-only)
+  misses     segments fetched from the network (read-only)
+*/
+#ifndef __RANGE_CACHE_SRC_H__
+#define __RANGE_CACHE_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+
+#include "range-cache.h"
+
+G_BEGIN_DECLS
+
+#define RANGE_CACHE_TYPE_SRC (range_cache_src_get_type ())
+#define RANGE_CACHE_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), RANGE_CACHE_TYPE_SRC, RangeCacheSrc))
+
+typedef struct _RangeCacheSrc RangeCacheSrc;
+typedef struct _RangeCacheSrcClass RangeCacheSrcClass;
+
+struct _RangeCacheSrc {
+  GstBaseSrc parent;
+
+  gchar *uri;                 /* without the "cache+" prefix */
+  gchar *cache_dir;
+  guint64 max_size;
+
+  RangeCache *cache;
+  RangeCacheFile *file;
+};
+
+struct _RangeCacheSrcClass {
+  GstBaseSrcClass parent_class;
+};
+
+GType range_cache_src_get_type (void);
+
+/* Registers the element for this process; call once after gst_init */
+gboolean range_cache_src_register (void);
+
+/* "cache+" + uri for http(s) URIs, a copy of uri for anything else */
+gchar *range_cache_src_wrap_uri (const gchar *uri);
+
+G_END_DECLS
+
+#endif /* __RANGE_CACHE_SRC_H__ */
@@ -0,0 +1,492 @@
+#include "range-cache.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_REDIRECTS 5
+
+struct _RangeCache {
+  gchar *root;
+  guint64 max_size;
+  GSocketClient *client;
+
+  GMutex lock;                /* protects stats and usage */
+  RangeCacheStats stats;
+  guint64 usage;              /* bytes of segments on disk */
+};
+
+struct _RangeCacheFile {
+  RangeCache *cache;
+  gchar *uri;
+  gchar *dir;
+  guint64 size;
+
+  /* The segment reads are currently served from */
+  gint64 current_index;
+  guint8 *current;
+  gsize current_len;
+};
+
+typedef struct _SegmentInfo {
+  gchar *path;
+  gint64 mtime;
+  guint64 size;
+} SegmentInfo;
+
+gchar *
+range_cache_default_root (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "gst-tutorials", "range-cache", NULL);
+}
+
+static void
+segment_info_free (SegmentInfo *info)
+{
+  g_free (info->path);
+  g_free (info);
+}
+
+static gint
+compare_mtime (gconstpointer a, gconstpointer b)
+{
+  const SegmentInfo *ia = *(SegmentInfo **) a, *ib = *(SegmentInfo **) b;
+
+  return (ia->mtime > ib->mtime) - (ia->mtime < ib->mtime);
+}
+
+/*
+ Recounts what is on disk and, if that is over the limit, deletes the least
+ recently used segments. `keep` (the segment just written) is never deleted.
+*/
+static void
+evict (RangeCache *cache, const gchar *keep)
+{
+  GPtrArray *segments = g_ptr_array_new_with_free_func ((GDestroyNotify) segment_info_free);
+  GDir *root, *dir;
+  const gchar *entry, *name;
+  guint64 usage = 0, evicted = 0;
+  guint i;
+
+  root = g_dir_open (cache->root, 0, NULL);
+  while (root && (entry = g_dir_read_name (root))) {
+    gchar *path = g_build_filename (cache->root, entry, NULL);
+
+    dir = g_dir_open (path, 0, NULL);
+    while (dir && (name = g_dir_read_name (dir))) {
+      SegmentInfo *info;
+      GStatBuf st;
+
+      if (!g_str_has_suffix (name, ".seg"))
+        continue;
+      info = g_new0 (SegmentInfo, 1);
+      info->path = g_build_filename (path, name, NULL);
+      if (g_stat (info->path, &st) != 0) {
+        segment_info_free (info);
+        continue;
+      }
+      info->mtime = st.st_mtime;
+      info->size = st.st_size;
+      usage += info->size;
+      g_ptr_array_add (segments, info);
+    }
+    if (dir)
+      g_dir_close (dir);
+    g_free (path);
+  }
+  if (root)
+    g_dir_close (root);
+
+  if (usage > cache->max_size) {
+    g_ptr_array_sort (segments, compare_mtime);
+    for (i = 0; i < segments->len && usage > cache->max_size; i++) {
+      SegmentInfo *info = g_ptr_array_index (segments, i);
+
+      if (g_strcmp0 (info->path, keep) == 0 || g_unlink (info->path) != 0)
+        continue;
+      usage -= info->size;
+      evicted++;
+    }
+  }
+  g_ptr_array_unref (segments);
+
+  g_mutex_lock (&cache->lock);
+  cache->usage = usage;
+  cache->stats.evicted += evicted;
+  g_mutex_unlock (&cache->lock);
+}
+
+RangeCache *
+range_cache_new (const gchar *root, guint64 max_size)
+{
+  RangeCache *cache = g_new0 (RangeCache, 1);
+
+  cache->root = g_strdup (root);
+  cache->max_size = max_size;
+  cache->client = g_socket_client_new ();
+  g_mutex_init (&cache->lock);
+  g_mkdir_with_parents (root, 0755);
+
+  /* Also applies a max_size lower than the one the cache was filled with */
+  evict (cache, NULL);
+  return cache;
+}
+
+void
+range_cache_free (RangeCache *cache)
+{
+  g_object_unref (cache->client);
+  g_mutex_clear (&cache->lock);
+  g_free (cache->root);
+  g_free (cache);
+}
+
+void
+range_cache_get_stats (RangeCache *cache, RangeCacheStats *stats)
+{
+  g_mutex_lock (&cache->lock);
+  *stats = cache->stats;
+  g_mutex_unlock (&cache->lock);
+}
+
+/* Parses "bytes <first>-<last>/<total>" */
+static gboolean
+parse_content_range (const gchar *value, guint64 *first, guint64 *last, guint64 *total)
+{
+  gchar *end;
+
+  while (*value == ' ')
+    value++;
+  if (!g_str_has_prefix (value, "bytes "))
+    return FALSE;
+  *first = g_ascii_strtoull (value + 6, &end, 10);
+  if (*end != '-')
+    return FALSE;
+  *last = g_ascii_strtoull (end + 1, &end, 10);
+  if (*end != '/')
+    return FALSE;
+  *total = g_ascii_strtoull (end + 1, &end, 10);
+  return *last >= *first && *total > *last;
+}
+
+/* Value of a "Name: value" header line, or NULL if the name does not match */
+static const gchar *
+header_value (const gchar *line, const gchar *name)
+{
+  gsize len = strlen (name);
+
+  if (g_ascii_strncasecmp (line, name, len) != 0 || line[len] != ':')
+    return NULL;
+  line += len + 1;
+  while (*line == ' ')
+    line++;
+  return line;
+}
+
+/*
+ GET bytes [start, end] of `uri` into `dest`. On success `*received` is what
+ the server sent (less than asked for at the end of the resource) and `*total`
+ the size of the whole resource.
+*/
+static gboolean
+http_get_range (RangeCache *cache, const gchar *uri, guint64 start, guint64 end,
+    guint8 *dest, gsize *received, guint64 *total, GError **error)
+{
+  gchar *location = g_strdup (uri);
+  gboolean ret = FALSE;
+  gint redirects;
+
+  for (redirects = 0; redirects <= MAX_REDIRECTS; redirects++) {
+    GSocketConnection *conn = NULL;
+    GDataInputStream *in = NULL;
+    GUri *parsed;
+    gchar *request = NULL, *line = NULL, *redirect = NULL, *host_header;
+    const gchar *host, *value;
+    guint64 first = 0, last = 0, length = 0;
+    gboolean https, have_range = FALSE, have_length = FALSE, retry = FALSE;
+    gint port, status = 0;
+
+    parsed = g_uri_parse (location, G_URI_FLAGS_ENCODED, error);
+    if (!parsed)
+      break;
+    https = g_ascii_strcasecmp (g_uri_get_scheme (parsed), "https") == 0;
+    host = g_uri_get_host (parsed);
+    port = g_uri_get_port (parsed);
+    if (port < 0)
+      port = https ? 443 : 80;
+
+    g_socket_client_set_tls (cache->client, https);
+    conn = g_socket_client_connect_to_host (cache->client, host, port, NULL, error);
+    if (!conn)
+      goto next;
+
+    if (port == (https ? 443 : 80))
+      host_header = g_strdup (host);
+    else
+      host_header = g_strdup_printf ("%s:%d", host, port);
+    request = g_strdup_printf ("GET %s%s%s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Range: bytes=%" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT "\r\n"
+        "User-Agent: gst-tutorials-range-cache\r\n"
+        "Connection: close\r\n\r\n",
+        *g_uri_get_path (parsed) ? g_uri_get_path (parsed) : "/",
+        g_uri_get_query (parsed) ? "?" : "",
+        g_uri_get_query (parsed) ? g_uri_get_query (parsed) : "",
+        host_header, start, end);
+    g_free (host_header);
+    if (!g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (conn)),
+            request, strlen (request), NULL, NULL, error))
+      goto next;
+
+    in = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (conn)));
+    g_data_input_stream_set_newline_type (in, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+
+    line = g_data_input_stream_read_line (in, NULL, NULL, error);
+    if (!line || sscanf (line, "HTTP/%*s %d", &status) != 1) {
+      if (line)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Bad status line '%s'", line);
+      else if (error && !*error)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED, "No response");
+      goto next;
+    }
+
+    /* Headers, up to the empty line */
+    while (TRUE) {
+      g_free (line);
+      line = g_data_input_stream_read_line (in, NULL, NULL, error);
+      if (!line || *line == '\0')
+        break;
+      if ((value = header_value (line, "Content-Range")))
+        have_range = parse_content_range (value, &first, &last, total);
+      else if ((value = header_value (line, "Content-Length"))) {
+        length = g_ascii_strtoull (value, NULL, 10);
+        have_length = TRUE;
+      } else if ((value = header_value (line, "Location")))
+        redirect = g_strdup (value);
+    }
+    if (!line)
+      goto next;
+
+    if (status >= 300 && status < 400 && redirect) {
+      gchar *resolved = g_uri_resolve_relative (location, redirect, G_URI_FLAGS_ENCODED, error);
+
+      if (resolved) {
+        g_free (location);
+        location = resolved;
+        retry = TRUE;
+      }
+      goto next;
+    }
+
+    if (status == 206 && have_range && first == start) {
+      /* Never more than we asked for, whatever the server says it sends;
+         the rest is dropped with the connection */
+      length = MIN (last, end) - first + 1;
+    } else if (status == 200 && have_length && start == 0) {
+      /* No range support, but the start of the body is what we wanted */
+      *total = length;
+      length = MIN (length, end + 1);
+    } else {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+          "HTTP %d for bytes %" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT " of %s",
+          status, start, end, location);
+      goto next;
+    }
+
+    ret = g_input_stream_read_all (G_INPUT_STREAM (in), dest, length, received, NULL, error);
+    if (ret && *received != length) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+          "Got %" G_GSIZE_FORMAT " of %" G_GUINT64_FORMAT " bytes", *received, length);
+      ret = FALSE;
+    }
+
+  next:
+    g_free (line);
+    g_free (request);
+    g_free (redirect);
+    if (in)
+      g_object_unref (in);
+    if (conn)
+      g_object_unref (conn);
+    g_uri_unref (parsed);
+    if (!retry)
+      break;
+  }
+
+  if (redirects > MAX_REDIRECTS)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Too many redirects for %s", uri);
+  g_free (location);
+  return ret;
+}
+
+static gchar *
+segment_path (RangeCacheFile *file, gint64 index)
+{
+  gchar name[32];
+
+  g_snprintf (name, sizeof (name), "%08" G_GINT64_MODIFIER "x.seg", index);
+  return g_build_filename (file->dir, name, NULL);
+}
+
+/* Stores a fetched segment and makes it the current one */
+static void
+store_segment (RangeCacheFile *file, gint64 index, guint8 *data, gsize len)
+{
+  RangeCache *cache = file->cache;
+  gchar *path = segment_path (file, index);
+  gboolean evict_now;
+
+  g_free (file->current);
+  file->current = data;
+  file->current_len = len;
+  file->current_index = index;
+
+  /* A cache we cannot write to only costs us the next run's hits */
+  if (!g_file_set_contents (path, (const gchar *) data, len, NULL)) {
+    g_free (path);
+    return;
+  }
+
+  g_mutex_lock (&cache->lock);
+  cache->usage += len;
+  evict_now = cache->usage > cache->max_size;
+  g_mutex_unlock (&cache->lock);
+  if (evict_now)
+    evict (cache, path);
+  g_free (path);
+}
+
+static gboolean
+fetch_segment (RangeCacheFile *file, gint64 index, GError **error)
+{
+  RangeCache *cache = file->cache;
+  guint64 start = index * RANGE_CACHE_SEGMENT_SIZE, total = 0;
+  guint8 *data = g_malloc (RANGE_CACHE_SEGMENT_SIZE);
+  gint64 before = g_get_monotonic_time ();
+  gsize received = 0;
+
+  if (!http_get_range (cache, file->uri, start, start + RANGE_CACHE_SEGMENT_SIZE - 1,
+          data, &received, &total, error)) {
+    g_free (data);
+    return FALSE;
+  }
+
+  g_mutex_lock (&cache->lock);
+  cache->stats.misses++;
+  cache->stats.bytes_fetched += received;
+  cache->stats.fetch_time += (g_get_monotonic_time () - before) * 1000;
+  g_mutex_unlock (&cache->lock);
+
+  if (file->size == 0)
+    file->size = total;
+  store_segment (file, index, data, received);
+  return TRUE;
+}
+
+static gboolean
+load_segment (RangeCacheFile *file, gint64 index, GError **error)
+{
+  guint64 expected = MIN (RANGE_CACHE_SEGMENT_SIZE, file->size - index * RANGE_CACHE_SEGMENT_SIZE);
+  gchar *path, *data = NULL;
+  gsize len = 0;
+
+  if (index == file->current_index)
+    return TRUE;
+
+  path = segment_path (file, index);
+  if (g_file_get_contents (path, &data, &len, NULL) && len == expected) {
+    /* Bump the mtime: eviction goes by least recently used */
+    g_utime (path, NULL);
+    g_free (path);
+    g_free (file->current);
+    file->current = (guint8 *) data;
+    file->current_len = len;
+    file->current_index = index;
+
+    g_mutex_lock (&file->cache->lock);
+    file->cache->stats.hits++;
+    g_mutex_unlock (&file->cache->lock);
+    return TRUE;
+  }
+  g_free (data);
+  g_free (path);
+
+  return fetch_segment (file, index, error);
+}
+
+RangeCacheFile *
+range_cache_open (RangeCache *cache, const gchar *uri, GError **error)
+{
+  RangeCacheFile *file = g_new0 (RangeCacheFile, 1);
+  gchar *hash, *size_path, *contents = NULL;
+
+  file->cache = cache;
+  file->uri = g_strdup (uri);
+  file->current_index = -1;
+  hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  file->dir = g_build_filename (cache->root, hash, NULL);
+  g_free (hash);
+  g_mkdir_with_parents (file->dir, 0755);
+
+  size_path = g_build_filename (file->dir, "size", NULL);
+  if (g_file_get_contents (size_path, &contents, NULL, NULL))
+    file->size = g_ascii_strtoull (contents, NULL, 10);
+  g_free (contents);
+
+  /* First time we see this URI: its first segment tells us the size */
+  if (file->size == 0) {
+    if (!fetch_segment (file, 0, error) || file->size == 0) {
+      if (error && !*error)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Unknown size for %s", uri);
+      g_free (size_path);
+      range_cache_file_close (file);
+      return NULL;
+    }
+    contents = g_strdup_printf ("%" G_GUINT64_FORMAT "\n", file->size);
+    g_file_set_contents (size_path, contents, -1, NULL);
+    g_free (contents);
+  }
+  g_free (size_path);
+  return file;
+}
+
+void
+range_cache_file_close (RangeCacheFile *file)
+{
+  g_free (file->current);
+  g_free (file->dir);
+  g_free (file->uri);
+  g_free (file);
+}
+
+guint64
+range_cache_file_get_size (RangeCacheFile *file)
+{
+  return file->size;
+}
+
+gssize
+range_cache_file_read (RangeCacheFile *file, guint64 offset, guint8 *dest,
+    gsize size, GError **error)
+{
+  gsize done = 0;
+
+  if (offset >= file->size)
+    return 0;
+  size = MIN (size, file->size - offset);
+
+  while (done < size) {
+    guint64 position = offset + done;
+    gint64 index = position / RANGE_CACHE_SEGMENT_SIZE;
+    gsize in_segment = position % RANGE_CACHE_SEGMENT_SIZE, n;
+
+    if (!load_segment (file, index, error))
+      return -1;
+    if (in_segment >= file->current_len)
+      break;
+    n = MIN (size - done, file->current_len - in_segment);
+    memcpy (dest + done, file->current + in_segment, n);
+    done += n;
+  }
+  return done;
+}
@@ -0,0 +1,57 @@
+/*
+On-disk, range-aware cache for media served over HTTP.
+
+Every URI gets a directory under the cache root (named by the SHA-1 of the URI)
+holding the resource's total size and fixed 1 MiB segments, each stored as its
+own file once fetched. A read is served from the segments it overlaps; missing
+segments are fetched with a single `Range: bytes=` request each, so a seek far
+into a file only downloads what is read from there, and a repeat run reads
+everything from disk.
+
+The cache is bounded: after every fetch, the least recently used segments
+(by file mtime, which is bumped on every hit) of all cached URIs are deleted
+until the cache is back under `max_size`.
+
+The HTTP client is deliberately small: HTTP/1.1 over GSocketClient (TLS for
+https through glib-networking), one connection per request, redirects followed,
+no chunked encoding. That is all a static file server or CDN needs.
+*/
+#ifndef __RANGE_CACHE_H__
+#define __RANGE_CACHE_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define RANGE_CACHE_SEGMENT_SIZE (1024 * 1024)
+
+typedef struct _RangeCache RangeCache;
+typedef struct _RangeCacheFile RangeCacheFile;
+
+typedef struct _RangeCacheStats {
+  guint64 hits;               /* segments read from disk */
+  guint64 misses;             /* segments fetched from the network */
+  guint64 bytes_fetched;
+  guint64 fetch_time;         /* nanoseconds spent in requests */
+  guint64 evicted;            /* segments deleted to stay under max_size */
+} RangeCacheStats;
+
+RangeCache *range_cache_new (const gchar *root, guint64 max_size);
+void range_cache_free (RangeCache *cache);
+void range_cache_get_stats (RangeCache *cache, RangeCacheStats *stats);
+
+/* The default root, under the user's cache directory */
+gchar *range_cache_default_root (void);
+
+/* Opening a URI for the first time fetches its first segment to learn its size */
+RangeCacheFile *range_cache_open (RangeCache *cache, const gchar *uri, GError **error);
+void range_cache_file_close (RangeCacheFile *file);
+guint64 range_cache_file_get_size (RangeCacheFile *file);
+
+/* Returns the number of bytes read (short at the end of the file), -1 on error */
+gssize range_cache_file_read (RangeCacheFile *file, guint64 offset, guint8 *dest,
+    gsize size, GError **error);
+
+G_END_DECLS
+
+#endif /* __RANGE_CACHE_H__ */
@@ -0,0 +1,551 @@
+#include "rtp-stream.h"
+
+#include <string.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#define CLOCK_RATE 90000
+/* Two raw frames; the kernel caps it at net.core.rmem_max */
+#define RECEIVE_BUFFER_SIZE (8 << 20)
+/* Frames between the jitterbuffer and the sink we remember capture times for */
+#define CAPTURE_SLOTS 16
+
+typedef struct {
+  const gchar *name;
+  const gchar *send;          /* ends in the payloader, named "pay" */
+  const gchar *caps;          /* what udpsrc receives */
+  const gchar *receive;       /* depayloader to raw video */
+} Codec;
+
+static const Codec codecs[] = {
+  [RTP_STREAM_H264] = { "h264",
+    "x264enc tune=zerolatency speed-preset=ultrafast key-int-max=30 "
+    "! rtph264pay name=pay config-interval=-1 pt=96",
+    "application/x-rtp,media=video,clock-rate=90000,encoding-name=H264,payload=96",
+    "rtph264depay ! avdec_h264" },
+  /* rtpvrawpay has no YUY2; the size is the color stream's */
+  [RTP_STREAM_RAW] = { "raw",
+    "videoconvert ! video/x-raw,format=UYVY ! rtpvrawpay name=pay pt=96",
+    "application/x-rtp,media=video,clock-rate=90000,encoding-name=RAW,"
+    "sampling=YCbCr-4:2:2,depth=(string)8,width=(string)1920,height=(string)1080,"
+    "colorimetry=(string)BT709,payload=96",
+    "rtpvrawdepay" },
+};
+
+struct _RtpSender {
+  GstElement *bin;
+  GstPad *pad;                /* the payloader's src pad */
+
+  /* Payloader streaming thread only */
+  GstSegment segment;
+
+  /* Written on the payloader's thread */
+  GMutex lock;
+  RtpSenderStats stats;
+
+  /* Main loop only */
+  RtpSenderStats reported_stats;
+  gint64 reported;
+  gint64 started;
+};
+
+struct _RtpReceiver {
+  GstElement *pipeline;
+  GstElement *jitter;
+  GstElement *render;
+  GstPad *jitter_sink;
+  GstPad *jitter_src;
+  GstPad *render_sink;
+  gboolean sync;
+
+  /* Render streaming thread only */
+  GstSegment segment;
+
+  GMutex lock;
+  RtpReceiverStats stats;
+  LatencyHistogram interval;  /* since the previous report */
+  /* RFC 3550 state, on udpsrc's thread */
+  gboolean seen_packet;
+  guint16 max_seq;
+  guint32 cycles;
+  guint32 base_seq;
+  guint32 last_rtptime;
+  gint32 transit;
+  gdouble jitter;             /* in RTP timestamp units */
+  /* Capture times by buffer timestamp, from the jitterbuffer to the sink */
+  struct {
+    GstClockTime pts;
+    guint64 capture;
+  } slots[CAPTURE_SLOTS];
+  guint next_slot;
+
+  /* Main loop only */
+  RtpReceiverStats reported_stats;
+  gint64 reported;
+  gint64 started;
+};
+
+gboolean
+rtp_stream_codec_from_string (const gchar *name, RtpStreamCodec *codec)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (codecs); i++) {
+    if (g_strcmp0 (name, codecs[i].name) == 0) {
+      *codec = i;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* Capture time in clock time, 0 if the pipeline has no clock yet */
+static guint64
+capture_time (GstElement *element, const GstSegment *segment, GstClockTime pts)
+{
+  GstClock *clock = gst_element_get_clock (element);
+  guint64 running_time, now;
+
+  if (!clock)
+    return 0;
+  now = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  /* Live sources timestamp in running time, at capture */
+  running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME, pts);
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return now;
+  return MIN (now, gst_element_get_base_time (element) + running_time);
+}
+
+static gboolean
+stamp_packet (GstBuffer *buffer, guint64 capture)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint64 data = GUINT64_TO_BE (capture);
+  gboolean ok;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READWRITE, &rtp))
+    return FALSE;
+  ok = gst_rtp_buffer_add_extension_onebyte_header (&rtp, RTP_STREAM_EXT_ID, &data,
+      sizeof (data));
+  gst_rtp_buffer_unmap (&rtp);
+  return ok;
+}
+
+/* Counts the packets leaving the payloader and stamps them */
+static GstPadProbeReturn
+payloader_probe (GstPad *pad, GstPadProbeInfo *info, RtpSender *sender)
+{
+  GstElement *element = GST_PAD_PARENT_ELEMENT (pad);
+  RtpSenderStats stats = { 0 };
+  GstBufferList *list = NULL;
+  GstBuffer *buffer = NULL;
+  guint i, n = 1;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT)
+      gst_event_copy_segment (event, &sender->segment);
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* Payloaders push a frame's packets as a list */
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    list = gst_buffer_list_make_writable (GST_PAD_PROBE_INFO_BUFFER_LIST (info));
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+    n = gst_buffer_list_length (list);
+  } else {
+    buffer = gst_buffer_make_writable (GST_PAD_PROBE_INFO_BUFFER (info));
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  }
+
+  for (i = 0; i < n; i++) {
+    guint64 capture;
+
+    if (list)
+      buffer = gst_buffer_list_get_writable (list, i);
+    capture = capture_time (element, &sender->segment, GST_BUFFER_PTS (buffer));
+    if (!capture || !stamp_packet (buffer, capture))
+      stats.unstamped++;
+    stats.packets++;
+    stats.bytes += gst_buffer_get_size (buffer);
+  }
+
+  g_mutex_lock (&sender->lock);
+  sender->stats.packets += stats.packets;
+  sender->stats.bytes += stats.bytes;
+  sender->stats.unstamped += stats.unstamped;
+  g_mutex_unlock (&sender->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+RtpSender *
+rtp_sender_new (GstElement *pipeline, GstElement *upstream, RtpStreamCodec codec,
+    const gchar *host, gint port, GError **error)
+{
+  RtpSender *sender;
+  GstElement *bin, *pay;
+  gchar *description;
+
+  description = g_strdup_printf ("%s ! udpsink host=\"%s\" port=%d sync=false async=false",
+      codecs[codec].send, host, port);
+  bin = gst_parse_bin_from_description (description, TRUE, error);
+  g_free (description);
+  if (!bin)
+    return NULL;
+
+  gst_bin_add (GST_BIN (pipeline), bin);
+  if (!gst_element_link (upstream, bin)) {
+    g_set_error (error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION,
+        "Could not link %s to the %s payloader", GST_OBJECT_NAME (upstream), codecs[codec].name);
+    gst_bin_remove (GST_BIN (pipeline), bin);
+    return NULL;
+  }
+
+  sender = g_new0 (RtpSender, 1);
+  sender->bin = gst_object_ref (bin);
+  gst_segment_init (&sender->segment, GST_FORMAT_TIME);
+  g_mutex_init (&sender->lock);
+
+  pay = gst_bin_get_by_name (GST_BIN (bin), "pay");
+  sender->pad = gst_element_get_static_pad (pay, "src");
+  gst_pad_add_probe (sender->pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, (GstPadProbeCallback) payloader_probe, sender, NULL);
+  gst_object_unref (pay);
+
+  sender->reported = sender->started = g_get_monotonic_time ();
+  return sender;
+}
+
+/* Once the pipeline is back in NULL */
+void
+rtp_sender_free (RtpSender *sender)
+{
+  gst_object_unref (sender->pad);
+  gst_object_unref (sender->bin);
+  g_mutex_clear (&sender->lock);
+  g_free (sender);
+}
+
+void
+rtp_sender_get_stats (RtpSender *sender, RtpSenderStats *stats)
+{
+  g_mutex_lock (&sender->lock);
+  *stats = sender->stats;
+  g_mutex_unlock (&sender->lock);
+}
+
+void
+rtp_sender_report (RtpSender *sender, gboolean final)
+{
+  RtpSenderStats stats;
+  gint64 now = g_get_monotonic_time ();
+  gdouble seconds;
+
+  rtp_sender_get_stats (sender, &stats);
+  if (final) {
+    seconds = (now - sender->started) / 1e6;
+    g_print ("RTP sender: %" G_GUINT64_FORMAT " packets, %.1f MB (%.1f Mbit/s), %"
+        G_GUINT64_FORMAT " without a capture time\n", stats.packets, stats.bytes / 1e6,
+        seconds > 0 ? stats.bytes * 8 / 1e6 / seconds : 0.0, stats.unstamped);
+    return;
+  }
+
+  seconds = (now - sender->reported) / 1e6;
+  g_print ("RTP sender: %.0f packets/s, %.1f Mbit/s\n",
+      seconds > 0 ? (stats.packets - sender->reported_stats.packets) / seconds : 0.0,
+      seconds > 0 ? (stats.bytes - sender->reported_stats.bytes) * 8 / 1e6 / seconds : 0.0);
+  sender->reported_stats = stats;
+  sender->reported = now;
+}
+
+/* RFC 3550 A.1 (without the probation), A.8 on the first packet of each frame */
+static GstPadProbeReturn
+network_probe (GstPad *pad, GstPadProbeInfo *info, RtpReceiver *receiver)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint32 arrival, rtptime;
+  guint16 seq;
+  gint32 transit, d;
+
+  if (!gst_rtp_buffer_map (GST_PAD_PROBE_INFO_BUFFER (info), GST_MAP_READ, &rtp))
+    return GST_PAD_PROBE_OK;
+  seq = gst_rtp_buffer_get_seq (&rtp);
+  rtptime = gst_rtp_buffer_get_timestamp (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+  arrival = gst_util_uint64_scale (gst_util_get_timestamp (), CLOCK_RATE, GST_SECOND);
+
+  g_mutex_lock (&receiver->lock);
+  if (!receiver->seen_packet) {
+    receiver->seen_packet = TRUE;
+    receiver->base_seq = receiver->max_seq = seq;
+    receiver->last_rtptime = rtptime;
+    receiver->transit = arrival - rtptime;
+  } else {
+    gint16 delta = seq - receiver->max_seq;
+
+    if (delta > 0) {
+      if (seq < receiver->max_seq)
+        receiver->cycles += 65536;
+      receiver->max_seq = seq;
+    }
+    if (rtptime != receiver->last_rtptime) {
+      transit = arrival - rtptime;
+      d = transit - receiver->transit;
+      receiver->transit = transit;
+      receiver->jitter += (ABS (d) - receiver->jitter) / 16;
+      receiver->last_rtptime = rtptime;
+    }
+  }
+  receiver->stats.received++;
+  receiver->stats.expected = receiver->cycles + receiver->max_seq - receiver->base_seq + 1;
+  receiver->stats.lost = (gint64) receiver->stats.expected - receiver->stats.received;
+  receiver->stats.jitter = receiver->jitter * GST_SECOND / CLOCK_RATE;
+  g_mutex_unlock (&receiver->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* Out of the jitterbuffer: remember the capture time under the timestamp it now has */
+static GstPadProbeReturn
+jitter_probe (GstPad *pad, GstPadProbeInfo *info, RtpReceiver *receiver)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint64 capture = 0;
+  gpointer data;
+  guint size;
+  guint last;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer) || !gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))
+    return GST_PAD_PROBE_OK;
+  if (gst_rtp_buffer_get_extension_onebyte_header (&rtp, RTP_STREAM_EXT_ID, 0, &data, &size)
+      && size == sizeof (capture)) {
+    memcpy (&capture, data, sizeof (capture));
+    capture = GUINT64_FROM_BE (capture);
+  }
+  gst_rtp_buffer_unmap (&rtp);
+  if (!capture)
+    return GST_PAD_PROBE_OK;
+
+  /* Once per frame */
+  g_mutex_lock (&receiver->lock);
+  last = (receiver->next_slot + CAPTURE_SLOTS - 1) % CAPTURE_SLOTS;
+  if (receiver->slots[last].pts != GST_BUFFER_PTS (buffer)) {
+    receiver->slots[receiver->next_slot].pts = GST_BUFFER_PTS (buffer);
+    receiver->slots[receiver->next_slot].capture = capture;
+    receiver->next_slot = (receiver->next_slot + 1) % CAPTURE_SLOTS;
+  }
+  g_mutex_unlock (&receiver->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+render_probe (GstPad *pad, GstPadProbeInfo *info, RtpReceiver *receiver)
+{
+  GstBuffer *buffer;
+  GstClock *clock;
+  GstClockTime render;
+  guint64 running_time, capture = 0;
+  guint i;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT)
+      gst_event_copy_segment (event, &receiver->segment);
+    return GST_PAD_PROBE_OK;
+  }
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  clock = gst_element_get_clock (receiver->render);
+  if (!clock)
+    return GST_PAD_PROBE_OK;
+  render = gst_clock_get_time (clock);
+  gst_object_unref (clock);
+
+  /* With sync the sink waits for the frame's time, unless it is already late */
+  running_time = gst_segment_to_running_time (&receiver->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  if (receiver->sync && GST_CLOCK_TIME_IS_VALID (running_time))
+    render = MAX (render, gst_element_get_base_time (receiver->render) + running_time +
+        gst_base_sink_get_latency (GST_BASE_SINK (receiver->render)));
+
+  g_mutex_lock (&receiver->lock);
+  receiver->stats.frames++;
+  for (i = 0; i < CAPTURE_SLOTS; i++)
+    if (receiver->slots[i].pts == GST_BUFFER_PTS (buffer))
+      capture = receiver->slots[i].capture;
+  if (capture && render > capture) {
+    latency_histogram_record (&receiver->stats.latency, render - capture);
+    latency_histogram_record (&receiver->interval, render - capture);
+  }
+  g_mutex_unlock (&receiver->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+/* netsim takes the delay as a range */
+static gchar *
+impairment_description (const RtpImpairment *impairment)
+{
+  gchar loss[G_ASCII_DTOSTR_BUF_SIZE];
+  gint min, max;
+
+  if (!impairment || (impairment->loss <= 0 && !impairment->delay_ms &&
+          !impairment->delay_jitter_ms))
+    return g_strdup ("");
+  min = MAX ((gint) impairment->delay_ms - (gint) impairment->delay_jitter_ms, 0);
+  max = impairment->delay_ms + impairment->delay_jitter_ms;
+  g_ascii_dtostr (loss, sizeof (loss), CLAMP (impairment->loss, 0, 1));
+  return g_strdup_printf ("! netsim drop-probability=%s delay-probability=%s "
+      "delay-distribution=uniform min-delay=%d max-delay=%d ", loss,
+      max > 0 ? "1.0" : "0.0", min, max);
+}
+
+RtpReceiver *
+rtp_receiver_new (gint port, RtpStreamCodec codec, guint latency_ms,
+    const RtpImpairment *impairment, const gchar *sink, GError **error)
+{
+  RtpReceiver *receiver;
+  GstElement *pipeline;
+  gchar *description, *impair;
+  guint i;
+
+  impair = impairment_description (impairment);
+  description = g_strdup_printf ("udpsrc port=%d buffer-size=%d timeout=%" G_GUINT64_FORMAT
+      " caps=\"%s\" %s! rtpjitterbuffer name=jitter latency=%u ! %s ! videoconvert "
+      "! %s name=render", port, RECEIVE_BUFFER_SIZE, (guint64) RTP_STREAM_TIMEOUT,
+      codecs[codec].caps, impair, latency_ms, codecs[codec].receive, sink);
+  pipeline = gst_parse_launch (description, error);
+  g_free (description);
+  g_free (impair);
+  if (!pipeline)
+    return NULL;
+
+  receiver = g_new0 (RtpReceiver, 1);
+  receiver->pipeline = pipeline;
+  receiver->jitter = gst_bin_get_by_name (GST_BIN (pipeline), "jitter");
+  receiver->render = gst_bin_get_by_name (GST_BIN (pipeline), "render");
+  /* A bin such as autovideosink renders on arrival as far as we can tell */
+  if (GST_IS_BASE_SINK (receiver->render))
+    g_object_get (receiver->render, "sync", &receiver->sync, NULL);
+  gst_segment_init (&receiver->segment, GST_FORMAT_TIME);
+  g_mutex_init (&receiver->lock);
+  latency_histogram_reset (&receiver->stats.latency);
+  latency_histogram_reset (&receiver->interval);
+  for (i = 0; i < CAPTURE_SLOTS; i++)
+    receiver->slots[i].pts = GST_CLOCK_TIME_NONE;
+
+  receiver->jitter_sink = gst_element_get_static_pad (receiver->jitter, "sink");
+  gst_pad_add_probe (receiver->jitter_sink, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) network_probe, receiver, NULL);
+  receiver->jitter_src = gst_element_get_static_pad (receiver->jitter, "src");
+  gst_pad_add_probe (receiver->jitter_src, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) jitter_probe, receiver, NULL);
+  receiver->render_sink = gst_element_get_static_pad (receiver->render, "sink");
+  gst_pad_add_probe (receiver->render_sink,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) render_probe, receiver, NULL);
+
+  receiver->reported = receiver->started = g_get_monotonic_time ();
+  return receiver;
+}
+
+void
+rtp_receiver_free (RtpReceiver *receiver)
+{
+  gst_object_unref (receiver->jitter_sink);
+  gst_object_unref (receiver->jitter_src);
+  gst_object_unref (receiver->render_sink);
+  gst_object_unref (receiver->jitter);
+  gst_object_unref (receiver->render);
+  gst_object_unref (receiver->pipeline);
+  g_mutex_clear (&receiver->lock);
+  g_free (receiver);
+}
+
+GstElement *
+rtp_receiver_get_pipeline (RtpReceiver *receiver)
+{
+  return receiver->pipeline;
+}
+
+void
+rtp_receiver_get_stats (RtpReceiver *receiver, RtpReceiverStats *stats)
+{
+  GstStructure *jitter_stats = NULL;
+
+  g_mutex_lock (&receiver->lock);
+  *stats = receiver->stats;
+  g_mutex_unlock (&receiver->lock);
+
+  g_object_get (receiver->jitter, "stats", &jitter_stats, NULL);
+  if (jitter_stats) {
+    gst_structure_get_uint64 (jitter_stats, "num-lost", &stats->given_up);
+    gst_structure_get_uint64 (jitter_stats, "num-late", &stats->late);
+    gst_structure_free (jitter_stats);
+  }
+}
+
+gboolean
+rtp_receiver_stream_ended (RtpReceiver *receiver, GstMessage *msg)
+{
+  gboolean started;
+
+  if (!gst_message_has_name (msg, "GstUDPSrcTimeout"))
+    return FALSE;
+  g_mutex_lock (&receiver->lock);
+  started = receiver->seen_packet;
+  g_mutex_unlock (&receiver->lock);
+  return started;
+}
+
+void
+rtp_receiver_report (RtpReceiver *receiver, gboolean final)
+{
+  RtpReceiverStats stats;
+  LatencyHistogram interval;
+  gint64 now = g_get_monotonic_time ();
+  gint64 expected, lost;
+  gdouble seconds;
+
+  rtp_receiver_get_stats (receiver, &stats);
+  g_mutex_lock (&receiver->lock);
+  interval = receiver->interval;
+  latency_histogram_reset (&receiver->interval);
+  g_mutex_unlock (&receiver->lock);
+
+  if (final) {
+    seconds = (now - receiver->started) / 1e6;
+    g_print ("RTP receiver: %" G_GUINT64_FORMAT " frames (%.1f frames/s)\n", stats.frames,
+        seconds > 0 ? stats.frames / seconds : 0.0);
+    g_print ("  %" G_GUINT64_FORMAT " packets of %" G_GUINT64_FORMAT " expected, %"
+        G_GINT64_FORMAT " lost (%.2f%%), jitter %.2f ms\n", stats.received, stats.expected,
+        stats.lost, stats.expected ? 100.0 * MAX (stats.lost, 0) / stats.expected : 0.0,
+        stats.jitter / 1e6);
+    g_print ("  jitterbuffer: %" G_GUINT64_FORMAT " packets given up, %" G_GUINT64_FORMAT
+        " too late\n", stats.given_up, stats.late);
+    if (stats.latency.count)
+      g_print ("  capture to render: p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+          latency_histogram_percentile (&stats.latency, 50) / 1e6,
+          latency_histogram_percentile (&stats.latency, 99) / 1e6, stats.latency.max / 1e6);
+    return;
+  }
+
+  /* RFC 3550 A.3: the fraction lost in the interval */
+  seconds = (now - receiver->reported) / 1e6;
+  expected = stats.expected - receiver->reported_stats.expected;
+  lost = expected - (gint64) (stats.received - receiver->reported_stats.received);
+  g_print ("RTP receiver: %.1f frames/s, %.2f%% lost, jitter %.2f ms, %" G_GUINT64_FORMAT
+      " given up", seconds > 0 ? (stats.frames - receiver->reported_stats.frames) / seconds : 0.0,
+      expected > 0 && lost > 0 ? 100.0 * lost / expected : 0.0, stats.jitter / 1e6,
+      stats.given_up - receiver->reported_stats.given_up);
+  if (interval.count)
+    g_print (", capture to render p50 %.1f ms, p99 %.1f ms",
+        latency_histogram_percentile (&interval, 50) / 1e6,
+        latency_histogram_percentile (&interval, 99) / 1e6);
+  g_print ("\n");
+  receiver->reported_stats = stats;
+  receiver->reported = now;
+}
@@ -0,0 +1,105 @@
+/*
+Sends the camera's frames to another machine over RTP/UDP, and receives them.
+
+The sender ends the capture pipeline in
+  h264: x264enc tune=zerolatency ! rtph264pay ! udpsink
+  raw:  videoconvert ! UYVY ! rtpvrawpay ! udpsink  (~1 Gbit/s, for a LAN)
+and writes the frame's capture time into every packet as a one-byte RTP
+header extension (RTP_STREAM_EXT_ID, 8 bytes): the buffer's timestamp in
+clock time, which v4l2src takes from the driver. The pipeline clock is the
+system clock, CLOCK_MONOTONIC, so on one machine (over loopback) the
+receiver reads it on the same clock.
+
+The receiver is a pipeline of its own:
+  udpsrc [! netsim] ! rtpjitterbuffer latency=N ! depayloader [! decoder]
+    ! videoconvert ! sink
+netsim (gst-plugins-bad) is only there with an RtpImpairment: it drops a
+share of the packets and delays them by a uniformly distributed time,
+which reorders them, to see which jitterbuffer latency a network needs.
+
+On the way into the jitterbuffer it keeps the receiver statistics of RFC 3550
+(A.1, A.3 and A.8): packets expected from the extended highest sequence
+number and received, hence lost, and the interarrival jitter, updated on the
+first packet of each frame (all the packets of a frame share a timestamp
+but are sent back to back). The jitterbuffer's own counts tell apart the
+packets it gave up waiting for and those that came too late. On the way out
+of the jitterbuffer the capture time is remembered by buffer timestamp,
+which the depayloader and decoder keep, and at the sink the frame's render
+time is worked out as live-latency.c does: with sync, base time + running
+time + the sink's latency, unless it is already late. The difference is the
+end-to-end latency, kept in a histogram.
+*/
+#ifndef __RTP_STREAM_H__
+#define __RTP_STREAM_H__
+
+#include <gst/gst.h>
+
+#include "latency-histogram.h"
+
+G_BEGIN_DECLS
+
+/* One-byte header extension carrying the capture time */
+#define RTP_STREAM_EXT_ID 1
+/* udpsrc posts a timeout this long after the last packet, which ends a receiver */
+#define RTP_STREAM_TIMEOUT (2 * GST_SECOND)
+
+typedef enum {
+  RTP_STREAM_H264,
+  RTP_STREAM_RAW,
+} RtpStreamCodec;
+
+gboolean rtp_stream_codec_from_string (const gchar *name, RtpStreamCodec *codec);
+
+typedef struct _RtpSenderStats {
+  guint64 packets;
+  guint64 bytes;
+  guint64 unstamped;          /* packets we could not add the capture time to */
+} RtpSenderStats;
+
+typedef struct _RtpSender RtpSender;
+
+/* Adds the encoder, payloader and udpsink and links `upstream` to them */
+RtpSender *rtp_sender_new (GstElement *pipeline, GstElement *upstream, RtpStreamCodec codec,
+    const gchar *host, gint port, GError **error);
+void rtp_sender_free (RtpSender *sender);
+
+void rtp_sender_get_stats (RtpSender *sender, RtpSenderStats *stats);
+/* Packets/s and Mbit/s since the previous report; `final` reports the whole run */
+void rtp_sender_report (RtpSender *sender, gboolean final);
+
+/* Synthetic network trouble on the receiving side, all zero for none */
+typedef struct _RtpImpairment {
+  gdouble loss;               /* share of packets dropped, 0..1 */
+  guint delay_ms;             /* mean added delay */
+  guint delay_jitter_ms;      /* +/- around it, uniformly */
+} RtpImpairment;
+
+typedef struct _RtpReceiverStats {
+  guint64 received;           /* packets into the jitterbuffer */
+  guint64 expected;           /* from the extended highest sequence number */
+  gint64 lost;                /* expected - received, negative with duplicates */
+  gdouble jitter;             /* interarrival jitter, nanoseconds */
+  guint64 given_up;           /* the jitterbuffer's lost packets: never came or too late */
+  guint64 late;               /* came after the jitterbuffer gave up on them */
+  guint64 frames;             /* reaching the sink */
+  LatencyHistogram latency;   /* capture to render, stamped frames only */
+} RtpReceiverStats;
+
+typedef struct _RtpReceiver RtpReceiver;
+
+/* A new pipeline receiving on `port` into `sink` (an element, may have properties) */
+RtpReceiver *rtp_receiver_new (gint port, RtpStreamCodec codec, guint latency_ms,
+    const RtpImpairment *impairment, const gchar *sink, GError **error);
+/* Once the pipeline is back in NULL; also unrefs the pipeline */
+void rtp_receiver_free (RtpReceiver *receiver);
+
+GstElement *rtp_receiver_get_pipeline (RtpReceiver *receiver);
+void rtp_receiver_get_stats (RtpReceiver *receiver, RtpReceiverStats *stats);
+/* For an ELEMENT message: is it udpsrc's timeout after the stream had started? */
+gboolean rtp_receiver_stream_ended (RtpReceiver *receiver, GstMessage *msg);
+/* Frames/s, loss, jitter and latency since the previous report; `final` reports the whole run */
+void rtp_receiver_report (RtpReceiver *receiver, gboolean final);
+
+G_END_DECLS
+
+#endif /* __RTP_STREAM_H__ */
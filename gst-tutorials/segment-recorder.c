@@ -0,0 +1,261 @@
+#include "segment-recorder.h"
+
+#include <string.h>
+
+#include "async-file-sink.h"
+
+/* Raw frames queued in front of the encoder before capture waits for it: a few
+   frames of slack for the encoder thread (about 16 frames of 1080p YUY2) */
+#define SEGMENT_RAW_QUEUE_BYTES (64 * 1024 * 1024)
+/* Encoded data queued in front of splitmuxsink: well beyond the worst fsync,
+   which async-finalize keeps off this branch anyway, and small once compressed */
+#define SEGMENT_QUEUE_TIME (10 * GST_SECOND)
+/* A stall this close to a segment start counts as a rollover stall (us) */
+#define ROLLOVER_WINDOW (G_USEC_PER_SEC / 2)
+
+struct _SegmentRecorder {
+  GstElement *bin;            /* owned by the pipeline */
+  GstElement *queue;
+  GstElement *splitmux;
+  gchar *location;
+  GstPad *capture_pad;
+  gulong capture_probe;
+
+  /* Capture thread */
+  gint captured;
+  gint64 first;               /* g_get_monotonic_time () of the first/last capture */
+  gint64 last;
+  gint64 max_stall;           /* microseconds */
+  gint64 max_rollover_stall;
+
+  /* Queue and encoder threads */
+  gint dequeued;
+  gint encoded;
+
+  /* Set on splitmuxsink's thread, read on the capture thread */
+  GMutex lock;
+  gint64 rollover;            /* g_get_monotonic_time () of the newest segment start */
+  guint segments;
+
+  /* Main loop only */
+  gint reported_encoded;
+  guint64 reported_bytes;
+  gint64 reported;
+};
+
+static GstPadProbeReturn
+capture_probe (GstPad *pad, GstPadProbeInfo *info, SegmentRecorder *recorder)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gint64 now = g_get_monotonic_time ();
+
+  if (g_atomic_int_add (&recorder->captured, 1) == 0) {
+    recorder->first = now;
+  } else {
+    gint64 stall = now - recorder->last, rollover;
+
+    /* Anything beyond a frame's time is time the capture thread did not have */
+    if (GST_BUFFER_DURATION_IS_VALID (buffer))
+      stall -= GST_BUFFER_DURATION (buffer) / GST_USECOND;
+    recorder->max_stall = MAX (recorder->max_stall, stall);
+
+    g_mutex_lock (&recorder->lock);
+    rollover = recorder->rollover;
+    g_mutex_unlock (&recorder->lock);
+    if (rollover && rollover >= recorder->last - ROLLOVER_WINDOW)
+      recorder->max_rollover_stall = MAX (recorder->max_rollover_stall, stall);
+  }
+  recorder->last = now;
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+count_probe (GstPad *pad, GstPadProbeInfo *info, gint *counter)
+{
+  g_atomic_int_inc (counter);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+add_count_probe (GstElement *element, const gchar *pad_name, gint *counter)
+{
+  GstPad *pad = gst_element_get_static_pad (element, pad_name);
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) count_probe,
+      counter, NULL);
+  gst_object_unref (pad);
+}
+
+/* A printf pattern with exactly one integer conversion (flags and width
+   allowed) and otherwise only literal text and %% */
+static gboolean
+location_is_valid (const gchar *location)
+{
+  const gchar *p = location;
+  gint conversions = 0;
+
+  while ((p = strchr (p, '%'))) {
+    p++;
+    if (*p == '%') {
+      p++;
+      continue;
+    }
+    while (*p && strchr ("-+ #0", *p))
+      p++;
+    while (g_ascii_isdigit (*p))
+      p++;
+    if (*p != 'd' && *p != 'i' && *p != 'u')
+      return FALSE;
+    p++;
+    conversions++;
+  }
+  return conversions == 1;
+}
+
+/* splitmuxsink's streaming thread, as a segment starts */
+static gchar *
+format_location (GstElement *splitmux, guint fragment_id, SegmentRecorder *recorder)
+{
+  g_mutex_lock (&recorder->lock);
+  recorder->rollover = g_get_monotonic_time ();
+  recorder->segments++;
+  g_mutex_unlock (&recorder->lock);
+  return g_strdup_printf (recorder->location, fragment_id);
+}
+
+SegmentRecorder *
+segment_recorder_new (GstElement *pipeline, GstElement *capture, GstElement *upstream,
+    const gchar *location, GstClockTime max_time, guint64 max_bytes)
+{
+  SegmentRecorder *recorder;
+  GstElement *bin, *encoder;
+  GError *error = NULL;
+  gchar *description;
+
+  if (!location_is_valid (location)) {
+    g_printerr ("The segment pattern '%s' needs exactly one %%d and no other %% "
+        "conversion.\n", location);
+    return NULL;
+  }
+  async_file_sink_register ();
+  description = g_strdup_printf ("queue name=queue max-size-buffers=0 "
+      "max-size-bytes=%u max-size-time=0 ! videoconvert ! "
+      "x264enc name=encoder tune=zerolatency speed-preset=ultrafast ! "
+      "queue max-size-buffers=0 max-size-bytes=0 max-size-time=%" G_GUINT64_FORMAT " ! "
+      "splitmuxsink name=splitmux muxer-factory=matroskamux sink-factory=asyncfilesink "
+      "async-finalize=true max-size-time=%" G_GUINT64_FORMAT " max-size-bytes=%"
+      G_GUINT64_FORMAT " send-keyframe-requests=%s", SEGMENT_RAW_QUEUE_BYTES, SEGMENT_QUEUE_TIME, max_time, max_bytes,
+      /* splitmuxsink only honours keyframe requests with a time bound alone */
+      max_time && !max_bytes ? "true" : "false");
+  bin = gst_parse_bin_from_description (description, TRUE, &error);
+  g_free (description);
+  if (!bin) {
+    g_printerr ("Could not build the recorder: %s\n", error->message);
+    g_clear_error (&error);
+    return NULL;
+  }
+  gst_object_set_name (GST_OBJECT (bin), "recorder");
+
+  recorder = g_new0 (SegmentRecorder, 1);
+  recorder->bin = bin;
+  recorder->queue = gst_bin_get_by_name (GST_BIN (bin), "queue");
+  recorder->splitmux = gst_bin_get_by_name (GST_BIN (bin), "splitmux");
+  recorder->location = g_strdup (location);
+  recorder->reported = g_get_monotonic_time ();
+  g_mutex_init (&recorder->lock);
+
+  g_signal_connect (recorder->splitmux, "format-location", G_CALLBACK (format_location),
+      recorder);
+  add_count_probe (recorder->queue, "src", &recorder->dequeued);
+  encoder = gst_bin_get_by_name (GST_BIN (bin), "encoder");
+  add_count_probe (encoder, "src", &recorder->encoded);
+  gst_object_unref (encoder);
+
+  recorder->capture_pad = gst_element_get_static_pad (capture, "src");
+  recorder->capture_probe = gst_pad_add_probe (recorder->capture_pad,
+      GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) capture_probe, recorder, NULL);
+
+  gst_bin_add (GST_BIN (pipeline), bin);
+  if (!gst_element_link (upstream, bin)) {
+    g_printerr ("Could not link %s to the recorder.\n", GST_OBJECT_NAME (upstream));
+    segment_recorder_free (recorder);
+    gst_bin_remove (GST_BIN (pipeline), bin);
+    return NULL;
+  }
+  return recorder;
+}
+
+void
+segment_recorder_free (SegmentRecorder *recorder)
+{
+  gst_pad_remove_probe (recorder->capture_pad, recorder->capture_probe);
+  gst_object_unref (recorder->capture_pad);
+  g_signal_handlers_disconnect_by_data (recorder->splitmux, recorder);
+  gst_object_unref (recorder->splitmux);
+  gst_object_unref (recorder->queue);
+  g_mutex_clear (&recorder->lock);
+  g_free (recorder->location);
+  g_free (recorder);
+}
+
+void
+segment_recorder_handle_message (SegmentRecorder *recorder, GstMessage *msg)
+{
+  const GstStructure *structure = gst_message_get_structure (msg);
+  GstClockTime running_time = GST_CLOCK_TIME_NONE;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ELEMENT ||
+      GST_MESSAGE_SRC (msg) != GST_OBJECT (recorder->splitmux) ||
+      !gst_structure_has_name (structure, "splitmuxsink-fragment-closed"))
+    return;
+
+  gst_structure_get_clock_time (structure, "running-time", &running_time);
+  g_print ("Segment closed: %s (at %" GST_TIME_FORMAT ")\n",
+      gst_structure_get_string (structure, "location"), GST_TIME_ARGS (running_time));
+}
+
+void
+segment_recorder_report (SegmentRecorder *recorder, gboolean final)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint captured = g_atomic_int_get (&recorder->captured);
+  gint dequeued = g_atomic_int_get (&recorder->dequeued);
+  gint encoded = g_atomic_int_get (&recorder->encoded);
+  AsyncFileSinkStats stats;
+  guint segments, level = 0;
+  gdouble seconds;
+
+  async_file_sink_get_stats (&stats);
+  g_mutex_lock (&recorder->lock);
+  segments = recorder->segments;
+  g_mutex_unlock (&recorder->lock);
+  g_object_get (recorder->queue, "current-level-buffers", &level, NULL);
+
+  if (!final) {
+    seconds = (now - recorder->reported) / 1e6;
+    g_print ("Recording: encode %.1f frames/s, write %.2f MB/s, %u segments, "
+        "worst capture stall %.1f ms (%.1f ms at rollover)\n",
+        seconds > 0 ? (encoded - recorder->reported_encoded) / seconds : 0.0,
+        seconds > 0 ? (stats.bytes - recorder->reported_bytes) / 1e6 / seconds : 0.0,
+        segments, recorder->max_stall / 1e3, recorder->max_rollover_stall / 1e3);
+    recorder->reported_encoded = encoded;
+    recorder->reported_bytes = stats.bytes;
+    recorder->reported = now;
+    return;
+  }
+
+  seconds = (recorder->last - recorder->first) / 1e6;
+  g_print ("\nRecording totals:\n");
+  g_print ("  frames: %d captured, %d encoded (%.1f frames/s), %d dropped before the encoder\n",
+      captured, encoded, seconds > 0 ? encoded / seconds : 0.0,
+      MAX (0, captured - dequeued - (gint) level));
+  g_print ("  segments: %u started, %u files closed\n", segments, stats.files);
+  g_print ("  written: %.1f MB, %.1f MB/s while writing, longest fsync %.1f ms,"
+      " longest wait for the writer %.1f ms\n", stats.bytes / 1e6,
+      stats.write_time ? stats.bytes / 1e6 / (stats.write_time / 1e9) : 0.0,
+      stats.max_fsync / 1e6, stats.max_wait / 1e6);
+  g_print ("  worst capture-thread stall: %.1f ms overall, %.1f ms at rollover\n",
+      recorder->max_stall / 1e3, recorder->max_rollover_stall / 1e3);
+  if (captured != encoded)
+    g_print ("  %d frames captured were not recorded\n", captured - encoded);
+}
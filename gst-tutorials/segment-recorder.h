@@ -0,0 +1,57 @@
+/*
+Continuous recording into bounded segments, without stalling capture.
+
+The branch hung off the capture element is
+  queue ! videoconvert ! x264enc tune=zerolatency ! queue ! splitmuxsink
+with splitmuxsink writing Matroska segments through asyncfilesink
+(async-file-sink.c):
+  - the first queue takes the encoder off the capture thread; it holds raw
+    frames, so it is bounded by bytes (SEGMENT_RAW_QUEUE_BYTES). The second
+    holds SEGMENT_QUEUE_TIME of encoded data, far more than a rollover or an
+    fsync takes, at a fraction of the memory. Neither drops: only an encoder
+    or disk that stays behind for longer than that holds up capture, and
+    that shows as a capture stall rather than as frames missing from the
+    recording,
+  - a segment ends after `max_time` or `max_bytes`; with a time bound,
+    splitmuxsink asks the encoder for a keyframe at the boundary so segments
+    have the requested length and the next one starts on the frame right
+    after, nothing is dropped or duplicated at rollover,
+  - async-finalize: the finished segment's muxer and sink are shut down on
+    a thread of splitmuxsink's while the next segment already records, so
+    writing the index and the fsync happen off the streaming threads,
+  - asyncfilesink writes from its own thread through a bounded queue.
+
+Capture stalls are measured on the capture element's src pad: the gap
+between two frames beyond the frame duration is time the capture thread
+was held up. The worst stall is kept overall and within ROLLOVER_WINDOW
+after a segment started, which is when a synchronous recorder would block.
+`segment_recorder_report` prints encoded frames/s, the write throughput,
+segments and the stalls; at the end also frames captured vs. encoded, which
+must match.
+*/
+#ifndef __SEGMENT_RECORDER_H__
+#define __SEGMENT_RECORDER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SegmentRecorder SegmentRecorder;
+
+/*
+ Adds the branch to `pipeline` after `upstream`; `capture` is the element
+ whose src pad is the capture thread. `location` is a printf pattern with
+ one %d for the segment number and no other conversion; NULL if it has
+ anything else or the branch cannot be linked. A bound of 0 is no bound.
+*/
+SegmentRecorder *segment_recorder_new (GstElement *pipeline, GstElement *capture,
+    GstElement *upstream, const gchar *location, GstClockTime max_time, guint64 max_bytes);
+void segment_recorder_free (SegmentRecorder *recorder);
+
+/* Takes splitmuxsink's fragment-opened/closed element messages */
+void segment_recorder_handle_message (SegmentRecorder *recorder, GstMessage *msg);
+void segment_recorder_report (SegmentRecorder *recorder, gboolean final);
+
+G_END_DECLS
+
+#endif /* __SEGMENT_RECORDER_H__ */
@@ -0,0 +1,335 @@
+#include "shm-share.h"
+
+#include <string.h>
+#include <gst/video/video.h>
+
+#define STAMP_MAGIC 0x534d4853  /* "SHMS" */
+
+/* Over the first bytes of a stamped frame */
+typedef struct {
+  guint32 magic;
+  guint32 frame;
+  guint64 captured;           /* gst_util_get_timestamp (), CLOCK_MONOTONIC */
+} Stamp;
+
+struct _ShmPublisher {
+  GstElement *pipeline;       /* not a ref */
+  GstElement *queue;
+  GstElement *sink;
+
+  gint captured;
+  gint shared;                /* reached shmsink */
+  gint clients;
+
+  /* Main loop only */
+  gint reported_captured;
+  gint reported_shared;
+  gint64 reported;            /* g_get_monotonic_time () of the previous report */
+  gint64 started;
+};
+
+struct _ShmSubscriber {
+  GstElement *pipeline;
+  GstPad *pad;                /* the queue's src pad, in front of the consumer */
+
+  /* Written on the consumer's thread */
+  GMutex lock;
+  ShmSubscriberStats stats;
+  LatencyHistogram interval;  /* since the previous report */
+  gboolean seen_frame;
+  guint32 last_frame;
+
+  /* Main loop only */
+  guint64 reported_frames;
+  guint64 reported_missed;
+  gint64 reported;
+  gint64 started;
+};
+
+/* The frame number is the probe's own, on the capture thread */
+static GstPadProbeReturn
+stamp_probe (GstPad *pad, GstPadProbeInfo *info, guint32 *next_frame)
+{
+  GstBuffer *buffer = gst_buffer_make_writable (GST_PAD_PROBE_INFO_BUFFER (info));
+  Stamp stamp = { STAMP_MAGIC, (*next_frame)++, gst_util_get_timestamp () };
+  GstMapInfo map;
+
+  /* Read-only memory (a driver's buffers) is left alone */
+  if (gst_buffer_map (buffer, &map, GST_MAP_WRITE)) {
+    if (map.size >= sizeof (stamp))
+      memcpy (map.data, &stamp, sizeof (stamp));
+    gst_buffer_unmap (buffer, &map);
+  }
+  GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  return GST_PAD_PROBE_OK;
+}
+
+gulong
+shm_share_add_stamp_probe (GstPad *pad)
+{
+  return gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) stamp_probe,
+      g_new0 (guint32, 1), g_free);
+}
+
+static GstPadProbeReturn
+count_probe (GstPad *pad, GstPadProbeInfo *info, gint *counter)
+{
+  g_atomic_int_inc (counter);
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+client_connected (GstElement *sink, gint fd, ShmPublisher *publisher)
+{
+  g_atomic_int_inc (&publisher->clients);
+}
+
+static void
+client_disconnected (GstElement *sink, gint fd, ShmPublisher *publisher)
+{
+  g_atomic_int_add (&publisher->clients, -1);
+}
+
+ShmPublisher *
+shm_publisher_new (GstElement *pipeline, GstElement *upstream, const gchar *socket_path,
+    const GstCaps *caps, guint shm_frames, gboolean stamp)
+{
+  ShmPublisher *publisher;
+  GstVideoInfo info;
+  GstPad *pad;
+
+  if (!gst_video_info_from_caps (&info, caps)) {
+    g_printerr ("Cannot share frames of unfixed caps.\n");
+    return NULL;
+  }
+
+  publisher = g_new0 (ShmPublisher, 1);
+  publisher->pipeline = pipeline;
+  publisher->queue = gst_element_factory_make ("queue", "share-queue");
+  publisher->sink = gst_element_factory_make ("shmsink", "share");
+  if (!publisher->queue || !publisher->sink) {
+    g_printerr ("Could not create shmsink.\n");
+    if (publisher->queue)
+      gst_object_unref (publisher->queue);
+    if (publisher->sink)
+      gst_object_unref (publisher->sink);
+    g_free (publisher);
+    return NULL;
+  }
+
+  /* Capture never waits for shmsink: when the shared memory is full, the oldest frame goes */
+  g_object_set (publisher->queue, "max-size-buffers", 2, "max-size-bytes", 0,
+      "max-size-time", (guint64) 0, NULL);
+  gst_util_set_object_arg (G_OBJECT (publisher->queue), "leaky", "downstream");
+  /* One extra frame for the allocator's alignment and headers */
+  g_object_set (publisher->sink, "socket-path", socket_path,
+      "shm-size", (guint) (GST_VIDEO_INFO_SIZE (&info) * (shm_frames + 1)),
+      "wait-for-connection", FALSE, "sync", FALSE, NULL);
+  g_signal_connect (publisher->sink, "client-connected", G_CALLBACK (client_connected), publisher);
+  g_signal_connect (publisher->sink, "client-disconnected",
+      G_CALLBACK (client_disconnected), publisher);
+
+  gst_bin_add_many (GST_BIN (pipeline), publisher->queue, publisher->sink, NULL);
+  if (!gst_element_link_many (upstream, publisher->queue, publisher->sink, NULL))
+    g_printerr ("Could not link %s to shmsink.\n", GST_OBJECT_NAME (upstream));
+  gst_object_ref (publisher->queue);
+  gst_object_ref (publisher->sink);
+
+  pad = gst_element_get_static_pad (upstream, "src");
+  if (stamp)
+    shm_share_add_stamp_probe (pad);
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) count_probe,
+      &publisher->captured, NULL);
+  gst_object_unref (pad);
+  pad = gst_element_get_static_pad (publisher->sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback) count_probe,
+      &publisher->shared, NULL);
+  gst_object_unref (pad);
+
+  publisher->reported = publisher->started = g_get_monotonic_time ();
+  return publisher;
+}
+
+/* Once the pipeline is back in NULL */
+void
+shm_publisher_free (ShmPublisher *publisher)
+{
+  g_signal_handlers_disconnect_by_data (publisher->sink, publisher);
+  gst_object_unref (publisher->queue);
+  gst_object_unref (publisher->sink);
+  g_free (publisher);
+}
+
+guint
+shm_publisher_get_n_clients (ShmPublisher *publisher)
+{
+  return MAX (g_atomic_int_get (&publisher->clients), 0);
+}
+
+void
+shm_publisher_report (ShmPublisher *publisher, gboolean final)
+{
+  gint captured = g_atomic_int_get (&publisher->captured);
+  gint shared = g_atomic_int_get (&publisher->shared);
+  gint64 now = g_get_monotonic_time ();
+  gdouble seconds = (now - publisher->reported) / 1e6;
+
+  if (final) {
+    seconds = (now - publisher->started) / 1e6;
+    g_print ("Publisher: %d frames captured, %d shared, %d dropped in front of shmsink "
+        "(%.1f frames/s shared)\n", captured, shared, captured - shared,
+        seconds > 0 ? shared / seconds : 0.0);
+    return;
+  }
+  g_print ("Publisher: %.1f frames/s captured, %.1f shared, %u subscribers\n",
+      seconds > 0 ? (captured - publisher->reported_captured) / seconds : 0.0,
+      seconds > 0 ? (shared - publisher->reported_shared) / seconds : 0.0,
+      shm_publisher_get_n_clients (publisher));
+  publisher->reported_captured = captured;
+  publisher->reported_shared = shared;
+  publisher->reported = now;
+}
+
+static GstPadProbeReturn
+consumer_probe (GstPad *pad, GstPadProbeInfo *info, ShmSubscriber *subscriber)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  guint64 now = gst_util_get_timestamp ();
+  Stamp stamp = { 0 };
+  GstMapInfo map;
+
+  if (gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    if (map.size >= sizeof (stamp))
+      memcpy (&stamp, map.data, sizeof (stamp));
+    gst_buffer_unmap (buffer, &map);
+  }
+
+  g_mutex_lock (&subscriber->lock);
+  subscriber->stats.frames++;
+  if (stamp.magic == STAMP_MAGIC) {
+    if (subscriber->seen_frame && stamp.frame > subscriber->last_frame + 1)
+      subscriber->stats.missed += stamp.frame - subscriber->last_frame - 1;
+    subscriber->seen_frame = TRUE;
+    subscriber->last_frame = stamp.frame;
+    if (now > stamp.captured) {
+      latency_histogram_record (&subscriber->stats.latency, now - stamp.captured);
+      latency_histogram_record (&subscriber->interval, now - stamp.captured);
+    }
+  }
+  g_mutex_unlock (&subscriber->lock);
+  return GST_PAD_PROBE_OK;
+}
+
+gchar *
+shm_subscriber_shm_source (const gchar *socket_path, const gchar *caps)
+{
+  return g_strdup_printf ("shmsrc socket-path=\"%s\" is-live=true do-timestamp=true ! %s",
+      socket_path, caps);
+}
+
+ShmSubscriber *
+shm_subscriber_new (const gchar *source, ShmPolicy policy, guint queue_size,
+    const gchar *consumer, GError **error)
+{
+  ShmSubscriber *subscriber;
+  GstElement *pipeline, *queue;
+  gchar *description;
+
+  description = g_strdup_printf ("%s ! queue name=policy max-size-buffers=%u max-size-bytes=0 "
+      "max-size-time=0%s ! %s", source, MAX (queue_size, 1),
+      policy == SHM_POLICY_DROP ? " leaky=downstream" : "", consumer);
+  pipeline = gst_parse_launch (description, error);
+  g_free (description);
+  if (!pipeline)
+    return NULL;
+
+  subscriber = g_new0 (ShmSubscriber, 1);
+  subscriber->pipeline = pipeline;
+  g_mutex_init (&subscriber->lock);
+  latency_histogram_reset (&subscriber->stats.latency);
+  latency_histogram_reset (&subscriber->interval);
+
+  queue = gst_bin_get_by_name (GST_BIN (pipeline), "policy");
+  subscriber->pad = gst_element_get_static_pad (queue, "src");
+  gst_pad_add_probe (subscriber->pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) consumer_probe, subscriber, NULL);
+  gst_object_unref (queue);
+
+  subscriber->reported = subscriber->started = g_get_monotonic_time ();
+  return subscriber;
+}
+
+/* Once the pipeline is back in NULL */
+void
+shm_subscriber_free (ShmSubscriber *subscriber)
+{
+  gst_object_unref (subscriber->pad);
+  gst_object_unref (subscriber->pipeline);
+  g_mutex_clear (&subscriber->lock);
+  g_free (subscriber);
+}
+
+GstElement *
+shm_subscriber_get_pipeline (ShmSubscriber *subscriber)
+{
+  return subscriber->pipeline;
+}
+
+void
+shm_subscriber_get_stats (ShmSubscriber *subscriber, ShmSubscriberStats *stats)
+{
+  g_mutex_lock (&subscriber->lock);
+  *stats = subscriber->stats;
+  g_mutex_unlock (&subscriber->lock);
+}
+
+void
+shm_subscriber_report (ShmSubscriber *subscriber, gboolean final)
+{
+  ShmSubscriberStats stats;
+  LatencyHistogram interval;
+  gint64 now = g_get_monotonic_time ();
+  gdouble seconds;
+
+  g_mutex_lock (&subscriber->lock);
+  stats = subscriber->stats;
+  interval = subscriber->interval;
+  latency_histogram_reset (&subscriber->interval);
+  g_mutex_unlock (&subscriber->lock);
+
+  if (final) {
+    seconds = (now - subscriber->started) / 1e6;
+    g_print ("Subscriber: %" G_GUINT64_FORMAT " frames (%.1f frames/s), %" G_GUINT64_FORMAT
+        " missed\n", stats.frames, seconds > 0 ? stats.frames / seconds : 0.0, stats.missed);
+    if (stats.latency.count)
+      g_print ("  capture to consumer: p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+          latency_histogram_percentile (&stats.latency, 50) / 1e6,
+          latency_histogram_percentile (&stats.latency, 99) / 1e6, stats.latency.max / 1e6);
+    return;
+  }
+
+  seconds = (now - subscriber->reported) / 1e6;
+  g_print ("Subscriber: %.1f frames/s, %" G_GUINT64_FORMAT " missed", seconds > 0 ?
+      (stats.frames - subscriber->reported_frames) / seconds : 0.0,
+      stats.missed - subscriber->reported_missed);
+  if (interval.count)
+    g_print (", capture to consumer p50 %.1f ms, p99 %.1f ms",
+        latency_histogram_percentile (&interval, 50) / 1e6,
+        latency_histogram_percentile (&interval, 99) / 1e6);
+  g_print ("\n");
+  subscriber->reported_frames = stats.frames;
+  subscriber->reported_missed = stats.missed;
+  subscriber->reported = now;
+}
+
+gboolean
+shm_policy_from_string (const gchar *name, ShmPolicy *policy)
+{
+  if (g_strcmp0 (name, "drop") == 0)
+    *policy = SHM_POLICY_DROP;
+  else if (g_strcmp0 (name, "block") == 0)
+    *policy = SHM_POLICY_BLOCK;
+  else
+    return FALSE;
+  return TRUE;
+}
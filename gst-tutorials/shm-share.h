@@ -0,0 +1,89 @@
+/*
+Shares one capture with other processes on the same machine through shared
+memory.
+
+Only one process can open the camera, but the analytics, the recorder and
+the UI are separate processes. The publisher ends the capture pipeline in
+  ... ! queue leaky=downstream max-size-buffers=2 ! shmsink
+shmsink offers its shared-memory allocator in the ALLOCATION query, so a
+source that takes it (videotestsrc does; v4l2src with io-mode=rw too)
+writes each frame straight into shared memory. Every subscriber connected
+to the socket gets a message pointing at the frame and maps it in place:
+a frame is written once whatever the number of subscribers, and its block
+is only reused once all of them released it.
+
+A subscriber is a pipeline of its own, "<source> ! queue ! <consumer>", the
+source being shmsrc (`shm_subscriber_shm_source`) or anything else that
+delivers the same frames. Its queue is its policy:
+  - SHM_POLICY_DROP: leaky, `queue_size` frames. A slow consumer loses its
+    oldest frames and never holds more than `queue_size` blocks, so it
+    cannot hold the others up.
+  - SHM_POLICY_BLOCK: not leaky. The consumer sees every frame, up to
+    `queue_size` behind; beyond that it stops reading and keeps its blocks.
+    Once the shared memory is full the publisher's own leaky queue drops
+    frames for everyone. The shared memory must therefore be sized for
+    the blocking subscribers.
+
+With `stamp`, the publisher writes a frame number and the capture time
+(CLOCK_MONOTONIC, the same clock in every process) over the first 16 bytes
+of each frame, a few pixels of the top-left corner. Subscribers find it in
+front of their consumer and keep a latency histogram from capture to
+consumer and a count of the frame numbers they never saw.
+*/
+#ifndef __SHM_SHARE_H__
+#define __SHM_SHARE_H__
+
+#include <gst/gst.h>
+
+#include "latency-histogram.h"
+
+G_BEGIN_DECLS
+
+/* Frames of shared memory per publisher */
+#define SHM_SHARE_FRAMES 8
+
+typedef struct _ShmPublisher ShmPublisher;
+
+/* Adds the leaky queue and shmsink and links `upstream` to them; `caps` must be fixed */
+ShmPublisher *shm_publisher_new (GstElement *pipeline, GstElement *upstream,
+    const gchar *socket_path, const GstCaps *caps, guint shm_frames, gboolean stamp);
+void shm_publisher_free (ShmPublisher *publisher);
+
+guint shm_publisher_get_n_clients (ShmPublisher *publisher);
+/* Frames/s captured and shared since the previous report; `final` reports the whole run */
+void shm_publisher_report (ShmPublisher *publisher, gboolean final);
+
+typedef enum {
+  SHM_POLICY_DROP,
+  SHM_POLICY_BLOCK,
+} ShmPolicy;
+
+typedef struct _ShmSubscriberStats {
+  guint64 frames;
+  guint64 missed;             /* frame numbers never seen */
+  LatencyHistogram latency;   /* capture to consumer, stamped frames only */
+} ShmSubscriberStats;
+
+typedef struct _ShmSubscriber ShmSubscriber;
+
+/* "shmsrc socket-path=... ! `caps`", for shm_subscriber_new */
+gchar *shm_subscriber_shm_source (const gchar *socket_path, const gchar *caps);
+
+/* Builds "`source` ! queue ! `consumer`" (gst-launch syntax) as a new pipeline */
+ShmSubscriber *shm_subscriber_new (const gchar *source, ShmPolicy policy, guint queue_size,
+    const gchar *consumer, GError **error);
+void shm_subscriber_free (ShmSubscriber *subscriber);
+
+GstElement *shm_subscriber_get_pipeline (ShmSubscriber *subscriber);
+void shm_subscriber_get_stats (ShmSubscriber *subscriber, ShmSubscriberStats *stats);
+/* Frames/s, misses and latency since the previous report; `final` reports the whole run */
+void shm_subscriber_report (ShmSubscriber *subscriber, gboolean final);
+
+gboolean shm_policy_from_string (const gchar *name, ShmPolicy *policy);
+
+/* Stamps the frames leaving `pad` like a stamping publisher, for other ways of sharing them */
+gulong shm_share_add_stamp_probe (GstPad *pad);
+
+G_END_DECLS
+
+#endif /* __SHM_SHARE_H__ */
@@ -0,0 +1,514 @@
+#include "simd-convert.h"
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+#define FRACTION_BITS 16
+#define ROUND (1 << (FRACTION_BITS - 1))
+
+enum {
+  PROP_0,
+  PROP_KERNEL,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ YUY2, NV12 }")));
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("BGRx")));
+
+G_DEFINE_TYPE (SimdConvert, simd_convert, GST_TYPE_VIDEO_FILTER);
+
+gboolean
+simd_convert_kernel_supported (SimdConvertKernel kernel)
+{
+  switch (kernel) {
+    case SIMD_CONVERT_SCALAR:
+      return TRUE;
+#ifdef HAVE_X86
+    case SIMD_CONVERT_SSE41:
+      return __builtin_cpu_supports ("sse4.1");
+    case SIMD_CONVERT_AVX2:
+      return __builtin_cpu_supports ("avx2");
+#endif
+    default:
+      return FALSE;
+  }
+}
+
+SimdConvertKernel
+simd_convert_best_kernel (void)
+{
+  if (simd_convert_kernel_supported (SIMD_CONVERT_AVX2))
+    return SIMD_CONVERT_AVX2;
+  if (simd_convert_kernel_supported (SIMD_CONVERT_SSE41))
+    return SIMD_CONVERT_SSE41;
+  return SIMD_CONVERT_SCALAR;
+}
+
+const gchar *
+simd_convert_kernel_name (SimdConvertKernel kernel)
+{
+  switch (kernel) {
+    case SIMD_CONVERT_SSE41:
+      return "sse4.1";
+    case SIMD_CONVERT_AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+void
+simd_convert_matrix_init (SimdConvertMatrix *matrix, const GstVideoColorimetry *colorimetry)
+{
+  gdouble Kr, Kb, Kg, y_scale, c_scale;
+
+  /* Unknown (or RGB) matrices: assume BT.601 like most cameras */
+  if (!gst_video_color_matrix_get_Kr_Kb (colorimetry->matrix, &Kr, &Kb)) {
+    Kr = 0.299;
+    Kb = 0.114;
+  }
+  Kg = 1.0 - Kr - Kb;
+
+  if (colorimetry->range == GST_VIDEO_COLOR_RANGE_0_255) {
+    matrix->y_offset = 0;
+    y_scale = c_scale = 1.0;
+  } else {
+    matrix->y_offset = 16;
+    y_scale = 255.0 / 219.0;
+    c_scale = 255.0 / 224.0;
+  }
+
+  matrix->cy = lrint (y_scale * (1 << FRACTION_BITS));
+  matrix->crv = lrint (2.0 * (1.0 - Kr) * c_scale * (1 << FRACTION_BITS));
+  matrix->cbu = lrint (2.0 * (1.0 - Kb) * c_scale * (1 << FRACTION_BITS));
+  matrix->cgu = lrint (2.0 * (1.0 - Kb) * Kb / Kg * c_scale * (1 << FRACTION_BITS));
+  matrix->cgv = lrint (2.0 * (1.0 - Kr) * Kr / Kg * c_scale * (1 << FRACTION_BITS));
+}
+
+/* The reference: the SIMD kernels do exactly this, several pixels at a time */
+static inline guint8
+clamp8 (gint32 value)
+{
+  return CLAMP (value, 0, 255);
+}
+
+static inline void
+convert_pixel (const SimdConvertMatrix *m, gint32 y, gint32 u, gint32 v, guint8 *dst)
+{
+  gint32 yy = (y - m->y_offset) * m->cy + ROUND;
+
+  u -= 128;
+  v -= 128;
+  dst[0] = clamp8 ((yy + m->cbu * u) >> FRACTION_BITS);
+  dst[1] = clamp8 ((yy - m->cgu * u - m->cgv * v) >> FRACTION_BITS);
+  dst[2] = clamp8 ((yy + m->crv * v) >> FRACTION_BITS);
+  dst[3] = 255;
+}
+
+/* Pixels from `x` to the end of the row; the SIMD kernels finish rows with these */
+static void
+yuy2_row_scalar (const guint8 *src, guint8 *dst, gint x, gint width, const SimdConvertMatrix *m)
+{
+  for (; x < width; x++) {
+    const guint8 *pair = src + (x & ~1) * 2;
+
+    convert_pixel (m, src[x * 2], pair[1], pair[3], dst + x * 4);
+  }
+}
+
+static void
+nv12_row_scalar (const guint8 *y, const guint8 *uv, guint8 *dst, gint x, gint width,
+    const SimdConvertMatrix *m)
+{
+  for (; x < width; x++)
+    convert_pixel (m, y[x], uv[x & ~1], uv[(x & ~1) + 1], dst + x * 4);
+}
+
+#ifdef HAVE_X86
+
+/*
+ Both kernels get 16-bit Y and interleaved U/V ([U0 V0 U1 V1 ...], one pair
+ per two pixels), whatever the input format, and widen to 32 bits for the
+ multiplies.
+*/
+
+__attribute__ ((target ("sse4.1")))
+static inline void
+yuv_to_bgr_sse41 (__m128i y, __m128i u, __m128i v, const SimdConvertMatrix *m,
+    __m128i *b, __m128i *g, __m128i *r)
+{
+  __m128i yy = _mm_add_epi32 (_mm_mullo_epi32 (y, _mm_set1_epi32 (m->cy)), _mm_set1_epi32 (ROUND));
+
+  *b = _mm_srai_epi32 (_mm_add_epi32 (yy, _mm_mullo_epi32 (u, _mm_set1_epi32 (m->cbu))),
+      FRACTION_BITS);
+  *g = _mm_srai_epi32 (_mm_sub_epi32 (_mm_sub_epi32 (yy,
+              _mm_mullo_epi32 (u, _mm_set1_epi32 (m->cgu))),
+          _mm_mullo_epi32 (v, _mm_set1_epi32 (m->cgv))), FRACTION_BITS);
+  *r = _mm_srai_epi32 (_mm_add_epi32 (yy, _mm_mullo_epi32 (v, _mm_set1_epi32 (m->crv))),
+      FRACTION_BITS);
+}
+
+/* 8 pixels */
+__attribute__ ((target ("sse4.1")))
+static inline void
+store8_sse41 (__m128i y16, __m128i uv16, const SimdConvertMatrix *m, guint8 *dst)
+{
+  const __m128i u_shuffle = _mm_setr_epi8 (0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+  const __m128i v_shuffle = _mm_setr_epi8 (2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+  __m128i y, uv, u, v, b[2], g[2], r[2], b8, g8, r8, bg, ra;
+
+  y = _mm_sub_epi16 (y16, _mm_set1_epi16 (m->y_offset));
+  uv = _mm_sub_epi16 (uv16, _mm_set1_epi16 (128));
+  u = _mm_shuffle_epi8 (uv, u_shuffle);
+  v = _mm_shuffle_epi8 (uv, v_shuffle);
+
+  yuv_to_bgr_sse41 (_mm_cvtepi16_epi32 (y), _mm_cvtepi16_epi32 (u), _mm_cvtepi16_epi32 (v),
+      m, &b[0], &g[0], &r[0]);
+  yuv_to_bgr_sse41 (_mm_cvtepi16_epi32 (_mm_srli_si128 (y, 8)),
+      _mm_cvtepi16_epi32 (_mm_srli_si128 (u, 8)), _mm_cvtepi16_epi32 (_mm_srli_si128 (v, 8)),
+      m, &b[1], &g[1], &r[1]);
+
+  /* Saturate to bytes and interleave into B G R x */
+  b8 = _mm_packus_epi16 (_mm_packs_epi32 (b[0], b[1]), _mm_setzero_si128 ());
+  g8 = _mm_packus_epi16 (_mm_packs_epi32 (g[0], g[1]), _mm_setzero_si128 ());
+  r8 = _mm_packus_epi16 (_mm_packs_epi32 (r[0], r[1]), _mm_setzero_si128 ());
+  bg = _mm_unpacklo_epi8 (b8, g8);
+  ra = _mm_unpacklo_epi8 (r8, _mm_set1_epi8 ((char) 0xff));
+  _mm_storeu_si128 ((__m128i *) dst, _mm_unpacklo_epi16 (bg, ra));
+  _mm_storeu_si128 ((__m128i *) (dst + 16), _mm_unpackhi_epi16 (bg, ra));
+}
+
+__attribute__ ((target ("sse4.1")))
+static void
+yuy2_row_sse41 (const guint8 *src, guint8 *dst, gint width, const SimdConvertMatrix *m)
+{
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    __m128i in = _mm_loadu_si128 ((const __m128i *) (src + x * 2));
+
+    store8_sse41 (_mm_and_si128 (in, mask), _mm_srli_epi16 (in, 8), m, dst + x * 4);
+  }
+  yuy2_row_scalar (src, dst, x, width, m);
+}
+
+__attribute__ ((target ("sse4.1")))
+static void
+nv12_row_sse41 (const guint8 *y, const guint8 *uv, guint8 *dst, gint width,
+    const SimdConvertMatrix *m)
+{
+  gint x;
+
+  for (x = 0; x + 8 <= width; x += 8)
+    store8_sse41 (_mm_cvtepu8_epi16 (_mm_loadl_epi64 ((const __m128i *) (y + x))),
+        _mm_cvtepu8_epi16 (_mm_loadl_epi64 ((const __m128i *) (uv + x))), m, dst + x * 4);
+  nv12_row_scalar (y, uv, dst, x, width, m);
+}
+
+/*
+ AVX2 shuffles, packs and unpacks work within each 128-bit lane, so each lane
+ holds 8 consecutive pixels and the lanes are put back in order at the end.
+*/
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+widen_lo_avx2 (__m256i x)
+{
+  return _mm256_srai_epi32 (_mm256_unpacklo_epi16 (x, x), 16);
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+widen_hi_avx2 (__m256i x)
+{
+  return _mm256_srai_epi32 (_mm256_unpackhi_epi16 (x, x), 16);
+}
+
+__attribute__ ((target ("avx2")))
+static inline void
+yuv_to_bgr_avx2 (__m256i y, __m256i u, __m256i v, const SimdConvertMatrix *m,
+    __m256i *b, __m256i *g, __m256i *r)
+{
+  __m256i yy = _mm256_add_epi32 (_mm256_mullo_epi32 (y, _mm256_set1_epi32 (m->cy)),
+      _mm256_set1_epi32 (ROUND));
+
+  *b = _mm256_srai_epi32 (_mm256_add_epi32 (yy,
+          _mm256_mullo_epi32 (u, _mm256_set1_epi32 (m->cbu))), FRACTION_BITS);
+  *g = _mm256_srai_epi32 (_mm256_sub_epi32 (_mm256_sub_epi32 (yy,
+              _mm256_mullo_epi32 (u, _mm256_set1_epi32 (m->cgu))),
+          _mm256_mullo_epi32 (v, _mm256_set1_epi32 (m->cgv))), FRACTION_BITS);
+  *r = _mm256_srai_epi32 (_mm256_add_epi32 (yy,
+          _mm256_mullo_epi32 (v, _mm256_set1_epi32 (m->crv))), FRACTION_BITS);
+}
+
+/* 16 pixels */
+__attribute__ ((target ("avx2")))
+static inline void
+store16_avx2 (__m256i y16, __m256i uv16, const SimdConvertMatrix *m, guint8 *dst)
+{
+  const __m256i u_shuffle = _mm256_setr_epi8 (0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13,
+      0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+  const __m256i v_shuffle = _mm256_setr_epi8 (2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15,
+      2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+  __m256i y, uv, u, v, b[2], g[2], r[2], b8, g8, r8, bg, ra, lo, hi;
+
+  y = _mm256_sub_epi16 (y16, _mm256_set1_epi16 (m->y_offset));
+  uv = _mm256_sub_epi16 (uv16, _mm256_set1_epi16 (128));
+  u = _mm256_shuffle_epi8 (uv, u_shuffle);
+  v = _mm256_shuffle_epi8 (uv, v_shuffle);
+
+  /* Pixels 0-3 and 4-7 of each lane */
+  yuv_to_bgr_avx2 (widen_lo_avx2 (y), widen_lo_avx2 (u), widen_lo_avx2 (v), m,
+      &b[0], &g[0], &r[0]);
+  yuv_to_bgr_avx2 (widen_hi_avx2 (y), widen_hi_avx2 (u), widen_hi_avx2 (v), m,
+      &b[1], &g[1], &r[1]);
+
+  b8 = _mm256_packus_epi16 (_mm256_packs_epi32 (b[0], b[1]), _mm256_setzero_si256 ());
+  g8 = _mm256_packus_epi16 (_mm256_packs_epi32 (g[0], g[1]), _mm256_setzero_si256 ());
+  r8 = _mm256_packus_epi16 (_mm256_packs_epi32 (r[0], r[1]), _mm256_setzero_si256 ());
+  bg = _mm256_unpacklo_epi8 (b8, g8);
+  ra = _mm256_unpacklo_epi8 (r8, _mm256_set1_epi8 ((char) 0xff));
+  lo = _mm256_unpacklo_epi16 (bg, ra);  /* pixels 0-3 | 8-11 */
+  hi = _mm256_unpackhi_epi16 (bg, ra);  /* pixels 4-7 | 12-15 */
+  _mm256_storeu_si256 ((__m256i *) dst, _mm256_permute2x128_si256 (lo, hi, 0x20));
+  _mm256_storeu_si256 ((__m256i *) (dst + 32), _mm256_permute2x128_si256 (lo, hi, 0x31));
+}
+
+__attribute__ ((target ("avx2")))
+static void
+yuy2_row_avx2 (const guint8 *src, guint8 *dst, gint width, const SimdConvertMatrix *m)
+{
+  const __m256i mask = _mm256_set1_epi16 (0x00ff);
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m256i in = _mm256_loadu_si256 ((const __m256i *) (src + x * 2));
+
+    store16_avx2 (_mm256_and_si256 (in, mask), _mm256_srli_epi16 (in, 8), m, dst + x * 4);
+  }
+  yuy2_row_scalar (src, dst, x, width, m);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+nv12_row_avx2 (const guint8 *y, const guint8 *uv, guint8 *dst, gint width,
+    const SimdConvertMatrix *m)
+{
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16)
+    store16_avx2 (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (y + x))),
+        _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i *) (uv + x))), m, dst + x * 4);
+  nv12_row_scalar (y, uv, dst, x, width, m);
+}
+
+#endif /* HAVE_X86 */
+
+void
+simd_convert_frame (SimdConvertKernel kernel, const SimdConvertMatrix *matrix,
+    const GstVideoFrame *in, GstVideoFrame *out)
+{
+  gint width = GST_VIDEO_FRAME_WIDTH (in);
+  gint height = GST_VIDEO_FRAME_HEIGHT (in);
+  gint out_stride = GST_VIDEO_FRAME_PLANE_STRIDE (out, 0);
+  gint row;
+
+  for (row = 0; row < height; row++) {
+    guint8 *dst = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (out, 0) + row * out_stride;
+
+    if (GST_VIDEO_FRAME_FORMAT (in) == GST_VIDEO_FORMAT_YUY2) {
+      const guint8 *src = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (in, 0) +
+          row * GST_VIDEO_FRAME_PLANE_STRIDE (in, 0);
+
+      switch (kernel) {
+#ifdef HAVE_X86
+        case SIMD_CONVERT_AVX2:
+          yuy2_row_avx2 (src, dst, width, matrix);
+          break;
+        case SIMD_CONVERT_SSE41:
+          yuy2_row_sse41 (src, dst, width, matrix);
+          break;
+#endif
+        default:
+          yuy2_row_scalar (src, dst, 0, width, matrix);
+          break;
+      }
+    } else {
+      const guint8 *y = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (in, 0) +
+          row * GST_VIDEO_FRAME_PLANE_STRIDE (in, 0);
+      const guint8 *uv = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (in, 1) +
+          (row / 2) * GST_VIDEO_FRAME_PLANE_STRIDE (in, 1);
+
+      switch (kernel) {
+#ifdef HAVE_X86
+        case SIMD_CONVERT_AVX2:
+          nv12_row_avx2 (y, uv, dst, width, matrix);
+          break;
+        case SIMD_CONVERT_SSE41:
+          nv12_row_sse41 (y, uv, dst, width, matrix);
+          break;
+#endif
+        default:
+          nv12_row_scalar (y, uv, dst, 0, width, matrix);
+          break;
+      }
+    }
+  }
+}
+
+static GstCaps *
+simd_convert_transform_caps (GstBaseTransform *trans, GstPadDirection direction,
+    GstCaps *caps, GstCaps *filter)
+{
+  GstCaps *result = gst_caps_new_empty ();
+  guint i;
+
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    GstStructure *structure = gst_structure_copy (gst_caps_get_structure (caps, i));
+
+    if (direction == GST_PAD_SINK) {
+      gst_structure_set (structure, "format", G_TYPE_STRING, "BGRx", NULL);
+    } else {
+      GValue formats = G_VALUE_INIT, format = G_VALUE_INIT;
+
+      g_value_init (&formats, GST_TYPE_LIST);
+      g_value_init (&format, G_TYPE_STRING);
+      g_value_set_static_string (&format, "YUY2");
+      gst_value_list_append_value (&formats, &format);
+      g_value_set_static_string (&format, "NV12");
+      gst_value_list_append_value (&formats, &format);
+      g_value_unset (&format);
+      gst_structure_take_value (structure, "format", &formats);
+    }
+    /* They describe YUV only; the output is plain RGB */
+    gst_structure_remove_fields (structure, "colorimetry", "chroma-site", NULL);
+    result = gst_caps_merge_structure (result, structure);
+  }
+
+  if (filter) {
+    GstCaps *intersection = gst_caps_intersect_full (filter, result, GST_CAPS_INTERSECT_FIRST);
+
+    gst_caps_unref (result);
+    result = intersection;
+  }
+  return result;
+}
+
+static gboolean
+simd_convert_set_info (GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *in_info,
+    GstCaps *outcaps, GstVideoInfo *out_info)
+{
+  SimdConvert *self = SIMD_CONVERT (filter);
+
+  simd_convert_matrix_init (&self->matrix, &in_info->colorimetry);
+  if (self->automatic)
+    self->kernel = simd_convert_best_kernel ();
+  GST_INFO_OBJECT (self, "converting %s with the %s kernel",
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (in_info)),
+      simd_convert_kernel_name (self->kernel));
+  return TRUE;
+}
+
+static GstFlowReturn
+simd_convert_transform_frame (GstVideoFilter *filter, GstVideoFrame *in, GstVideoFrame *out)
+{
+  SimdConvert *self = SIMD_CONVERT (filter);
+
+  simd_convert_frame (self->kernel, &self->matrix, in, out);
+  return GST_FLOW_OK;
+}
+
+static void
+simd_convert_set_property (GObject *object, guint prop_id, const GValue *value,
+    GParamSpec *pspec)
+{
+  SimdConvert *self = SIMD_CONVERT (object);
+  const gchar *name;
+  SimdConvertKernel kernel;
+
+  switch (prop_id) {
+    case PROP_KERNEL:
+      name = g_value_get_string (value);
+      if (g_strcmp0 (name, "avx2") == 0)
+        kernel = SIMD_CONVERT_AVX2;
+      else if (g_strcmp0 (name, "sse4.1") == 0)
+        kernel = SIMD_CONVERT_SSE41;
+      else if (g_strcmp0 (name, "scalar") == 0)
+        kernel = SIMD_CONVERT_SCALAR;
+      else
+        kernel = simd_convert_best_kernel ();
+
+      self->automatic = (g_strcmp0 (name, "auto") == 0 || name == NULL);
+      if (!simd_convert_kernel_supported (kernel)) {
+        GST_WARNING_OBJECT (self, "this CPU has no %s, using the best kernel it has", name);
+        kernel = simd_convert_best_kernel ();
+      }
+      self->kernel = kernel;
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+simd_convert_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  SimdConvert *self = SIMD_CONVERT (object);
+
+  switch (prop_id) {
+    case PROP_KERNEL:
+      g_value_set_string (value, simd_convert_kernel_name (self->kernel));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+simd_convert_class_init (SimdConvertClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *transform_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+  gobject_class->set_property = simd_convert_set_property;
+  gobject_class->get_property = simd_convert_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_KERNEL,
+      g_param_spec_string ("kernel", "Kernel",
+          "Conversion kernel: auto, avx2, sse4.1 or scalar", "auto",
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class, "SIMD colorspace converter",
+      "Filter/Converter/Video", "Converts YUY2 and NV12 to BGRx with AVX2/SSE4.1 kernels",
+      "gst-tutorials");
+
+  transform_class->transform_caps = GST_DEBUG_FUNCPTR (simd_convert_transform_caps);
+  filter_class->set_info = GST_DEBUG_FUNCPTR (simd_convert_set_info);
+  filter_class->transform_frame = GST_DEBUG_FUNCPTR (simd_convert_transform_frame);
+}
+
+static void
+simd_convert_init (SimdConvert *self)
+{
+  self->automatic = TRUE;
+  self->kernel = simd_convert_best_kernel ();
+}
+
+gboolean
+simd_convert_register (void)
+{
+  /* Registered without a plugin and with no rank: only used when asked for by name */
+  return gst_element_register (NULL, "simdconvert", GST_RANK_NONE, SIMD_TYPE_CONVERT);
+}
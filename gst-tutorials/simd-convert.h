@@ -0,0 +1,85 @@
+/*
+`simdconvert`: YUY2/NV12 to BGRx conversion with SIMD kernels.
+
+videoconvert handles every format pair through a generic unpack, matrix,
+pack chain. The camera node only ever needs YUY2 (the RealSense color
+stream) or NV12 to BGRx (what ximagesink takes), so this element does just
+those two conversions, each pixel in a single pass:
+  - an AVX2 kernel (16 pixels per step), an SSE4.1 kernel (8 pixels per
+    step) and a scalar fallback, picked at runtime from what the CPU
+    supports (`__builtin_cpu_supports`),
+  - all three use the same 32-bit fixed-point arithmetic (16 fractional
+    bits) and produce identical output, so the kernel in use never changes
+    a frame,
+  - the matrix (BT.601, BT.709, ...) and range (limited or full) come from
+    the input caps' colorimetry,
+  - chroma is not interpolated: both pixels of a pair share their U/V.
+
+Properties:
+  kernel   "auto" (default), "avx2", "sse4.1" or "scalar"; reading it back
+           after negotiation tells which kernel is in use
+
+The kernels are also exposed directly for bench-simd-convert.c.
+*/
+#ifndef __SIMD_CONVERT_H__
+#define __SIMD_CONVERT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  SIMD_CONVERT_SCALAR,
+  SIMD_CONVERT_SSE41,
+  SIMD_CONVERT_AVX2,
+} SimdConvertKernel;
+
+/* Fixed-point YUV -> RGB coefficients, 16 fractional bits */
+typedef struct _SimdConvertMatrix {
+  gint32 y_offset;            /* 16 for limited range, 0 for full */
+  gint32 cy;
+  gint32 crv;
+  gint32 cgu;
+  gint32 cgv;
+  gint32 cbu;
+} SimdConvertMatrix;
+
+/* The best kernel this CPU supports */
+SimdConvertKernel simd_convert_best_kernel (void);
+gboolean simd_convert_kernel_supported (SimdConvertKernel kernel);
+const gchar *simd_convert_kernel_name (SimdConvertKernel kernel);
+
+void simd_convert_matrix_init (SimdConvertMatrix *matrix, const GstVideoColorimetry *colorimetry);
+
+/* `in` is YUY2 or NV12, `out` BGRx of the same size */
+void simd_convert_frame (SimdConvertKernel kernel, const SimdConvertMatrix *matrix,
+    const GstVideoFrame *in, GstVideoFrame *out);
+
+#define SIMD_TYPE_CONVERT (simd_convert_get_type ())
+#define SIMD_CONVERT(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), SIMD_TYPE_CONVERT, SimdConvert))
+
+typedef struct _SimdConvert SimdConvert;
+typedef struct _SimdConvertClass SimdConvertClass;
+
+struct _SimdConvert {
+  GstVideoFilter parent;
+
+  gboolean automatic;         /* kernel "auto" */
+  SimdConvertKernel kernel;
+  SimdConvertMatrix matrix;
+};
+
+struct _SimdConvertClass {
+  GstVideoFilterClass parent_class;
+};
+
+GType simd_convert_get_type (void);
+
+/* Registers the element for this process; call once after gst_init */
+gboolean simd_convert_register (void);
+
+G_END_DECLS
+
+#endif /* __SIMD_CONVERT_H__ */
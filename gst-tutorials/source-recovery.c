@@ -0,0 +1,224 @@
+#include "source-recovery.h"
+
+struct _SourceRecovery {
+  GstElement *pipeline;       /* not a ref */
+  GstElement *source;
+  guint max_retries;
+  GstBus *bus;
+  GstPad *src_pad;
+  gulong probe_id;
+
+  /* Set on the thread that posts the error, cleared by the first new frame */
+  GMutex lock;
+  gboolean faulted;
+  guint64 fault_time;         /* gst_util_get_timestamp () */
+  SourceRecoveryStats stats;
+
+  /* Main loop only */
+  guint timeout_id;
+  guint attempt;              /* in a row, without a frame in between */
+  guint seen_recovered;
+  GstMessage *last_error;
+};
+
+static gboolean
+from_source (SourceRecovery *recovery, GstMessage *msg)
+{
+  GstObject *src = GST_MESSAGE_SRC (msg);
+
+  return src == GST_OBJECT (recovery->source) ||
+      gst_object_has_as_ancestor (src, GST_OBJECT (recovery->source));
+}
+
+/* On the thread posting the error, i.e. before the source pushes its EOS */
+static void
+sync_error (GstBus *bus, GstMessage *msg, SourceRecovery *recovery)
+{
+  if (!from_source (recovery, msg))
+    return;
+
+  g_mutex_lock (&recovery->lock);
+  if (!recovery->faulted) {
+    recovery->faulted = TRUE;
+    recovery->fault_time = gst_util_get_timestamp ();
+  }
+  g_mutex_unlock (&recovery->lock);
+}
+
+static GstPadProbeReturn
+src_probe (GstPad *pad, GstPadProbeInfo *info, SourceRecovery *recovery)
+{
+  GstPadProbeReturn ret = GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&recovery->lock);
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    if (recovery->faulted) {
+      recovery->faulted = FALSE;
+      recovery->stats.recovered++;
+      latency_histogram_record (&recovery->stats.recovery_time,
+          gst_util_get_timestamp () - recovery->fault_time);
+    }
+  } else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_EOS &&
+      recovery->faulted) {
+    /* basesrc ends the stream after a fatal error; the stream goes on */
+    ret = GST_PAD_PROBE_DROP;
+  }
+  g_mutex_unlock (&recovery->lock);
+  return ret;
+}
+
+static void schedule_restart (SourceRecovery *recovery);
+
+static void
+give_up (SourceRecovery *recovery)
+{
+  g_mutex_lock (&recovery->lock);
+  recovery->stats.gave_up = TRUE;
+  g_mutex_unlock (&recovery->lock);
+  g_printerr ("Giving up on %s after %u restarts.\n", GST_OBJECT_NAME (recovery->source),
+      recovery->attempt);
+  /* For the caller's ERROR handler, which now gets it */
+  gst_element_post_message (recovery->source, gst_message_copy (recovery->last_error));
+}
+
+static gboolean
+restart (SourceRecovery *recovery)
+{
+  GstClock *clock;
+
+  recovery->timeout_id = 0;
+  /* READY stops the streaming thread; NULL also closes the device */
+  gst_element_set_state (recovery->source,
+      recovery->attempt > 1 ? GST_STATE_NULL : GST_STATE_READY);
+
+  /* The source goes on with the pipeline's clock and base time */
+  clock = gst_element_get_clock (recovery->pipeline);
+  if (clock) {
+    gst_element_set_clock (recovery->source, clock);
+    gst_object_unref (clock);
+  }
+  gst_element_set_base_time (recovery->source,
+      gst_element_get_base_time (recovery->pipeline));
+
+  if (!gst_element_sync_state_with_parent (recovery->source)) {
+    g_printerr ("Could not restart %s.\n", GST_OBJECT_NAME (recovery->source));
+    if (recovery->max_retries && recovery->attempt >= recovery->max_retries)
+      give_up (recovery);
+    else
+      schedule_restart (recovery);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_restart (SourceRecovery *recovery)
+{
+  GstClockTime delay = MIN (SOURCE_RECOVERY_FIRST_DELAY << MIN (recovery->attempt, 16),
+      SOURCE_RECOVERY_MAX_DELAY);
+
+  recovery->attempt++;
+  g_mutex_lock (&recovery->lock);
+  recovery->stats.attempts++;
+  g_mutex_unlock (&recovery->lock);
+  g_print ("Restarting %s in %" G_GUINT64_FORMAT " ms (attempt %u)\n",
+      GST_OBJECT_NAME (recovery->source), delay / GST_MSECOND, recovery->attempt);
+  recovery->timeout_id = g_timeout_add (delay / GST_MSECOND, (GSourceFunc) restart, recovery);
+}
+
+gboolean
+source_recovery_handle_error (SourceRecovery *recovery, GstMessage *msg)
+{
+  GError *error = NULL;
+  guint recovered;
+
+  if (!from_source (recovery, msg) || recovery->stats.gave_up)
+    return FALSE;
+  /* basesrc follows its element's error with a flow error, a failed start posts one too */
+  if (recovery->timeout_id)
+    return TRUE;
+
+  g_mutex_lock (&recovery->lock);
+  recovered = recovery->stats.recovered;
+  if (recovered != recovery->seen_recovered || recovery->attempt == 0)
+    recovery->stats.faults++;
+  g_mutex_unlock (&recovery->lock);
+  /* A frame came since the last attempt: this is a new fault, start over */
+  if (recovered != recovery->seen_recovered) {
+    recovery->seen_recovered = recovered;
+    recovery->attempt = 0;
+  }
+
+  gst_message_replace (&recovery->last_error, msg);
+  gst_message_parse_error (msg, &error, NULL);
+  g_printerr ("Error from %s: %s\n", GST_OBJECT_NAME (GST_MESSAGE_SRC (msg)), error->message);
+  g_clear_error (&error);
+
+  if (recovery->max_retries && recovery->attempt >= recovery->max_retries) {
+    g_mutex_lock (&recovery->lock);
+    recovery->stats.gave_up = TRUE;
+    g_mutex_unlock (&recovery->lock);
+    return FALSE;
+  }
+  schedule_restart (recovery);
+  return TRUE;
+}
+
+SourceRecovery *
+source_recovery_new (GstElement *pipeline, GstElement *source, guint max_retries)
+{
+  SourceRecovery *recovery = g_new0 (SourceRecovery, 1);
+
+  recovery->pipeline = pipeline;
+  recovery->source = gst_object_ref (source);
+  recovery->max_retries = max_retries;
+  g_mutex_init (&recovery->lock);
+  latency_histogram_reset (&recovery->stats.recovery_time);
+
+  recovery->bus = gst_element_get_bus (pipeline);
+  gst_bus_enable_sync_message_emission (recovery->bus);
+  g_signal_connect (recovery->bus, "sync-message::error", G_CALLBACK (sync_error), recovery);
+
+  recovery->src_pad = gst_element_get_static_pad (source, "src");
+  recovery->probe_id = gst_pad_add_probe (recovery->src_pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) src_probe, recovery, NULL);
+  return recovery;
+}
+
+void
+source_recovery_free (SourceRecovery *recovery)
+{
+  if (recovery->timeout_id)
+    g_source_remove (recovery->timeout_id);
+  gst_pad_remove_probe (recovery->src_pad, recovery->probe_id);
+  gst_object_unref (recovery->src_pad);
+  g_signal_handlers_disconnect_by_data (recovery->bus, recovery);
+  gst_bus_disable_sync_message_emission (recovery->bus);
+  gst_object_unref (recovery->bus);
+  gst_message_replace (&recovery->last_error, NULL);
+  gst_object_unref (recovery->source);
+  g_mutex_clear (&recovery->lock);
+  g_free (recovery);
+}
+
+void
+source_recovery_get_stats (SourceRecovery *recovery, SourceRecoveryStats *stats)
+{
+  g_mutex_lock (&recovery->lock);
+  *stats = recovery->stats;
+  g_mutex_unlock (&recovery->lock);
+}
+
+void
+source_recovery_report (SourceRecovery *recovery)
+{
+  SourceRecoveryStats stats;
+
+  source_recovery_get_stats (recovery, &stats);
+  g_print ("Source recovery: %u faults, %u recovered with %u restarts%s\n", stats.faults,
+      stats.recovered, stats.attempts, stats.gave_up ? ", then gave up" : "");
+  if (stats.recovered)
+    g_print ("  error to first frame: p50 %.1f ms, max %.1f ms\n",
+        latency_histogram_percentile (&stats.recovery_time, 50) / 1e6,
+        stats.recovery_time.max / 1e6);
+}
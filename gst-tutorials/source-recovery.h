@@ -0,0 +1,60 @@
+/*
+Restarts a failed source in place, leaving the rest of the pipeline running.
+
+When a camera hiccups, v4l2src posts an ERROR and its streaming thread
+stops. The programs used to stop on any ERROR, and getting the camera back
+meant taking the whole pipeline to NULL and building it again: elements,
+caps negotiation, buffer pools, the sink's window. The supervisor only
+cycles the source:
+  - errors posted by the source (or anything inside it) are taken; any
+    other error is left to the caller, which usually stops,
+  - the EOS the source pushes downstream after a fatal error is dropped at
+    its src pad, so the sink never sees the stream end,
+  - after a backoff the source alone goes to READY (NULL from the second
+    attempt on, which also reopens the device) and back to the pipeline's
+    state, on the pipeline's clock and base time, so its new frames carry
+    running times that continue where the old ones stopped; everything
+    downstream stays in PLAYING with its caps and pools,
+  - the backoff starts at SOURCE_RECOVERY_FIRST_DELAY and doubles with
+    every attempt that does not bring a frame, up to SOURCE_RECOVERY_MAX_DELAY;
+    after `max_retries` attempts in a row without a frame (0 = no limit)
+    the supervisor gives up and posts the last error again for the
+    caller to handle.
+
+Recovery time is from the error (on the thread that posted it) to the first
+frame out of the restarted source, kept in a histogram.
+*/
+#ifndef __SOURCE_RECOVERY_H__
+#define __SOURCE_RECOVERY_H__
+
+#include <gst/gst.h>
+
+#include "latency-histogram.h"
+
+G_BEGIN_DECLS
+
+#define SOURCE_RECOVERY_FIRST_DELAY (20 * GST_MSECOND)
+#define SOURCE_RECOVERY_MAX_DELAY (2 * GST_SECOND)
+
+typedef struct _SourceRecovery SourceRecovery;
+
+typedef struct _SourceRecoveryStats {
+  guint faults;               /* errors that started a recovery */
+  guint recovered;
+  guint attempts;             /* restarts tried, successful or not */
+  gboolean gave_up;
+  LatencyHistogram recovery_time;
+} SourceRecoveryStats;
+
+SourceRecovery *source_recovery_new (GstElement *pipeline, GstElement *source, guint max_retries);
+void source_recovery_free (SourceRecovery *recovery);
+
+/* For the ERROR handler: TRUE if the error was the source's and is taken care of */
+gboolean source_recovery_handle_error (SourceRecovery *recovery, GstMessage *msg);
+
+void source_recovery_get_stats (SourceRecovery *recovery, SourceRecoveryStats *stats);
+void source_recovery_report (SourceRecovery *recovery);
+
+G_END_DECLS
+
+#endif /* __SOURCE_RECOVERY_H__ */
@@ -0,0 +1,200 @@
+#include "startup-profile.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct _Mark {
+  gchar *phase;
+  gint64 time;                /* g_get_monotonic_time () */
+} Mark;
+
+static GMutex lock;
+static gint64 start_time = 0;
+static gdouble before_main = -1;  /* ms between exec and startup_profile_start */
+static GArray *marks = NULL;
+static gboolean dumped = FALSE;
+
+/* How long ago the process started, from /proc/self/stat (field 22, in ticks) */
+static gdouble
+ms_since_exec (void)
+{
+  gchar *stat = NULL, *fields;
+  guint64 start_ticks = 0;
+  struct timespec now;
+  gint i;
+
+  if (!g_file_get_contents ("/proc/self/stat", &stat, NULL, NULL))
+    return -1;
+  /* The command name may contain spaces, so count fields after its ')' */
+  fields = strrchr (stat, ')');
+  for (i = 2; fields && i < 22; i++)
+    fields = strchr (fields + 1, ' ');
+  if (fields)
+    start_ticks = g_ascii_strtoull (fields + 1, NULL, 10);
+  g_free (stat);
+  if (!fields || clock_gettime (CLOCK_BOOTTIME, &now) != 0)
+    return -1;
+
+  return (now.tv_sec + now.tv_nsec / 1e9 - (gdouble) start_ticks / sysconf (_SC_CLK_TCK)) * 1e3;
+}
+
+void
+startup_profile_start (void)
+{
+  start_time = g_get_monotonic_time ();
+  before_main = ms_since_exec ();
+  marks = g_array_new (FALSE, FALSE, sizeof (Mark));
+}
+
+/* Only the first occurrence of a phase counts */
+static void
+mark_once (const gchar *phase)
+{
+  gint64 now = g_get_monotonic_time ();
+  Mark mark;
+  guint i;
+
+  g_mutex_lock (&lock);
+  if (!marks) {
+    g_mutex_unlock (&lock);
+    return;
+  }
+  for (i = 0; i < marks->len; i++) {
+    if (g_str_equal (g_array_index (marks, Mark, i).phase, phase)) {
+      g_mutex_unlock (&lock);
+      return;
+    }
+  }
+  mark.phase = g_strdup (phase);
+  mark.time = now;
+  g_array_append_val (marks, mark);
+  g_mutex_unlock (&lock);
+}
+
+void
+startup_profile_mark (const gchar *phase)
+{
+  mark_once (phase);
+}
+
+static gboolean
+dump_idle (gpointer user_data)
+{
+  startup_profile_dump ();
+  return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn
+sink_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_CAPS)
+      mark_once ("caps negotiated");
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* Print from the main loop, not the streaming thread */
+  mark_once ("first buffer");
+  g_idle_add (dump_idle, NULL);
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void
+watch_sink (GstElement *element)
+{
+  GstPad *pad;
+
+  if (GST_IS_BIN (element) || !GST_OBJECT_FLAG_IS_SET (element, GST_ELEMENT_FLAG_SINK))
+    return;
+  pad = gst_element_get_static_pad (element, "sink");
+  if (!pad)
+    return;
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      sink_probe, NULL, NULL);
+  gst_object_unref (pad);
+}
+
+static void
+deep_element_added (GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data)
+{
+  watch_sink (element);
+}
+
+static void
+sync_message (GstBus *bus, GstMessage *msg, GstElement *pipeline)
+{
+  if (GST_MESSAGE_SRC (msg) != GST_OBJECT (pipeline))
+    return;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_STATE_CHANGED) {
+    GstState old_state, new_state;
+    gchar *phase;
+
+    gst_message_parse_state_changed (msg, &old_state, &new_state, NULL);
+    phase = g_strdup_printf ("state %s->%s", gst_element_state_get_name (old_state),
+        gst_element_state_get_name (new_state));
+    mark_once (phase);
+    g_free (phase);
+  } else if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ASYNC_DONE) {
+    mark_once ("preroll (ASYNC_DONE)");
+  }
+}
+
+void
+startup_profile_attach (GstElement *pipeline)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  GstBus *bus;
+
+  it = gst_bin_iterate_recurse (GST_BIN (pipeline));
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    watch_sink (g_value_get_object (&item));
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  g_signal_connect (pipeline, "deep-element-added", G_CALLBACK (deep_element_added), NULL);
+
+  bus = gst_element_get_bus (pipeline);
+  /* A bus has one sync handler; the signal leaves it to whoever else needs it */
+  gst_bus_enable_sync_message_emission (bus);
+  g_signal_connect (bus, "sync-message", G_CALLBACK (sync_message), pipeline);
+  gst_object_unref (bus);
+}
+
+void
+startup_profile_dump (void)
+{
+  GList *plugins;
+  gint64 previous = start_time;
+  guint i, n_plugins;
+
+  g_mutex_lock (&lock);
+  if (!marks || dumped) {
+    g_mutex_unlock (&lock);
+    return;
+  }
+  dumped = TRUE;
+
+  g_print ("\nStartup profile (ms):\n");
+  g_print ("  %-32s %10s %10s\n", "phase", "at", "took");
+  if (before_main >= 0)
+    g_print ("  %-32s %10.1f %10s\n", "exec -> main (+-10 ms)", -before_main, "");
+  for (i = 0; i < marks->len; i++) {
+    Mark *mark = &g_array_index (marks, Mark, i);
+
+    g_print ("  %-32s %10.2f %10.2f\n", mark->phase, (mark->time - start_time) / 1e3,
+        (mark->time - previous) / 1e3);
+    previous = mark->time;
+  }
+  g_mutex_unlock (&lock);
+
+  if (gst_is_initialized ()) {
+    plugins = gst_registry_get_plugin_list (gst_registry_get ());
+    n_plugins = g_list_length (plugins);
+    gst_plugin_list_free (plugins);
+    g_print ("  registry: %u plugins\n", n_plugins);
+  }
+}
@@ -0,0 +1,37 @@
+/*
+Startup profiler: where the time to the first frame goes.
+
+A process has one startup, so the profile is global. The application marks
+the phases only it knows about (`startup_profile_mark`, e.g. after gst_init or
+after creating its elements); `startup_profile_attach` records the rest from
+the pipeline itself:
+  - every state transition of the pipeline (bus sync-message signal, so the
+    time is when the message was posted, not when the main loop got to it),
+  - caps negotiated: the first CAPS event reaching a sink,
+  - preroll: the pipeline's first ASYNC_DONE,
+  - first buffer: the first buffer reaching a sink.
+The profile is printed once the first buffer has arrived, with each phase's
+time since `startup_profile_start` and since the previous phase, preceded by
+how long the process had already been running before main (from /proc, in
+scheduler ticks) and followed by the size of the plugin registry that
+gst_init loaded.
+*/
+#ifndef __STARTUP_PROFILE_H__
+#define __STARTUP_PROFILE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Call first thing in main; everything is timed from here */
+void startup_profile_start (void);
+void startup_profile_mark (const gchar *phase);
+
+/* Records state changes, caps, preroll and the first buffer of `pipeline` */
+void startup_profile_attach (GstElement *pipeline);
+
+void startup_profile_dump (void);
+
+G_END_DECLS
+
+#endif /* __STARTUP_PROFILE_H__ */
@@ -0,0 +1,198 @@
+#include "stream-router.h"
+
+typedef struct _Branch {
+  GstElement *bin;
+  gchar *caps_name;
+  const StreamRule *rule;
+
+  /* Only written from the branch's streaming thread */
+  GThread *thread;
+  guint64 buffers;
+  guint64 bytes;
+  guint64 first;              /* gst_util_get_timestamp () of the first buffer */
+  guint64 last;
+} Branch;
+
+struct _StreamRouter {
+  GstElement *pipeline;
+  const StreamRule *rules;
+  guint n_rules;
+
+  GMutex lock;                /* pad-added runs on streaming threads */
+  GPtrArray *branches;
+  guint next_id;              /* names stay unique when a branch is given up */
+};
+
+static void
+branch_free (Branch *branch)
+{
+  g_free (branch->caps_name);
+  g_free (branch);
+}
+
+StreamRouter *
+stream_router_new (GstElement *pipeline, const StreamRule *rules, guint n_rules)
+{
+  StreamRouter *router = g_new0 (StreamRouter, 1);
+
+  router->pipeline = pipeline;
+  router->rules = rules;
+  router->n_rules = n_rules;
+  g_mutex_init (&router->lock);
+  router->branches = g_ptr_array_new_with_free_func ((GDestroyNotify) branch_free);
+  return router;
+}
+
+void
+stream_router_free (StreamRouter *router)
+{
+  g_ptr_array_unref (router->branches);
+  g_mutex_clear (&router->lock);
+  g_free (router);
+}
+
+static GstPadProbeReturn
+branch_probe (GstPad *pad, GstPadProbeInfo *info, Branch *branch)
+{
+  guint64 now = gst_util_get_timestamp ();
+
+  if (branch->buffers == 0) {
+    branch->first = now;
+    branch->thread = g_thread_self ();
+  }
+  branch->buffers++;
+  branch->bytes += gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+  branch->last = now;
+  return GST_PAD_PROBE_OK;
+}
+
+static const StreamRule *
+match_rule (StreamRouter *router, const gchar *caps_name)
+{
+  guint i;
+
+  for (i = 0; i < router->n_rules; i++)
+    if (g_str_has_prefix (caps_name, router->rules[i].caps_prefix))
+      return &router->rules[i];
+  return NULL;
+}
+
+gboolean
+stream_router_route_pad (StreamRouter *router, GstPad *pad)
+{
+  const StreamRule *rule;
+  GstElement *bin, *queue;
+  GstPad *sink_pad, *queue_pad;
+  Branch *branch;
+  GstCaps *caps;
+  GError *error = NULL;
+  gchar *description, *caps_name, *name;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (!caps)
+    caps = gst_pad_query_caps (pad, NULL);
+  if (gst_caps_is_empty (caps) || gst_caps_is_any (caps)) {
+    gst_caps_unref (caps);
+    return FALSE;
+  }
+  caps_name = g_strdup (gst_structure_get_name (gst_caps_get_structure (caps, 0)));
+  gst_caps_unref (caps);
+
+  rule = match_rule (router, caps_name);
+  if (!rule) {
+    g_print ("No branch for '%s' (pad %s), leaving it unlinked.\n", caps_name, GST_PAD_NAME (pad));
+    g_free (caps_name);
+    return FALSE;
+  }
+
+  /* The queue is what puts the branch on a thread of its own */
+  description = g_strdup_printf ("queue name=head ! %s", rule->branch);
+  bin = gst_parse_bin_from_description (description, TRUE, &error);
+  g_free (description);
+  if (!bin) {
+    g_printerr ("Could not build branch '%s': %s\n", rule->branch, error->message);
+    g_clear_error (&error);
+    g_free (caps_name);
+    return FALSE;
+  }
+
+  branch = g_new0 (Branch, 1);
+  branch->bin = bin;
+  branch->caps_name = caps_name;
+  branch->rule = rule;
+
+  queue = gst_bin_get_by_name (GST_BIN (bin), "head");
+  queue_pad = gst_element_get_static_pad (queue, "src");
+  gst_pad_add_probe (queue_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) branch_probe, branch, NULL);
+  gst_object_unref (queue_pad);
+  gst_object_unref (queue);
+
+  g_mutex_lock (&router->lock);
+  name = g_strdup_printf ("branch%u", router->next_id++);
+  g_mutex_unlock (&router->lock);
+  gst_object_set_name (GST_OBJECT (bin), name);
+  g_free (name);
+
+  gst_bin_add (GST_BIN (router->pipeline), bin);
+  sink_pad = gst_element_get_static_pad (bin, "sink");
+  if (GST_PAD_LINK_FAILED (gst_pad_link (pad, sink_pad))) {
+    g_printerr ("Could not link %s to '%s'.\n", GST_PAD_NAME (pad), rule->branch);
+    gst_object_unref (sink_pad);
+    /* Not left in the pipeline unlinked; removing it drops the last ref */
+    gst_element_set_state (bin, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (router->pipeline), bin);
+    branch_free (branch);
+    return FALSE;
+  }
+  gst_object_unref (sink_pad);
+  gst_element_sync_state_with_parent (bin);
+
+  g_mutex_lock (&router->lock);
+  g_ptr_array_add (router->branches, branch);
+  g_mutex_unlock (&router->lock);
+
+  g_print ("Routed '%s' (pad %s) to %s: %s\n", caps_name, GST_PAD_NAME (pad),
+      GST_OBJECT_NAME (bin), rule->branch);
+  return TRUE;
+}
+
+guint
+stream_router_get_n_branches (StreamRouter *router)
+{
+  guint n;
+
+  g_mutex_lock (&router->lock);
+  n = router->branches->len;
+  g_mutex_unlock (&router->lock);
+  return n;
+}
+
+void
+stream_router_dump (StreamRouter *router)
+{
+  GHashTable *threads = g_hash_table_new (NULL, NULL);
+  guint i;
+
+  g_print ("\nPer-branch throughput:\n");
+  g_print ("  %-10s %-20s %10s %12s %10s %10s\n", "branch", "caps", "buffers", "buffers/s", "MB/s",
+      "seconds");
+
+  g_mutex_lock (&router->lock);
+  for (i = 0; i < router->branches->len; i++) {
+    Branch *branch = g_ptr_array_index (router->branches, i);
+    gdouble seconds = (branch->last - branch->first) / 1e9;
+
+    if (branch->thread)
+      g_hash_table_add (threads, branch->thread);
+    g_print ("  %-10s %-20s %10" G_GUINT64_FORMAT " %12.1f %10.2f %10.2f\n",
+        GST_OBJECT_NAME (branch->bin), branch->caps_name, branch->buffers,
+        seconds > 0 ? branch->buffers / seconds : 0.0,
+        seconds > 0 ? branch->bytes / seconds / 1e6 : 0.0, seconds);
+  }
+  g_print ("  %u branches on %u streaming threads\n", router->branches->len,
+      g_hash_table_size (threads));
+  g_mutex_unlock (&router->lock);
+
+  g_hash_table_unref (threads);
+}
@@ -0,0 +1,46 @@
+/*
+Routes every stream a demuxer/decodebin exposes to a branch of its own.
+
+bt3 used to link the first raw audio pad and ignore the rest. The router
+instead handles each pad-added: the pad's caps pick the first matching rule
+and a new branch is built from that rule's description, always starting with a
+queue. The queue gives each branch its own streaming thread, so with several
+video/audio tracks everything after the queue runs in parallel per stream
+instead of a stream being dropped. Expose the pads before decoding (as bt3
+does through uridecodebin's autoplug-select) and put a decoder in the branch
+to decode the streams in parallel too.
+
+Rules are matched on the caps name prefix, in order; a rule with an empty
+prefix matches anything and makes a good last-resort `fakesink`. Pads that
+match no rule are left unlinked.
+
+Each branch counts the buffers and bytes leaving its queue (on the branch's
+own thread) and `stream_router_dump` prints per-branch throughput.
+*/
+#ifndef __STREAM_ROUTER_H__
+#define __STREAM_ROUTER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _StreamRule {
+  const gchar *caps_prefix;     /* e.g. "audio/x-raw", "" for anything */
+  const gchar *branch;          /* gst-launch syntax, e.g. "audioconvert ! autoaudiosink" */
+} StreamRule;
+
+typedef struct _StreamRouter StreamRouter;
+
+/* `rules` must stay valid as long as the router */
+StreamRouter *stream_router_new (GstElement *pipeline, const StreamRule *rules, guint n_rules);
+void stream_router_free (StreamRouter *router);
+
+/* From the application's pad-added handler; returns FALSE if not routed */
+gboolean stream_router_route_pad (StreamRouter *router, GstPad *pad);
+
+guint stream_router_get_n_branches (StreamRouter *router);
+void stream_router_dump (StreamRouter *router);
+
+G_END_DECLS
+
+#endif /* __STREAM_ROUTER_H__ */